@@ -0,0 +1,225 @@
+// DR. ROBOTNIK'S RING RACERS
+//-----------------------------------------------------------------------------
+// Copyright (C) 2024 by Kart Krew.
+//
+// This program is free software distributed under the
+// terms of the GNU General Public License, version 2.
+// See the 'LICENSE' file for more details.
+//-----------------------------------------------------------------------------
+/// \file  core/instrument.cpp
+/// \brief Named counters and scoped timers for any thread
+
+#include "instrument.h"
+
+#include <array>
+#include <cstring>
+#include <mutex>
+
+namespace srb2::instrument
+{
+
+std::atomic<bool> g_enabled = false;
+
+namespace
+{
+
+// One per thread. Only that thread writes to it, so adding is a relaxed
+// load and store; the main thread only ever reads it. Threads past
+// INSTRUMENT_MAXTHREADS share the last block, and add atomically.
+struct ThreadBlock
+{
+	std::array<std::atomic<uint64_t>, INSTRUMENT_MAXCOUNTERS> values {};
+	std::array<std::atomic<uint32_t>, INSTRUMENT_MAXCOUNTERS> calls {};
+	bool shared = false;
+};
+
+// What a block had added up to at the last frame
+struct Snapshot
+{
+	std::array<uint64_t, INSTRUMENT_MAXCOUNTERS> values {};
+	std::array<uint32_t, INSTRUMENT_MAXCOUNTERS> calls {};
+};
+
+struct Registry
+{
+	std::mutex mutex;
+
+	// Counter 0 takes whatever doesn't fit
+	std::array<const char*, INSTRUMENT_MAXCOUNTERS> names {"(too many counters)"};
+	std::array<bool, INSTRUMENT_MAXCOUNTERS> timers {};
+	std::atomic<size_t> numcounters = 1;
+
+	// Never freed: threads may still add to them while the game exits
+	std::array<ThreadBlock*, INSTRUMENT_MAXTHREADS> blocks {};
+	std::atomic<size_t> numblocks = 0;
+
+	// Main thread only
+	std::array<Snapshot, INSTRUMENT_MAXTHREADS> snapshots;
+	std::array<instrumentstat_t, INSTRUMENT_MAXCOUNTERS> frame {};
+	size_t framecounters = 0; // counters summed up last frame
+};
+
+Registry& registry()
+{
+	static Registry* r = new Registry();
+	return *r;
+}
+
+thread_local ThreadBlock* t_block = nullptr;
+
+ThreadBlock* this_thread_block()
+{
+	if (t_block)
+		return t_block;
+
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	const size_t n = r.numblocks.load(std::memory_order_relaxed);
+
+	if (n < INSTRUMENT_MAXTHREADS)
+	{
+		t_block = new ThreadBlock();
+		t_block->shared = (n == INSTRUMENT_MAXTHREADS - 1);
+		r.blocks[n] = t_block;
+		r.numblocks.store(n + 1, std::memory_order_release);
+	}
+	else
+		t_block = r.blocks[INSTRUMENT_MAXTHREADS - 1];
+
+	return t_block;
+}
+
+} // namespace
+
+uint16_t register_counter(const char* name, bool timer)
+{
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	const size_t n = r.numcounters.load(std::memory_order_relaxed);
+
+	for (size_t i = 1; i < n; i++)
+	{
+		if (!strcmp(r.names[i], name))
+			return i;
+	}
+
+	if (n == INSTRUMENT_MAXCOUNTERS)
+		return 0;
+
+	r.names[n] = name;
+	r.timers[n] = timer;
+	r.numcounters.store(n + 1, std::memory_order_release);
+
+	return n;
+}
+
+void add(uint16_t counter, uint64_t value)
+{
+	ThreadBlock* block = this_thread_block();
+
+	if (block->shared)
+	{
+		block->values[counter].fetch_add(value, std::memory_order_relaxed);
+		block->calls[counter].fetch_add(1, std::memory_order_relaxed);
+	}
+	else
+	{
+		block->values[counter].store(block->values[counter].load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+		block->calls[counter].store(block->calls[counter].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+}
+
+} // namespace srb2::instrument
+
+using namespace srb2::instrument;
+
+UINT16 I_InstrumentCounter(const char *name, boolean timer)
+{
+	return register_counter(name, timer);
+}
+
+precise_t I_InstrumentBegin(void)
+{
+	return enabled() ? I_GetPreciseTime() : 0;
+}
+
+void I_InstrumentEnd(UINT16 counter, precise_t start)
+{
+	if (start && enabled())
+		add(counter, I_GetPreciseTime() - start);
+}
+
+void I_InstrumentCount(UINT16 counter, UINT32 n)
+{
+	if (enabled())
+		add(counter, n);
+}
+
+void I_InstrumentFrame(boolean wanted)
+{
+	ZoneScoped;
+
+	Registry& r = registry();
+	const size_t numcounters = r.numcounters.load(std::memory_order_acquire);
+	const size_t numblocks = r.numblocks.load(std::memory_order_acquire);
+	const bool plot = TracyIsConnected;
+
+	for (size_t c = 0; c < numcounters; c++)
+	{
+		instrumentstat_t& stat = r.frame[c];
+
+		stat = {};
+		stat.name = r.names[c];
+		stat.timer = r.timers[c];
+	}
+
+	for (size_t b = 0; b < numblocks; b++)
+	{
+		ThreadBlock* block = r.blocks[b];
+		Snapshot& snapshot = r.snapshots[b];
+
+		for (size_t c = 0; c < numcounters; c++)
+		{
+			const uint64_t value = block->values[c].load(std::memory_order_relaxed);
+			const uint32_t calls = block->calls[c].load(std::memory_order_relaxed);
+
+			if (calls == snapshot.calls[c])
+				continue;
+
+			r.frame[c].value += value - snapshot.values[c];
+			r.frame[c].calls += calls - snapshot.calls[c];
+			r.frame[c].threads++;
+
+			snapshot.values[c] = value;
+			snapshot.calls[c] = calls;
+		}
+	}
+
+	if (plot)
+	{
+		[[maybe_unused]] const double us = 1000000.0 / (double)I_GetPrecisePrecision();
+
+		for (size_t c = 1; c < numcounters; c++)
+		{
+			const instrumentstat_t& stat = r.frame[c];
+
+			if (stat.timer)
+				TracyPlot(stat.name, (double)stat.value * us);
+			else
+				TracyPlot(stat.name, (int64_t)stat.value);
+		}
+	}
+
+	r.framecounters = numcounters;
+	g_enabled.store(wanted || plot, std::memory_order_relaxed);
+}
+
+size_t I_InstrumentNumCounters(void)
+{
+	return registry().framecounters;
+}
+
+void I_InstrumentStat(size_t counter, instrumentstat_t *stat)
+{
+	*stat = registry().frame[counter];
+}
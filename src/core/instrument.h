@@ -0,0 +1,175 @@
+// DR. ROBOTNIK'S RING RACERS
+//-----------------------------------------------------------------------------
+// Copyright (C) 2024 by Kart Krew.
+//
+// This program is free software distributed under the
+// terms of the GNU General Public License, version 2.
+// See the 'LICENSE' file for more details.
+//-----------------------------------------------------------------------------
+/// \file  core/instrument.h
+/// \brief Named counters and scoped timers for any thread
+
+#ifndef __SRB2_CORE_INSTRUMENT_H__
+#define __SRB2_CORE_INSTRUMENT_H__
+
+#include "../doomtype.h"
+
+//
+// Counters are added to from any thread without locking: each thread
+// adds to a block of its own, and I_InstrumentFrame sums every block up
+// once a frame, on the main thread. The sums show on the "Instrumented"
+// perfstats page and, with a profiler connected, as Tracy plots.
+//
+// Nothing is measured unless one of those is looking. Until then a timer
+// costs a relaxed load, unless it also fills in a perfstats time.
+//
+// Names have to be string literals, since Tracy keeps the pointer.
+//
+
+#define INSTRUMENT_MAXCOUNTERS 128
+#define INSTRUMENT_MAXTHREADS 64
+
+#ifdef __cplusplus
+
+#include <atomic>
+#include <cstdint>
+
+#include <tracy/tracy/Tracy.hpp>
+
+#include "../i_system.h"
+
+namespace srb2::instrument
+{
+
+extern std::atomic<bool> g_enabled;
+
+uint16_t register_counter(const char* name, bool timer);
+void add(uint16_t counter, uint64_t value);
+
+inline bool enabled()
+{
+	return g_enabled.load(std::memory_order_relaxed);
+}
+
+class Counter
+{
+	uint16_t index_;
+
+public:
+	Counter(const char* name, bool timer) : index_(register_counter(name, timer)) {}
+
+	uint16_t index() const { return index_; }
+
+	void add(uint64_t value) const
+	{
+		if (enabled())
+			instrument::add(index_, value);
+	}
+};
+
+/// Times the scope it lives in. If out is given, the time always goes
+/// there too, for perfstats times that have been kept all along.
+class ScopedTimer
+{
+	const Counter& counter_;
+	precise_t* out_;
+	precise_t start_;
+	bool timing_;
+
+public:
+	explicit ScopedTimer(const Counter& counter, precise_t* out = nullptr)
+		: counter_(counter), out_(out), start_(0), timing_(out != nullptr || enabled())
+	{
+		if (timing_)
+			start_ = I_GetPreciseTime();
+	}
+
+	ScopedTimer(const ScopedTimer&) = delete;
+	ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+	~ScopedTimer()
+	{
+		if (!timing_)
+			return;
+
+		const precise_t elapsed = I_GetPreciseTime() - start_;
+
+		if (out_)
+			*out_ = elapsed;
+
+		counter_.add(elapsed);
+	}
+};
+
+} // namespace srb2::instrument
+
+#define INSTRUMENT_CONCAT2(a, b) a##b
+#define INSTRUMENT_CONCAT(a, b) INSTRUMENT_CONCAT2(a, b)
+#define INSTRUMENT_COUNTER INSTRUMENT_CONCAT(instrument_counter_, __LINE__)
+
+/// Times the rest of the scope, and makes it a Tracy zone.
+#define INSTRUMENT_SCOPE(name) \
+	static const srb2::instrument::Counter INSTRUMENT_COUNTER(name, true); \
+	const srb2::instrument::ScopedTimer INSTRUMENT_CONCAT(instrument_timer_, __LINE__)(INSTRUMENT_COUNTER); \
+	ZoneScopedN(name)
+
+/// Same, and also leaves the time in the precise_t out.
+#define INSTRUMENT_SCOPE_TO(name, out) \
+	static const srb2::instrument::Counter INSTRUMENT_COUNTER(name, true); \
+	const srb2::instrument::ScopedTimer INSTRUMENT_CONCAT(instrument_timer_, __LINE__)(INSTRUMENT_COUNTER, &(out)); \
+	ZoneScopedN(name)
+
+/// Adds n to a counter.
+#define INSTRUMENT_COUNT(name, n) \
+	do { \
+		static const srb2::instrument::Counter INSTRUMENT_COUNTER(name, false); \
+		INSTRUMENT_COUNTER.add(n); \
+	} while (0)
+
+extern "C" {
+
+#endif // __cplusplus
+
+typedef struct
+{
+	const char *name;
+	boolean timer;
+	UINT64 value; // precise_t for timers
+	UINT32 calls;
+	UINT8 threads; // that added to it
+} instrumentstat_t;
+
+// C code registers counters by hand, and times with Begin and End:
+//
+//   static UINT16 counter;
+//   precise_t start;
+//
+//   if (!counter)
+//       counter = I_InstrumentCounter("Something", true);
+//
+//   start = I_InstrumentBegin();
+//   ...
+//   I_InstrumentEnd(counter, start);
+
+UINT16 I_InstrumentCounter(const char *name, boolean timer);
+
+// Returns 0 if nothing is being measured.
+precise_t I_InstrumentBegin(void);
+void I_InstrumentEnd(UINT16 counter, precise_t start);
+
+void I_InstrumentCount(UINT16 counter, UINT32 n);
+
+// Sums up what every thread added since the last frame, and turns
+// measuring on or off for the next one.
+void I_InstrumentFrame(boolean wanted);
+
+size_t I_InstrumentNumCounters(void);
+
+// What a counter added up to last frame.
+void I_InstrumentStat(size_t counter, instrumentstat_t *stat);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // __SRB2_CORE_INSTRUMENT_H__
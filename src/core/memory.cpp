@@ -10,62 +10,198 @@
 
 #include "memory.h"
 
-#include <array>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
 #include <new>
-
-#include "../z_zone.h"
+#include <thread>
+#include <vector>
 
 namespace
 {
 
+/// @brief Linear allocator made of one or more chunks. When a frame needs more than one
+/// chunk, the chunks are merged into a single bigger one on reset, so a steady frame
+/// allocates from one contiguous block and never calls malloc. The merged chunk is capped,
+/// since loops that draw without a frame reset, such as wipes and loading screens, pile
+/// many frames into one.
 class LinearMemory
 {
-	size_t size_;
-	size_t height_;
-	void* memory_;
+	struct Chunk
+	{
+		Chunk* next;
+		size_t size;
+		size_t height;
+	};
+
+	static constexpr size_t kHeaderSize = (sizeof(Chunk) + 15) & ~15;
+
+	size_t chunk_size_;
+	size_t max_chunk_size_;
+	Chunk* head_; // chunk being allocated from; older chunks follow
+	uint32_t generation_;
+
+	Chunk* new_chunk(size_t size);
+	void free_chunks() noexcept;
 
 public:
-	constexpr explicit LinearMemory(size_t size) noexcept;
+	explicit LinearMemory(size_t chunk_size) noexcept;
+	LinearMemory(const LinearMemory&) = delete;
+	~LinearMemory();
 
 	void* allocate(size_t size);
 	void reset() noexcept;
+
+	uint32_t generation() const noexcept { return generation_; }
+	void set_generation(uint32_t generation) noexcept { generation_ = generation; }
 };
 
-constexpr LinearMemory::LinearMemory(size_t size) noexcept : size_(size), height_{0}, memory_{nullptr} {}
+LinearMemory::LinearMemory(size_t chunk_size) noexcept
+	: chunk_size_(chunk_size), max_chunk_size_(chunk_size * 4), head_(nullptr), generation_(0)
+{
+}
+
+LinearMemory::~LinearMemory()
+{
+	free_chunks();
+}
+
+LinearMemory::Chunk* LinearMemory::new_chunk(size_t size)
+{
+	Chunk* chunk = static_cast<Chunk*>(std::malloc(kHeaderSize + size));
+	if (chunk == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	chunk->next = head_;
+	chunk->size = size;
+	chunk->height = 0;
+	head_ = chunk;
+	return chunk;
+}
+
+void LinearMemory::free_chunks() noexcept
+{
+	while (head_ != nullptr)
+	{
+		Chunk* next = head_->next;
+		std::free(head_);
+		head_ = next;
+	}
+}
 
 void* LinearMemory::allocate(size_t size)
 {
 	size_t aligned_size = (size + 15) & ~15;
-	if (height_ + aligned_size > size_)
+	if (aligned_size < size)
 	{
 		throw std::bad_alloc();
 	}
 
-	if (memory_ == nullptr)
+	Chunk* chunk = head_;
+	if (chunk == nullptr || chunk->height + aligned_size > chunk->size)
 	{
-		memory_ = Z_Malloc(size_, PU_STATIC, nullptr);
+		chunk = new_chunk(std::max(aligned_size, chunk_size_));
 	}
 
-	void* ptr = (void*)((uintptr_t)(memory_) + height_);
-	height_ += aligned_size;
+	void* ptr = (void*)((uintptr_t)(chunk) + kHeaderSize + chunk->height);
+	chunk->height += aligned_size;
 	return ptr;
 }
 
 void LinearMemory::reset() noexcept
 {
-	height_ = 0;
+	if (head_ != nullptr && head_->next != nullptr)
+	{
+		// Last frame overflowed; size the single chunk for next time
+		size_t total = 0;
+		for (Chunk* chunk = head_; chunk != nullptr; chunk = chunk->next)
+		{
+			total += chunk->size;
+		}
+		free_chunks();
+		chunk_size_ = std::clamp(total, chunk_size_, max_chunk_size_);
+	}
+
+	if (head_ != nullptr)
+	{
+		head_->height = 0;
+	}
+}
+
+constexpr size_t kMainThreadChunkSize = 4 * 1024 * 1024;
+constexpr size_t kWorkerChunkSize = 256 * 1024;
+
+// Bumped by Z_Frame_Reset. Each thread's memory notices on its next allocation and rewinds.
+std::atomic<uint32_t> g_frame_generation {0};
+
+std::mutex g_frame_memories_mutex;
+std::vector<std::unique_ptr<LinearMemory>> g_frame_memories;
+
+LinearMemory* g_main_frame_memory = nullptr;
+
+// Set by Z_Frame_SetMainThread, before any other thread is started. Static
+// initialization can't be relied on for this: on Android, it runs on another thread.
+std::thread::id g_main_thread_id;
+
+LinearMemory* register_frame_memory(size_t chunk_size)
+{
+	std::lock_guard<std::mutex> lock(g_frame_memories_mutex);
+	g_frame_memories.push_back(std::make_unique<LinearMemory>(chunk_size));
+	LinearMemory* memory = g_frame_memories.back().get();
+	memory->set_generation(g_frame_generation.load(std::memory_order_acquire));
+	return memory;
 }
 
-} // namespace
+LinearMemory& this_thread_frame_memory()
+{
+	// Kept alive in g_frame_memories past thread exit, since other threads may still be
+	// reading frame memory handed out here.
+	thread_local LinearMemory* memory = nullptr;
+
+	if (memory == nullptr)
+	{
+		bool main_thread = std::this_thread::get_id() == g_main_thread_id;
+		memory = register_frame_memory(main_thread ? kMainThreadChunkSize : kWorkerChunkSize);
+		if (main_thread)
+		{
+			g_main_frame_memory = memory;
+		}
+	}
+
+	uint32_t generation = g_frame_generation.load(std::memory_order_acquire);
+	if (memory->generation() != generation)
+	{
+		memory->reset();
+		memory->set_generation(generation);
+	}
 
-static LinearMemory g_frame_memory {4 * 1024 * 1024};
+	return *memory;
+}
+
+} // namespace
 
 void* Z_Frame_Alloc(size_t size)
 {
-	return g_frame_memory.allocate(size);
+	return this_thread_frame_memory().allocate(size);
+}
+
+void Z_Frame_SetMainThread()
+{
+	g_main_thread_id = std::this_thread::get_id();
 }
 
 void Z_Frame_Reset()
 {
-	g_frame_memory.reset();
+	uint32_t generation = g_frame_generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+
+	// Rewind the main thread eagerly; workers catch up lazily
+	if (g_main_frame_memory != nullptr)
+	{
+		g_main_frame_memory->reset();
+		g_main_frame_memory->set_generation(generation);
+	}
 }
@@ -18,15 +18,57 @@ extern "C" {
 #endif // __cpluspplus
 
 /// @brief Allocate a block of memory with a lifespan of the current main-thread frame.
-/// This function is NOT thread-safe, but the allocated memory may be used across threads.
-/// @return a pointer to a block of memory aligned with libc malloc alignment, or null if allocation fails
+/// This function is thread-safe; each thread allocates from its own chunks, and the memory
+/// may be used across threads until the frame ends.
+/// @return a pointer to a block of memory aligned to 16 bytes. Throws std::bad_alloc on failure.
 void* Z_Frame_Alloc(size_t size);
 
-/// @brief Resets per-frame memory. Not thread safe.
+/// @brief Marks the calling thread as the main thread, whose frame memory is sized for the
+/// renderer. Must be called before the main thread first allocates frame memory.
+void Z_Frame_SetMainThread(void);
+
+/// @brief Ends the current frame, invalidating all per-frame memory on every thread.
+/// Must be called from the main thread while no other thread is using frame memory.
 void Z_Frame_Reset(void);
 
 #ifdef __cplusplus
 } // extern "C"
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace srb2
+{
+
+/// @brief STL allocator over Z_Frame_Alloc. deallocate is a no-op; everything is reclaimed
+/// by Z_Frame_Reset, so containers using this must not be used past the end of the frame.
+template <typename T>
+class FrameAllocator
+{
+public:
+	using value_type = T;
+
+	static_assert(alignof(T) <= 16, "frame memory is only aligned to 16 bytes");
+
+	FrameAllocator() noexcept = default;
+	template <typename U>
+	FrameAllocator(const FrameAllocator<U>&) noexcept {}
+
+	T* allocate(std::size_t n) { return static_cast<T*>(Z_Frame_Alloc(n * sizeof(T))); }
+	void deallocate(T*, std::size_t) noexcept {}
+
+	template <typename U>
+	bool operator==(const FrameAllocator<U>&) const noexcept { return true; }
+	template <typename U>
+	bool operator!=(const FrameAllocator<U>&) const noexcept { return false; }
+};
+
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
+
+} // namespace srb2
+
 #endif // __cplusplus
 
 #endif // __SRB2_CORE_MEMORY_H__
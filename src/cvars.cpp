@@ -297,6 +297,7 @@ const auto GraphicsDriver = consvar_t::Builder(cvlist_graphics_driver).save();
 // These usually save...
 //
 
+consvar_t cv_addons_cachesize = Player("addons_cachesize", "4096").min_max(1, 1048576, {{0, "Unlimited"}}); // in MB
 consvar_t cv_addons_md5 = Player("addons_md5", "Name").values({{0, "Name"}, {1, "Contents"}});
 consvar_t cv_addons_search_case = Player("addons_search_case", "No").yes_no();
 consvar_t cv_addons_search_type = Player("addons_search_type", "Anywhere").values({{0, "Start"}, {1, "Anywhere"}});
@@ -400,6 +401,8 @@ consvar_t cv_menuframeskip = Player("menuframeskip", "Off").values({
 	{0, "Off"},
 });
 consvar_t cv_movebob = Player("movebob", "1.0").floating_point().min_max(0, 4*FRACUNIT);
+consvar_t cv_netbatchio = Player("netbatchio", "On").on_off(); // recvmmsg/sendmmsg, where the platform has them
+consvar_t cv_netiothread = Player("netiothread", "On").on_off(); // takes effect when the socket is next opened
 consvar_t cv_netstat = Player("netstat", "Off").on_off().dont_save(); // show bandwidth statistics
 consvar_t cv_netticbuffer = Player("netticbuffer", "1").min_max(0, 3);
 
@@ -510,6 +513,9 @@ consvar_t cv_discordinvites = Server("discordinvites", "Everyone").values({{0, "
 
 consvar_t cv_downloading = Server("downloading", "On").on_off().dont_save();
 
+// Deflate level for gamestates sent to joining clients, or LZF to spend less time compressing
+consvar_t cv_gamestatecompression = Server("gamestatecompression", "6").min_max(1, 9, {{0, "LZF"}});
+
 // Okay, whoever said homremoval causes a performance hit should be shot.
 consvar_t cv_homremoval = Server("homremoval", "Yes").values({{0, "No"}, {1, "Yes"}, {2, "Flash"}});
 
@@ -524,6 +530,9 @@ consvar_t cv_kartvoices = Server("tauntvoices", "On").on_off();
 consvar_t cv_kartspeedometer = Server("speedometer", "Percentage").values({{0, "Off"}, {1, "Percentage"}, {2, "Kilometers"}, {3, "Miles"}, {4, "Fracunits"}}); // use tics in display
 consvar_t cv_kicktime = Server("kicktime", "20").values(CV_Unsigned);
 
+// Keep UDMF maps read and their blockmaps built on disk, by TEXTMAP MD5
+consvar_t cv_mapcache = Server("mapcache", "On").on_off();
+
 void MasterServer_OnChange(void);
 consvar_t cv_masterserver = Server("masterserver", "https://ms.kartkrew.org/ms/api").onchange(MasterServer_OnChange);
 consvar_t cv_masterserver_nagattempts = Server("masterserver_nagattempts", "5").values(CV_Unsigned);
@@ -547,6 +556,12 @@ void NetTimeout_OnChange(void);
 consvar_t cv_nettimeout = Server("nettimeout", "210").min_max(TICRATE/7, 60*TICRATE).onchange(NetTimeout_OnChange);
 
 consvar_t cv_pause = NetVar("pausepermission", "Server Admins").values({{0, "Server Admins"}, {1, "Everyone"}});
+
+// Keeps the last few minutes of perfstats on disk, mostly for dedicated servers
+void PS_Record_OnChange(void);
+consvar_t cv_perfstats_record = Server("perfstats_record", "Off").on_off().onchange(PS_Record_OnChange);
+consvar_t cv_perfstats_recordlength = Server("perfstats_recordlength", "600").min_max(10, 3600); // seconds
+
 consvar_t cv_pingmeasurement = Server("pingmeasurement", "Frames").values({{0, "Frames"}, {1, "Milliseconds"}});
 consvar_t cv_playbackspeed = Server("playbackspeed", "1").min_max(1, 10).dont_save();
 
@@ -603,6 +618,9 @@ consvar_t cv_blamecfail = NetVar("blamecfail", "Off").on_off();
 // Speed of file downloading (in packets per tic)
 consvar_t cv_downloadspeed = NetVar("downloadspeed", "32").min_max(1, 300);
 
+// Pace downloads with a congestion window instead of downloadspeed
+consvar_t cv_downloadwindow = NetVar("downloadwindow", "On").on_off();
+
 #ifdef DUMPCONSISTENCY
 	consvar_t cv_dumpconsistency = NetVar(cvlist_dumpconsistency)("dumpconsistency", "Off").on_off();
 #endif
@@ -1046,6 +1064,9 @@ consvar_t cv_lossless_recorder = Player("lossless_recorder", "GIF").values(lossl
 
 consvar_t cv_screenshot_colorprofile = Player("screenshot_colorprofile", "Yes").yes_no();
 
+// Screenshots and movie frames waiting on the encoder thread
+consvar_t cv_encoder_queue = Player("encoder_queue", "8").min_max(1, 64);
+
 extern CV_PossibleValue_t zlib_mem_level_t[];
 extern CV_PossibleValue_t zlib_level_t[];
 extern CV_PossibleValue_t zlib_strategy_t[];
@@ -16,6 +16,10 @@
 #include <unistd.h> //for unlink
 #endif
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #include "i_time.h"
 #include "i_net.h"
 #include "i_system.h"
@@ -43,6 +47,7 @@
 #include "r_local.h"
 #include "m_argv.h"
 #include "p_setup.h"
+#include "p_polyobj.h"
 #include "lzf.h"
 #include "lua_script.h"
 #include "lua_hook.h"
@@ -115,6 +120,17 @@ static boolean resendingsavegame[MAXNETNODES]; // Are we resending the savegame?
 static tic_t savegameresendcooldown[MAXNETNODES]; // How long before we can resend again?
 static tic_t freezetimeout[MAXNETNODES]; // Until when can this node freeze the server before getting a timeout?
 
+// How the gamestate sent to joining clients is compressed
+typedef enum
+{
+	GAMESTATE_RAW,
+	GAMESTATE_LZF,
+	GAMESTATE_DEFLATE,
+} gamestatecodec_t;
+
+// Codec byte and uncompressed length
+#define GAMESTATE_HEADERSIZE (sizeof(UINT8) + sizeof(UINT32))
+
 // Incremented by cv_joindelay when a client joins, decremented each tic.
 // If higher than cv_joindelay * 2 (3 joins in a short timespan), joins are temporarily disabled.
 static tic_t joindelay = 0;
@@ -149,6 +165,10 @@ static tic_t maketic;
 
 static INT16 consistancy[BACKUPTICS];
 
+// The hashes each consistancy value was folded from, and the tic they were made on
+static UINT64 consistencyhashes[BACKUPTICS][NUMCONSISTENCYHASHES];
+static tic_t consistencyhashtic[BACKUPTICS];
+
 static UINT8 player_joining = false;
 UINT8 hu_redownloadinggamestate = 0;
 
@@ -1248,31 +1268,46 @@ static boolean SV_ResendingSavegameToAnyone(void)
 	return false;
 }
 
+// Compresses a gamestate with the codec picked by cv_gamestatecompression.
+// Returns the compressed length, or 0 if it didn't come out smaller.
+static size_t SV_CompressSaveGame(const UINT8 *in, size_t inlen, UINT8 *out, size_t outlen, UINT8 *codec)
+{
+#ifdef HAVE_ZLIB
+	if (cv_gamestatecompression.value > 0)
+	{
+		uLongf compressedlen = outlen;
+
+		*codec = GAMESTATE_DEFLATE;
+
+		if (compress2(out, &compressedlen, in, inlen, cv_gamestatecompression.value) == Z_OK)
+			return compressedlen;
+
+		return 0;
+	}
+#endif
+
+	*codec = GAMESTATE_LZF;
+	return lzf_compress(in, inlen, out, outlen);
+}
+
 static void SV_SendSaveGame(INT32 node, boolean resending)
 {
 	size_t length, compressedlen;
 	savebuffer_t save = {0};
 	UINT8 *compressedsave;
 	UINT8 *buffertosend;
+	UINT8 codec = GAMESTATE_RAW;
+	precise_t start = I_GetPreciseTime();
+	precise_t precision = I_GetPrecisePrecision();
 
-	// first save it in a malloced buffer
-	if (P_SaveBufferAlloc(&save, NETSAVEGAMESIZE) == false)
+	// first save it in a malloced buffer, leaving room for the codec and uncompressed length.
+	if (P_SaveNetGameAlloc(&save, GAMESTATE_HEADERSIZE, resending) == false)
 	{
 		CONS_Alert(CONS_ERROR, M_GetText("No more free memory for savegame\n"));
 		return;
 	}
 
-	// Leave room for the uncompressed length.
-	save.p += sizeof(UINT32);
-
-	P_SaveNetGame(&save, resending);
-
 	length = save.p - save.buffer;
-	if (length > NETSAVEGAMESIZE)
-	{
-		P_SaveBufferFree(&save);
-		I_Error("Savegame buffer overrun");
-	}
 
 	// Allocate space for compressed save: one byte fewer than for the
 	// uncompressed data to ensure that the compression is worthwhile.
@@ -1284,26 +1319,35 @@ static void SV_SendSaveGame(INT32 node, boolean resending)
 	}
 
 	// Attempt to compress it.
-	if ((compressedlen = lzf_compress(save.buffer + sizeof(UINT32), length - sizeof(UINT32), compressedsave + sizeof(UINT32), length - sizeof(UINT32) - 1)))
+	if ((compressedlen = SV_CompressSaveGame(save.buffer + GAMESTATE_HEADERSIZE, length - GAMESTATE_HEADERSIZE, compressedsave + GAMESTATE_HEADERSIZE, length - GAMESTATE_HEADERSIZE - 1, &codec)))
 	{
 		// Compressing succeeded; send compressed data
+		UINT8 *p = compressedsave;
+
 		P_SaveBufferFree(&save);
 
-		// State that we're compressed.
+		// State how we're compressed.
 		buffertosend = compressedsave;
-		WRITEUINT32(compressedsave, length - sizeof(UINT32));
-		length = compressedlen + sizeof(UINT32);
+		WRITEUINT8(p, codec);
+		WRITEUINT32(p, length - GAMESTATE_HEADERSIZE);
+		length = compressedlen + GAMESTATE_HEADERSIZE;
 	}
 	else
 	{
 		// Compression failed to make it smaller; send original
+		UINT8 *p = save.buffer;
+
 		Z_Free(compressedsave);
 
 		// State that we're not compressed
 		buffertosend = save.buffer;
-		WRITEUINT32(save.buffer, 0);
+		WRITEUINT8(p, GAMESTATE_RAW);
+		WRITEUINT32(p, 0);
 	}
 
+	CONS_Debug(DBG_NETPLAY, "Sending gamestate to node %d: %s bytes, codec %u, took %.2f ms\n",
+		node, sizeu1(length), codec, (double)(I_GetPreciseTime() - start) * 1000.0 / (double)precision);
+
 	AddRamToSendQueue(node, buffertosend, length, SF_Z_RAM, 0);
 
 	// Remember when we started sending the savegame so we can handle timeouts
@@ -1359,6 +1403,7 @@ static void CL_LoadReceivedSavegame(boolean reloading)
 {
 	savebuffer_t save = {0};
 	size_t length, decompressedlen;
+	UINT8 codec;
 	char tmpsave[256];
 
 	sprintf(tmpsave, "%s" PATHSEP TMPSAVENAME, srb2home);
@@ -1373,12 +1418,33 @@ static void CL_LoadReceivedSavegame(boolean reloading)
 	CONS_Printf(M_GetText("Loading savegame length %s\n"), sizeu1(length));
 
 	// Decompress saved game if necessary.
+	codec = READUINT8(save.p);
 	decompressedlen = READUINT32(save.p);
-	if (decompressedlen > 0)
+	if (codec != GAMESTATE_RAW)
 	{
 		UINT8 *decompressedbuffer = Z_Malloc(decompressedlen, PU_STATIC, NULL);
 
-		lzf_decompress(save.p, length - sizeof(UINT32), decompressedbuffer, decompressedlen);
+		switch (codec)
+		{
+			case GAMESTATE_LZF:
+				if (lzf_decompress(save.p, length - GAMESTATE_HEADERSIZE, decompressedbuffer, decompressedlen) != decompressedlen)
+					I_Error("Can't decompress savegame sent");
+				break;
+#ifdef HAVE_ZLIB
+			case GAMESTATE_DEFLATE:
+			{
+				uLongf inflatedlen = decompressedlen;
+
+				if (uncompress(decompressedbuffer, &inflatedlen, save.p, length - GAMESTATE_HEADERSIZE) != Z_OK
+					|| inflatedlen != decompressedlen)
+					I_Error("Can't decompress savegame sent");
+				break;
+			}
+#endif
+			default:
+				I_Error("Savegame sent uses an unknown compression method (%u)", codec);
+				break;
+		}
 
 		P_SaveBufferFree(&save);
 		P_SaveBufferFromExisting(&save, decompressedbuffer, decompressedlen);
@@ -3271,6 +3337,7 @@ void D_ClientServerInit(void)
 	COM_AddCommand("droprate", Command_Droprate);
 #endif
 	COM_AddCommand("numnodes", Command_Numnodes);
+	COM_AddCommand("netiostats", Command_NetIOStats);
 
 	RegisterNetXCmd(XD_KICK, Got_KickCmd);
 	RegisterNetXCmd(XD_ADDPLAYER, Got_AddPlayer);
@@ -4799,6 +4866,80 @@ static void FuzzTiccmd(ticcmd_t* target)
 	}
 }
 
+static const char *consistencyhashnames[NUMCONSISTENCYHASHES] =
+{
+	"players",
+	"mobjs",
+	"sectors",
+	"polyobjects",
+	"RNG",
+};
+
+// Asks a node for the hashes behind a consistancy value that didn't match.
+static void SV_AskConsistency(INT32 node, tic_t tic)
+{
+	netbuffer->packettype = PT_ASKCONSISTENCY;
+	netbuffer->u.consistency.tic = LONG(tic);
+	HSendPacket(node, true, 0, sizeof (netbuffer->u.consistency.tic));
+}
+
+// Sends the server the hashes for a tic, if they are still around.
+static void CL_SendConsistency(void)
+{
+	const tic_t tic = LONG(netbuffer->u.consistency.tic);
+	INT32 i;
+
+	if (consistencyhashtic[tic % BACKUPTICS] != tic)
+		return;
+
+	netbuffer->packettype = PT_CONSISTENCY;
+	netbuffer->u.consistency.tic = LONG(tic);
+
+	for (i = 0; i < NUMCONSISTENCYHASHES; i++)
+	{
+		const UINT64 hash = consistencyhashes[tic % BACKUPTICS][i];
+		netbuffer->u.consistency.hashes[i][0] = LONG((UINT32)hash);
+		netbuffer->u.consistency.hashes[i][1] = LONG((UINT32)(hash >> 32));
+	}
+
+	HSendPacket(servernode, true, 0, sizeof (consistency_pak));
+}
+
+// Compares a node's hashes with ours, and reports which parts of the game state differ.
+static void SV_CompareConsistency(INT32 netconsole)
+{
+	const tic_t tic = LONG(netbuffer->u.consistency.tic);
+	char diverged[128] = "";
+	INT32 i;
+
+	if (doomcom->datalength < (INT16)(BASEPACKETSIZE + sizeof (consistency_pak)))
+		return;
+
+	if (consistencyhashtic[tic % BACKUPTICS] != tic)
+		return;
+
+	for (i = 0; i < NUMCONSISTENCYHASHES; i++)
+	{
+		const UINT64 hash = (UINT64)(UINT32)LONG(netbuffer->u.consistency.hashes[i][0])
+			| ((UINT64)(UINT32)LONG(netbuffer->u.consistency.hashes[i][1]) << 32);
+
+		if (hash != consistencyhashes[tic % BACKUPTICS][i])
+		{
+			if (diverged[0])
+				strlcat(diverged, ", ", sizeof diverged);
+			strlcat(diverged, consistencyhashnames[i], sizeof diverged);
+		}
+	}
+
+	if (!diverged[0])
+		strlcpy(diverged, "nothing hashed (only the check value)", sizeof diverged);
+
+	if (cv_blamecfail.value)
+		CONS_Printf(M_GetText("Synch failure for player %d (%s) on tic %u diverged in: %s\n"),
+			netconsole+1, player_names[netconsole], tic, diverged);
+	DEBFILE(va("player %d desynched on tic %u in: %s\n", netconsole, tic, diverged));
+}
+
 /** Handles a packet received from a node that is in game
   *
   * \param node The packet sender
@@ -4982,6 +5123,8 @@ static void HandlePacketFromPlayer(SINT8 node)
 				&& !resendingsavegame[node] && savegameresendcooldown[node] <= I_GetTime()
 				&& !SV_ResendingSavegameToAnyone())
 			{
+				SV_AskConsistency(node, realstart);
+
 				if (cv_resynchattempts.value)
 				{
 					// Tell the client we are about to resend them the gamestate
@@ -5110,6 +5253,14 @@ static void HandlePacketFromPlayer(SINT8 node)
 		case PT_SAY:
 			PT_Say(node);
 			break;
+		case PT_ASKCONSISTENCY:
+			if (client && node == servernode)
+				CL_SendConsistency();
+			break;
+		case PT_CONSISTENCY:
+			if (server && netconsole != -1)
+				SV_CompareConsistency(netconsole);
+			break;
 		case PT_LOGIN:
 			if (client)
 				break;
@@ -5513,173 +5664,208 @@ static void GetPackets(void)
 }
 
 //
-// NetUpdate
-// Builds ticcmds for console player,
-// sends out a packet
+// Consistency hashing
 //
-// no more use random generator, because at very first tic isn't yet synchronized
-// Note: It is called consistAncy on purpose.
+// 64-bit mixing in the style of xxHash. The values are spread over four
+// lanes, so each lane is an independent chain the CPU can run side by side.
 //
-static INT16 Consistancy(void)
+#define CONSISTENCY_PRIME1 UINT64_C(0x9E3779B185EBCA87)
+#define CONSISTENCY_PRIME2 UINT64_C(0xC2B2AE3D27D4EB4F)
+#define CONSISTENCY_PRIME3 UINT64_C(0x165667B19E3779F9)
+
+static inline UINT64 ConsistencyMix(UINT64 acc, UINT32 value)
 {
-	INT32 i;
-	UINT32 ret = 0;
-#ifdef MOBJCONSISTANCY
-	thinker_t *th;
-	mobj_t *mo;
-#endif
+	acc += value * CONSISTENCY_PRIME2;
+	acc = (acc << 31) | (acc >> 33);
+	return acc * CONSISTENCY_PRIME1;
+}
 
-	DEBFILE(va("TIC %u ", gametic));
+static UINT64 ConsistencyFinish(const UINT64 lanes[4])
+{
+	UINT64 acc = ((lanes[0] << 1) | (lanes[0] >> 63))
+		+ ((lanes[1] << 7) | (lanes[1] >> 57))
+		+ ((lanes[2] << 12) | (lanes[2] >> 52))
+		+ ((lanes[3] << 18) | (lanes[3] >> 46));
+
+	acc ^= acc >> 33;
+	acc *= CONSISTENCY_PRIME2;
+	acc ^= acc >> 29;
+	acc *= CONSISTENCY_PRIME3;
+	acc ^= acc >> 32;
+
+	return acc;
+}
+
+#define CONSISTENCY_LANES_INIT {CONSISTENCY_PRIME1, CONSISTENCY_PRIME2, CONSISTENCY_PRIME3, 0}
+
+static UINT64 ConsistencyPlayers(void)
+{
+	UINT64 lanes[4] = CONSISTENCY_LANES_INIT;
+	INT32 i;
 
 	for (i = 0; i < MAXPLAYERS; i++)
 	{
+		const player_t *player = &players[i];
+
 		if (!playeringame[i])
-			ret ^= 0xCCCC;
-		else if (!players[i].mo || gamestate != GS_LEVEL);
-		else
 		{
-			ret += players[i].mo->x;
-			ret -= players[i].mo->y;
-			ret += players[i].itemtype;
-			ret *= i+1;
+			lanes[0] = ConsistencyMix(lanes[0], 0xCCCC);
+			continue;
 		}
-	}
-	// I give up
-	// Coop desynching enemies is painful
-	if (gamestate == GS_LEVEL)
-	{
-		for (i = 0; i < PRNUMSYNCED; i++)
+
+		lanes[0] = ConsistencyMix(lanes[0], player->itemtype);
+		lanes[1] = ConsistencyMix(lanes[1], player->itemamount);
+		lanes[2] = ConsistencyMix(lanes[2], player->rings);
+		lanes[3] = ConsistencyMix(lanes[3], player->laps);
+
+		if (player->mo && gamestate == GS_LEVEL)
 		{
-			if (i & 1)
-			{
-				ret -= P_GetRandSeed(i);
-			}
-			else
-			{
-				ret += P_GetRandSeed(i);
-			}
+			lanes[0] = ConsistencyMix(lanes[0], player->mo->x);
+			lanes[1] = ConsistencyMix(lanes[1], player->mo->y);
+			lanes[2] = ConsistencyMix(lanes[2], player->mo->z);
+			lanes[3] = ConsistencyMix(lanes[3], player->mo->angle);
+			lanes[0] = ConsistencyMix(lanes[0], player->mo->momx);
+			lanes[1] = ConsistencyMix(lanes[1], player->mo->momy);
+			lanes[2] = ConsistencyMix(lanes[2], player->mo->momz);
 		}
 	}
 
-#ifdef MOBJCONSISTANCY
-	if (gamestate == GS_LEVEL)
+	return ConsistencyFinish(lanes);
+}
+
+static UINT64 ConsistencyMobjs(void)
+{
+	UINT64 lanes[4] = CONSISTENCY_LANES_INIT;
+	const thinker_t *th;
+
+	for (th = thlist[THINK_MOBJ].next; th != &thlist[THINK_MOBJ]; th = th->next)
 	{
-		for (th = thlist[THINK_MOBJ].next; th != &thlist[THINK_MOBJ]; th = th->next)
-		{
-			if (th->function.acp1 == (actionf_p1)P_RemoveThinkerDelayed)
-				continue;
+		const mobj_t *mo = (const mobj_t *)th;
 
-			mo = (mobj_t *)th;
+		if (th->function.acp1 == (actionf_p1)P_RemoveThinkerDelayed)
+			continue;
 
-			if (TypeIsNetSynced(mo->type) == false)
-				continue;
+		if (TypeIsNetSynced(mo->type) == false)
+			continue;
 
-			if (mo->flags & (MF_SPECIAL | MF_SOLID | MF_PUSHABLE | MF_BOSS | MF_MISSILE | MF_SPRING | MF_ELEMENTAL | MF_FIRE | MF_ENEMY | MF_PAIN | MF_DONTPUNT))
-			{
-				ret -= mo->type;
-				ret += mo->x;
-				ret -= mo->y;
-				ret += mo->z;
-				ret -= mo->momx;
-				ret += mo->momy;
-				ret -= mo->momz;
-				ret += mo->angle;
-				ret -= mo->flags;
-				ret += mo->flags2;
-				ret -= mo->eflags;
-				if (mo->target && TypeIsNetSynced(mo->target->type))
-				{
-					ret += mo->target->type;
-					ret -= mo->target->x;
-					ret += mo->target->y;
-					ret -= mo->target->z;
-					ret += mo->target->momx;
-					ret -= mo->target->momy;
-					ret += mo->target->momz;
-					ret -= mo->target->angle;
-					ret += mo->target->flags;
-					ret -= mo->target->flags2;
-					ret += mo->target->eflags;
-					ret -= mo->target->state - states;
-					ret += mo->target->tics;
-					ret -= mo->target->sprite;
-					//ret += mo->target->frame;
-				}
-				else
-					ret ^= 0x3333;
-				if (mo->tracer && TypeIsNetSynced(mo->tracer->type))
-				{
-					ret += mo->tracer->type;
-					ret -= mo->tracer->x;
-					ret += mo->tracer->y;
-					ret -= mo->tracer->z;
-					ret += mo->tracer->momx;
-					ret -= mo->tracer->momy;
-					ret += mo->tracer->momz;
-					ret -= mo->tracer->angle;
-					ret += mo->tracer->flags;
-					ret -= mo->tracer->flags2;
-					ret += mo->tracer->eflags;
-					ret -= mo->tracer->state - states;
-					ret += mo->tracer->tics;
-					ret -= mo->tracer->sprite;
-					//ret += mo->tracer->frame;
-				}
-				else
-					ret ^= 0xAAAA;
-				// SRB2Kart: We use hnext & hprev very extensively
-				if (mo->hnext && TypeIsNetSynced(mo->hnext->type))
-				{
-					ret += mo->hnext->type;
-					ret -= mo->hnext->x;
-					ret += mo->hnext->y;
-					ret -= mo->hnext->z;
-					ret += mo->hnext->momx;
-					ret -= mo->hnext->momy;
-					ret += mo->hnext->momz;
-					ret -= mo->hnext->angle;
-					ret += mo->hnext->flags;
-					ret -= mo->hnext->flags2;
-					ret += mo->hnext->eflags;
-					ret -= mo->hnext->state - states;
-					ret += mo->hnext->tics;
-					ret -= mo->hnext->sprite;
-					//ret += mo->hnext->frame;
-				}
-				else
-					ret ^= 0x5555;
-				if (mo->hprev && TypeIsNetSynced(mo->hprev->type))
-				{
-					ret += mo->hprev->type;
-					ret -= mo->hprev->x;
-					ret += mo->hprev->y;
-					ret -= mo->hprev->z;
-					ret += mo->hprev->momx;
-					ret -= mo->hprev->momy;
-					ret += mo->hprev->momz;
-					ret -= mo->hprev->angle;
-					ret += mo->hprev->flags;
-					ret -= mo->hprev->flags2;
-					ret += mo->hprev->eflags;
-					ret -= mo->hprev->state - states;
-					ret += mo->hprev->tics;
-					ret -= mo->hprev->sprite;
-					//ret += mo->hprev->frame;
-				}
-				else
-					ret ^= 0xCCCC;
-				ret -= mo->state - states;
-				ret += mo->tics;
-				ret -= mo->sprite;
-				//ret += mo->frame;
-			}
-		}
+		// Only physical state. Animation state is left out, since
+		// cosmetic code is allowed to play with it.
+		lanes[0] = ConsistencyMix(lanes[0], mo->type);
+		lanes[1] = ConsistencyMix(lanes[1], mo->x);
+		lanes[2] = ConsistencyMix(lanes[2], mo->y);
+		lanes[3] = ConsistencyMix(lanes[3], mo->z);
+		lanes[0] = ConsistencyMix(lanes[0], mo->momx);
+		lanes[1] = ConsistencyMix(lanes[1], mo->momy);
+		lanes[2] = ConsistencyMix(lanes[2], mo->momz);
+		lanes[3] = ConsistencyMix(lanes[3], mo->angle);
+		lanes[0] = ConsistencyMix(lanes[0], mo->flags);
+		lanes[1] = ConsistencyMix(lanes[1], mo->flags2);
+		lanes[2] = ConsistencyMix(lanes[2], mo->eflags);
+		lanes[3] = ConsistencyMix(lanes[3], mo->health);
+	}
+
+	return ConsistencyFinish(lanes);
+}
+
+static UINT64 ConsistencySectors(void)
+{
+	UINT64 lanes[4] = CONSISTENCY_LANES_INIT;
+	size_t i;
+
+	for (i = 0; i < numsectors; i++)
+	{
+		const sector_t *sec = &sectors[i];
+
+		lanes[0] = ConsistencyMix(lanes[0], sec->floorheight);
+		lanes[1] = ConsistencyMix(lanes[1], sec->ceilingheight);
+		lanes[2] = ConsistencyMix(lanes[2], sec->lightlevel);
+		lanes[3] = ConsistencyMix(lanes[3], sec->special);
+		lanes[0] = ConsistencyMix(lanes[0], sec->floorpic);
+		lanes[1] = ConsistencyMix(lanes[1], sec->ceilingpic);
 	}
-#endif
 
-	DEBFILE(va("Consistancy = %u\n", (ret & 0xFFFF)));
+	return ConsistencyFinish(lanes);
+}
+
+static UINT64 ConsistencyPolyobjects(void)
+{
+	UINT64 lanes[4] = CONSISTENCY_LANES_INIT;
+	INT32 i;
+
+	for (i = 0; i < numPolyObjects; i++)
+	{
+		const polyobj_t *po = &PolyObjects[i];
+
+		lanes[0] = ConsistencyMix(lanes[0], po->id);
+		lanes[1] = ConsistencyMix(lanes[1], po->centerPt.x);
+		lanes[2] = ConsistencyMix(lanes[2], po->centerPt.y);
+		lanes[3] = ConsistencyMix(lanes[3], po->angle);
+		lanes[0] = ConsistencyMix(lanes[0], po->flags);
+		lanes[1] = ConsistencyMix(lanes[1], po->translucency);
+	}
+
+	return ConsistencyFinish(lanes);
+}
+
+static UINT64 ConsistencyRNG(void)
+{
+	UINT64 lanes[4] = CONSISTENCY_LANES_INIT;
+	INT32 i;
+
+	for (i = 0; i < PRNUMSYNCED; i++)
+	{
+		lanes[i & 3] = ConsistencyMix(lanes[i & 3], P_GetRandSeed(i));
+	}
+
+	return ConsistencyFinish(lanes);
+}
+
+//
+// NetUpdate
+// Builds ticcmds for console player,
+// sends out a packet
+//
+// no more use random generator, because at very first tic isn't yet synchronized
+// Note: It is called consistAncy on purpose.
+//
+// Hashes each part of the game state into consistencyhashes for the
+// current tic, and folds them down to the 16 bits sent with every
+// ticcmd. A desync spreads to the rest of the game state within a
+// few tics, so the short check value still catches one quickly. The
+// full hashes are only sent when they are needed to pin it down.
+//
+static INT16 Consistancy(void)
+{
+	UINT64 *hashes = consistencyhashes[gametic % BACKUPTICS];
+	UINT64 lanes[4] = CONSISTENCY_LANES_INIT;
+	INT32 i;
 
-	return (INT16)(ret & 0xFFFF);
+	DEBFILE(va("TIC %u ", gametic));
+
+	memset(hashes, 0, sizeof (consistencyhashes[0]));
+	hashes[CONSISTENCY_PLAYERS] = ConsistencyPlayers();
+
+	if (gamestate == GS_LEVEL)
+	{
+		hashes[CONSISTENCY_MOBJS] = ConsistencyMobjs();
+		hashes[CONSISTENCY_SECTORS] = ConsistencySectors();
+		hashes[CONSISTENCY_POLYOBJECTS] = ConsistencyPolyobjects();
+		hashes[CONSISTENCY_RNG] = ConsistencyRNG();
+	}
+
+	consistencyhashtic[gametic % BACKUPTICS] = gametic;
+
+	for (i = 0; i < NUMCONSISTENCYHASHES; i++)
+	{
+		lanes[i & 3] = ConsistencyMix(lanes[i & 3], (UINT32)hashes[i]);
+		lanes[i & 3] = ConsistencyMix(lanes[i & 3], (UINT32)(hashes[i] >> 32));
+	}
+
+	lanes[0] = ConsistencyFinish(lanes);
+
+	DEBFILE(va("Consistancy = %u\n", (UINT32)((lanes[0] ^ (lanes[0] >> 16) ^ (lanes[0] >> 32) ^ (lanes[0] >> 48)) & 0xFFFF)));
+
+	return (INT16)((lanes[0] ^ (lanes[0] >> 16) ^ (lanes[0] >> 32) ^ (lanes[0] >> 48)) & 0xFFFF);
 }
 
 // confusing, but this DOESN'T send PT_NODEKEEPALIVE, it sends PT_BASICKEEPALIVE
@@ -6166,6 +6352,7 @@ boolean TryRunTics(tic_t realtics)
 			consistancy[gametic % BACKUPTICS] = Consistancy();
 
 			ps_tictime = I_GetPreciseTime() - ps_tictime;
+			PS_RecordTic();
 
 			// Leave a certain amount of tics present in the net buffer as long as we've ran at least one tic this frame.
 			if (client && gamestate == GS_LEVEL && leveltime > 1 && neededtic <= gametic + cv_netticbuffer.value)
@@ -6598,6 +6785,9 @@ void NetKeepAlive(void)
 	Net_AckTicker();
 	HandleNodeTimeouts();
 	FileSendTicker();
+
+	if (I_NetFlush)
+		I_NetFlush();
 }
 
 // If a tree falls in the forest but nobody is around to hear it, does it make a tic?
@@ -6783,6 +6973,13 @@ void NetUpdate(void)
 	}
 
 	FileSendTicker();
+
+	// Keep acking downloads that happen in-game, such as Lua files
+	if (client)
+		FileReceiveTicker();
+
+	if (I_NetFlush)
+		I_NetFlush();
 }
 
 /** Returns the number of players playing.
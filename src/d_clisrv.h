@@ -34,7 +34,7 @@ The 'packet version' is used to distinguish packet formats.
 This version is independent of VERSION and SUBVERSION. Different
 applications may follow different packet versions.
 */
-#define PACKETVERSION 0
+#define PACKETVERSION 2
 
 // Network play related stuff.
 // There is a data struct that stores network
@@ -135,6 +135,9 @@ typedef enum
 
 	PT_SAY,				// "Hey server, please send this chat message to everyone via XD_SAY"
 
+	PT_ASKCONSISTENCY,	// Server, to client: "your consistency failed, what did you hash for this tic?"
+	PT_CONSISTENCY,		// Client, to server: "here are the hashes for each part of the game state"
+
 	NUMPACKETTYPE
 } packettype_t;
 
@@ -150,6 +153,7 @@ void Command_Drop(void);
 void Command_Droprate(void);
 #endif
 void Command_Numnodes(void);
+void Command_NetIOStats(void);
 
 #if defined(_MSC_VER)
 #pragma pack(1)
@@ -393,6 +397,24 @@ struct resultsall_pak
 	uint8_t signature[MAXPLAYERS][SIGNATURELENGTH];
 } ATTRPACK;
 
+// Parts of the game state hashed separately for consistency checks,
+// so a desync can be narrowed down to one of them
+typedef enum
+{
+	CONSISTENCY_PLAYERS,
+	CONSISTENCY_MOBJS,
+	CONSISTENCY_SECTORS,
+	CONSISTENCY_POLYOBJECTS,
+	CONSISTENCY_RNG,
+	NUMCONSISTENCYHASHES
+} consistencyhash_t;
+
+struct consistency_pak
+{
+	UINT32 tic;
+	UINT32 hashes[NUMCONSISTENCYHASHES][2]; // Low and high halves of each 64-bit hash
+} ATTRPACK;
+
 struct say_pak
 {
 	char message[HU_MAXMSGLEN];
@@ -451,6 +473,7 @@ struct doomdata_t
 		responseall_pak responseall;			// 256 bytes
 		resultsall_pak resultsall;				// 1024 bytes. Also, you really shouldn't trust anything here.
 		say_pak say;							// I don't care anymore.
+		consistency_pak consistency;			// 44 bytes
 	} u; // This is needed to pack diff packet types data together
 } ATTRPACK;
 
@@ -554,8 +577,9 @@ extern boolean server_lagless;
 extern consvar_t cv_mindelay;
 
 extern consvar_t cv_netticbuffer, cv_allownewplayer, cv_maxconnections, cv_joindelay;
+extern consvar_t cv_gamestatecompression;
 extern consvar_t cv_pingtimeout, cv_resynchattempts, cv_blamecfail;
-extern consvar_t cv_maxsend, cv_noticedownload, cv_downloadspeed;
+extern consvar_t cv_maxsend, cv_noticedownload, cv_downloadspeed, cv_downloadwindow;
 
 #ifdef VANILLAJOINNEXTROUND
 extern consvar_t cv_joinnextround;
@@ -72,6 +72,8 @@
 #include "keys.h"
 #include "g_input.h" // tutorial mode control scheming
 #include "m_perfstats.h"
+#include "m_benchmark.h"
+#include "core/instrument.h"
 #include "core/memory.h"
 
 #include "monocypher/monocypher.h"
@@ -897,6 +899,7 @@ void D_SRB2Loop(void)
 		g_dc = {};
 		Z_Frame_Reset();
 		srb2::r_debug::clear_frame_list();
+		I_InstrumentFrame(cv_perfstats.value == PS_INSTRUMENT);
 
 		{
 			// Casting the return value of a function is bad practice (apparently)
@@ -1086,6 +1089,9 @@ void D_SRB2Loop(void)
 		// Fully completed frame made.
 		finishprecise = I_GetPreciseTime();
 
+		if (demo.timing)
+			M_BenchmarkSample(finishprecise - enterprecise, ranwipe);
+
 		// Use the time before sleep for frameskip calculations:
 		// post-sleep time is literally being intentionally wasted
 		deltasecs = (double)((INT64)(finishprecise - enterprecise)) / I_GetPrecisePrecision();
@@ -1479,6 +1485,9 @@ void D_SRB2Main(void)
 	boolean autostart = false;
 	INT32 newgametype = -1;
 
+	// Before anything draws, so the main thread gets the big frame memory
+	Z_Frame_SetMainThread();
+
 	/* break the version string into version numbers, for netplay */
 	D_ConvertVersionNumbers();
 	D_AbbrevCommit();
@@ -2008,6 +2017,13 @@ void D_SRB2Main(void)
 	if (!autostart)
 		M_PushSpecialParameters(); // push all "+" parameters at the command buffer
 
+	if (M_BenchmarkStart())
+	{
+		G_SetGamestate(GS_NULL);
+		wipegamestate = GS_NULL;
+		return;
+	}
+
 	// demo doesn't need anymore to be added with D_AddFile()
 	p = M_CheckParm("-playdemo");
 	if (!p)
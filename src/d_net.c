@@ -74,6 +74,7 @@ INT16 hardware_MAXPACKETLENGTH;
 
 boolean (*I_NetGet)(void) = NULL;
 void (*I_NetSend)(void) = NULL;
+void (*I_NetFlush)(void) = NULL;
 boolean (*I_NetCanSend)(void) = NULL;
 boolean (*I_NetCanGet)(void) = NULL;
 void (*I_NetCloseSocket)(void) = NULL;
@@ -822,7 +823,12 @@ static const char *packettypename[NUMPACKETTYPE] =
 
 	"CHALLENGEALL",
 	"RESPONSEALL",
-	"RESULTSALL"
+	"RESULTSALL",
+
+	"SAY",
+
+	"ASKCONSISTENCY",
+	"CONSISTENCY"
 };
 
 static void DebugPrintpacket(const char *header)
@@ -1331,6 +1337,7 @@ boolean D_CheckNetGame(void)
 
 	I_NetGet = Internal_Get;
 	I_NetSend = Internal_Send;
+	I_NetFlush = NULL;
 	I_NetCanSend = NULL;
 	I_NetCloseSocket = NULL;
 	I_NetFreeNodenum = Internal_FreeNodenum;
@@ -1541,6 +1548,7 @@ void D_CloseConnection(void)
 
 		I_NetGet = Internal_Get;
 		I_NetSend = Internal_Send;
+		I_NetFlush = NULL;
 		I_NetCanSend = NULL;
 		I_NetCloseSocket = NULL;
 		I_NetFreeNodenum = Internal_FreeNodenum;
@@ -0,0 +1,490 @@
+// DR. ROBOTNIK'S RING RACERS
+//-----------------------------------------------------------------------------
+// Copyright (C) 2024 by Kart Krew.
+//
+// This program is free software distributed under the
+// terms of the GNU General Public License, version 2.
+// See the 'LICENSE' file for more details.
+//-----------------------------------------------------------------------------
+/// \file  d_netcache.c
+/// \brief Local addon cache, indexed by MD5.
+///        The index is kept in memory as an open-addressed hash
+///        table keyed on the MD5, and saved to DOWNLOAD/cache/index
+///        once a file check or download is done with it.
+
+#include <stdio.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <direct.h>
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+
+#include "doomdef.h"
+#include "d_main.h"
+#include "d_netfil.h"
+#include "d_netcache.h"
+#include "i_system.h"
+#include "m_misc.h"
+#include "w_wad.h"
+#include "z_zone.h"
+
+#define CACHEDIR "cache"
+#define INDEXNAME "index"
+#define INDEXHEADER "RRADDONCACHE 1"
+
+typedef struct
+{
+	UINT8 md5sum[16];
+	char *path;
+	UINT32 size;
+	INT64 mtime; // Both checked before trusting the MD5
+	INT64 lastused;
+	boolean cached; // In the cache directory, so ours to delete
+	boolean verified; // MD5 checked; downloads are hashed on their next lookup
+} addoncacheentry_t;
+
+// Flags in the index, where files used to only be cached or not
+#define INDEX_CACHED 1
+#define INDEX_UNVERIFIED 2
+
+static addoncacheentry_t *entries;
+static size_t numentries, maxentries;
+
+// Open addressing over entries; -1 is an empty slot
+static INT32 *table;
+static size_t tablesize; // Power of two, at least twice numentries
+
+static boolean loaded = false;
+static boolean dirty = false; // Changed since it was last saved
+
+static size_t HashMD5(const UINT8 *md5sum)
+{
+	// MD5s are already as well mixed as it gets
+	return (size_t)(md5sum[0] | (md5sum[1] << 8) | (md5sum[2] << 16) | ((UINT32)md5sum[3] << 24));
+}
+
+static void RebuildTable(void)
+{
+	size_t i, slot;
+
+	while (tablesize < numentries * 2 + 16)
+		tablesize = tablesize ? tablesize * 2 : 64;
+
+	table = Z_Realloc(table, tablesize * sizeof (*table), PU_STATIC, NULL);
+	memset(table, -1, tablesize * sizeof (*table));
+
+	for (i = 0; i < numentries; i++)
+	{
+		for (slot = HashMD5(entries[i].md5sum) & (tablesize - 1); table[slot] != -1; slot = (slot + 1) & (tablesize - 1))
+			;
+		table[slot] = (INT32)i;
+	}
+}
+
+static addoncacheentry_t *FindEntry(const UINT8 *md5sum)
+{
+	size_t slot;
+
+	if (!tablesize)
+		return NULL;
+
+	for (slot = HashMD5(md5sum) & (tablesize - 1); table[slot] != -1; slot = (slot + 1) & (tablesize - 1))
+	{
+		if (!memcmp(entries[table[slot]].md5sum, md5sum, 16))
+			return &entries[table[slot]];
+	}
+
+	return NULL;
+}
+
+static addoncacheentry_t *AddEntry(const UINT8 *md5sum, const char *path)
+{
+	addoncacheentry_t *entry;
+
+	if (numentries == maxentries)
+	{
+		maxentries = maxentries ? maxentries * 2 : 64;
+		entries = Z_Realloc(entries, maxentries * sizeof (*entries), PU_STATIC, NULL);
+	}
+
+	entry = &entries[numentries++];
+	memset(entry, 0, sizeof (*entry));
+	memcpy(entry->md5sum, md5sum, 16);
+	entry->path = Z_StrDup(path);
+
+	RebuildTable();
+	return &entries[numentries - 1];
+}
+
+static void RemoveEntry(addoncacheentry_t *entry)
+{
+	Z_Free(entry->path);
+	*entry = entries[--numentries];
+	RebuildTable();
+}
+
+static void MD5ToHex(const UINT8 *md5sum, char *hex)
+{
+	size_t i;
+
+	for (i = 0; i < 16; i++)
+		sprintf(&hex[i * 2], "%02x", md5sum[i]);
+}
+
+static boolean HexToMD5(const char *hex, UINT8 *md5sum)
+{
+	size_t i;
+	unsigned int byte;
+
+	for (i = 0; i < 16; i++)
+	{
+		if (sscanf(&hex[i * 2], "%2x", &byte) != 1)
+			return false;
+		md5sum[i] = (UINT8)byte;
+	}
+
+	return true;
+}
+
+static const char *CachePath(void)
+{
+	return va("%s" PATHSEP CACHEDIR, downloaddir);
+}
+
+static const char *IndexPath(void)
+{
+	return va("%s" PATHSEP CACHEDIR PATHSEP INDEXNAME, downloaddir);
+}
+
+// Reads the size and modification time of a file. Returns false if it's gone.
+static boolean StatFile(const char *path, UINT32 *size, INT64 *mtime)
+{
+	struct stat st;
+
+	if (stat(path, &st) != 0)
+		return false;
+
+	*size = (UINT32)st.st_size;
+	*mtime = (INT64)st.st_mtime;
+	return true;
+}
+
+static void SaveIndex(void)
+{
+	char path[MAX_WADPATH], temp[MAX_WADPATH];
+	char hex[33];
+	FILE *f;
+	size_t i;
+
+	strlcpy(path, IndexPath(), sizeof path);
+	snprintf(temp, sizeof temp, "%s.tmp", path);
+
+	I_mkdir(downloaddir, 0755);
+	I_mkdir(CachePath(), 0755);
+
+	f = fopen(temp, "w");
+	if (!f)
+	{
+		CONS_Alert(CONS_WARNING, "Couldn't write addon cache index %s\n", temp);
+		return;
+	}
+
+	fprintf(f, INDEXHEADER "\n");
+
+	for (i = 0; i < numentries; i++)
+	{
+		MD5ToHex(entries[i].md5sum, hex);
+		fprintf(f, "%s %u %lld %lld %d %s\n", hex, entries[i].size,
+			(long long)entries[i].mtime, (long long)entries[i].lastused,
+			(entries[i].cached ? INDEX_CACHED : 0) | (entries[i].verified ? 0 : INDEX_UNVERIFIED),
+			entries[i].path);
+	}
+
+	fclose(f);
+	dirty = false;
+
+	// Replace the old index in one step, so a crash can't leave half of one
+	remove(path);
+	if (rename(temp, path) != 0)
+		CONS_Alert(CONS_WARNING, "Couldn't write addon cache index %s\n", path);
+}
+
+static void LoadIndex(void)
+{
+	char line[MAX_WADPATH + 128];
+	FILE *f;
+
+	loaded = true;
+
+	f = fopen(IndexPath(), "r");
+	if (!f)
+		return;
+
+	if (!fgets(line, sizeof line, f) || strncmp(line, INDEXHEADER, strlen(INDEXHEADER)))
+	{
+		fclose(f);
+		return;
+	}
+
+	while (fgets(line, sizeof line, f))
+	{
+		char hex[33];
+		UINT8 md5sum[16];
+		unsigned int size;
+		long long mtime, lastused;
+		int flags, pathstart = 0;
+		addoncacheentry_t *entry;
+
+		line[strcspn(line, "\r\n")] = '\0';
+
+		if (sscanf(line, "%32s %u %lld %lld %d %n", hex, &size, &mtime, &lastused, &flags, &pathstart) < 5
+			|| !pathstart || !line[pathstart] || !HexToMD5(hex, md5sum) || FindEntry(md5sum))
+			continue;
+
+		entry = AddEntry(md5sum, &line[pathstart]);
+		entry->size = size;
+		entry->mtime = mtime;
+		entry->lastused = lastused;
+		entry->cached = (flags & INDEX_CACHED) != 0;
+		entry->verified = !(flags & INDEX_UNVERIFIED);
+	}
+
+	fclose(f);
+}
+
+static void LoadIndexOnce(void)
+{
+	if (!loaded)
+		LoadIndex();
+}
+
+// Can't delete a file that's loaded, on top of it being rude
+static boolean FileInUse(const char *path)
+{
+	UINT16 i;
+
+	for (i = 0; i < numwadfiles; i++)
+	{
+		if (wadfiles[i] && !strcmp(wadfiles[i]->filename, path))
+			return true;
+	}
+
+	return false;
+}
+
+// Deletes a cached file and the MD5 directory it is in
+static void DeleteCachedFile(const char *path)
+{
+	char dir[MAX_WADPATH];
+	char *slash;
+
+	remove(path);
+
+	strlcpy(dir, path, sizeof dir);
+	slash = strrchr(dir, PATHSEP[0]);
+	if (slash)
+	{
+		*slash = '\0';
+		rmdir(dir);
+	}
+}
+
+// Evicts least recently used files until the cache fits its size limit.
+// The file with the MD5 keep, if any, stays regardless.
+static boolean TrimCache(const UINT8 *keep, UINT64 limit)
+{
+	boolean changed = false;
+
+	for (;;)
+	{
+		addoncacheentry_t *oldest = NULL;
+		UINT64 total = 0;
+		size_t i;
+
+		for (i = 0; i < numentries; i++)
+		{
+			if (!entries[i].cached)
+				continue;
+
+			total += entries[i].size;
+
+			if (!(keep && !memcmp(entries[i].md5sum, keep, 16)) && !FileInUse(entries[i].path)
+				&& (!oldest || entries[i].lastused < oldest->lastused))
+				oldest = &entries[i];
+		}
+
+		if (total <= limit || !oldest)
+			break;
+
+		CONS_Debug(DBG_NETPLAY, "Evicting %s from the addon cache\n", oldest->path);
+		DeleteCachedFile(oldest->path);
+		RemoveEntry(oldest);
+		changed = true;
+	}
+
+	if (changed)
+		dirty = true;
+
+	return changed;
+}
+
+static UINT64 CacheLimit(void)
+{
+	if (!cv_addons_cachesize.value)
+		return UINT64_MAX;
+	return (UINT64)cv_addons_cachesize.value << 20;
+}
+
+boolean D_AddonCacheLookup(const UINT8 *md5sum, char *filename)
+{
+	addoncacheentry_t *entry;
+	UINT32 size;
+	INT64 mtime;
+
+	LoadIndexOnce();
+
+	entry = FindEntry(md5sum);
+	if (!entry)
+		return false;
+
+	if (!StatFile(entry->path, &size, &mtime) || size != entry->size || mtime != entry->mtime)
+	{
+		// Changed or gone since we indexed it
+		CONS_Debug(DBG_NETPLAY, "Addon cache entry %s is stale\n", entry->path);
+		RemoveEntry(entry);
+		dirty = true;
+		return false;
+	}
+
+	if (!entry->verified)
+	{
+		if (checkfilemd5(entry->path, md5sum) != FS_FOUND)
+		{
+			CONS_Alert(CONS_WARNING, "%s doesn't match the server's copy, dropping it from the addon cache\n", entry->path);
+			if (entry->cached && !FileInUse(entry->path))
+				DeleteCachedFile(entry->path);
+			RemoveEntry(entry);
+			dirty = true;
+			return false;
+		}
+
+		entry->verified = true;
+	}
+
+	strlcpy(filename, entry->path, MAX_WADPATH);
+	entry->lastused = (INT64)time(NULL);
+	dirty = true;
+	return true;
+}
+
+// Indexes a file, trusting that it has the MD5 given
+static void Remember(const char *filename, const UINT8 *md5sum, boolean verified)
+{
+	addoncacheentry_t *entry;
+	const char *cachepath;
+	UINT32 size;
+	INT64 mtime;
+
+	LoadIndexOnce();
+
+	if (!StatFile(filename, &size, &mtime))
+		return;
+
+	entry = FindEntry(md5sum);
+	if (!entry)
+		entry = AddEntry(md5sum, filename);
+	else if (strcmp(entry->path, filename))
+	{
+		Z_Free(entry->path);
+		entry->path = Z_StrDup(filename);
+	}
+
+	cachepath = CachePath();
+
+	entry->size = size;
+	entry->mtime = mtime;
+	entry->lastused = (INT64)time(NULL);
+	entry->cached = !strncmp(filename, cachepath, strlen(cachepath));
+	entry->verified = verified;
+
+	dirty = true;
+}
+
+void D_AddonCacheRemember(const char *filename, const UINT8 *md5sum)
+{
+	Remember(filename, md5sum, true);
+}
+
+void D_AddonCacheDownloadPath(char *filename, const UINT8 *md5sum)
+{
+	char hex[33];
+	char dir[MAX_WADPATH];
+	char path[MAX_WADPATH];
+
+	MD5ToHex(md5sum, hex);
+
+	snprintf(dir, sizeof dir, "%s" PATHSEP "%s", CachePath(), hex);
+	if (snprintf(path, sizeof path, "%s" PATHSEP "%s", dir, filename) >= (int)sizeof path)
+	{
+		// Too long for the cache; download it the old way, by name alone
+		strcatbf(filename, downloaddir, "/");
+		return;
+	}
+
+	I_mkdir(downloaddir, 0755);
+	I_mkdir(CachePath(), 0755);
+	I_mkdir(dir, 0755);
+
+	strlcpy(filename, path, MAX_WADPATH);
+}
+
+void D_AddonCacheAddDownload(const char *filename, const UINT8 *md5sum, boolean verified)
+{
+	const char *cachepath;
+
+	cachepath = CachePath();
+	if (strncmp(filename, cachepath, strlen(cachepath)))
+		return; // Not an addon download
+
+	Remember(filename, md5sum, verified);
+	TrimCache(md5sum, CacheLimit());
+	D_AddonCacheSave();
+}
+
+void D_AddonCacheSave(void)
+{
+	if (dirty)
+		SaveIndex();
+}
+
+void Command_AddonCache_f(void)
+{
+	UINT64 total = 0;
+	size_t i, cached = 0;
+
+	LoadIndexOnce();
+
+	if (COM_Argc() > 1 && !stricmp(COM_Argv(1), "clear"))
+	{
+		TrimCache(NULL, 0);
+		D_AddonCacheSave();
+	}
+
+	for (i = 0; i < numentries; i++)
+	{
+		if (!entries[i].cached)
+			continue;
+
+		total += entries[i].size;
+		cached++;
+	}
+
+	CONS_Printf("%s files indexed, %s of them downloaded into the cache (%s MB)\n",
+		sizeu1(numentries), sizeu2(cached), sizeu3((size_t)(total >> 20)));
+	if (cv_addons_cachesize.value)
+		CONS_Printf("The cache is kept under %d MB.\n", cv_addons_cachesize.value);
+}
@@ -0,0 +1,64 @@
+// DR. ROBOTNIK'S RING RACERS
+//-----------------------------------------------------------------------------
+// Copyright (C) 2024 by Kart Krew.
+//
+// This program is free software distributed under the
+// terms of the GNU General Public License, version 2.
+// See the 'LICENSE' file for more details.
+//-----------------------------------------------------------------------------
+/// \file  d_netcache.h
+/// \brief Local addon cache, indexed by MD5
+
+#ifndef __D_NETCACHE__
+#define __D_NETCACHE__
+
+#include "doomtype.h"
+#include "command.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Every file a server asks for is identified by its MD5, so the cache
+// files them by MD5 rather than by name: downloads go to
+// DOWNLOAD/cache/<md5>/<name>, and an index remembers where each MD5
+// lives, including matching files found elsewhere by findfile. Joining
+// a server only has to stat a file the index knows about, rather than
+// search for it by name and hash it again, and a pack renamed between
+// servers is only ever downloaded once.
+//
+// Files in the cache directory are evicted least recently used first
+// once they add up to more than addons_cachesize megabytes. Files that
+// live anywhere else are only indexed, never deleted.
+//
+
+extern consvar_t cv_addons_cachesize;
+
+// If a file with this MD5 is indexed and unchanged on disk, copies its
+// path into filename (MAX_WADPATH bytes) and returns true
+boolean D_AddonCacheLookup(const UINT8 *md5sum, char *filename);
+
+// Indexes a file whose MD5 was just checked, so the next lookup is free
+void D_AddonCacheRemember(const char *filename, const UINT8 *md5sum);
+
+// Turns filename, a bare file name, into the path to download it to,
+// and creates the directories on the way
+void D_AddonCacheDownloadPath(char *filename, const UINT8 *md5sum);
+
+// Indexes a finished download, trims the cache and saves the index.
+// If verified is false, the file is hashed the first time it is looked
+// up, and dropped from the cache if it doesn't match.
+void D_AddonCacheAddDownload(const char *filename, const UINT8 *md5sum, boolean verified);
+
+// Lookups and remembered files only change the index in memory; this
+// writes it out if anything changed since it was last saved
+void D_AddonCacheSave(void);
+
+void Command_AddonCache_f(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // __D_NETCACHE__
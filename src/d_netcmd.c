@@ -33,6 +33,7 @@
 #include "am_map.h"
 #include "byteptr.h"
 #include "d_netfil.h"
+#include "d_netcache.h"
 #include "p_spec.h"
 #include "m_cheat.h"
 #include "d_clisrv.h"
@@ -48,6 +49,7 @@
 #include "lua_hook.h"
 #include "m_cond.h"
 #include "m_anigif.h"
+#include "m_encoder.h"
 #include "md5.h"
 
 // SRB2kart
@@ -241,6 +243,7 @@ CV_PossibleValue_t perfstats_cons_t[] = {
 	{PS_LOGIC, "Logic"},
 	{PS_BOT, "Bots"},
 	{PS_THINKFRAME, "ThinkFrame"},
+	{PS_INSTRUMENT, "Instrumented"},
 	{0, NULL}
 };
 
@@ -431,6 +434,8 @@ void D_RegisterServerCommands(void)
 #endif
 
 	COM_AddDebugCommand("downloads", Command_Downloads_f);
+	COM_AddCommand("addoncache", Command_AddonCache_f);
+	COM_AddCommand("perfstats_export", Command_PerfStatsExport_f);
 
 	COM_AddDebugCommand("give", Command_KartGiveItem_f);
 	COM_AddDebugCommand("give2", Command_KartGiveItem_f);
@@ -460,6 +465,7 @@ void D_RegisterServerCommands(void)
 
 	COM_AddDebugCommand("numthinkers", Command_Numthinkers_f);
 	COM_AddDebugCommand("countmobjs", Command_CountMobjs_f);
+	COM_AddDebugCommand("waypointbench", Command_WaypointBench_f);
 
 #ifdef _DEBUG
 	COM_AddDebugCommand("causecfail", Command_CauseCfail_f);
@@ -536,6 +542,10 @@ void D_RegisterClientCommands(void)
 	COM_AddCommand("startmovie", Command_StartMovie_f);
 	COM_AddCommand("startlossless", Command_StartLossless_f);
 	COM_AddCommand("stopmovie", Command_StopMovie_f);
+	COM_AddCommand("encoderstats", Command_EncoderStats_f);
+#ifdef HAVE_ANIGIF
+	COM_AddCommand("gifbench", Command_GifBench_f);
+#endif
 	COM_AddDebugCommand("minigen", M_MinimapGenerate);
 
 #ifdef SRB2_CONFIG_ENABLE_WEBM_MOVIES
@@ -47,6 +47,7 @@
 #include "d_net.h"
 #include "w_wad.h"
 #include "d_netfil.h"
+#include "d_netcache.h"
 #include "z_zone.h"
 #include "byteptr.h"
 #include "p_setup.h"
@@ -80,6 +81,54 @@ typedef struct filetx_s
 	struct filetx_s *next; // Next file in the list
 } filetx_t;
 
+// Where a fragment is in a windowed transfer
+typedef enum
+{
+	FRAGMENT_IDLE, // Not sent yet, or acknowledged
+	FRAGMENT_INFLIGHT, // Sent and waiting for an ack
+	FRAGMENT_LOST, // Given up on, waiting in the retransmit queue
+} fragmentstate_t;
+
+typedef struct
+{
+	precise_t senttime; // When it was last sent
+	UINT32 seq; // Which send that was
+	UINT8 state;
+	UINT8 sends;
+} fragmentsend_t;
+
+// Congestion control for one windowed transfer, in the spirit of TCP:
+// a window of fragments in flight that grows until a loss or a rise in
+// RTT shows the link is full, then halves. Fragments are spread across
+// the RTT instead of sent in bursts.
+typedef struct
+{
+	fragmentsend_t *fragments;
+	UINT32 numfragments;
+	UINT32 nextnew; // First fragment that was never sent
+
+	// Fragments in the order they were sent, oldest first.
+	// Acked ones are left in and skipped when they reach the front.
+	UINT32 *inflight;
+	UINT32 inflighthead, inflightcount;
+	UINT32 outstanding; // Fragments actually still in flight
+
+	// Fragments to send again, in the order they were found lost
+	UINT32 *lost;
+	UINT32 losthead, lostcount;
+
+	UINT32 seq; // Number of sends so far
+	UINT32 highestackedseq;
+	UINT32 recoveryseq; // The window is only cut again for a fragment sent after this
+
+	UINT32 cwnd, ssthresh; // In fragments
+	UINT32 cwndcount; // Acks towards the next window increase
+	UINT64 credit; // Fragments we may send right now, 16.16 fixed point
+
+	precise_t srtt, rttvar, minrtt;
+	precise_t lasttick;
+} filewindow_t;
+
 // Current transfers (one for each node)
 typedef struct filetran_s
 {
@@ -91,6 +140,7 @@ typedef struct filetran_s
 	UINT32 ackedsize;
 	FILE *currentfile; // The file currently being sent/received
 	tic_t dontsenduntil;
+	filewindow_t *window; // Only for windowed transfers
 } filetran_t;
 static filetran_t transfer[MAXNETNODES];
 
@@ -447,8 +497,8 @@ tryagain:
 			CONS_Printf(" file \"%s\" (id %d)\n", i, fileneeded[i].filename);
 #endif
 
-			// put it in download dir
-			strcatbf(fileneeded[i].filename, downloaddir, "/");
+			// put it in the download cache
+			D_AddonCacheDownloadPath(fileneeded[i].filename, fileneeded[i].md5sum);
 			fileneeded[i].status = FS_REQUESTED;
 		}
 	}
@@ -622,12 +672,22 @@ INT32 CL_CheckFiles(void)
 
 		packetsize += nameonlylength(fileneeded[i].filename) + 22;
 
-		fileneeded[i].status = findfile(fileneeded[i].filename, fileneeded[i].md5sum, true);
+		// The cache knows files by content, so it finds renamed copies without hashing anything
+		if (D_AddonCacheLookup(fileneeded[i].md5sum, fileneeded[i].filename))
+			fileneeded[i].status = FS_FOUND;
+		else
+		{
+			fileneeded[i].status = findfile(fileneeded[i].filename, fileneeded[i].md5sum, true);
+			if (fileneeded[i].status == FS_FOUND)
+				D_AddonCacheRemember(fileneeded[i].filename, fileneeded[i].md5sum);
+		}
 		CONS_Debug(DBG_NETPLAY, "found %d\n", fileneeded[i].status);
 		return 4;
 	}
 
 	//now making it here means we've checked the entire list and no FS_NOTCHECKED files remain
+	D_AddonCacheSave();
+
 	if (numwadfiles+filestoload > MAX_WADFILES)
 		return 3;
 	else if (downloadrequired)
@@ -1055,6 +1115,203 @@ boolean AddLuaFileToSendQueue(INT32 node, const char *filename)
 	return true;
 }
 
+#define FILEWINDOW_INITIAL 16 // Fragments in flight before the first ack
+#define FILEWINDOW_MIN 2
+#define FILEWINDOW_MAX 4096
+#define FILEWINDOW_REORDER 3 // How many later sends must be acked before a fragment counts as lost
+#define FILEWINDOW_MAXPERTIC 512 // So a huge window can't stall a frame
+#define FILEWINDOW_CREDITBITS 16
+
+static void SV_FreeFileWindow(filetran_t *trans)
+{
+	if (!trans->window)
+		return;
+
+	free(trans->window->fragments);
+	free(trans->window->inflight);
+	free(trans->window->lost);
+	free(trans->window);
+	trans->window = NULL;
+}
+
+static void SV_StartFileWindow(filetran_t *trans, UINT32 numfragments)
+{
+	filewindow_t *w;
+
+	SV_FreeFileWindow(trans);
+
+	w = calloc(1, sizeof(*w));
+	if (!w)
+		I_Error("FileSendTicker: No more memory\n");
+
+	// Even an empty file needs its one fragment, to tell the client it exists
+	numfragments = max(numfragments, 1);
+
+	w->fragments = calloc(numfragments, sizeof(*w->fragments));
+	w->inflight = malloc(numfragments * sizeof(*w->inflight));
+	w->lost = malloc(numfragments * sizeof(*w->lost));
+	if (!(w->fragments && w->inflight && w->lost))
+		I_Error("FileSendTicker: No more memory\n");
+
+	w->numfragments = numfragments;
+	w->cwnd = FILEWINDOW_INITIAL;
+	w->ssthresh = FILEWINDOW_MAX;
+	w->credit = (UINT64)FILEWINDOW_INITIAL << FILEWINDOW_CREDITBITS;
+	w->lasttick = I_GetPreciseTime();
+
+	trans->window = w;
+}
+
+// How long to wait for an ack before a fragment counts as lost
+static precise_t SV_FileWindowTimeout(const filewindow_t *w)
+{
+	const precise_t second = I_GetPrecisePrecision();
+	precise_t rto;
+
+	if (!w->srtt)
+		return second;
+
+	rto = w->srtt + 4 * w->rttvar;
+	rto = max(rto, second / 5);
+	rto = min(rto, 3 * second);
+	return rto;
+}
+
+// Halves the window, at most once per round trip
+static void SV_FileWindowCongestion(filewindow_t *w, UINT32 seq)
+{
+	if (seq <= w->recoveryseq)
+		return; // Sent before the last cut, so already accounted for
+
+	w->ssthresh = max(w->cwnd / 2, FILEWINDOW_MIN);
+	w->cwnd = w->ssthresh;
+	w->cwndcount = 0;
+	w->recoveryseq = w->seq;
+}
+
+static void SV_QueueLostFragment(filewindow_t *w, UINT32 fragment)
+{
+	w->fragments[fragment].state = FRAGMENT_LOST;
+	w->lost[(w->losthead + w->lostcount) % w->numfragments] = fragment;
+	w->lostcount++;
+}
+
+// Updates the RTT estimate and grows the window for a newly acked fragment
+static void SV_FileFragmentAcked(filewindow_t *w, UINT32 fragment)
+{
+	fragmentsend_t *frag;
+	precise_t sample, delta;
+
+	if (fragment >= w->numfragments)
+		return;
+
+	frag = &w->fragments[fragment];
+
+	if (frag->state == FRAGMENT_LOST)
+	{
+		// The ack was just late; it will be skipped in the retransmit queue
+		frag->state = FRAGMENT_IDLE;
+		return;
+	}
+
+	if (frag->state != FRAGMENT_INFLIGHT)
+		return;
+
+	frag->state = FRAGMENT_IDLE;
+	w->outstanding--;
+	w->highestackedseq = max(w->highestackedseq, frag->seq);
+
+	// Only time fragments sent once, as there's no telling which send a resend's ack is for
+	if (frag->sends == 1)
+	{
+		sample = I_GetPreciseTime() - frag->senttime;
+
+		if (!w->srtt)
+		{
+			w->srtt = w->minrtt = sample;
+			w->rttvar = sample / 2;
+		}
+		else
+		{
+			delta = (sample > w->srtt) ? sample - w->srtt : w->srtt - sample;
+			w->rttvar = (3 * w->rttvar + delta) / 4;
+			w->srtt = (7 * w->srtt + sample) / 8;
+			w->minrtt = min(w->minrtt, sample);
+		}
+
+		// Queues building up on the way to the client would delay
+		// game traffic too, so back off before anything gets dropped
+		if (sample > w->minrtt + I_GetPrecisePrecision() / 10)
+		{
+			SV_FileWindowCongestion(w, frag->seq);
+			return;
+		}
+	}
+
+	if (w->cwnd < w->ssthresh)
+		w->cwnd++; // Slow start
+	else if (++w->cwndcount >= w->cwnd)
+	{
+		w->cwnd++; // One more fragment per round trip
+		w->cwndcount = 0;
+	}
+
+	w->cwnd = min(w->cwnd, FILEWINDOW_MAX);
+}
+
+// Moves fragments that were overtaken by later acks, or timed out, to the retransmit queue
+static void SV_DetectLostFragments(filewindow_t *w, precise_t now)
+{
+	const precise_t rto = SV_FileWindowTimeout(w);
+
+	while (w->inflightcount)
+	{
+		const UINT32 fragment = w->inflight[w->inflighthead];
+		fragmentsend_t *frag = &w->fragments[fragment];
+
+		if (frag->state == FRAGMENT_INFLIGHT)
+		{
+			// Everything behind this one was sent later, so it can't be lost either
+			if (frag->seq + FILEWINDOW_REORDER > w->highestackedseq && now - frag->senttime < rto)
+				break;
+
+			w->outstanding--;
+			SV_QueueLostFragment(w, fragment);
+			SV_FileWindowCongestion(w, frag->seq);
+		}
+
+		w->inflighthead = (w->inflighthead + 1) % w->numfragments;
+		w->inflightcount--;
+	}
+}
+
+// Returns the next fragment to send, resends first, or -1 if there is none right now
+static INT32 SV_NextWindowFragment(filetran_t *trans)
+{
+	filewindow_t *w = trans->window;
+
+	while (w->lostcount)
+	{
+		const UINT32 fragment = w->lost[w->losthead];
+
+		w->losthead = (w->losthead + 1) % w->numfragments;
+		w->lostcount--;
+
+		if (w->fragments[fragment].state == FRAGMENT_LOST)
+			return (INT32)fragment;
+	}
+
+	while (w->nextnew < w->numfragments)
+	{
+		const UINT32 fragment = w->nextnew++;
+
+		if (!trans->ackedfragments[fragment]) // Resumed downloads have some already
+			return (INT32)fragment;
+	}
+
+	return -1;
+}
+
 /** Stops sending a file for a node, and removes the file request from the list,
   * either because the file has been fully sent or because the node was disconnected
   *
@@ -1095,21 +1352,166 @@ static void SV_EndFileSend(INT32 node)
 		free(transfer[node].ackedfragments);
 	transfer[node].ackedfragments = NULL;
 
+	SV_FreeFileWindow(&transfer[node]);
+
 	filestosend--;
 }
 
 #define FILEFRAGMENTSIZE (software_MAXPACKETLENGTH - (FILETXHEADER + BASEPACKETSIZE))
 
+// Opens the first file in a node's queue and resets its transfer state
+static void SV_StartFileSend(INT32 node)
+{
+	filetran_t *trans = &transfer[node];
+	filetx_t *f = trans->txlist;
+
+	if (!f->ram) // Sending a file
+	{
+		long filesize;
+
+		trans->currentfile =
+			fopen(f->id.filename, "rb");
+
+		if (!trans->currentfile)
+			I_Error("File %s does not exist",
+				f->id.filename);
+
+		fseek(trans->currentfile, 0, SEEK_END);
+		filesize = ftell(trans->currentfile);
+
+		// Nobody wants to transfer a file bigger
+		// than 4GB!
+		if (filesize >= LONG_MAX)
+			I_Error("filesize of %s is too large", f->id.filename);
+		if (filesize == -1)
+			I_Error("Error getting filesize of %s", f->id.filename);
+
+		f->size = (UINT32)filesize;
+		fseek(trans->currentfile, 0, SEEK_SET);
+	}
+	else // Sending RAM
+		trans->currentfile = (FILE *)1; // Set currentfile to a non-null value to indicate that it is open
+
+	trans->iteration = 1;
+	trans->ackediteration = 0;
+	trans->position = 0;
+	trans->ackedsize = 0;
+
+	trans->ackedfragments = calloc(f->size / FILEFRAGMENTSIZE + 1, sizeof(*trans->ackedfragments));
+	if (!trans->ackedfragments)
+		I_Error("FileSendTicker: No more memory\n");
+
+	trans->dontsenduntil = 0;
+
+	if (cv_downloadwindow.value)
+		SV_StartFileWindow(trans, (f->size + FILEFRAGMENTSIZE - 1) / FILEFRAGMENTSIZE);
+}
+
+// Sends the fragment of a node's current file that starts at position.
+// Returns false if it couldn't be sent.
+static boolean SV_SendFileFragment(INT32 node, UINT32 position)
+{
+	filetran_t *trans = &transfer[node];
+	filetx_t *f = trans->txlist;
+	filetx_pak *p = (void*)&netbuffer->u.filetxpak;
+	size_t fragmentsize;
+
+	// Build a packet containing a file fragment
+	netbuffer->packettype = PT_FILEFRAGMENT;
+	fragmentsize = FILEFRAGMENTSIZE;
+	if (f->size-position < fragmentsize)
+		fragmentsize = f->size-position;
+	if (f->ram)
+		M_Memcpy(p->data, &f->id.ram[position], fragmentsize);
+	else
+	{
+		fseek(trans->currentfile, position, SEEK_SET);
+
+		if (fread(p->data, 1, fragmentsize, trans->currentfile) != fragmentsize)
+			I_Error("FileSendTicker: can't read %s byte on %s at %d because %s", sizeu1(fragmentsize), f->id.filename, position, M_FileError(trans->currentfile));
+	}
+	p->iteration = trans->iteration;
+	p->position = LONG(position);
+	p->fileid = f->fileid;
+	p->filesize = LONG(f->size);
+	p->size = SHORT((UINT16)FILEFRAGMENTSIZE);
+
+	// Send the packet
+	return HSendPacket(node, false, 0, FILETXHEADER + fragmentsize); // Don't use the default acknowledgement system
+}
+
+/** Sends fragments to each node as its congestion window allows
+  *
+  */
+static void SV_WindowedFileSendTicker(void)
+{
+	const precise_t now = I_GetPreciseTime();
+	INT32 node;
+
+	for (node = 0; node < MAXNETNODES; node++)
+	{
+		filetran_t *trans = &transfer[node];
+		filewindow_t *w;
+		precise_t elapsed, srtt;
+		INT32 fragment, sent = 0;
+
+		if (!trans->txlist)
+			continue;
+
+		if (!trans->currentfile)
+			SV_StartFileSend(node);
+		else if (!trans->window) // Windowed downloads were turned on mid-transfer
+			SV_StartFileWindow(trans, (trans->txlist->size + FILEFRAGMENTSIZE - 1) / FILEFRAGMENTSIZE);
+
+		w = trans->window;
+
+		SV_DetectLostFragments(w, now);
+
+		// Spread a window's worth of fragments over each round trip
+		elapsed = min(now - w->lasttick, I_GetPrecisePrecision());
+		w->lasttick = now;
+		srtt = w->srtt ? w->srtt : I_GetPrecisePrecision() / 10;
+		w->credit += ((UINT64)w->cwnd << FILEWINDOW_CREDITBITS) * elapsed / srtt;
+		w->credit = min(w->credit, (UINT64)w->cwnd << FILEWINDOW_CREDITBITS);
+
+		while (w->outstanding < w->cwnd
+			&& w->credit >= (1 << FILEWINDOW_CREDITBITS)
+			&& sent < FILEWINDOW_MAXPERTIC
+			&& (fragment = SV_NextWindowFragment(trans)) != -1)
+		{
+			fragmentsend_t *frag = &w->fragments[fragment];
+
+			if (!SV_SendFileFragment(node, (UINT32)fragment * FILEFRAGMENTSIZE))
+			{
+				// Try again next time
+				SV_QueueLostFragment(w, fragment);
+				break;
+			}
+
+			frag->state = FRAGMENT_INFLIGHT;
+			frag->seq = ++w->seq;
+			frag->senttime = now;
+			if (frag->sends < UINT8_MAX)
+				frag->sends++;
+
+			w->inflight[(w->inflighthead + w->inflightcount) % w->numfragments] = fragment;
+			w->inflightcount++;
+			w->outstanding++;
+
+			w->credit -= (1 << FILEWINDOW_CREDITBITS);
+			sent++;
+		}
+	}
+}
+
 /** Handles file transmission
   *
   */
 void FileSendTicker(void)
 {
 	static INT32 currentnode = 0;
-	filetx_pak *p;
-	size_t fragmentsize;
 	filetx_t *f;
-	INT32 packetsent, ram, i, j;
+	INT32 packetsent, i, j;
 
 	// If someone is taking too long to download, kick them with a timeout
 	// to prevent blocking the rest of the server...
@@ -1130,9 +1532,13 @@ void FileSendTicker(void)
 	if (!filestosend) // No file to send
 		return;
 
-	packetsent = cv_downloadspeed.value;
+	if (cv_downloadwindow.value)
+	{
+		SV_WindowedFileSendTicker();
+		return;
+	}
 
-	netbuffer->packettype = PT_FILEFRAGMENT;
+	packetsent = cv_downloadspeed.value;
 
 	// (((sendbytes-nowsentbyte)*TICRATE)/(I_GetTime()-starttime)<(UINT32)net_bandwidth)
 	while (packetsent-- && filestosend != 0)
@@ -1149,48 +1555,14 @@ void FileSendTicker(void)
 
 		currentnode = (i+1) % MAXNETNODES;
 		f = transfer[i].txlist;
-		ram = f->ram;
 
 		// Open the file if it isn't open yet, or
 		if (!transfer[i].currentfile)
+			SV_StartFileSend(i);
+		else if (transfer[i].window)
 		{
-			if (!ram) // Sending a file
-			{
-				long filesize;
-
-				transfer[i].currentfile =
-					fopen(f->id.filename, "rb");
-
-				if (!transfer[i].currentfile)
-					I_Error("File %s does not exist",
-						f->id.filename);
-
-				fseek(transfer[i].currentfile, 0, SEEK_END);
-				filesize = ftell(transfer[i].currentfile);
-
-				// Nobody wants to transfer a file bigger
-				// than 4GB!
-				if (filesize >= LONG_MAX)
-					I_Error("filesize of %s is too large", f->id.filename);
-				if (filesize == -1)
-					I_Error("Error getting filesize of %s", f->id.filename);
-
-				f->size = (UINT32)filesize;
-				fseek(transfer[i].currentfile, 0, SEEK_SET);
-			}
-			else // Sending RAM
-				transfer[i].currentfile = (FILE *)1; // Set currentfile to a non-null value to indicate that it is open
-
-			transfer[i].iteration = 1;
-			transfer[i].ackediteration = 0;
-			transfer[i].position = 0;
-			transfer[i].ackedsize = 0;
-
-			transfer[i].ackedfragments = calloc(f->size / FILEFRAGMENTSIZE + 1, sizeof(*transfer[i].ackedfragments));
-			if (!transfer[i].ackedfragments)
-				I_Error("FileSendTicker: No more memory\n");
-
-			transfer[i].dontsenduntil = 0;
+			// Windowed downloads were turned off mid-transfer
+			SV_FreeFileWindow(&transfer[i]);
 		}
 
 		// If the client hasn't acknowledged any fragment from the previous iteration,
@@ -1213,29 +1585,12 @@ void FileSendTicker(void)
 			}
 		}
 
-		// Build a packet containing a file fragment
-		p = (void*)&netbuffer->u.filetxpak;
-		fragmentsize = FILEFRAGMENTSIZE;
-		if (f->size-transfer[i].position < fragmentsize)
-			fragmentsize = f->size-transfer[i].position;
-		if (ram)
-			M_Memcpy(p->data, &f->id.ram[transfer[i].position], fragmentsize);
-		else
-		{
-			fseek(transfer[i].currentfile, transfer[i].position, SEEK_SET);
-
-			if (fread(p->data, 1, fragmentsize, transfer[i].currentfile) != fragmentsize)
-				I_Error("FileSendTicker: can't read %s byte on %s at %d because %s", sizeu1(fragmentsize), f->id.filename, transfer[i].position, M_FileError(transfer[i].currentfile));
-		}
-		p->iteration = transfer[i].iteration;
-		p->position = LONG(transfer[i].position);
-		p->fileid = f->fileid;
-		p->filesize = LONG(f->size);
-		p->size = SHORT((UINT16)FILEFRAGMENTSIZE);
-
-		// Send the packet
-		if (HSendPacket(i, false, 0, FILETXHEADER + fragmentsize)) // Don't use the default acknowledgement system
+		if (SV_SendFileFragment(i, transfer[i].position))
 		{ // Success
+			size_t fragmentsize = FILEFRAGMENTSIZE;
+			if (f->size-transfer[i].position < fragmentsize)
+				fragmentsize = f->size-transfer[i].position;
+
 			transfer[i].position = (UINT32)(transfer[i].position + fragmentsize);
 			if (transfer[i].position >= f->size)
 			{
@@ -1285,17 +1640,23 @@ void PT_FileAck(void)
 		for (j = 0; j < 32; j++)
 			if (LONG(segment->acks) & (1 << j))
 			{
-				if (LONG(segment->start) * FILEFRAGMENTSIZE >= trans->txlist->size)
+				const UINT32 fragment = LONG(segment->start) + j;
+
+				if (LONG(segment->start) * FILEFRAGMENTSIZE >= trans->txlist->size
+					|| fragment > trans->txlist->size / FILEFRAGMENTSIZE)
 				{
 					Net_CloseConnection(node);
 					return;
 				}
 
-				if (!trans->ackedfragments[LONG(segment->start) + j])
+				if (!trans->ackedfragments[fragment])
 				{
-					trans->ackedfragments[LONG(segment->start) + j] = true;
+					trans->ackedfragments[fragment] = true;
 					trans->ackedsize += FILEFRAGMENTSIZE;
 
+					if (trans->window)
+						SV_FileFragmentAcked(trans->window, fragment);
+
 					// If the last missing fragment was acked, finish!
 					if (trans->ackedsize == trans->txlist->size)
 					{
@@ -1350,6 +1711,7 @@ static void SendAckPacket(fileack_pak *packet, UINT8 fileid)
 	netbuffer->packettype = PT_FILEACK;
 	M_Memcpy(&netbuffer->u.fileack, packet, packetsize);
 	HSendPacket(servernode, false, 0, packetsize);
+	lasttimeackpacketsent = I_GetTime();
 
 	// Clear the packet
 	memset(packet, 0, sizeof(*packet) + 512);
@@ -1388,7 +1750,9 @@ void FileReceiveTicker(void)
 
 		if (file->status == FS_DOWNLOADING)
 		{
-			if (lasttimeackpacketsent - I_GetTime() > TICRATE / 2)
+			// Ack as soon as there is something to ack, so the server can
+			// measure the round trip, and otherwise every half second
+			if (file->ackpacket->numsegments || I_GetTime() - lasttimeackpacketsent > TICRATE / 2)
 				SendAckPacket(file->ackpacket, i);
 
 			// When resuming a tranfer, start with telling
@@ -1535,6 +1899,8 @@ void PT_FileFragment(void)
 				CONS_Printf(M_GetText("Downloading %s...(done)\n"),
 					filename);
 
+				D_AddonCacheAddDownload(filename, file->md5sum, false);
+
 				// Tell the server we have received the file
 				netbuffer->packettype = PT_FILERECEIVED;
 				netbuffer->u.filereceived = filenum;
@@ -1715,7 +2081,7 @@ size_t nameonlylength(const char *s)
 #define O_BINARY 0
 #endif
 
-filestatus_t checkfilemd5(char *filename, const UINT8 *wantedmd5sum)
+filestatus_t checkfilemd5(const char *filename, const UINT8 *wantedmd5sum)
 {
 #if defined (NOMD5)
 	(void)wantedmd5sum;
@@ -1860,7 +2226,7 @@ void CURLPrepareFile(const char* url, int dfilenum)
 
 		CONS_Printf("Downloading %s from %s\n", curl_realname, url);
 
-		strcatbf(curl_curfile->filename, downloaddir, "/");
+		D_AddonCacheDownloadPath(curl_curfile->filename, curl_curfile->md5sum);
 		curl_curfile->file = fopen(curl_curfile->filename, "wb");
 		curl_easy_setopt(http_handle, CURLOPT_WRITEDATA, curl_curfile->file);
 		curl_easy_setopt(http_handle, CURLOPT_WRITEFUNCTION, curlwrite_data);
@@ -1944,6 +2310,7 @@ void CURLGetFile(void)
 					downloadcompletednum++;
 					downloadcompletedsize += curl_curfile->totalsize;
 					curl_curfile->status = FS_FOUND;
+					D_AddonCacheAddDownload(curl_curfile->filename, curl_curfile->md5sum, true);
 				}
 			}
 
@@ -159,7 +159,7 @@ boolean fileexist(char *filename, time_t ptime);
 // Search a file in the wadpath, return FS_FOUND when found
 filestatus_t findfile(char *filename, const UINT8 *wantedmd5sum,
 	boolean completepath);
-filestatus_t checkfilemd5(char *filename, const UINT8 *wantedmd5sum);
+filestatus_t checkfilemd5(const char *filename, const UINT8 *wantedmd5sum);
 
 void nameonly(char *s);
 size_t nameonlylength(const char *s);
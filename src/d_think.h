@@ -52,7 +52,7 @@ struct thinker_t
 	// killough 11/98: count of how many other objects reference
 	// this one using pointers. Used for garbage collection.
 	INT32 references;
-	boolean cachable;
+	zpool_t *pool; // if set, the thinker is returned to this pool instead of Z_Free
 
 #ifdef PARANOIA
 	INT32 debug_mobjtype;
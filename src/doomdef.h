@@ -497,6 +497,21 @@ char *M_GetToken(const char *inputString);
 void M_UnGetToken(void);
 UINT32 M_GetTokenPos(void);
 
+typedef struct
+{
+	const char *input;
+	UINT32 inputLength;
+	UINT32 startPos, endPos; // token read last is input[startPos] for tokenLength chars
+	UINT32 tokenLength;
+	UINT8 inComment; // 0 = not in comment, 1 = // Single-line, 2 = /* Multi-line */
+	boolean isString; // did we strip quotes from this token?
+} tokenizer_t;
+
+// Reentrant tokenizer: finds the next token without copying it anywhere,
+// so any number of them can walk the same input at once
+void M_TokenizerInit(tokenizer_t *t, const char *inputString, size_t inputLength);
+boolean M_TokenizerNext(tokenizer_t *t);
+
 void M_TokenizerOpen(const char *inputString, size_t inputLength);
 void M_TokenizerClose(void);
 const char *M_TokenizerRead(UINT32 i);
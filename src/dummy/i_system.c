@@ -50,9 +50,11 @@ ticcmd_t *I_BaseTiccmd2(void)
 	return NULL;
 }
 
+INT32 quitstatus = 0;
+
 void I_Quit(void)
 {
-	exit(0);
+	exit(quitstatus);
 }
 
 void I_Error(const char *error, ...)
@@ -17,6 +17,7 @@
 
 font_t       fontv[MAX_FONTS];
 int          fontc;
+UINT32       fontgeneration;
 
 static void
 FontCache (font_t *fnt)
@@ -44,6 +45,8 @@ Font_Load (void)
 	{
 		FontCache(&fontv[i]);
 	}
+
+	fontgeneration++;
 }
 
 int
@@ -72,7 +75,10 @@ Font_Register (const font_t *sfnt)
 	d = Font_DumbRegister(sfnt);
 
 	if (d >= 0)
+	{
 		FontCache(&fontv[d]);
+		fontgeneration++;
+	}
 
 	return d;
 }
@@ -34,6 +34,12 @@ struct font_t
 extern font_t fontv[MAX_FONTS];
 extern int    fontc;
 
+/*
+Changes whenever font patches are (re)loaded, so anything holding on to
+them knows to let go.
+*/
+extern UINT32 fontgeneration;
+
 /*
 Reloads already registered fonts.
 */
@@ -37,6 +37,7 @@
 #include "m_cond.h"
 #include "k_menu.h"
 #include "m_argv.h"
+#include "m_benchmark.h"
 #include "hu_stuff.h"
 #include "z_zone.h"
 #include "i_video.h"
@@ -4031,6 +4032,13 @@ static void G_StopTimingDemo(void)
 	if (restorecv_vidwait != cv_vidwait.value)
 		CV_SetValue(&cv_vidwait, restorecv_vidwait);
 
+	// Benchmarks go on to their next demo, or quit
+	if (M_BenchmarkActive())
+	{
+		M_BenchmarkDemoDone();
+		return;
+	}
+
 	if (timedemo_quit)
 		COM_ImmedExecute("quit");
 	else
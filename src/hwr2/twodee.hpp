@@ -21,6 +21,7 @@
 #include <tcb/span.hpp>
 
 #include "blendmode.hpp"
+#include "../core/memory.h"
 #include "../cxxutil.hpp"
 #include "../doomtype.h"
 
@@ -84,11 +85,12 @@ BlendMode get_blend_mode(const Draw2dCmd& cmd) noexcept;
 bool is_draw_lines(const Draw2dCmd& cmd) noexcept;
 std::size_t elements(const Draw2dCmd& cmd) noexcept;
 
+// Draw lists only live until the next flush, so they are kept in frame memory
 struct Draw2dList
 {
-	std::vector<TwodeeVertex> vertices;
-	std::vector<uint16_t> indices;
-	std::vector<Draw2dCmd> cmds;
+	FrameVector<TwodeeVertex> vertices;
+	FrameVector<uint16_t> indices;
+	FrameVector<Draw2dCmd> cmds;
 
 	static constexpr const std::size_t kMaxVertices = 65536;
 };
@@ -99,9 +101,9 @@ class Draw2dVerticesBuilder;
 /// @brief Buffered 2D drawing context
 class Twodee
 {
-	std::vector<Draw2dList> lists_;
-	std::vector<TwodeeVertex> current_verts_;
-	std::vector<uint16_t> current_indices_;
+	FrameVector<Draw2dList> lists_;
+	FrameVector<TwodeeVertex> current_verts_;
+	FrameVector<uint16_t> current_indices_;
 
 	friend class Draw2dQuadBuilder;
 	friend class Draw2dVerticesBuilder;
@@ -117,12 +119,12 @@ public:
 	Draw2dQuadBuilder begin_quad() noexcept;
 	Draw2dVerticesBuilder begin_verts() noexcept;
 
-	typename std::vector<Draw2dList>::iterator begin() noexcept { return lists_.begin(); }
-	typename std::vector<Draw2dList>::iterator end() noexcept { return lists_.end(); }
-	typename std::vector<Draw2dList>::const_iterator begin() const noexcept { return lists_.cbegin(); }
-	typename std::vector<Draw2dList>::const_iterator end() const noexcept { return lists_.cend(); }
-	typename std::vector<Draw2dList>::const_iterator cbegin() const noexcept { return lists_.cbegin(); }
-	typename std::vector<Draw2dList>::const_iterator cend() const noexcept { return lists_.cend(); }
+	typename FrameVector<Draw2dList>::iterator begin() noexcept { return lists_.begin(); }
+	typename FrameVector<Draw2dList>::iterator end() noexcept { return lists_.end(); }
+	typename FrameVector<Draw2dList>::const_iterator begin() const noexcept { return lists_.cbegin(); }
+	typename FrameVector<Draw2dList>::const_iterator end() const noexcept { return lists_.cend(); }
+	typename FrameVector<Draw2dList>::const_iterator cbegin() const noexcept { return lists_.cbegin(); }
+	typename FrameVector<Draw2dList>::const_iterator cend() const noexcept { return lists_.cend(); }
 };
 
 class Draw2dQuadBuilder
@@ -205,7 +207,7 @@ class Draw2dVerticesBuilder
 {
 	Draw2dVertices tris_;
 	Twodee& ctx_;
-	std::vector<std::array<float, 4>> verts_;
+	FrameVector<std::array<float, 4>> verts_;
 	float r_ = 1.f;
 	float g_ = 1.f;
 	float b_ = 1.f;
@@ -11,7 +11,6 @@
 #include "twodee_renderer.hpp"
 
 #include <algorithm>
-#include <unordered_set>
 
 #include <stb_rect_pack.h>
 #include <glm/gtc/matrix_transform.hpp>
@@ -117,16 +116,14 @@ static PipelineDesc make_pipeline_desc(TwodeePipelineKey key)
 		{0.f, 0.f, 0.f, 1.f}};
 }
 
-void TwodeeRenderer::rewrite_patch_quad_vertices(Draw2dList& list, const Draw2dPatchQuad& cmd) const
+void TwodeeRenderer::rewrite_patch_quad_vertices(
+	Draw2dList& list,
+	const Draw2dPatchQuad& cmd,
+	srb2::NotNull<const PatchAtlas*> atlas
+) const
 {
 	// Patch quads are clipped according to the patch's atlas entry
 	const patch_t* patch = cmd.patch;
-	if (patch == nullptr)
-	{
-		return;
-	}
-
-	srb2::NotNull<const PatchAtlas*> atlas = patch_atlas_cache_->find_patch(patch);
 	std::optional<PatchAtlas::Entry> entry_optional = atlas->find_patch(patch);
 	SRB2_ASSERT(entry_optional.has_value());
 	PatchAtlas::Entry entry = *entry_optional;
@@ -283,7 +280,10 @@ void TwodeeRenderer::flush(Rhi& rhi, Handle<GraphicsContext> ctx, Twodee& twodee
 	}
 
 	// Stage 1 - command list patch detection
-	std::unordered_set<const patch_t*> found_patches;
+	// Runs of quads often share a patch or colormap (text especially), so
+	// those are only looked up when they change from one quad to the next
+	const patch_t* last_patch = nullptr;
+	const uint8_t* last_colormap = nullptr;
 	for (const auto& list : twodee)
 	{
 		for (const auto& cmd : list.cmds)
@@ -291,13 +291,15 @@ void TwodeeRenderer::flush(Rhi& rhi, Handle<GraphicsContext> ctx, Twodee& twodee
 			auto visitor = srb2::Overload {
 				[&](const Draw2dPatchQuad& cmd)
 				{
-					if (cmd.patch != nullptr)
+					if (cmd.patch != nullptr && cmd.patch != last_patch)
 					{
-						found_patches.insert(cmd.patch);
+						patch_atlas_cache_->queue_patch(cmd.patch);
+						last_patch = cmd.patch;
 					}
-					if (cmd.colormap != nullptr)
+					if (cmd.colormap != nullptr && cmd.colormap != last_colormap)
 					{
 						palette_manager_->find_or_create_colormap(rhi, ctx, cmd.colormap);
+						last_colormap = cmd.colormap;
 					}
 				},
 				[&](const Draw2dVertices& cmd) {}};
@@ -305,10 +307,6 @@ void TwodeeRenderer::flush(Rhi& rhi, Handle<GraphicsContext> ctx, Twodee& twodee
 		}
 	}
 
-	for (auto patch : found_patches)
-	{
-		patch_atlas_cache_->queue_patch(patch);
-	}
 	patch_atlas_cache_->pack(rhi, ctx);
 
 	size_t list_index = 0;
@@ -386,6 +384,13 @@ void TwodeeRenderer::flush(Rhi& rhi, Handle<GraphicsContext> ctx, Twodee& twodee
 			TwodeePipelineKey pk = pipeline_key_for_cmd(cmd);
 			new_cmd_needed = new_cmd_needed || (pk != merged_cmd.pipeline_key);
 
+			// The patch's atlas is needed three times below; only look it up once
+			const PatchAtlas* atlas = nullptr;
+			if (const Draw2dPatchQuad* quad = std::get_if<Draw2dPatchQuad>(&cmd); quad && quad->patch != nullptr)
+			{
+				atlas = patch_atlas_cache_->find_patch(quad->patch);
+			}
+
 			// We need to split the merged commands based on the kind of texture
 			// Patches are converted to atlas texture indexes, which we've just packed the patch rects for
 			// Flats are uploaded as individual textures.
@@ -398,8 +403,7 @@ void TwodeeRenderer::flush(Rhi& rhi, Handle<GraphicsContext> ctx, Twodee& twodee
 					}
 					else
 					{
-						srb2::NotNull<const PatchAtlas*> atlas = patch_atlas_cache_->find_patch(cmd.patch);
-						std::optional<MergedTwodeeCommand::Texture> atlas_index_texture = atlas->texture();
+						std::optional<MergedTwodeeCommand::Texture> atlas_index_texture = srb2::NotNull(atlas)->texture();
 						new_cmd_needed = new_cmd_needed || (merged_cmd.texture != atlas_index_texture);
 					}
 
@@ -432,8 +436,7 @@ void TwodeeRenderer::flush(Rhi& rhi, Handle<GraphicsContext> ctx, Twodee& twodee
 					{
 						if (cmd.patch != nullptr)
 						{
-							srb2::NotNull<const PatchAtlas*> atlas = patch_atlas_cache_->find_patch(cmd.patch);
-							the_new_one.texture = atlas->texture();
+							the_new_one.texture = srb2::NotNull(atlas)->texture();
 						}
 						else
 						{
@@ -470,7 +473,13 @@ void TwodeeRenderer::flush(Rhi& rhi, Handle<GraphicsContext> ctx, Twodee& twodee
 			// Perform coordinate transformations
 			{
 				auto vtx_transform_visitor = srb2::Overload {
-					[&](const Draw2dPatchQuad& cmd) { rewrite_patch_quad_vertices(list, cmd); },
+					[&](const Draw2dPatchQuad& cmd)
+					{
+						if (cmd.patch != nullptr)
+						{
+							rewrite_patch_quad_vertices(list, cmd, atlas);
+						}
+					},
 					[&](const Draw2dVertices& cmd) {}};
 				std::visit(vtx_transform_visitor, cmd);
 			}
@@ -99,7 +99,7 @@ class TwodeeRenderer final
 	rhi::Handle<rhi::Texture> default_tex_;
 	std::unordered_map<TwodeePipelineKey, rhi::Handle<rhi::Pipeline>> pipelines_;
 
-	void rewrite_patch_quad_vertices(Draw2dList& list, const Draw2dPatchQuad& cmd) const;
+	void rewrite_patch_quad_vertices(Draw2dList& list, const Draw2dPatchQuad& cmd, srb2::NotNull<const PatchAtlas*> atlas) const;
 
 	void initialize(rhi::Rhi& rhi, rhi::Handle<rhi::GraphicsContext> ctx);
 
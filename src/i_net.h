@@ -37,6 +37,9 @@ extern "C" {
 extern INT16 hardware_MAXPACKETLENGTH;
 extern INT32 net_bandwidth; // in byte/s
 
+extern consvar_t cv_netbatchio;
+extern consvar_t cv_netiothread;
+
 #if defined(_MSC_VER)
 #pragma pack(1)
 #endif
@@ -106,6 +109,10 @@ extern boolean (*I_NetCanGet)(void);
 */
 extern void (*I_NetSend)(void);
 
+/**	\brief send any packets the driver is holding back to send in one go
+*/
+extern void (*I_NetFlush)(void);
+
 /**	\brief ask to driver if all is ok to send data now
 */
 extern boolean (*I_NetCanSend)(void);
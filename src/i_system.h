@@ -38,6 +38,11 @@ extern UINT8 keyboard_started;
 /** \brief Set to true when inside a signal handler that will exit the program. */
 extern boolean g_in_exiting_signal_handler;
 
+/**	\brief	Exit code for I_Quit, 0 unless something like a benchmark that
+	found a regression sets it
+*/
+extern INT32 quitstatus;
+
 /**	\brief	The I_GetFreeMem function
 
 	\param	total	total memory in the system
@@ -13,6 +13,10 @@
 ///        This is not really OS-dependent because all OSes have the same socket API.
 ///        Just use ifdef for OS-dependent parts.
 
+#if defined (__linux__) && !defined (_GNU_SOURCE)
+	#define _GNU_SOURCE // recvmmsg, sendmmsg
+#endif
+
 #include "i_tcp_detail.h"
 #include "i_system.h"
 #include "i_time.h"
@@ -22,6 +26,7 @@
 #include "m_argv.h"
 #include "stun.h"
 #include "z_zone.h"
+#include "i_threads.h"
 
 #include "doomstat.h"
 
@@ -38,6 +43,17 @@
 
 #define DEFAULTPORT "5029"
 
+// Linux can move many datagrams per syscall with recvmmsg/sendmmsg
+#if defined (__linux__) && defined (MSG_WAITFORONE)
+	#define USE_MMSG
+#endif
+
+// Receive on a thread of our own, handing packets over through a lock-free queue
+#if defined (HAVE_THREADS) && !defined (__STDC_NO_ATOMICS__)
+	#define USE_NETTHREAD
+	#include <stdatomic.h>
+#endif
+
 #ifdef USE_WINSOCK
 	typedef SOCKET SOCKET_TYPE;
 	#define ERRSOCKET (SOCKET_ERROR)
@@ -72,6 +88,7 @@ mysockaddr_t clientaddress[MAXNETNODES+1];
 static mysockaddr_t broadcastaddress[MAXNETNODES+1];
 static size_t broadcastaddresses = 0;
 static boolean nodeconnected[MAXNETNODES+1];
+static fd_set masterset;
 static const INT32 hole_punch_magic = MSBF_LONG (0x52eb11);
 
 static bannednode_t SOCK_bannednode[MAXNETNODES+1]; /// \note do we really need the +1?
@@ -80,6 +97,83 @@ static boolean init_tcp_driver = false;
 static const char *serverport_name = DEFAULTPORT;
 static const char *clientport_name;/* any port */
 
+// The network thread counts what it receives while the game reads
+// the counts, so they're atomic wherever that thread can run
+#ifdef USE_NETTHREAD
+typedef atomic_uint_fast64_t netiocount_t;
+#define NETIO_ADD(count, n) atomic_fetch_add_explicit(&(count), (n), memory_order_relaxed)
+#define NETIO_GET(count) ((UINT64)atomic_load_explicit(&(count), memory_order_relaxed))
+#define NETIO_CLEAR(count) atomic_store_explicit(&(count), 0, memory_order_relaxed)
+#else
+typedef UINT64 netiocount_t;
+#define NETIO_ADD(count, n) ((count) += (n))
+#define NETIO_GET(count) (count)
+#define NETIO_CLEAR(count) ((count) = 0)
+#endif
+
+// Syscalls made and packets moved by them, for netiostats
+static struct
+{
+	netiocount_t recvcalls, recvpackets;
+	netiocount_t sendcalls, sendpackets;
+} netiostats;
+
+#ifdef USE_MMSG
+#define MMSGBATCH 32
+
+// A batch of datagrams in the layout recvmmsg/sendmmsg want
+typedef struct
+{
+	struct mmsghdr hdr[MMSGBATCH];
+	struct iovec iov[MMSGBATCH];
+	mysockaddr_t address[MMSGBATCH];
+	SOCKET_TYPE socket[MMSGBATCH];
+	INT16 node[MMSGBATCH]; // node to blame for send errors, -1 for none
+	UINT8 data[MMSGBATCH][MAXPACKETLENGTH];
+	size_t head, count;
+} mmsgring_t;
+
+static mmsgring_t mmsgrecv, mmsgsend;
+static boolean mmsgunsupported = false; // kernel said ENOSYS, so don't try again
+
+static boolean SOCK_UseMmsg(void)
+{
+	return cv_netbatchio.value && !mmsgunsupported;
+}
+#endif
+
+#ifdef USE_NETTHREAD
+#define NETINBOUNDSIZE 256 // power of two
+
+// A packet the network thread took off a socket
+typedef struct
+{
+	precise_t time; // when it was received
+	SOCKET_TYPE socket;
+	mysockaddr_t address;
+	socklen_t addresslen;
+	INT16 length;
+	char data[MAXPACKETLENGTH];
+} netinbound_t;
+
+// Single producer (the network thread), single consumer (SOCK_Get).
+// head and tail only ever count up; slots are indexed modulo the size.
+static struct
+{
+	netinbound_t packets[NETINBOUNDSIZE];
+	atomic_size_t head, tail;
+	atomic_int quit, running;
+	netiocount_t received, stalls; // added to by the network thread
+	UINT64 taken;
+	precise_t waited; // total time packets sat in the queue
+} netinbound;
+
+static boolean netthreadactive = false;
+#ifdef USE_MMSG
+static boolean netthreadbatch; // cv_netbatchio when the thread was started
+#endif
+#endif
+
 #ifdef USE_WINSOCK
 // stupid microsoft makes things complicated
 static char *get_WSAErrorStr(int e)
@@ -399,6 +493,56 @@ void Command_Numnodes(void)
 				connected, ingame);
 }
 
+static void NetIOStatsLine(const char *what, UINT64 calls, UINT64 packets)
+{
+	CONS_Printf("%s: %s packets in %s syscalls (%.2f per syscall)\n", what,
+		sizeu1((size_t)packets), sizeu2((size_t)calls),
+		calls ? (double)packets / (double)calls : 0.0);
+}
+
+void Command_NetIOStats(void)
+{
+#ifdef USE_MMSG
+	if (SOCK_UseMmsg())
+		CONS_Printf("Socket I/O: recvmmsg/sendmmsg, up to %d packets per syscall\n", MMSGBATCH);
+	else
+		CONS_Printf("Socket I/O: recvfrom/sendto%s\n", mmsgunsupported ? " (batching not supported by kernel)" : "");
+#else
+	CONS_Printf("Socket I/O: recvfrom/sendto (batching not available on this platform)\n");
+#endif
+
+	NetIOStatsLine("Received", NETIO_GET(netiostats.recvcalls), NETIO_GET(netiostats.recvpackets));
+	NetIOStatsLine("Sent", NETIO_GET(netiostats.sendcalls), NETIO_GET(netiostats.sendpackets));
+
+#ifdef USE_NETTHREAD
+	if (netthreadactive)
+	{
+		const precise_t precision = I_GetPrecisePrecision();
+
+		CONS_Printf("Network thread: %s packets queued, %s taken, queue was full %s times\n",
+			sizeu1((size_t)NETIO_GET(netinbound.received)), sizeu2((size_t)netinbound.taken),
+			sizeu3((size_t)NETIO_GET(netinbound.stalls)));
+		if (netinbound.taken)
+			CONS_Printf("Average wait in queue: %.3f ms\n",
+				(double)netinbound.waited * 1000.0 / (double)precision / (double)netinbound.taken);
+	}
+#endif
+
+	if (COM_Argc() > 1 && !stricmp(COM_Argv(1), "reset"))
+	{
+		NETIO_CLEAR(netiostats.recvcalls);
+		NETIO_CLEAR(netiostats.recvpackets);
+		NETIO_CLEAR(netiostats.sendcalls);
+		NETIO_CLEAR(netiostats.sendpackets);
+#ifdef USE_NETTHREAD
+		NETIO_CLEAR(netinbound.received);
+		NETIO_CLEAR(netinbound.stalls);
+		netinbound.taken = 0;
+		netinbound.waited = 0;
+#endif
+	}
+}
+
 static boolean hole_punch(ssize_t c)
 {
 	if (c == 10 && holepunchpacket->magic == hole_punch_magic)
@@ -420,62 +564,380 @@ static boolean hole_punch(ssize_t c)
 	}
 }
 
-// Returns true if a packet was received from a new node, false in all other cases
-static boolean SOCK_Get(void)
+// Works out which node the packet in doomcom came from, and sets doomcom->remotenode.
+// remotenode is left at -1 if the packet was handled here or there is no room for its sender.
+// Returns true if the packet is from a new node
+static boolean SOCK_ReceivedFrom(SOCKET_TYPE socket, mysockaddr_t *fromaddress, socklen_t fromlen, ssize_t c)
 {
-	size_t n;
 	int j;
-	ssize_t c;
-	mysockaddr_t fromaddress;
-	socklen_t fromlen;
 
-	for (n = 0; n < mysocketses; n++)
+	doomcom->remotenode = -1;
+
+#ifdef USE_STUN
+	if (STUN_got_response(doomcom->data, c))
 	{
-		fromlen = (socklen_t)sizeof(fromaddress);
-		c = recvfrom(mysockets[n], (char *)&doomcom->data, MAXPACKETLENGTH, 0,
-			(void *)&fromaddress, &fromlen);
+		return false;
+	}
+#endif
+
+	if (hole_punch(c))
+	{
+		return false;
+	}
+
+	// find remote node number
+	for (j = 1; j <= MAXNETNODES; j++) //include LAN
+	{
+		if (SOCK_cmpaddr(fromaddress, &clientaddress[j], 0))
+		{
+			doomcom->remotenode = (INT16)j; // good packet from a game player
+			doomcom->datalength = (INT16)c;
+			nodesocket[j] = socket;
+			return false;
+		}
+	}
+	// not found
+
+	// find a free slot
+	j = getfreenode();
+	if (j > 0)
+	{
+		M_Memcpy(&clientaddress[j], fromaddress, fromlen);
+		nodesocket[j] = socket;
+		DEBFILE(va("New node detected: node:%d address:%s\n", j,
+				SOCK_GetNodeAddress(j)));
+		doomcom->remotenode = (INT16)j; // good packet from a game player
+		doomcom->datalength = (INT16)c;
+
+		return true;
+	}
+	else
+		DEBFILE("New node detected: No more free slots\n");
+
+	return false;
+}
+
+#ifdef USE_MMSG
+static void SOCK_Flush(void);
+
+// Refills the receive ring with whatever is waiting on every socket.
+// Returns false if there was nothing.
+static boolean SOCK_FillRecvRing(void)
+{
+	size_t n, i;
+	int c;
+
+	mmsgrecv.head = mmsgrecv.count = 0;
+
+	for (n = 0; n < mysocketses && mmsgrecv.count < MMSGBATCH; n++)
+	{
+		for (i = mmsgrecv.count; i < MMSGBATCH; i++)
+		{
+			mmsgrecv.iov[i].iov_base = mmsgrecv.data[i];
+			mmsgrecv.iov[i].iov_len = MAXPACKETLENGTH;
+			memset(&mmsgrecv.hdr[i], 0, sizeof (mmsgrecv.hdr[i]));
+			mmsgrecv.hdr[i].msg_hdr.msg_name = &mmsgrecv.address[i];
+			mmsgrecv.hdr[i].msg_hdr.msg_namelen = (socklen_t)sizeof (mmsgrecv.address[i]);
+			mmsgrecv.hdr[i].msg_hdr.msg_iov = &mmsgrecv.iov[i];
+			mmsgrecv.hdr[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		c = recvmmsg(mysockets[n], &mmsgrecv.hdr[mmsgrecv.count],
+			(unsigned int)(MMSGBATCH - mmsgrecv.count), MSG_DONTWAIT, NULL);
+		NETIO_ADD(netiostats.recvcalls, 1);
+
 		if (c > 0)
 		{
-#ifdef USE_STUN
-			if (STUN_got_response(doomcom->data, c))
-			{
-				break;
-			}
+			for (i = mmsgrecv.count; i < mmsgrecv.count + c; i++)
+				mmsgrecv.socket[i] = mysockets[n];
+			mmsgrecv.count += c;
+			NETIO_ADD(netiostats.recvpackets, c);
+		}
+		else if (c < 0 && errno == ENOSYS)
+		{
+			CONS_Alert(CONS_WARNING, "recvmmsg is not supported, falling back to recvfrom\n");
+			mmsgunsupported = true;
+			break;
+		}
+	}
+
+	return (mmsgrecv.count > 0);
+}
+
+// Hands out the next packet from the receive ring, refilling it when empty
+static boolean SOCK_GetBatched(void)
+{
+	// Anything still queued was probably sent expecting the reply we're looking for
+	SOCK_Flush();
+
+	while (mmsgrecv.head < mmsgrecv.count || SOCK_FillRecvRing())
+	{
+		const size_t i = mmsgrecv.head++;
+		const ssize_t c = (ssize_t)mmsgrecv.hdr[i].msg_len;
+		boolean newnode;
+
+		if (c <= 0)
+			continue;
+
+		M_Memcpy(doomcom->data, mmsgrecv.data[i], c);
+		newnode = SOCK_ReceivedFrom(mmsgrecv.socket[i], &mmsgrecv.address[i],
+			mmsgrecv.hdr[i].msg_hdr.msg_namelen, c);
+
+		if (doomcom->remotenode != -1)
+			return newnode;
+	}
+
+	doomcom->remotenode = -1; // no packet
+	return false;
+}
 #endif
 
-			if (hole_punch(c))
+#ifdef USE_NETTHREAD
+static boolean FD_CPY(fd_set *src, fd_set *dst, SOCKET_TYPE *fd, size_t len);
+
+// Queues a packet the network thread just wrote into the slot at head
+static void SOCK_QueueInbound(size_t head, SOCKET_TYPE socket, socklen_t addresslen, ssize_t c)
+{
+	netinbound_t *packet = &netinbound.packets[head & (NETINBOUNDSIZE - 1)];
+
+	packet->time = I_GetPreciseTime();
+	packet->socket = socket;
+	packet->addresslen = addresslen;
+	packet->length = (INT16)c; // empty ones are skipped by SOCK_GetQueued
+}
+
+#ifdef USE_MMSG
+// Takes up to room packets off a socket with one recvmmsg, straight into
+// the queue. Returns how many, 0 for none, or -1 if the kernel can't.
+static int SOCK_IOThreadBatch(SOCKET_TYPE socket, size_t head, size_t room)
+{
+	struct mmsghdr hdr[MMSGBATCH];
+	struct iovec iov[MMSGBATCH];
+	size_t i;
+	int c;
+
+	if (room > MMSGBATCH)
+		room = MMSGBATCH;
+
+	for (i = 0; i < room; i++)
+	{
+		netinbound_t *packet = &netinbound.packets[(head + i) & (NETINBOUNDSIZE - 1)];
+
+		iov[i].iov_base = packet->data;
+		iov[i].iov_len = MAXPACKETLENGTH;
+		memset(&hdr[i], 0, sizeof (hdr[i]));
+		hdr[i].msg_hdr.msg_name = &packet->address;
+		hdr[i].msg_hdr.msg_namelen = (socklen_t)sizeof (packet->address);
+		hdr[i].msg_hdr.msg_iov = &iov[i];
+		hdr[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	c = recvmmsg(socket, hdr, (unsigned int)room, MSG_DONTWAIT, NULL);
+	NETIO_ADD(netiostats.recvcalls, 1);
+
+	if (c < 0)
+		return (errno == ENOSYS) ? -1 : 0;
+
+	for (i = 0; i < (size_t)c; i++)
+		SOCK_QueueInbound(head + i, socket, hdr[i].msg_hdr.msg_namelen, hdr[i].msg_len);
+
+	return c;
+}
+#endif
+
+// Takes packets off the sockets as soon as they arrive, so a long
+// frame can't leave them to overflow the socket buffer
+static void SOCK_IOThread(void *userdata)
+{
+#ifdef USE_MMSG
+	boolean batch = netthreadbatch;
+#endif
+
+	(void)userdata;
+
+	while (!atomic_load(&netinbound.quit) && !I_thread_is_stopped())
+	{
+		struct timeval timeout = {0, 10000}; // check for quit every 10ms
+		fd_set tset;
+		size_t n;
+
+		if (!FD_CPY(&masterset, &tset, mysockets, mysocketses))
+			break;
+
+		if (select(255, &tset, NULL, NULL, &timeout) < 1)
+			continue;
+
+		for (n = 0; n < mysocketses; n++)
+		{
+			const size_t head = atomic_load_explicit(&netinbound.head, memory_order_relaxed);
+			const size_t room = NETINBOUNDSIZE - (head - atomic_load_explicit(&netinbound.tail, memory_order_acquire));
+			netinbound_t *packet;
+			ssize_t c;
+
+			if (!FD_ISSET(mysockets[n], &tset))
+				continue;
+
+			if (room == 0)
 			{
+				// Full; leave it to the socket buffer until the game catches up
+				NETIO_ADD(netinbound.stalls, 1);
+				I_Sleep(1);
 				break;
 			}
 
-			// find remote node number
-			for (j = 1; j <= MAXNETNODES; j++) //include LAN
+#ifdef USE_MMSG
+			if (batch)
 			{
-				if (SOCK_cmpaddr(&fromaddress, &clientaddress[j], 0))
+				c = SOCK_IOThreadBatch(mysockets[n], head, room);
+
+				if (c > 0)
 				{
-					doomcom->remotenode = (INT16)j; // good packet from a game player
-					doomcom->datalength = (INT16)c;
-					nodesocket[j] = mysockets[n];
-					return false;
+					atomic_store_explicit(&netinbound.head, head + c, memory_order_release);
+					NETIO_ADD(netiostats.recvpackets, c);
+					NETIO_ADD(netinbound.received, c);
+					continue;
 				}
-			}
-			// not found
 
-			// find a free slot
-			j = getfreenode();
-			if (j > 0)
-			{
-				M_Memcpy(&clientaddress[j], &fromaddress, fromlen);
-				nodesocket[j] = mysockets[n];
-				DEBFILE(va("New node detected: node:%d address:%s\n", j,
-						SOCK_GetNodeAddress(j)));
-				doomcom->remotenode = (INT16)j; // good packet from a game player
-				doomcom->datalength = (INT16)c;
-
-				return true;
+				if (c == 0)
+					continue;
+
+				batch = false; // no recvmmsg after all, so do it one at a time
 			}
-			else
-				DEBFILE("New node detected: No more free slots\n");
+#endif
+
+			packet = &netinbound.packets[head & (NETINBOUNDSIZE - 1)];
+			packet->addresslen = (socklen_t)sizeof (packet->address);
+			c = recvfrom(mysockets[n], packet->data, MAXPACKETLENGTH, 0,
+				(void *)&packet->address, &packet->addresslen);
+			NETIO_ADD(netiostats.recvcalls, 1);
+
+			if (c <= 0)
+				continue;
+
+			SOCK_QueueInbound(head, mysockets[n], packet->addresslen, c);
+
+			atomic_store_explicit(&netinbound.head, head + 1, memory_order_release);
+			NETIO_ADD(netiostats.recvpackets, 1);
+			NETIO_ADD(netinbound.received, 1);
+		}
+	}
+
+	atomic_store(&netinbound.running, 0);
+}
+
+static void SOCK_StartIOThread(void)
+{
+	if (!cv_netiothread.value || I_thread_is_stopped())
+		return;
+
+	atomic_store(&netinbound.head, 0);
+	atomic_store(&netinbound.tail, 0);
+	atomic_store(&netinbound.quit, 0);
+	atomic_store(&netinbound.running, 1);
+	netthreadactive = true;
+#ifdef USE_MMSG
+	netthreadbatch = SOCK_UseMmsg();
+#endif
+
+	I_spawn_thread("net-io", SOCK_IOThread, NULL);
+}
+
+static void SOCK_StopIOThread(void)
+{
+	if (!netthreadactive)
+		return;
+
+	atomic_store(&netinbound.quit, 1);
+	while (atomic_load(&netinbound.running) && !I_thread_is_stopped())
+		I_Sleep(1);
+
+	netthreadactive = false;
+}
+
+// Hands out the next packet the network thread queued
+static boolean SOCK_GetQueued(void)
+{
+#ifdef USE_MMSG
+	SOCK_Flush();
+#endif
+
+	for (;;)
+	{
+		const size_t tail = atomic_load_explicit(&netinbound.tail, memory_order_relaxed);
+		netinbound_t *packet;
+		boolean newnode;
+
+		if (tail == atomic_load_explicit(&netinbound.head, memory_order_acquire))
+			break;
+
+		packet = &netinbound.packets[tail & (NETINBOUNDSIZE - 1)];
+
+		if (packet->length <= 0)
+		{
+			atomic_store_explicit(&netinbound.tail, tail + 1, memory_order_release);
+			continue;
+		}
+
+		M_Memcpy(doomcom->data, packet->data, packet->length);
+		newnode = SOCK_ReceivedFrom(packet->socket, &packet->address, packet->addresslen, packet->length);
+
+		netinbound.taken++;
+		netinbound.waited += I_GetPreciseTime() - packet->time;
+
+		atomic_store_explicit(&netinbound.tail, tail + 1, memory_order_release);
+
+		if (doomcom->remotenode != -1)
+			return newnode;
+	}
+
+	doomcom->remotenode = -1; // no packet
+	return false;
+}
+#endif
+
+// Returns true if a packet was received from a new node, false in all other cases
+static boolean SOCK_Get(void)
+{
+	size_t n;
+	ssize_t c;
+	mysockaddr_t fromaddress;
+	socklen_t fromlen;
+	boolean newnode;
+
+#ifdef USE_NETTHREAD
+	if (netthreadactive)
+	{
+		if (atomic_load(&netinbound.running))
+			return SOCK_GetQueued();
+
+		// The thread gave up, with no sockets left to wait on. Hand out
+		// what it queued before that, then go back to receiving here.
+		newnode = SOCK_GetQueued();
+		if (doomcom->remotenode != -1)
+			return newnode;
+
+		netthreadactive = false;
+	}
+#endif
+
+#ifdef USE_MMSG
+	// Drain the ring even if batching was just turned off
+	if (SOCK_UseMmsg() || mmsgrecv.head < mmsgrecv.count)
+		return SOCK_GetBatched();
+#endif
+
+	for (n = 0; n < mysocketses; n++)
+	{
+		fromlen = (socklen_t)sizeof(fromaddress);
+		c = recvfrom(mysockets[n], (char *)&doomcom->data, MAXPACKETLENGTH, 0,
+			(void *)&fromaddress, &fromlen);
+		NETIO_ADD(netiostats.recvcalls, 1);
+		if (c > 0)
+		{
+			NETIO_ADD(netiostats.recvpackets, 1);
+			newnode = SOCK_ReceivedFrom(mysockets[n], &fromaddress, fromlen, c);
+			if (doomcom->remotenode != -1)
+				return newnode;
 		}
 	}
 
@@ -485,7 +947,6 @@ static boolean SOCK_Get(void)
 
 // check if we can send (do not go over the buffer)
 
-static fd_set masterset;
 
 #ifdef SELECTTEST
 static boolean FD_CPY(fd_set *src, fd_set *dst, SOCKET_TYPE *fd, size_t len)
@@ -534,24 +995,120 @@ static boolean SOCK_CanGet(void)
 }
 #endif
 
-static inline ssize_t SOCK_SendToAddr(SOCKET_TYPE socket, mysockaddr_t *sockaddr)
+static inline socklen_t SOCK_AddrLen(mysockaddr_t *sockaddr)
 {
-	socklen_t d4 = (socklen_t)sizeof(struct sockaddr_in);
+	switch (sockaddr->any.sa_family)
+	{
+		case AF_INET:  return (socklen_t)sizeof(struct sockaddr_in);
 #ifdef HAVE_IPV6
-	socklen_t d6 = (socklen_t)sizeof(struct sockaddr_in6);
+		case AF_INET6: return (socklen_t)sizeof(struct sockaddr_in6);
 #endif
-	socklen_t d, da = (socklen_t)sizeof(mysockaddr_t);
+		default:       return (socklen_t)sizeof(mysockaddr_t);
+	}
+}
 
-	switch (sockaddr->any.sa_family)
+#ifdef USE_MMSG
+static void SOCK_SendQueued(size_t i)
+{
+	sendto(mmsgsend.socket[i], mmsgsend.data[i], mmsgsend.iov[i].iov_len, 0,
+		&mmsgsend.address[i].any, mmsgsend.hdr[i].msg_hdr.msg_namelen);
+	NETIO_ADD(netiostats.sendcalls, 1);
+	NETIO_ADD(netiostats.sendpackets, 1);
+}
+
+// Sends everything in the send queue, one sendmmsg per run of packets on the same socket
+static void SOCK_Flush(void)
+{
+	size_t start = 0, end;
+	int c, e;
+
+	while (start < mmsgsend.count)
 	{
-		case AF_INET:  d = d4; break;
-#ifdef HAVE_IPV6
-		case AF_INET6: d = d6; break;
+		const SOCKET_TYPE socket = mmsgsend.socket[start];
+
+		for (end = start + 1; end < mmsgsend.count && mmsgsend.socket[end] == socket; end++)
+			;
+
+		while (start < end)
+		{
+			if (mmsgunsupported)
+			{
+				SOCK_SendQueued(start++);
+				continue;
+			}
+
+			c = sendmmsg(socket, &mmsgsend.hdr[start], (unsigned int)(end - start), 0);
+			NETIO_ADD(netiostats.sendcalls, 1);
+
+			if (c > 0)
+			{
+				NETIO_ADD(netiostats.sendpackets, c);
+				start += c;
+				continue;
+			}
+
+			// The packet at start failed; drop it like sendto would have
+			e = errno; // save error code so it can't be modified later
+			if (e == ENOSYS)
+			{
+				CONS_Alert(CONS_WARNING, "sendmmsg is not supported, falling back to sendto\n");
+				mmsgunsupported = true;
+				continue;
+			}
+
+			if (mmsgsend.node[start] != -1 && e != ECONNREFUSED && e != EWOULDBLOCK)
+				I_Error("SOCK_Send, error sending to node %d (%s) #%u: %s", mmsgsend.node[start],
+					SOCK_GetNodeAddress(mmsgsend.node[start]), e, strerror(e));
+			start++;
+		}
+	}
+
+	mmsgsend.count = 0;
+}
+
+static void SOCK_QueueToAddr(SOCKET_TYPE socket, mysockaddr_t *sockaddr, INT16 node)
+{
+	size_t i;
+
+	if (mmsgsend.count == MMSGBATCH)
+		SOCK_Flush();
+
+	i = mmsgsend.count++;
+
+	M_Memcpy(mmsgsend.data[i], &doomcom->data, doomcom->datalength);
+	M_Memcpy(&mmsgsend.address[i], sockaddr, sizeof (mmsgsend.address[i]));
+	mmsgsend.socket[i] = socket;
+	mmsgsend.node[i] = node;
+
+	mmsgsend.iov[i].iov_base = mmsgsend.data[i];
+	mmsgsend.iov[i].iov_len = doomcom->datalength;
+	memset(&mmsgsend.hdr[i], 0, sizeof (mmsgsend.hdr[i]));
+	mmsgsend.hdr[i].msg_hdr.msg_name = &mmsgsend.address[i];
+	mmsgsend.hdr[i].msg_hdr.msg_namelen = SOCK_AddrLen(sockaddr);
+	mmsgsend.hdr[i].msg_hdr.msg_iov = &mmsgsend.iov[i];
+	mmsgsend.hdr[i].msg_hdr.msg_iovlen = 1;
+}
 #endif
-		default:       d = da; break;
+
+// Sends doomcom's packet. When batching, it is queued
+// instead, and errors are checked on flush if blame is a node.
+static inline ssize_t SOCK_SendToAddr(SOCKET_TYPE socket, mysockaddr_t *sockaddr, INT16 blame)
+{
+#ifdef USE_MMSG
+	if (SOCK_UseMmsg())
+	{
+		SOCK_QueueToAddr(socket, sockaddr, blame);
+		return 0;
 	}
+	else if (mmsgsend.count)
+		SOCK_Flush(); // keep the order if batching was just turned off
+#else
+	(void)blame;
+#endif
 
-	return sendto(socket, (char *)&doomcom->data, doomcom->datalength, 0, &sockaddr->any, d);
+	NETIO_ADD(netiostats.sendcalls, 1);
+	NETIO_ADD(netiostats.sendpackets, 1);
+	return sendto(socket, (char *)&doomcom->data, doomcom->datalength, 0, &sockaddr->any, SOCK_AddrLen(sockaddr));
 }
 
 static void SOCK_Send(void)
@@ -569,7 +1126,7 @@ static void SOCK_Send(void)
 			for (j = 0; j < broadcastaddresses; j++)
 			{
 				if (myfamily[i] == broadcastaddress[j].any.sa_family)
-					SOCK_SendToAddr(mysockets[i], &broadcastaddress[j]);
+					SOCK_SendToAddr(mysockets[i], &broadcastaddress[j], -1);
 			}
 		}
 		return;
@@ -579,13 +1136,13 @@ static void SOCK_Send(void)
 		for (i = 0; i < mysocketses; i++)
 		{
 			if (myfamily[i] == clientaddress[doomcom->remotenode].any.sa_family)
-				SOCK_SendToAddr(mysockets[i], &clientaddress[doomcom->remotenode]);
+				SOCK_SendToAddr(mysockets[i], &clientaddress[doomcom->remotenode], -1);
 		}
 		return;
 	}
 	else
 	{
-		c = SOCK_SendToAddr(nodesocket[doomcom->remotenode], &clientaddress[doomcom->remotenode]);
+		c = SOCK_SendToAddr(nodesocket[doomcom->remotenode], &clientaddress[doomcom->remotenode], doomcom->remotenode);
 	}
 
 	if (c == ERRSOCKET)
@@ -1009,6 +1566,17 @@ boolean I_InitTcpDriver(void)
 static void SOCK_CloseSocket(void)
 {
 	size_t i;
+
+#ifdef USE_NETTHREAD
+	SOCK_StopIOThread();
+#endif
+
+#ifdef USE_MMSG
+	// Last words, such as PT_SERVERSHUTDOWN, still need to go out
+	SOCK_Flush();
+	mmsgrecv.head = mmsgrecv.count = 0;
+#endif
+
 	for (i=0; i < MAXNETNODES+1; i++)
 	{
 		if (mysockets[i] != (SOCKET_TYPE)ERRSOCKET
@@ -1159,6 +1727,9 @@ static boolean SOCK_OpenSocket(void)
 	nodeconnected[BROADCASTADDR] = true;
 	I_NetSend = SOCK_Send;
 	I_NetGet = SOCK_Get;
+#ifdef USE_MMSG
+	I_NetFlush = SOCK_Flush;
+#endif
 	I_NetCloseSocket = SOCK_CloseSocket;
 	I_NetFreeNodenum = SOCK_FreeNodenum;
 	I_NetMakeNodewPort = SOCK_NetMakeNodewPort;
@@ -1174,7 +1745,13 @@ static boolean SOCK_OpenSocket(void)
 
 	// build the socket but close it first
 	SOCK_CloseSocket();
-	return UDP_Socket();
+	if (!UDP_Socket())
+		return false;
+
+#ifdef USE_NETTHREAD
+	SOCK_StartIOThread();
+#endif
+	return true;
 }
 
 // https://github.com/jameds/holepunch/blob/master/holepunch.c#L75
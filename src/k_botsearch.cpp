@@ -687,8 +687,6 @@ void K_NudgePredictionTowardsObjects(botprediction_t *predict, const player_t *p
 
 	const precise_t time = I_GetPreciseTime();
 
-	INT32 xl, xh, yl, yh, bx, by;
-
 	fixed_t distToPredict = 0;
 	fixed_t radToPredict = 0;
 	angle_t angleToPredict = 0;
@@ -735,20 +733,7 @@ void K_NudgePredictionTowardsObjects(botprediction_t *predict, const player_t *p
 		g_nudgeSearch.avoidObjs[i] = 0;
 	}
 
-	xl = (unsigned)(avgX - (radToPredict + MAXRADIUS) - bmaporgx)>>MAPBLOCKSHIFT;
-	xh = (unsigned)(avgX + (radToPredict + MAXRADIUS) - bmaporgx)>>MAPBLOCKSHIFT;
-	yl = (unsigned)(avgY - (radToPredict + MAXRADIUS) - bmaporgy)>>MAPBLOCKSHIFT;
-	yh = (unsigned)(avgY + (radToPredict + MAXRADIUS) - bmaporgy)>>MAPBLOCKSHIFT;
-
-	BMBOUNDFIX(xl, xh, yl, yh);
-
-	for (bx = xl; bx <= xh; bx++)
-	{
-		for (by = yl; by <= yh; by++)
-		{
-			P_BlockThingsIterator(bx, by, K_FindObjectsForNudging);
-		}
-	}
+	P_RadiusThingsIterator(avgX, avgY, radToPredict + MAXRADIUS, K_FindObjectsForNudging);
 
 	// Handle dodge characters
 	if (g_nudgeSearch.avoidObjs[1] > 0 || g_nudgeSearch.avoidObjs[0] > 0)
@@ -971,8 +956,6 @@ INT32 K_PositionBully(const player_t *player)
 {
 	ZoneScoped;
 
-	INT32 xl, xh, yl, yh, bx, by;
-
 	angle_t ourangle, destangle, angle;
 	INT16 anglediff;
 
@@ -982,20 +965,7 @@ INT32 K_PositionBully(const player_t *player)
 	g_bullySearch.annoymo = NULL;
 	g_bullySearch.annoyscore = 0;
 
-	xl = (unsigned)(g_bullySearch.botmo->x - g_bullySearch.distancetocheck - bmaporgx)>>MAPBLOCKSHIFT;
-	xh = (unsigned)(g_bullySearch.botmo->x + g_bullySearch.distancetocheck - bmaporgx)>>MAPBLOCKSHIFT;
-	yl = (unsigned)(g_bullySearch.botmo->y - g_bullySearch.distancetocheck - bmaporgy)>>MAPBLOCKSHIFT;
-	yh = (unsigned)(g_bullySearch.botmo->y + g_bullySearch.distancetocheck - bmaporgy)>>MAPBLOCKSHIFT;
-
-	BMBOUNDFIX(xl, xh, yl, yh);
-
-	for (bx = xl; bx <= xh; bx++)
-	{
-		for (by = yl; by <= yh; by++)
-		{
-			P_BlockThingsIterator(bx, by, K_FindPlayersToBully);
-		}
-	}
+	P_RadiusThingsIterator(g_bullySearch.botmo->x, g_bullySearch.botmo->y, g_bullySearch.distancetocheck, K_FindPlayersToBully);
 
 	if (g_bullySearch.annoymo == NULL)
 	{
@@ -243,7 +243,7 @@ struct TargetTracking
 			return false;
 		}
 
-		if (!P_CheckSight(stplyr->mo, const_cast<mobj_t*>(mobj)))
+		if (!P_CheckSightCached(stplyr->mo, const_cast<mobj_t*>(mobj)))
 		{
 			// Can't see
 			return false;
@@ -376,7 +376,7 @@ bool is_object_tracking_target(const mobj_t* mobj)
 
 	case MT_SPRAYCAN:
 		return !(mobj->renderflags & (RF_TRANSMASK | RF_DONTDRAW)) && // the spraycan wasn't collected yet
-			P_CheckSight(stplyr->mo, const_cast<mobj_t*>(mobj));
+			P_CheckSightCached(stplyr->mo, const_cast<mobj_t*>(mobj));
 
 	default:
 		return false;
@@ -458,7 +458,7 @@ Visibility is_object_visible(const mobj_t* mobj)
 
 	default:
 		// Transparent when not visible.
-		return P_CheckSight(stplyr->mo, const_cast<mobj_t*>(mobj)) ? Visibility::kVisible : Visibility::kTransparent;
+		return P_CheckSightCached(stplyr->mo, const_cast<mobj_t*>(mobj)) ? Visibility::kVisible : Visibility::kTransparent;
 	}
 }
 
@@ -808,6 +808,24 @@ void K_drawTargetHUD(const vector3_t* origin, player_t* player)
 	mobj_t* mobj = nullptr;
 	mobj_t* next = nullptr;
 
+	if (stplyr->mo != nullptr)
+	{
+		// Most trackers end up needing a sight check, so
+		// answer them all at once to fill the sight cache.
+		std::vector<losquery_t> queries;
+
+		for (mobj = trackercap; mobj; mobj = mobj->itnext)
+		{
+			if (mobj->health > 0 && mobj != stplyr->mo)
+			{
+				queries.push_back({stplyr->mo, mobj});
+			}
+		}
+
+		std::vector<boolean> results(queries.size());
+		P_CheckSightBatch(LOS_CHECKSIGHT, queries.data(), results.data(), queries.size());
+	}
+
 	for (mobj = trackercap; mobj; mobj = next)
 	{
 		next = mobj->itnext;
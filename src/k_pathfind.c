@@ -16,9 +16,31 @@
 #include "z_zone.h"
 #include "k_bheap.h"
 
-static const size_t DEFAULT_NODEARRAY_CAPACITY = 8U;
-static const size_t DEFAULT_OPENSET_CAPACITY   = 8U;
-static const size_t DEFAULT_CLOSEDSET_CAPACITY = 8U;
+static const size_t DEFAULT_NODEARRAY_CAPACITY = 256U;
+static const size_t DEFAULT_OPENSET_CAPACITY   = 16U;
+static const size_t DEFAULT_CLOSEDSET_CAPACITY = 256U;
+
+// Where a graph node is in the nodes array, for pathfinding with getnodeindex.
+// A slot is only valid if its generation matches the current search.
+typedef struct
+{
+	UINT32 seengeneration;   // The search this node was added to the nodes array in
+	UINT32 closedgeneration; // The search this node was added to the closed set in
+	size_t nodeindex;        // The node's index in the nodes array
+} pathfindslot_t;
+
+// Scratch memory kept between searches, so pathfinding doesn't allocate unless the graph got bigger.
+static struct
+{
+	pathfindnode_t  *nodesarray;
+	size_t          nodesarraycapacity;
+	pathfindnode_t  **closedset;
+	size_t          closedsetcapacity;
+	bheap_t         openset;
+	pathfindslot_t  *slots;
+	size_t          numslots;
+	UINT32          generation;
+} scratch;
 
 
 /*--------------------------------------------------
@@ -69,42 +91,145 @@ static void K_NodeUpdateHeapIndex(void *const node, const size_t newheapindex)
 	}
 }
 
+/*--------------------------------------------------
+	static void K_PrepareScratch(const pathfindsetup_t *const pathfindsetup)
+
+		Makes sure the scratch memory is allocated and big enough for a search, and starts a new generation so all of
+		the slots from the previous searches are invalid.
+
+	Input Arguments:-
+		pathfindsetup - The setup for the pathfinding
+
+	Return:-
+		None
+--------------------------------------------------*/
+static void K_PrepareScratch(const pathfindsetup_t *const pathfindsetup)
+{
+	const boolean indexed = (pathfindsetup->getnodeindex != NULL && pathfindsetup->numnodes > 0U);
+	size_t nodesarraycapacity = DEFAULT_NODEARRAY_CAPACITY;
+
+	if (indexed == true)
+	{
+		// Every node can only be added once, so the nodes array never needs to grow during the search.
+		nodesarraycapacity = max(nodesarraycapacity, pathfindsetup->numnodes);
+
+		if (pathfindsetup->numnodes > scratch.numslots)
+		{
+			Z_Free(scratch.slots);
+			scratch.slots = Z_Calloc(pathfindsetup->numnodes * sizeof(pathfindslot_t), PU_STATIC, NULL);
+			scratch.numslots = pathfindsetup->numnodes;
+			scratch.generation = 0U;
+		}
+
+		if (++scratch.generation == 0U)
+		{
+			// Wrapped around, old slots could look valid again
+			memset(scratch.slots, 0, scratch.numslots * sizeof(pathfindslot_t));
+			scratch.generation = 1U;
+		}
+	}
+
+	if (scratch.nodesarraycapacity < nodesarraycapacity)
+	{
+		scratch.nodesarray = Z_Realloc(scratch.nodesarray, nodesarraycapacity * sizeof(pathfindnode_t), PU_STATIC, NULL);
+		scratch.nodesarraycapacity = nodesarraycapacity;
+
+		if (scratch.nodesarray == NULL)
+		{
+			I_Error("K_PathfindAStar: Out of memory allocating nodes array.");
+		}
+	}
+
+	if (scratch.closedset == NULL)
+	{
+		scratch.closedsetcapacity = DEFAULT_CLOSEDSET_CAPACITY;
+		scratch.closedset = Z_Calloc(scratch.closedsetcapacity * sizeof(pathfindnode_t*), PU_STATIC, NULL);
+	}
+
+	if (K_BHeapValid(&scratch.openset) == false)
+	{
+		K_BHeapInit(&scratch.openset, DEFAULT_OPENSET_CAPACITY);
+	}
+
+	scratch.openset.count = 0U;
+}
+
+/*--------------------------------------------------
+	static size_t K_NodeSlotIndex(const pathfindsetup_t *const pathfindsetup, void *nodedata)
+
+		Gets the slot index of a node's data, or SIZE_MAX if the setup doesn't give nodes indexes.
+
+	Input Arguments:-
+		pathfindsetup - The setup for the pathfinding
+		nodedata      - The data of the node
+
+	Return:-
+		The slot index of the node
+--------------------------------------------------*/
+static size_t K_NodeSlotIndex(const pathfindsetup_t *const pathfindsetup, void *nodedata)
+{
+	size_t slotindex = SIZE_MAX;
+
+	if (pathfindsetup->getnodeindex != NULL && pathfindsetup->numnodes > 0U)
+	{
+		slotindex = pathfindsetup->getnodeindex(nodedata);
+		I_Assert(slotindex < pathfindsetup->numnodes);
+	}
+
+	return slotindex;
+}
+
 /*--------------------------------------------------
 	static pathfindnode_t *K_NodesArrayContainsNodeData(
-		pathfindnode_t *nodesarray,
+		const pathfindsetup_t *const pathfindsetup,
 		void* nodedata,
 		size_t nodesarraycount)
 
-		Checks whether the Nodes Array contains a node with a waypoint. Searches from the end to the start for speed
-			reasons.
+		Checks whether the Nodes Array contains a node with a waypoint. Uses the node's slot when the setup has node
+		indexes, otherwise searches from the end to the start for speed reasons.
 
 	Input Arguments:-
-		nodesarray      - The nodes array within the A* algorithm
-		waypoint        - The waypoint to check is within the nodes array
+		pathfindsetup   - The setup for the pathfinding
+		nodedata        - The data to check is within the nodes array
 		nodesarraycount - The current size of the nodes array
 
 	Return:-
 		The pathfind node that has the waypoint if there is one. NULL if the waypoint is not in the nodes array.
 --------------------------------------------------*/
 static pathfindnode_t *K_NodesArrayContainsNodeData(
-	pathfindnode_t *nodesarray,
+	const pathfindsetup_t *const pathfindsetup,
 	void* nodedata,
 	size_t nodesarraycount)
 {
 	pathfindnode_t *foundnode = NULL;
+	size_t slotindex = SIZE_MAX;
 	size_t i = 0U;
 
-	I_Assert(nodesarray != NULL);
+	I_Assert(scratch.nodesarray != NULL);
 	I_Assert(nodedata != NULL);
 
+	slotindex = K_NodeSlotIndex(pathfindsetup, nodedata);
+
+	if (slotindex != SIZE_MAX)
+	{
+		const pathfindslot_t *slot = &scratch.slots[slotindex];
+
+		if (slot->seengeneration == scratch.generation)
+		{
+			foundnode = &scratch.nodesarray[slot->nodeindex];
+		}
+
+		return foundnode;
+	}
+
 	// It is more likely that we'll find the node we are looking for from the end of the array
 	// Yes, the for loop looks weird, remember that size_t is unsigned and we want to check 0, after it hits 0 it
 	// will loop back up to SIZE_MAX
 	for (i = nodesarraycount - 1U; i < nodesarraycount; i--)
 	{
-		if (nodesarray[i].nodedata == nodedata)
+		if (scratch.nodesarray[i].nodedata == nodedata)
 		{
-			foundnode = &nodesarray[i];
+			foundnode = &scratch.nodesarray[i];
 			break;
 		}
 	}
@@ -112,31 +237,47 @@ static pathfindnode_t *K_NodesArrayContainsNodeData(
 }
 
 /*--------------------------------------------------
-	static boolean K_ClosedsetContainsNode(pathfindnode_t **closedset, pathfindnode_t *node, size_t closedsetcount)
+	static boolean K_ClosedsetContainsNode(
+		const pathfindsetup_t *const pathfindsetup,
+		pathfindnode_t *node,
+		size_t closedsetcount)
 
-		Checks whether the Closedset contains a node. Searches from the end to the start for speed reasons.
+		Checks whether the Closedset contains a node. Uses the node's slot when the setup has node indexes, otherwise
+		searches from the end to the start for speed reasons.
 
 	Input Arguments:-
-		closedset      - The closed set within the A* algorithm
+		pathfindsetup  - The setup for the pathfinding
 		node           - The node to check is within the closed set
 		closedsetcount - The current size of the closedset
 
 	Return:-
 		True if the node is in the closed set, false if it isn't
 --------------------------------------------------*/
-static boolean K_ClosedsetContainsNode(pathfindnode_t **closedset, pathfindnode_t *node, size_t closedsetcount)
+static boolean K_ClosedsetContainsNode(
+	const pathfindsetup_t *const pathfindsetup,
+	pathfindnode_t *node,
+	size_t closedsetcount)
 {
 	boolean nodeisinclosedset = false;
+	size_t slotindex = SIZE_MAX;
 	size_t i = 0U;
 
-	I_Assert(closedset != NULL);
+	I_Assert(scratch.closedset != NULL);
 	I_Assert(node != NULL);
+
+	slotindex = K_NodeSlotIndex(pathfindsetup, node->nodedata);
+
+	if (slotindex != SIZE_MAX)
+	{
+		return (scratch.slots[slotindex].closedgeneration == scratch.generation);
+	}
+
 	// It is more likely that we'll find the node we are looking for from the end of the array
 	// Yes, the for loop looks weird, remember that size_t is unsigned and we want to check 0, after it hits 0 it
 	// will loop back up to SIZE_MAX
 	for (i = closedsetcount - 1U; i < closedsetcount; i--)
 	{
-		if (closedset[i] == node)
+		if (scratch.closedset[i] == node)
 		{
 			nodeisinclosedset = true;
 			break;
@@ -316,10 +457,8 @@ boolean K_PathfindAStar(path_t *const path, pathfindsetup_t *const pathfindsetup
 		}
 		else
 		{
-			bheap_t        openset                 = {0};
+			bheap_t        *openset                = &scratch.openset;
 			bheapitem_t    poppedbheapitem         = {0};
-			pathfindnode_t *nodesarray             = NULL;
-			pathfindnode_t **closedset             = NULL;
 			pathfindnode_t *newnode                = NULL;
 			pathfindnode_t *currentnode            = NULL;
 			pathfindnode_t *connectingnode         = NULL;
@@ -330,58 +469,36 @@ boolean K_PathfindAStar(path_t *const path, pathfindsetup_t *const pathfindsetup
 			size_t         connectingnodeheapindex = 0U;
 			size_t         nodesarraycount         = 0U;
 			size_t         closedsetcount          = 0U;
+			size_t         slotindex               = SIZE_MAX;
 			size_t         i                       = 0U;
 			UINT32         tentativegscore         = 0U;
 
-			// Set the dynamic structure capacites to defaults if they are 0
-			if (pathfindsetup->nodesarraycapacity == 0U)
-			{
-				pathfindsetup->nodesarraycapacity = DEFAULT_NODEARRAY_CAPACITY;
-			}
-			if (pathfindsetup->opensetcapacity == 0U)
-			{
-				pathfindsetup->opensetcapacity = DEFAULT_OPENSET_CAPACITY;
-			}
-			if (pathfindsetup->closedsetcapacity == 0U)
-			{
-				pathfindsetup->closedsetcapacity = DEFAULT_CLOSEDSET_CAPACITY;
-			}
-
-			// Allocate the necessary memory
-			nodesarray = Z_Calloc(pathfindsetup->nodesarraycapacity * sizeof(pathfindnode_t), PU_STATIC, NULL);
-			if (nodesarray == NULL)
-			{
-				I_Error("K_PathfindAStar: Out of memory allocating nodes array.");
-			}
-			closedset = Z_Calloc(pathfindsetup->closedsetcapacity * sizeof(pathfindnode_t*), PU_STATIC, NULL);
-			if (closedset == NULL)
-			{
-				I_Error("K_PathfindAStar: Out of memory allocating closed set.");
-			}
-			K_BHeapInit(&openset, pathfindsetup->opensetcapacity);
+			// Reuse the memory from the last search
+			K_PrepareScratch(pathfindsetup);
 
 			// Create the first node and add it to the open set
-			newnode            = &nodesarray[nodesarraycount];
+			newnode            = &scratch.nodesarray[nodesarraycount];
 			newnode->heapindex = SIZE_MAX;
 			newnode->nodedata  = pathfindsetup->startnodedata;
 			newnode->camefrom  = NULL;
 			newnode->gscore    = 0U;
 			newnode->hscore    = pathfindsetup->getheuristic(newnode->nodedata, pathfindsetup->endnodedata);
-			nodesarraycount++;
-			K_BHeapPush(&openset, newnode, K_NodeGetFScore(newnode), K_NodeUpdateHeapIndex);
 
-			// update openset capacity if it changed
-			if (openset.capacity != pathfindsetup->opensetcapacity)
+			if ((slotindex = K_NodeSlotIndex(pathfindsetup, newnode->nodedata)) != SIZE_MAX)
 			{
-				pathfindsetup->opensetcapacity = openset.capacity;
+				scratch.slots[slotindex].seengeneration = scratch.generation;
+				scratch.slots[slotindex].nodeindex = nodesarraycount;
 			}
 
+			nodesarraycount++;
+			K_BHeapPush(openset, newnode, K_NodeGetFScore(newnode), K_NodeUpdateHeapIndex);
+
 			// Go through each node in the openset, adding new ones from each node to it
 			// this continues until a path is found or there are no more nodes to check
-			while (openset.count > 0U)
+			while (openset->count > 0U)
 			{
 				// pop the best node off of the openset
-				K_BHeapPop(&openset, &poppedbheapitem);
+				K_BHeapPop(openset, &poppedbheapitem);
 				currentnode = (pathfindnode_t*)poppedbheapitem.data;
 
 				if (pathfindsetup->getfinished(currentnode, pathfindsetup) == true)
@@ -391,19 +508,26 @@ boolean K_PathfindAStar(path_t *const path, pathfindsetup_t *const pathfindsetup
 				}
 
 				// Place the node we just popped into the closed set, as we are now evaluating it
-				if (closedsetcount >= pathfindsetup->closedsetcapacity)
+				if ((slotindex = K_NodeSlotIndex(pathfindsetup, currentnode->nodedata)) != SIZE_MAX)
 				{
-					// Need to reallocate closedset to fit another node
-					pathfindsetup->closedsetcapacity = pathfindsetup->closedsetcapacity * 2;
-					closedset =
-						Z_Realloc(closedset, pathfindsetup->closedsetcapacity * sizeof(pathfindnode_t*), PU_STATIC, NULL);
-					if (closedset == NULL)
+					scratch.slots[slotindex].closedgeneration = scratch.generation;
+				}
+				else
+				{
+					if (closedsetcount >= scratch.closedsetcapacity)
 					{
-						I_Error("K_PathfindAStar: Out of memory reallocating closed set.");
+						// Need to reallocate closedset to fit another node
+						scratch.closedsetcapacity = scratch.closedsetcapacity * 2;
+						scratch.closedset =
+							Z_Realloc(scratch.closedset, scratch.closedsetcapacity * sizeof(pathfindnode_t*), PU_STATIC, NULL);
+						if (scratch.closedset == NULL)
+						{
+							I_Error("K_PathfindAStar: Out of memory reallocating closed set.");
+						}
 					}
+					scratch.closedset[closedsetcount] = currentnode;
+					closedsetcount++;
 				}
-				closedset[closedsetcount] = currentnode;
-				closedsetcount++;
 
 				// Get the needed data for the next nodes from the current node
 				connectingnodesdata = pathfindsetup->getconnectednodes(currentnode->nodedata, &numconnectingnodes);
@@ -441,13 +565,13 @@ boolean K_PathfindAStar(path_t *const path, pathfindsetup_t *const pathfindsetup
 							tentativegscore = currentnode->gscore + connectingnodecosts[i];
 
 							// find this data in the nodes array if it's been generated before
-							connectingnode = K_NodesArrayContainsNodeData(nodesarray, checknodedata, nodesarraycount);
+							connectingnode = K_NodesArrayContainsNodeData(pathfindsetup, checknodedata, nodesarraycount);
 
 							if (connectingnode != NULL)
 							{
 								// The connecting node has been seen before, so it must be in either the closedset (skip it)
 								// or the openset (re-evaluate it's gscore)
-								if (K_ClosedsetContainsNode(closedset, connectingnode, closedsetcount) == true)
+								if (K_ClosedsetContainsNode(pathfindsetup, connectingnode, closedsetcount) == true)
 								{
 									continue;
 								}
@@ -458,11 +582,11 @@ boolean K_PathfindAStar(path_t *const path, pathfindsetup_t *const pathfindsetup
 									connectingnode->camefrom = currentnode;
 
 									connectingnodeheapindex =
-										K_BHeapContains(&openset, connectingnode, connectingnode->heapindex);
+										K_BHeapContains(openset, connectingnode, connectingnode->heapindex);
 									if (connectingnodeheapindex != SIZE_MAX)
 									{
 										K_UpdateBHeapItemValue(
-											&openset.array[connectingnodeheapindex], K_NodeGetFScore(connectingnode));
+											&openset->array[connectingnodeheapindex], K_NodeGetFScore(connectingnode));
 									}
 									else
 									{
@@ -474,12 +598,14 @@ boolean K_PathfindAStar(path_t *const path, pathfindsetup_t *const pathfindsetup
 							else
 							{
 								// Node is not created yet, so it hasn't been seen so far
-								// Reallocate nodesarray if it's full
-								if (nodesarraycount >= pathfindsetup->nodesarraycapacity)
+								// Reallocate nodesarray if it's full. Never happens when nodes have indexes, as the
+								// nodes array is already big enough for the whole graph.
+								if (nodesarraycount >= scratch.nodesarraycapacity)
 								{
+									pathfindnode_t *nodesarray = scratch.nodesarray;
 									pathfindnode_t *nodesarrayrealloc = NULL;
-									pathfindsetup->nodesarraycapacity = pathfindsetup->nodesarraycapacity * 2;
-									nodesarrayrealloc = Z_Realloc(nodesarray, pathfindsetup->nodesarraycapacity * sizeof(pathfindnode_t), PU_STATIC, NULL);
+									scratch.nodesarraycapacity = scratch.nodesarraycapacity * 2;
+									nodesarrayrealloc = Z_Realloc(nodesarray, scratch.nodesarraycapacity * sizeof(pathfindnode_t), PU_STATIC, NULL);
 
 									if (nodesarrayrealloc == NULL)
 									{
@@ -493,13 +619,13 @@ boolean K_PathfindAStar(path_t *const path, pathfindsetup_t *const pathfindsetup
 										size_t arrayindex = 0U;
 										for (j = 0U; j < closedsetcount; j++)
 										{
-											arrayindex = closedset[j] - nodesarray;
-											closedset[j] = &nodesarrayrealloc[arrayindex];
+											arrayindex = scratch.closedset[j] - nodesarray;
+											scratch.closedset[j] = &nodesarrayrealloc[arrayindex];
 										}
-										for (j = 0U; j < openset.count; j++)
+										for (j = 0U; j < openset->count; j++)
 										{
-											arrayindex = ((pathfindnode_t *)(openset.array[j].data)) - nodesarray;
-											openset.array[j].data = &nodesarrayrealloc[arrayindex];
+											arrayindex = ((pathfindnode_t *)(openset->array[j].data)) - nodesarray;
+											openset->array[j].data = &nodesarrayrealloc[arrayindex];
 										}
 										for (j = 0U; j < nodesarraycount; j++)
 										{
@@ -514,28 +640,33 @@ boolean K_PathfindAStar(path_t *const path, pathfindsetup_t *const pathfindsetup
 										currentnode = &nodesarrayrealloc[arrayindex];
 									}
 
-									nodesarray = nodesarrayrealloc;
+									scratch.nodesarray = nodesarrayrealloc;
 								}
 
 								// Create the new node and add it to the nodes array and open set
-								newnode            = &nodesarray[nodesarraycount];
+								newnode            = &scratch.nodesarray[nodesarraycount];
 								newnode->heapindex = SIZE_MAX;
 								newnode->nodedata  = checknodedata;
 								newnode->camefrom  = currentnode;
 								newnode->gscore    = tentativegscore;
 								newnode->hscore    = pathfindsetup->getheuristic(newnode->nodedata, pathfindsetup->endnodedata);
+
+								if ((slotindex = K_NodeSlotIndex(pathfindsetup, newnode->nodedata)) != SIZE_MAX)
+								{
+									scratch.slots[slotindex].seengeneration = scratch.generation;
+									scratch.slots[slotindex].nodeindex = nodesarraycount;
+								}
+
 								nodesarraycount++;
-								K_BHeapPush(&openset, newnode, K_NodeGetFScore(newnode), K_NodeUpdateHeapIndex);
+								K_BHeapPush(openset, newnode, K_NodeGetFScore(newnode), K_NodeUpdateHeapIndex);
 							}
 						}
 					}
 				}
 			}
 
-			// Clean up the memory
-			K_BHeapFree(&openset);
-			Z_Free(closedset);
-			Z_Free(nodesarray);
+			// The scratch memory is kept for the next search, but the open set can't hold onto these nodes
+			openset->count = 0U;
 		}
 	}
 
@@ -36,6 +36,9 @@ typedef boolean(*getnodetraversablefunc)(void*, void*);
 // function pointer for getting if a node is our pathfinding end point
 typedef boolean(*getpathfindfinishedfunc)(void*, void*);
 
+// function pointer for getting a node's unique index in the graph, from 0 to numnodes - 1
+typedef size_t(*getnodeindexfunc)(void*);
+
 
 // A pathfindnode contains information about a node from the pathfinding
 // heapindex is only used within the pathfinding algorithm itself, and is always 0 after it is completed
@@ -55,22 +58,19 @@ struct path_t {
 };
 
 // Contains info about the pathfinding used to setup the algorithm
-// (e.g. the base capacities of the dynamically allocated arrays)
-// should be setup by the caller before starting pathfinding
-// base capacities will be 8 if they aren't setup, missing callback functions will cause an error.
-// Can be accessed after the pathfinding is complete to get the final capacities of them
+// should be setup by the caller before starting pathfinding, missing callback functions will cause an error.
+// getnodeindex and numnodes are optional, but without them finding already visited nodes is a linear search.
 struct pathfindsetup_t {
-	size_t opensetcapacity;
-	size_t closedsetcapacity;
-	size_t nodesarraycapacity;
 	void   *startnodedata;
 	void   *endnodedata;
 	UINT32 endgscore;
+	size_t numnodes;
 	getconnectednodesfunc getconnectednodes;
 	getnodeconnectioncostsfunc getconnectioncosts;
 	getnodeheuristicfunc getheuristic;
 	getnodetraversablefunc gettraversable;
 	getpathfindfinishedfunc getfinished;
+	getnodeindexfunc getnodeindex;
 };
 
 
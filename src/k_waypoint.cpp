@@ -20,10 +20,16 @@
 #include "z_zone.h"
 #include "g_game.h"
 #include "p_slopes.h"
+#include "command.h"
+#include "i_system.h"
 
 #include "cxxutil.hpp"
 
 #include <algorithm>
+#include <array>
+#include <functional>
+#include <queue>
+#include <utility>
 #include <vector>
 
 #include <fmt/format.h>
@@ -31,12 +37,6 @@
 // The number of sparkles per waypoint connection in the waypoint visualisation
 static const UINT32 SPARKLES_PER_CONNECTION = 16U;
 
-// Some defaults for the size of the dynamically allocated sets for pathfinding. These are kept for the purpose of
-// allocating a size that is less likely to need reallocating again during the pathfinding.
-#define OPENSET_BASE_SIZE    (16U)
-#define CLOSEDSET_BASE_SIZE  (256U)
-#define NODESARRAY_BASE_SIZE (256U)
-
 static waypoint_t *waypointheap  = NULL;
 static waypoint_t *firstwaypoint = NULL;
 static waypoint_t *finishline    = NULL;
@@ -49,9 +49,49 @@ static INT32 trackcomplexity = 0;
 
 static size_t numwaypoints       = 0U;
 static size_t numwaypointmobjs   = 0U;
-static size_t baseopensetsize    = OPENSET_BASE_SIZE;
-static size_t baseclosedsetsize  = CLOSEDSET_BASE_SIZE;
-static size_t basenodesarraysize = NODESARRAY_BASE_SIZE;
+
+// Precomputed routes to the finish line, indexed by waypoint heap index. One set for each shortcut variant.
+enum
+{
+	ROUTE_NOSHORTCUTS,
+	ROUTE_SHORTCUTS,
+	NUMROUTES
+};
+
+static const UINT32 ROUTE_UNREACHABLE = UINT32_MAX;
+
+static struct
+{
+	std::vector<UINT32> dist[NUMROUTES];
+	std::vector<UINT32> next[NUMROUTES];
+	std::vector<UINT8>  flags;    // Enabled/shortcut state the tables were built with
+	boolean             dirty = true;
+	tic_t               checkedtic = 0;
+} g_routes;
+
+// Uniform grid over the waypoint positions, for answering nearest waypoint queries without checking every waypoint.
+// Positions are in whole map units, the same units the distance checks use, so cell bounds are exact lower bounds.
+#define WAYPOINTGRID_MINCELLSIZE (1024)
+#define WAYPOINTGRID_MAXCELLS (256)
+
+static struct
+{
+	std::vector<UINT32> cellstart;  // Offsets into points for each cell, plus one past the end
+	std::vector<UINT32> points;     // Heap indexes of the waypoints whose position is in each cell
+	std::vector<UINT32> footstart;  // Offsets into footprints for each cell, plus one past the end
+	std::vector<UINT32> footprints; // Heap indexes of the waypoints whose radius overlaps each cell
+	std::vector<INT32>  posx;       // Waypoint positions and radii the grid was built with
+	std::vector<INT32>  posy;
+	std::vector<INT32>  rad;
+	std::vector<UINT32> candidates; // Scratch list for K_GetBestWaypointForMobj
+	INT32               originx = 0;
+	INT32               originy = 0;
+	INT32               width = 0;
+	INT32               height = 0;
+	INT32               cellsize = WAYPOINTGRID_MINCELLSIZE;
+	boolean             dirty = true;
+	tic_t               checkedtic = 0;
+} g_waypointgrid;
 
 
 /*--------------------------------------------------
@@ -300,40 +340,334 @@ INT32 K_GetTrackComplexity(void)
 }
 
 /*--------------------------------------------------
-	waypoint_t *K_GetClosestWaypointToMobj(mobj_t *const mobj)
+	static INT32 K_WaypointGridFloorDiv(INT32 a, INT32 b)
 
-		See header file for description.
+		Integer division rounding towards negative infinity, so points left of or below the grid still map to the
+		cell they would be in if the grid extended that far.
 --------------------------------------------------*/
-waypoint_t *K_GetClosestWaypointToMobj(mobj_t *const mobj)
+static INT32 K_WaypointGridFloorDiv(INT32 a, INT32 b)
 {
-	waypoint_t *closestwaypoint = NULL;
+	INT32 quotient = a / b;
 
-	if ((mobj == NULL) || P_MobjWasRemoved(mobj))
+	if ((a % b != 0) && ((a < 0) != (b < 0)))
 	{
-		CONS_Debug(DBG_GAMELOGIC, "NULL mobj in K_GetClosestWaypointToMobj.\n");
+		quotient--;
 	}
-	else
+
+	return quotient;
+}
+
+/*--------------------------------------------------
+	static INT32 K_WaypointGridCellDist(INT32 cx, INT32 cy, INT32 x, INT32 y)
+
+		Returns the smallest horizontal and vertical offset, whichever is larger, between a point and any point in a
+		grid cell. Both distance formulas used on waypoints are never smaller than this.
+--------------------------------------------------*/
+static INT32 K_WaypointGridCellDist(INT32 cx, INT32 cy, INT32 x, INT32 y)
+{
+	const INT32 x0 = g_waypointgrid.originx + (cx * g_waypointgrid.cellsize);
+	const INT32 y0 = g_waypointgrid.originy + (cy * g_waypointgrid.cellsize);
+	const INT32 x1 = x0 + g_waypointgrid.cellsize - 1;
+	const INT32 y1 = y0 + g_waypointgrid.cellsize - 1;
+	const INT32 gapx = std::max({0, x0 - x, x - x1});
+	const INT32 gapy = std::max({0, y0 - y, y - y1});
+
+	return std::max(gapx, gapy);
+}
+
+/*--------------------------------------------------
+	static INT32 K_WaypointGridCellAt(INT32 x, INT32 y)
+
+		Returns the index of the grid cell containing a point, or -1 if the point is outside of the grid.
+--------------------------------------------------*/
+static INT32 K_WaypointGridCellAt(INT32 x, INT32 y)
+{
+	const INT32 cx = K_WaypointGridFloorDiv(x - g_waypointgrid.originx, g_waypointgrid.cellsize);
+	const INT32 cy = K_WaypointGridFloorDiv(y - g_waypointgrid.originy, g_waypointgrid.cellsize);
+
+	if (cx < 0 || cx >= g_waypointgrid.width || cy < 0 || cy >= g_waypointgrid.height)
 	{
-		size_t     i              = 0U;
-		waypoint_t *checkwaypoint = NULL;
-		fixed_t    closestdist    = INT32_MAX;
-		fixed_t    checkdist      = INT32_MAX;
+		return -1;
+	}
+
+	return (cy * g_waypointgrid.width) + cx;
+}
+
+/*--------------------------------------------------
+	static void K_BuildWaypointGrid(void)
+
+		Buckets every waypoint into the grid cell its position is in, and into every cell its radius overlaps. The
+		grid is sized to cover the radii too, and the cells are made bigger on huge maps to keep the grid small.
+--------------------------------------------------*/
+static void K_BuildWaypointGrid(void)
+{
+	auto &grid = g_waypointgrid;
+	INT32 minx = INT32_MAX, miny = INT32_MAX;
+	INT32 maxx = INT32_MIN, maxy = INT32_MIN;
 
-		for (i = 0; i < numwaypoints; i++)
+	grid.posx.resize(numwaypoints);
+	grid.posy.resize(numwaypoints);
+	grid.rad.resize(numwaypoints);
+
+	for (size_t i = 0U; i < numwaypoints; i++)
+	{
+		const mobj_t *const mobj = waypointheap[i].mobj;
+		const INT32 reach = std::max(0, mobj->radius / FRACUNIT);
+
+		grid.posx[i] = mobj->x / FRACUNIT;
+		grid.posy[i] = mobj->y / FRACUNIT;
+		grid.rad[i] = mobj->radius / FRACUNIT;
+
+		minx = std::min(minx, grid.posx[i] - reach);
+		miny = std::min(miny, grid.posy[i] - reach);
+		maxx = std::max(maxx, grid.posx[i] + reach);
+		maxy = std::max(maxy, grid.posy[i] + reach);
+	}
+
+	const INT32 extent = std::max(maxx - minx, maxy - miny) + 1;
+
+	grid.cellsize = std::max(WAYPOINTGRID_MINCELLSIZE, (extent / WAYPOINTGRID_MAXCELLS) + 1);
+	grid.originx = minx;
+	grid.originy = miny;
+	grid.width = ((maxx - minx) / grid.cellsize) + 1;
+	grid.height = ((maxy - miny) / grid.cellsize) + 1;
+
+	const size_t numcells = (size_t)grid.width * (size_t)grid.height;
+
+	// Counting sort by cell, for both lists
+	grid.cellstart.assign(numcells + 1, 0U);
+	grid.footstart.assign(numcells + 1, 0U);
+
+	auto each_footprint_cell = [&](size_t i, auto &&func)
+	{
+		if (grid.rad[i] < 0)
 		{
-			checkwaypoint = &waypointheap[i];
+			return;
+		}
 
-			checkdist = P_AproxDistance(
-				(mobj->x / FRACUNIT) - (checkwaypoint->mobj->x / FRACUNIT),
-				(mobj->y / FRACUNIT) - (checkwaypoint->mobj->y / FRACUNIT));
-			checkdist = P_AproxDistance(checkdist, (mobj->z / FRACUNIT) - (checkwaypoint->mobj->z / FRACUNIT));
+		const INT32 cx0 = (grid.posx[i] - grid.rad[i] - grid.originx) / grid.cellsize;
+		const INT32 cy0 = (grid.posy[i] - grid.rad[i] - grid.originy) / grid.cellsize;
+		const INT32 cx1 = (grid.posx[i] + grid.rad[i] - grid.originx) / grid.cellsize;
+		const INT32 cy1 = (grid.posy[i] + grid.rad[i] - grid.originy) / grid.cellsize;
 
-			if (checkdist < closestdist)
+		for (INT32 cy = cy0; cy <= cy1; cy++)
+		{
+			for (INT32 cx = cx0; cx <= cx1; cx++)
 			{
-				closestwaypoint = checkwaypoint;
-				closestdist = checkdist;
+				func((cy * grid.width) + cx);
+			}
+		}
+	};
+
+	for (size_t i = 0U; i < numwaypoints; i++)
+	{
+		grid.cellstart[K_WaypointGridCellAt(grid.posx[i], grid.posy[i]) + 1]++;
+		each_footprint_cell(i, [&](INT32 cell) { grid.footstart[cell + 1]++; });
+	}
+
+	for (size_t cell = 0U; cell < numcells; cell++)
+	{
+		grid.cellstart[cell + 1] += grid.cellstart[cell];
+		grid.footstart[cell + 1] += grid.footstart[cell];
+	}
+
+	std::vector<UINT32> pointfill(grid.cellstart.begin(), grid.cellstart.end() - 1);
+	std::vector<UINT32> footfill(grid.footstart.begin(), grid.footstart.end() - 1);
+
+	grid.points.resize(grid.cellstart[numcells]);
+	grid.footprints.resize(grid.footstart[numcells]);
+
+	// Filled in heap order, so each cell's lists stay sorted by heap index
+	for (size_t i = 0U; i < numwaypoints; i++)
+	{
+		grid.points[pointfill[K_WaypointGridCellAt(grid.posx[i], grid.posy[i])]++] = (UINT32)i;
+		each_footprint_cell(i, [&](INT32 cell) { grid.footprints[footfill[cell]++] = (UINT32)i; });
+	}
+
+	grid.dirty = false;
+	grid.checkedtic = leveltime;
+}
+
+/*--------------------------------------------------
+	static boolean K_WaypointGridReady(void)
+
+		Makes sure the waypoint grid matches where the waypoints currently are, rebuilding it if not. Waypoints don't
+		move on their own, but Lua can move them, which gets picked up by comparing against the saved positions once
+		per tic.
+
+	Return:-
+		True if the grid can be used, false if there are no waypoints.
+--------------------------------------------------*/
+static boolean K_WaypointGridReady(void)
+{
+	auto &grid = g_waypointgrid;
+
+	if (waypointheap == NULL || numwaypoints == 0U)
+	{
+		return false;
+	}
+
+	if (grid.dirty == false && grid.checkedtic != leveltime)
+	{
+		for (size_t i = 0U; i < numwaypoints; i++)
+		{
+			const mobj_t *const mobj = waypointheap[i].mobj;
+
+			if (grid.posx[i] != mobj->x / FRACUNIT
+				|| grid.posy[i] != mobj->y / FRACUNIT
+				|| grid.rad[i] != mobj->radius / FRACUNIT)
+			{
+				grid.dirty = true;
+				break;
 			}
 		}
+
+		grid.checkedtic = leveltime;
+	}
+
+	if (grid.dirty == true)
+	{
+		K_BuildWaypointGrid();
+	}
+
+	return true;
+}
+
+/*--------------------------------------------------
+	template <typename VisitCell, typename StopRing>
+	static void K_WaypointGridSearch(INT32 x, INT32 y, VisitCell &&visitcell, StopRing &&stopring)
+
+		Visits the grid cells in square rings of increasing distance around a point, which may be outside of the
+		grid. visitcell is called with the index and K_WaypointGridCellDist of every cell. Before each ring, stopring
+		is called with a distance no cell in that ring or any later ring can be closer than, and the search ends if
+		it returns true.
+--------------------------------------------------*/
+template <typename VisitCell, typename StopRing>
+static void K_WaypointGridSearch(INT32 x, INT32 y, VisitCell &&visitcell, StopRing &&stopring)
+{
+	const auto &grid = g_waypointgrid;
+	const INT32 qcx = K_WaypointGridFloorDiv(x - grid.originx, grid.cellsize);
+	const INT32 qcy = K_WaypointGridFloorDiv(y - grid.originy, grid.cellsize);
+	const INT32 maxring = std::max({abs(qcx), abs(qcx - (grid.width - 1)), abs(qcy), abs(qcy - (grid.height - 1))});
+
+	for (INT32 ring = 0; ring <= maxring; ring++)
+	{
+		if (stopring((ring == 0) ? 0 : ((ring - 1) * grid.cellsize) + 1) == true)
+		{
+			break;
+		}
+
+		for (INT32 cy = std::max(0, qcy - ring); cy <= std::min(grid.height - 1, qcy + ring); cy++)
+		{
+			// Only the top and bottom rows of a ring are full, the rest are just the two ends
+			const INT32 step = (cy == qcy - ring || cy == qcy + ring) ? 1 : (ring * 2);
+
+			for (INT32 cx = qcx - ring; cx <= qcx + ring; cx += step)
+			{
+				if (cx >= 0 && cx < grid.width)
+				{
+					visitcell((cy * grid.width) + cx, K_WaypointGridCellDist(cx, cy, x, y));
+				}
+			}
+		}
+	}
+}
+
+/*--------------------------------------------------
+	static fixed_t K_WaypointDistanceToPoint(waypoint_t *const waypoint, INT32 x, INT32 y, INT32 z)
+
+		The distance K_GetClosestWaypointToMobj compares waypoints by, from a point in whole map units.
+--------------------------------------------------*/
+static fixed_t K_WaypointDistanceToPoint(waypoint_t *const waypoint, INT32 x, INT32 y, INT32 z)
+{
+	fixed_t dist = P_AproxDistance(
+		x - (waypoint->mobj->x / FRACUNIT),
+		y - (waypoint->mobj->y / FRACUNIT));
+
+	return P_AproxDistance(dist, z - (waypoint->mobj->z / FRACUNIT));
+}
+
+/*--------------------------------------------------
+	static waypoint_t *K_ScanClosestWaypoint(INT32 x, INT32 y, INT32 z)
+
+		Finds the closest waypoint to a point by checking every waypoint. Of equally close waypoints, the first in
+		the heap is picked.
+--------------------------------------------------*/
+static waypoint_t *K_ScanClosestWaypoint(INT32 x, INT32 y, INT32 z)
+{
+	waypoint_t *closestwaypoint = NULL;
+	fixed_t    closestdist      = INT32_MAX;
+
+	for (size_t i = 0; i < numwaypoints; i++)
+	{
+		waypoint_t *const checkwaypoint = &waypointheap[i];
+		const fixed_t checkdist = K_WaypointDistanceToPoint(checkwaypoint, x, y, z);
+
+		if (checkdist < closestdist)
+		{
+			closestwaypoint = checkwaypoint;
+			closestdist = checkdist;
+		}
+	}
+
+	return closestwaypoint;
+}
+
+/*--------------------------------------------------
+	static waypoint_t *K_GridClosestWaypoint(INT32 x, INT32 y, INT32 z)
+
+		Finds the same waypoint as K_ScanClosestWaypoint using the waypoint grid. Searching stops once no cell left
+		can be closer than the best waypoint so far, and ties are broken by heap index like the scan does.
+--------------------------------------------------*/
+static waypoint_t *K_GridClosestWaypoint(INT32 x, INT32 y, INT32 z)
+{
+	const auto &grid = g_waypointgrid;
+	size_t  closestindex = SIZE_MAX;
+	fixed_t closestdist  = INT32_MAX;
+
+	K_WaypointGridSearch(
+		x, y,
+		[&](INT32 cell, INT32 celldist)
+		{
+			if (celldist > closestdist)
+			{
+				return;
+			}
+
+			for (UINT32 k = grid.cellstart[cell]; k < grid.cellstart[cell + 1]; k++)
+			{
+				const size_t i = grid.points[k];
+				const fixed_t checkdist = K_WaypointDistanceToPoint(&waypointheap[i], x, y, z);
+
+				if (checkdist < closestdist || (checkdist == closestdist && closestindex != SIZE_MAX && i < closestindex))
+				{
+					closestindex = i;
+					closestdist = checkdist;
+				}
+			}
+		},
+		[&](INT32 ringdist) { return ringdist > closestdist; }
+	);
+
+	return (closestindex == SIZE_MAX) ? NULL : &waypointheap[closestindex];
+}
+
+/*--------------------------------------------------
+	waypoint_t *K_GetClosestWaypointToMobj(mobj_t *const mobj)
+
+		See header file for description.
+--------------------------------------------------*/
+waypoint_t *K_GetClosestWaypointToMobj(mobj_t *const mobj)
+{
+	waypoint_t *closestwaypoint = NULL;
+
+	if ((mobj == NULL) || P_MobjWasRemoved(mobj))
+	{
+		CONS_Debug(DBG_GAMELOGIC, "NULL mobj in K_GetClosestWaypointToMobj.\n");
+	}
+	else if (K_WaypointGridReady() == true)
+	{
+		closestwaypoint = K_GridClosestWaypoint(mobj->x / FRACUNIT, mobj->y / FRACUNIT, mobj->z / FRACUNIT);
 	}
 
 	return closestwaypoint;
@@ -354,9 +688,7 @@ static void K_CompareOverlappingWaypoint
 		fixed_t     *const bestfindist)
 {
 	const boolean useshortcuts = false;
-	const boolean huntbackwards = false;
-	boolean pathfindsuccess = false;
-	path_t pathtofinish = {0};
+	UINT32 findist = 0U;
 
 	if (K_GetWaypointIsShortcut(*bestwaypoint) == false
 		&& K_GetWaypointIsShortcut(checkwaypoint) == true)
@@ -365,27 +697,33 @@ static void K_CompareOverlappingWaypoint
 		return;
 	}
 
-	pathfindsuccess =
-		K_PathfindToWaypoint(checkwaypoint, finishline, &pathtofinish, useshortcuts, huntbackwards);
-
-	if (pathfindsuccess == true)
+	if (K_GetWaypointDistanceToFinish(checkwaypoint, useshortcuts, &findist) == true)
 	{
-		if ((INT32)(pathtofinish.totaldist) < *bestfindist)
+		if ((INT32)(findist) < *bestfindist)
 		{
 			*bestwaypoint = checkwaypoint;
-			*bestfindist = pathtofinish.totaldist;
+			*bestfindist = findist;
 		}
-
-		Z_Free(pathtofinish.array);
 	}
 }
 
 /*--------------------------------------------------
-	waypoint_t *K_GetBestWaypointForMobj(mobj_t *const mobj, waypoint_t *const hint)
+	static waypoint_t *K_FindBestWaypointForMobj(mobj_t *const mobj, waypoint_t *const hint, boolean usegrid)
 
-		See header file for description.
+		Does the work for K_GetBestWaypointForMobj. The waypoints are compared in heap order, and each comparison
+		depends on the ones before it. Once any waypoint has been picked, the only waypoints that can still change
+		the result are ones closer than it, or ones close enough to be inside their own radius. The grid can find
+		those, and comparing just them in heap order gives the same result as comparing every waypoint.
+
+	Input Arguments:-
+		mobj - mobj to get the waypoint for.
+		hint - a previously known nearby waypoint to optimize searching.
+		usegrid - Whether to use the waypoint grid, or check every waypoint.
+
+	Return:-
+		The best waypoint for the mobj, or NULL if there were no matches
 --------------------------------------------------*/
-waypoint_t *K_GetBestWaypointForMobj(mobj_t *const mobj, waypoint_t *const hint)
+static waypoint_t *K_FindBestWaypointForMobj(mobj_t *const mobj, waypoint_t *const hint, boolean usegrid)
 {
 	waypoint_t *bestwaypoint = NULL;
 
@@ -494,15 +832,95 @@ waypoint_t *K_GetBestWaypointForMobj(mobj_t *const mobj, waypoint_t *const hint)
 			sort_waypoint(hint);
 		}
 
-		for (size_t i = 0U; i < numwaypoints; i++)
+		size_t i = 0U;
+
+		// Nothing has been picked yet, so any waypoint could be the one
+		for (; i < numwaypoints && closestdist == INT32_MAX; i++)
 		{
 			sort_waypoint(&waypointheap[i]);
 		}
+
+		if (i < numwaypoints && usegrid == true && K_WaypointGridReady() == true)
+		{
+			auto &grid = g_waypointgrid;
+			const INT32 x = mobj->x / FRACUNIT;
+			const INT32 y = mobj->y / FRACUNIT;
+			const fixed_t pickeddist = closestdist;
+			const INT32 cell = K_WaypointGridCellAt(x, y);
+
+			// Neither distance used above is ever smaller than this
+			auto mindist = [&](UINT32 index)
+			{
+				return std::max(abs(x - grid.posx[index]), abs(y - grid.posy[index]));
+			};
+
+			grid.candidates.clear();
+
+			K_WaypointGridSearch(
+				x, y,
+				[&](INT32 searchcell, INT32 celldist)
+				{
+					if (celldist >= pickeddist)
+					{
+						return;
+					}
+
+					for (UINT32 k = grid.cellstart[searchcell]; k < grid.cellstart[searchcell + 1]; k++)
+					{
+						const UINT32 index = grid.points[k];
+
+						if (index >= i && mindist(index) < pickeddist)
+						{
+							grid.candidates.push_back(index);
+						}
+					}
+				},
+				[&](INT32 ringdist) { return ringdist >= pickeddist; }
+			);
+
+			if (cell != -1)
+			{
+				for (UINT32 k = grid.footstart[cell]; k < grid.footstart[cell + 1]; k++)
+				{
+					const UINT32 index = grid.footprints[k];
+
+					if (index >= i && mindist(index) <= grid.rad[index])
+					{
+						grid.candidates.push_back(index);
+					}
+				}
+			}
+
+			std::sort(grid.candidates.begin(), grid.candidates.end());
+			grid.candidates.erase(std::unique(grid.candidates.begin(), grid.candidates.end()), grid.candidates.end());
+
+			for (UINT32 index : grid.candidates)
+			{
+				sort_waypoint(&waypointheap[index]);
+			}
+		}
+		else
+		{
+			for (; i < numwaypoints; i++)
+			{
+				sort_waypoint(&waypointheap[i]);
+			}
+		}
 	}
 
 	return bestwaypoint;
 }
 
+/*--------------------------------------------------
+	waypoint_t *K_GetBestWaypointForMobj(mobj_t *const mobj, waypoint_t *const hint)
+
+		See header file for description.
+--------------------------------------------------*/
+waypoint_t *K_GetBestWaypointForMobj(mobj_t *const mobj, waypoint_t *const hint)
+{
+	return K_FindBestWaypointForMobj(mobj, hint, true);
+}
+
 /*--------------------------------------------------
 	size_t K_GetWaypointHeapIndex(waypoint_t *waypoint)
 
@@ -819,120 +1237,45 @@ void K_DebugWaypointsVisualise(void)
 }
 
 /*--------------------------------------------------
-	static size_t K_GetOpensetBaseSize(void)
-
-		Gets the base size the Openset hinary heap should have
-
-	Input Arguments:-
-		None
-
-	Return:-
-		The base size the Openset binary heap should have
---------------------------------------------------*/
-static size_t K_GetOpensetBaseSize(void)
-{
-	size_t returnsize = 0;
-
-	returnsize = baseopensetsize;
-
-	return returnsize;
-}
-
-/*--------------------------------------------------
-	static size_t K_GetClosedsetBaseSize(void)
-
-		Gets the base size the Closedset heap should have
-
-	Input Arguments:-
-		None
-
-	Return:-
-		The base size the Closedset heap should have
---------------------------------------------------*/
-static size_t K_GetClosedsetBaseSize(void)
-{
-	size_t returnsize = 0;
-
-	returnsize = baseclosedsetsize;
-
-	return returnsize;
-}
-
-/*--------------------------------------------------
-	static size_t K_GetNodesArrayBaseSize(void)
+	static size_t K_WaypointPathfindNumNodes(void)
 
-		Gets the base size the Nodes array should have
+		Gets the number of node indexes the pathfinding needs for waypoints. For pathfinding only.
 
 	Input Arguments:-
 		None
 
 	Return:-
-		The base size the Nodes array should have
+		The number of waypoints, plus one slot for a waypoint outside of the heap.
 --------------------------------------------------*/
-static size_t K_GetNodesArrayBaseSize(void)
+static size_t K_WaypointPathfindNumNodes(void)
 {
-	size_t returnsize = 0;
-
-	returnsize = basenodesarraysize;
-
-	return returnsize;
+	return numwaypoints + 1U;
 }
 
 /*--------------------------------------------------
-	static void K_UpdateOpensetBaseSize(size_t newbaseopensetsize)
+	static size_t K_WaypointPathfindGetIndex(void *data)
 
-		Sets the new base size of the openset binary heap, if it is bigger than before.
+		Gets the unique index of a waypoint used as a pathfindnode. For pathfinding only.
+		Waypoints that aren't in the heap (the fake finish line used for measuring the circuit length) all share the
+		last index, which is fine as only the starting node can be one of them.
 
 	Input Arguments:-
-		newbaseopensetsize - The size to try and set the base Openset size to
+		data - Should point to a waypoint_t to get the index of
 
 	Return:-
-		None
+		The waypoint's heap index, or numwaypoints if it isn't in the heap.
 --------------------------------------------------*/
-static void K_UpdateOpensetBaseSize(size_t newbaseopensetsize)
+static size_t K_WaypointPathfindGetIndex(void *data)
 {
-	if (newbaseopensetsize > baseopensetsize)
-	{
-		baseopensetsize = newbaseopensetsize;
-	}
-}
+	const uintptr_t waypoint = reinterpret_cast<uintptr_t>(data);
+	const uintptr_t heapstart = reinterpret_cast<uintptr_t>(waypointheap);
 
-/*--------------------------------------------------
-	static void K_UpdateClosedsetBaseSize(size_t newbaseclosedsetsize)
-
-		Sets the new base size of the closedset heap, if it is bigger than before.
-
-	Input Arguments:-
-		newbaseclosedsetsize - The size to try and set the base Closedset size to
-
-	Return:-
-		None
---------------------------------------------------*/
-static void K_UpdateClosedsetBaseSize(size_t newbaseclosedsetsize)
-{
-	if (newbaseclosedsetsize > baseopensetsize)
+	if (waypoint < heapstart || waypoint >= heapstart + numwaypoints * sizeof(waypoint_t))
 	{
-		baseclosedsetsize = newbaseclosedsetsize;
+		return numwaypoints;
 	}
-}
-
-/*--------------------------------------------------
-	static void K_UpdateNodesArrayBaseSize(size_t newnodesarraysize)
 
-		Sets the new base size of the nodes array, if it is bigger than before.
-
-	Input Arguments:-
-		newnodesarraysize - The size to try and set the base nodes array size to
-
-	Return:-
-		None
---------------------------------------------------*/
-static void K_UpdateNodesArrayBaseSize(size_t newnodesarraysize)
-{
-	if (newnodesarraysize > basenodesarraysize)
-	{
-		basenodesarraysize = newnodesarraysize;
-	}
+	return (waypoint - heapstart) / sizeof(waypoint_t);
 }
 
 /*--------------------------------------------------
@@ -1355,9 +1698,6 @@ boolean K_PathfindToWaypoint(
 			traversablefunc = K_WaypointPathfindTraversableAllEnabled;
 		}
 
-		pathfindsetup.opensetcapacity    = K_GetOpensetBaseSize();
-		pathfindsetup.closedsetcapacity  = K_GetClosedsetBaseSize();
-		pathfindsetup.nodesarraycapacity = K_GetNodesArrayBaseSize();
 		pathfindsetup.startnodedata      = sourcewaypoint;
 		pathfindsetup.endnodedata        = destinationwaypoint;
 		pathfindsetup.getconnectednodes  = nextnodesfunc;
@@ -1365,12 +1705,10 @@ boolean K_PathfindToWaypoint(
 		pathfindsetup.getheuristic       = heuristicfunc;
 		pathfindsetup.gettraversable     = traversablefunc;
 		pathfindsetup.getfinished        = finishedfunc;
+		pathfindsetup.getnodeindex       = K_WaypointPathfindGetIndex;
+		pathfindsetup.numnodes           = K_WaypointPathfindNumNodes();
 
 		pathfound = K_PathfindAStar(returnpath, &pathfindsetup);
-
-		K_UpdateOpensetBaseSize(pathfindsetup.opensetcapacity);
-		K_UpdateClosedsetBaseSize(pathfindsetup.closedsetcapacity);
-		K_UpdateNodesArrayBaseSize(pathfindsetup.nodesarraycapacity);
 	}
 
 	return pathfound;
@@ -1430,9 +1768,6 @@ boolean K_PathfindThruCircuit(
 			traversablefunc = K_WaypointPathfindTraversableAllEnabled;
 		}
 
-		pathfindsetup.opensetcapacity    = K_GetOpensetBaseSize();
-		pathfindsetup.closedsetcapacity  = K_GetClosedsetBaseSize();
-		pathfindsetup.nodesarraycapacity = K_GetNodesArrayBaseSize();
 		pathfindsetup.startnodedata      = sourcewaypoint;
 		pathfindsetup.endnodedata        = finishline;
 		pathfindsetup.endgscore          = traveldistance;
@@ -1441,12 +1776,10 @@ boolean K_PathfindThruCircuit(
 		pathfindsetup.getheuristic       = heuristicfunc;
 		pathfindsetup.gettraversable     = traversablefunc;
 		pathfindsetup.getfinished        = finishedfunc;
+		pathfindsetup.getnodeindex       = K_WaypointPathfindGetIndex;
+		pathfindsetup.numnodes           = K_WaypointPathfindNumNodes();
 
 		pathfound = K_PathfindAStar(returnpath, &pathfindsetup);
-
-		K_UpdateOpensetBaseSize(pathfindsetup.opensetcapacity);
-		K_UpdateClosedsetBaseSize(pathfindsetup.closedsetcapacity);
-		K_UpdateNodesArrayBaseSize(pathfindsetup.nodesarraycapacity);
 	}
 
 	return pathfound;
@@ -1506,9 +1839,6 @@ boolean K_PathfindThruCircuitSpawnable(
 			traversablefunc = K_WaypointPathfindTraversableAllEnabled;
 		}
 
-		pathfindsetup.opensetcapacity    = K_GetOpensetBaseSize();
-		pathfindsetup.closedsetcapacity  = K_GetClosedsetBaseSize();
-		pathfindsetup.nodesarraycapacity = K_GetNodesArrayBaseSize();
 		pathfindsetup.startnodedata      = sourcewaypoint;
 		pathfindsetup.endnodedata        = finishline;
 		pathfindsetup.endgscore          = traveldistance;
@@ -1517,12 +1847,10 @@ boolean K_PathfindThruCircuitSpawnable(
 		pathfindsetup.getheuristic       = heuristicfunc;
 		pathfindsetup.gettraversable     = traversablefunc;
 		pathfindsetup.getfinished        = finishedfunc;
+		pathfindsetup.getnodeindex       = K_WaypointPathfindGetIndex;
+		pathfindsetup.numnodes           = K_WaypointPathfindNumNodes();
 
 		pathfound = K_PathfindAStar(returnpath, &pathfindsetup);
-
-		K_UpdateOpensetBaseSize(pathfindsetup.opensetcapacity);
-		K_UpdateClosedsetBaseSize(pathfindsetup.closedsetcapacity);
-		K_UpdateNodesArrayBaseSize(pathfindsetup.nodesarraycapacity);
 	}
 
 	return pathfound;
@@ -1583,6 +1911,12 @@ waypoint_t *K_GetNextWaypointToDestination(
 		{
 			nextwaypoint = sourcewaypoint->prevwaypoints[0];
 		}
+		else if ((huntbackwards == false) && (destinationwaypoint == finishline)
+			&& (K_GetWaypointDistanceToFinish(sourcewaypoint, useshortcuts, NULL) == true))
+		{
+			// The precomputed routes already know the shortest path to the finish line
+			nextwaypoint = K_GetWaypointNextToFinish(sourcewaypoint, useshortcuts);
+		}
 		else
 		{
 			path_t                     pathtowaypoint  = {0};
@@ -1605,9 +1939,6 @@ waypoint_t *K_GetNextWaypointToDestination(
 				traversablefunc = K_WaypointPathfindTraversableAllEnabled;
 			}
 
-			pathfindsetup.opensetcapacity    = K_GetOpensetBaseSize();
-			pathfindsetup.closedsetcapacity  = K_GetClosedsetBaseSize();
-			pathfindsetup.nodesarraycapacity = K_GetNodesArrayBaseSize();
 			pathfindsetup.startnodedata      = sourcewaypoint;
 			pathfindsetup.endnodedata        = destinationwaypoint;
 			pathfindsetup.getconnectednodes  = nextnodesfunc;
@@ -1615,13 +1946,11 @@ waypoint_t *K_GetNextWaypointToDestination(
 			pathfindsetup.getheuristic       = heuristicfunc;
 			pathfindsetup.gettraversable     = traversablefunc;
 			pathfindsetup.getfinished        = finishedfunc;
+			pathfindsetup.getnodeindex       = K_WaypointPathfindGetIndex;
+			pathfindsetup.numnodes           = K_WaypointPathfindNumNodes();
 
 			pathfindsuccess = K_PathfindAStar(&pathtowaypoint, &pathfindsetup);
 
-			K_UpdateOpensetBaseSize(pathfindsetup.opensetcapacity);
-			K_UpdateClosedsetBaseSize(pathfindsetup.closedsetcapacity);
-			K_UpdateNodesArrayBaseSize(pathfindsetup.nodesarraycapacity);
-
 			if (pathfindsuccess)
 			{
 				// A direct path to the destination has been found.
@@ -1636,64 +1965,313 @@ waypoint_t *K_GetNextWaypointToDestination(
 					nextwaypoint = (waypoint_t*)pathtowaypoint.array[0].nodedata;
 				}
 
-				Z_Free(pathtowaypoint.array);
+				Z_Free(pathtowaypoint.array);
+			}
+			else
+			{
+				size_t     i                   = 0U;
+				waypoint_t **nextwaypointlist  = NULL;
+				size_t     numnextwaypoints    = 0U;
+				boolean waypointisenabled      = true;
+				boolean waypointisshortcut     = false;
+
+				if (huntbackwards)
+				{
+					nextwaypointlist = sourcewaypoint->prevwaypoints;
+					numnextwaypoints = sourcewaypoint->numprevwaypoints;
+				}
+				else
+				{
+					nextwaypointlist = sourcewaypoint->nextwaypoints;
+					numnextwaypoints = sourcewaypoint->numnextwaypoints;
+				}
+
+				// No direct path to the destination has been found, choose a next waypoint from what is available
+				// 1. If shortcuts are allowed, pick the first shortcut path that is enabled
+				// 2. If shortcuts aren't allowed, or there are no shortcuts, pick the first enabled waypoint
+				// 3. If there's no waypoints enabled, then nothing can be done and there is no next waypoint
+				if (useshortcuts)
+				{
+					for (i = 0U; i < numnextwaypoints; i++)
+					{
+						waypointisenabled  = K_GetWaypointIsEnabled(nextwaypointlist[i]);
+						waypointisshortcut = K_GetWaypointIsShortcut(nextwaypointlist[i]);
+
+						if (waypointisenabled && waypointisshortcut)
+						{
+							nextwaypoint = nextwaypointlist[i];
+							break;
+						}
+					}
+				}
+
+				if (nextwaypoint == NULL)
+				{
+					for (i = 0U; i < numnextwaypoints; i++)
+					{
+						waypointisenabled  = K_GetWaypointIsEnabled(nextwaypointlist[i]);
+
+						if (waypointisenabled)
+						{
+							nextwaypoint = nextwaypointlist[i];
+							break;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	return nextwaypoint;
+}
+
+/*--------------------------------------------------
+	static UINT8 K_GetWaypointRouteFlags(waypoint_t *const waypoint)
+
+		Packs the waypoint state that the precomputed routes depend on.
+
+	Input Arguments:-
+		waypoint - The waypoint to get the flags of
+
+	Return:-
+		Bit 0 set if enabled, bit 1 set if a shortcut.
+--------------------------------------------------*/
+static UINT8 K_GetWaypointRouteFlags(waypoint_t *const waypoint)
+{
+	return (K_GetWaypointIsEnabled(waypoint) ? 1 : 0) | (K_GetWaypointIsShortcut(waypoint) ? 2 : 0);
+}
+
+/*--------------------------------------------------
+	static boolean K_RouteCanTraverse(const UINT8 *flags, size_t from, size_t to, size_t route)
+
+		The table equivalent of the pathfinding traversable functions, for the edge from one waypoint to the next.
+
+	Input Arguments:-
+		flags - The route flags of every waypoint
+		from  - Heap index of the waypoint the edge leaves
+		to    - Heap index of the waypoint the edge enters
+		route - ROUTE_SHORTCUTS or ROUTE_NOSHORTCUTS
+
+	Return:-
+		True if the edge can be used in this route, false otherwise.
+--------------------------------------------------*/
+static boolean K_RouteCanTraverse(const UINT8 *flags, size_t from, size_t to, size_t route)
+{
+	if (!(flags[to] & 1))
+	{
+		return false;
+	}
+
+	if (route == ROUTE_NOSHORTCUTS)
+	{
+		// Allow shortcuts to be used if the previous waypoint is already a shortcut.
+		return (!(flags[to] & 2) || (flags[from] & 2));
+	}
+
+	return true;
+}
+
+/*--------------------------------------------------
+	static void K_BuildWaypointRoutes(void)
+
+		Runs Dijkstra backwards from the finish line over the waypoint graph, filling in the distance to the finish
+		line and the next waypoint towards it for every waypoint, for both shortcut variants.
+--------------------------------------------------*/
+static void K_BuildWaypointRoutes(void)
+{
+	using QueueItem = std::pair<UINT32, size_t>;
+	const size_t finishindex = K_GetWaypointHeapIndex(finishline);
+
+	g_routes.flags.resize(numwaypoints);
+
+	for (size_t i = 0U; i < numwaypoints; i++)
+	{
+		g_routes.flags[i] = K_GetWaypointRouteFlags(&waypointheap[i]);
+	}
+
+	for (size_t route = 0U; route < NUMROUTES; route++)
+	{
+		std::vector<UINT32> &dist = g_routes.dist[route];
+		std::vector<UINT32> &next = g_routes.next[route];
+		std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> openset;
+
+		dist.assign(numwaypoints, ROUTE_UNREACHABLE);
+		next.assign(numwaypoints, ROUTE_UNREACHABLE);
+
+		dist[finishindex] = 0U;
+		next[finishindex] = (UINT32)finishindex;
+		openset.emplace(0U, finishindex);
+
+		while (openset.empty() == false)
+		{
+			const QueueItem item = openset.top();
+			const size_t to = item.second;
+			waypoint_t *const waypoint = &waypointheap[to];
+
+			openset.pop();
+
+			if (item.first != dist[to])
+			{
+				// Stale, a shorter route was found after this was queued
+				continue;
 			}
-			else
+
+			for (size_t i = 0U; i < waypoint->numprevwaypoints; i++)
 			{
-				size_t     i                   = 0U;
-				waypoint_t **nextwaypointlist  = NULL;
-				size_t     numnextwaypoints    = 0U;
-				boolean waypointisenabled      = true;
-				boolean waypointisshortcut     = false;
+				const size_t from = K_GetWaypointHeapIndex(waypoint->prevwaypoints[i]);
+				const UINT32 newdist = dist[to] + waypoint->prevwaypointdistances[i];
 
-				if (huntbackwards)
+				if (K_RouteCanTraverse(g_routes.flags.data(), from, to, route) == false)
 				{
-					nextwaypointlist = sourcewaypoint->prevwaypoints;
-					numnextwaypoints = sourcewaypoint->numprevwaypoints;
+					continue;
 				}
-				else
+
+				if (newdist < dist[from])
 				{
-					nextwaypointlist = sourcewaypoint->nextwaypoints;
-					numnextwaypoints = sourcewaypoint->numnextwaypoints;
+					dist[from] = newdist;
+					next[from] = (UINT32)to;
+					openset.emplace(newdist, from);
 				}
+			}
+		}
+	}
 
-				// No direct path to the destination has been found, choose a next waypoint from what is available
-				// 1. If shortcuts are allowed, pick the first shortcut path that is enabled
-				// 2. If shortcuts aren't allowed, or there are no shortcuts, pick the first enabled waypoint
-				// 3. If there's no waypoints enabled, then nothing can be done and there is no next waypoint
-				if (useshortcuts)
-				{
-					for (i = 0U; i < numnextwaypoints; i++)
-					{
-						waypointisenabled  = K_GetWaypointIsEnabled(nextwaypointlist[i]);
-						waypointisshortcut = K_GetWaypointIsShortcut(nextwaypointlist[i]);
+	g_routes.dirty = false;
+	g_routes.checkedtic = leveltime;
+}
 
-						if (waypointisenabled && waypointisshortcut)
-						{
-							nextwaypoint = nextwaypointlist[i];
-							break;
-						}
-					}
-				}
+/*--------------------------------------------------
+	static boolean K_WaypointRoutesReady(void)
 
-				if (nextwaypoint == NULL)
-				{
-					for (i = 0U; i < numnextwaypoints; i++)
-					{
-						waypointisenabled  = K_GetWaypointIsEnabled(nextwaypointlist[i]);
+		Makes sure the precomputed routes match the current waypoint state, rebuilding them if not. Waypoints can be
+		toggled by linedef executors, which invalidate the routes directly, or by Lua, which gets picked up by
+		comparing against the saved state once per tic.
 
-						if (waypointisenabled)
-						{
-							nextwaypoint = nextwaypointlist[i];
-							break;
-						}
-					}
-				}
+	Return:-
+		True if the routes can be used, false if there is no waypoint graph to use.
+--------------------------------------------------*/
+static boolean K_WaypointRoutesReady(void)
+{
+	if (waypointheap == NULL || finishline == NULL || numwaypoints == 0U)
+	{
+		return false;
+	}
+
+	if (g_routes.dirty == false && g_routes.checkedtic != leveltime)
+	{
+		for (size_t i = 0U; i < numwaypoints; i++)
+		{
+			if (g_routes.flags[i] != K_GetWaypointRouteFlags(&waypointheap[i]))
+			{
+				g_routes.dirty = true;
+				break;
 			}
 		}
+
+		g_routes.checkedtic = leveltime;
 	}
 
-	return nextwaypoint;
+	if (g_routes.dirty == true)
+	{
+		K_BuildWaypointRoutes();
+	}
+
+	return true;
+}
+
+/*--------------------------------------------------
+	static boolean K_WaypointRouteValid(waypoint_t *const waypoint)
+
+		The same early outs K_PathfindToWaypoint has for paths to the finish line, so table lookups fail in the same
+		cases the pathfinding does.
+--------------------------------------------------*/
+static boolean K_WaypointRouteValid(waypoint_t *const waypoint)
+{
+	if (waypoint == NULL)
+	{
+		return false;
+	}
+
+	if (waypoint->numnextwaypoints == 0U)
+	{
+		return false;
+	}
+
+	if (finishline->numprevwaypoints == 0U || finishline->numnextwaypoints == 0U)
+	{
+		return false;
+	}
+
+	return K_WaypointRoutesReady();
+}
+
+/*--------------------------------------------------
+	boolean K_GetWaypointDistanceToFinish(
+		waypoint_t *const waypoint,
+		const boolean     useshortcuts,
+		UINT32 *const     returndist)
+
+		See header file for description.
+--------------------------------------------------*/
+boolean K_GetWaypointDistanceToFinish(
+	waypoint_t *const waypoint,
+	const boolean     useshortcuts,
+	UINT32 *const     returndist)
+{
+	UINT32 dist = ROUTE_UNREACHABLE;
+
+	if (K_WaypointRouteValid(waypoint) == false)
+	{
+		return false;
+	}
+
+	dist = g_routes.dist[useshortcuts ? ROUTE_SHORTCUTS : ROUTE_NOSHORTCUTS][K_GetWaypointHeapIndex(waypoint)];
+
+	if (dist == ROUTE_UNREACHABLE)
+	{
+		return false;
+	}
+
+	if (returndist != NULL)
+	{
+		*returndist = dist;
+	}
+
+	return true;
+}
+
+/*--------------------------------------------------
+	waypoint_t *K_GetWaypointNextToFinish(waypoint_t *const waypoint, const boolean useshortcuts)
+
+		See header file for description.
+--------------------------------------------------*/
+waypoint_t *K_GetWaypointNextToFinish(waypoint_t *const waypoint, const boolean useshortcuts)
+{
+	UINT32 next = ROUTE_UNREACHABLE;
+
+	if (K_WaypointRouteValid(waypoint) == false)
+	{
+		return NULL;
+	}
+
+	next = g_routes.next[useshortcuts ? ROUTE_SHORTCUTS : ROUTE_NOSHORTCUTS][K_GetWaypointHeapIndex(waypoint)];
+
+	if (next == ROUTE_UNREACHABLE)
+	{
+		return NULL;
+	}
+
+	return &waypointheap[next];
+}
+
+/*--------------------------------------------------
+	void K_InvalidateWaypointRoutes(void)
+
+		See header file for description.
+--------------------------------------------------*/
+void K_InvalidateWaypointRoutes(void)
+{
+	g_routes.dirty = true;
 }
 
 /*--------------------------------------------------
@@ -2785,6 +3363,8 @@ boolean K_SetupWaypointList(void)
 					K_CalculateTrackComplexity();
 				}
 
+				K_BuildWaypointGrid();
+
 				setupsuccessful = true;
 			}
 		}
@@ -2808,6 +3388,23 @@ void K_ClearWaypoints(void)
 	numwaypointmobjs = 0U;
 	circuitlength    = 0U;
 	trackcomplexity  = 0U;
+
+	for (size_t route = 0U; route < NUMROUTES; route++)
+	{
+		g_routes.dist[route].clear();
+		g_routes.next[route].clear();
+	}
+	g_routes.flags.clear();
+	K_InvalidateWaypointRoutes();
+
+	g_waypointgrid.cellstart.clear();
+	g_waypointgrid.points.clear();
+	g_waypointgrid.footstart.clear();
+	g_waypointgrid.footprints.clear();
+	g_waypointgrid.posx.clear();
+	g_waypointgrid.posy.clear();
+	g_waypointgrid.rad.clear();
+	g_waypointgrid.dirty = true;
 }
 
 /*--------------------------------------------------
@@ -2988,3 +3585,218 @@ void K_AdjustWaypointsParameters (void)
 		}
 	}
 }
+
+/*--------------------------------------------------
+	void Command_WaypointBench_f(void)
+
+		See header file for description.
+--------------------------------------------------*/
+void Command_WaypointBench_f(void)
+{
+	const boolean useshortcuts = false;
+	const boolean huntbackwards = false;
+	INT32 iterations = 10;
+	UINT32 mismatches = 0U;
+
+	auto elapsed_us = [](precise_t start)
+	{
+		return (double)(I_GetPreciseTime() - start) * 1000000.0 / (double)I_GetPrecisePrecision();
+	};
+
+	if (G_GamestateUsesLevel() == false || waypointheap == NULL || finishline == NULL)
+	{
+		CONS_Printf("You must be in a level with waypoints to use this.\n");
+		return;
+	}
+
+	if (COM_Argc() >= 2)
+	{
+		iterations = std::max(1, atoi(COM_Argv(1)));
+	}
+
+	CONS_Printf("%s waypoints, %d iterations\n", sizeu1(numwaypoints), iterations);
+
+	// Full A* from every waypoint to the finish line
+	{
+		UINT32 numfound = 0U;
+		precise_t start = I_GetPreciseTime();
+
+		for (INT32 i = 0; i < iterations; i++)
+		{
+			for (size_t j = 0U; j < numwaypoints; j++)
+			{
+				path_t path = {0};
+
+				if (K_PathfindToWaypoint(&waypointheap[j], finishline, &path, useshortcuts, huntbackwards) == true)
+				{
+					numfound++;
+					Z_Free(path.array);
+				}
+			}
+		}
+
+		double us = elapsed_us(start);
+		CONS_Printf("pathfind: %.2f us per query (%u found)\n", us / (double)(iterations * numwaypoints), numfound / iterations);
+	}
+
+	// Rebuilding the precomputed routes
+	{
+		precise_t start = I_GetPreciseTime();
+
+		for (INT32 i = 0; i < iterations; i++)
+		{
+			K_InvalidateWaypointRoutes();
+			K_WaypointRoutesReady();
+		}
+
+		CONS_Printf("route build: %.2f us\n", elapsed_us(start) / (double)iterations);
+	}
+
+	// Looking the same distances up from the routes
+	{
+		UINT32 total = 0U;
+		precise_t start = I_GetPreciseTime();
+
+		for (INT32 i = 0; i < iterations; i++)
+		{
+			for (size_t j = 0U; j < numwaypoints; j++)
+			{
+				UINT32 dist = 0U;
+
+				if (K_GetWaypointDistanceToFinish(&waypointheap[j], useshortcuts, &dist) == true)
+				{
+					total += dist;
+				}
+			}
+		}
+
+		double us = elapsed_us(start);
+		CONS_Printf("route lookup: %.3f us per query (checksum %u)\n", us / (double)(iterations * numwaypoints), total);
+	}
+
+	for (size_t j = 0U; j < numwaypoints; j++)
+	{
+		path_t path = {0};
+		UINT32 dist = 0U;
+		const boolean found = K_PathfindToWaypoint(&waypointheap[j], finishline, &path, useshortcuts, huntbackwards);
+		const boolean lookedup = K_GetWaypointDistanceToFinish(&waypointheap[j], useshortcuts, &dist);
+
+		if (found != lookedup || (found == true && path.totaldist != dist))
+		{
+			mismatches++;
+		}
+
+		if (found == true)
+		{
+			Z_Free(path.array);
+		}
+	}
+
+	CONS_Printf("routes disagreeing with pathfinding: %u\n", mismatches);
+
+	// Nearest waypoint queries, from points scattered around every waypoint
+	{
+		std::vector<std::array<INT32, 3>> points;
+		UINT32 scanchecksum = 0U, gridchecksum = 0U;
+
+		for (size_t j = 0U; j < numwaypoints; j++)
+		{
+			const mobj_t *const mobj = waypointheap[j].mobj;
+
+			points.push_back({
+				(mobj->x / FRACUNIT) + (INT32)((j * 7919U) % 4096U) - 2048,
+				(mobj->y / FRACUNIT) + (INT32)((j * 6091U) % 4096U) - 2048,
+				(mobj->z / FRACUNIT) + (INT32)((j * 4271U) % 512U) - 256
+			});
+		}
+
+		K_WaypointGridReady();
+
+		precise_t start = I_GetPreciseTime();
+
+		for (INT32 i = 0; i < iterations; i++)
+		{
+			for (const auto &point : points)
+			{
+				scanchecksum += K_GetWaypointHeapIndex(K_ScanClosestWaypoint(point[0], point[1], point[2]));
+			}
+		}
+
+		const double scanus = elapsed_us(start);
+
+		start = I_GetPreciseTime();
+
+		for (INT32 i = 0; i < iterations; i++)
+		{
+			for (const auto &point : points)
+			{
+				gridchecksum += K_GetWaypointHeapIndex(K_GridClosestWaypoint(point[0], point[1], point[2]));
+			}
+		}
+
+		const double gridus = elapsed_us(start);
+		const double numqueries = (double)(iterations * points.size());
+
+		CONS_Printf("closest waypoint: scan %.3f us, grid %.3f us per query (%d x %d cells of %d)\n",
+			scanus / numqueries, gridus / numqueries,
+			g_waypointgrid.width, g_waypointgrid.height, g_waypointgrid.cellsize);
+
+		mismatches = 0U;
+
+		for (const auto &point : points)
+		{
+			if (K_ScanClosestWaypoint(point[0], point[1], point[2]) != K_GridClosestWaypoint(point[0], point[1], point[2]))
+			{
+				mismatches++;
+			}
+		}
+
+		CONS_Printf("closest waypoint disagreeing: %u (checksums %u, %u)\n", mismatches, scanchecksum, gridchecksum);
+	}
+
+	// Best waypoint for every player, with and without their current waypoint as the hint
+	{
+		std::vector<std::pair<mobj_t *, waypoint_t *>> queries;
+		double scanus = 0.0, gridus = 0.0;
+
+		for (INT32 j = 0; j < MAXPLAYERS; j++)
+		{
+			if (playeringame[j] && players[j].mo != NULL && P_MobjWasRemoved(players[j].mo) == false)
+			{
+				queries.emplace_back(players[j].mo, players[j].currentwaypoint);
+				queries.emplace_back(players[j].mo, nullptr);
+			}
+		}
+
+		if (queries.empty() == true)
+		{
+			return;
+		}
+
+		mismatches = 0U;
+
+		for (INT32 i = 0; i < iterations; i++)
+		{
+			for (const auto &query : queries)
+			{
+				precise_t start = I_GetPreciseTime();
+				waypoint_t *const scanned = K_FindBestWaypointForMobj(query.first, query.second, false);
+				scanus += elapsed_us(start);
+
+				start = I_GetPreciseTime();
+				waypoint_t *const gridded = K_FindBestWaypointForMobj(query.first, query.second, true);
+				gridus += elapsed_us(start);
+
+				if (scanned != gridded)
+				{
+					mismatches++;
+				}
+			}
+		}
+
+		const double numqueries = (double)(iterations * queries.size());
+
+		CONS_Printf("best waypoint: scan %.3f us, grid %.3f us per query\n", scanus / numqueries, gridus / numqueries);
+		CONS_Printf("best waypoint disagreeing: %u\n", mismatches / iterations);
+	}
+}
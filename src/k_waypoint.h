@@ -357,6 +357,59 @@ waypoint_t *K_GetNextWaypointToDestination(
 	const boolean     huntbackwards);
 
 
+/*--------------------------------------------------
+	boolean K_GetWaypointDistanceToFinish(
+		waypoint_t *const waypoint,
+		const boolean     useshortcuts,
+		UINT32 *const     returndist)
+
+		Looks up the shortest distance from a waypoint to the finish line. This is the same as the totaldist of
+		K_PathfindToWaypoint to the finish line going forwards, but uses routes precomputed on first use and only
+		rebuilt when a waypoint is enabled or disabled.
+
+	Input Arguments:-
+		waypoint     - The waypoint to start from
+		useshortcuts - Whether to use waypoints that are marked as being shortcuts
+		returndist   - Where to put the distance, can be NULL
+
+	Return:-
+		True if the finish line can be reached, false otherwise.
+--------------------------------------------------*/
+
+boolean K_GetWaypointDistanceToFinish(
+	waypoint_t *const waypoint,
+	const boolean     useshortcuts,
+	UINT32 *const     returndist);
+
+
+/*--------------------------------------------------
+	waypoint_t *K_GetWaypointNextToFinish(waypoint_t *const waypoint, const boolean useshortcuts)
+
+		Looks up the next waypoint on the shortest path from a waypoint to the finish line, from the same precomputed
+		routes as K_GetWaypointDistanceToFinish.
+
+	Input Arguments:-
+		waypoint     - The waypoint to start from
+		useshortcuts - Whether to use waypoints that are marked as being shortcuts
+
+	Return:-
+		The next waypoint towards the finish line, the finish line itself if waypoint is the finish line, or NULL if
+		the finish line can't be reached.
+--------------------------------------------------*/
+
+waypoint_t *K_GetWaypointNextToFinish(waypoint_t *const waypoint, const boolean useshortcuts);
+
+
+/*--------------------------------------------------
+	void K_InvalidateWaypointRoutes(void)
+
+		Marks the precomputed routes to the finish line as outdated, so they are rebuilt on next use. Call this after
+		changing whether a waypoint is enabled.
+--------------------------------------------------*/
+
+void K_InvalidateWaypointRoutes(void);
+
+
 /*--------------------------------------------------
 	waypoint_t *K_SearchWaypointGraphForMobj(mobj_t *const mobj)
 
@@ -472,6 +525,16 @@ void K_ClearWaypoints(void);
 
 void K_AdjustWaypointsParameters (void);
 
+
+/*--------------------------------------------------
+	void Command_WaypointBench_f(void)
+
+		Console command that times pathfinding, the precomputed routes, and closest/best waypoint lookups over every
+		waypoint in the current level, and checks the faster versions agree with checking everything.
+--------------------------------------------------*/
+
+void Command_WaypointBench_f(void);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -82,7 +82,7 @@ static UINT8 lib_searchBlockmap_Objects(lua_State *L, INT32 x, INT32 y, mobj_t *
 static UINT8 lib_searchBlockmap_Lines(lua_State *L, INT32 x, INT32 y, mobj_t *thing)
 {
 	INT32 offset;
-	const INT32 *list; // Big blockmap
+	const UINT32 *list, *end;
 	polymaplink_t *plink; // haleyjd 02/22/06
 	line_t *ld;
 
@@ -134,10 +134,7 @@ static UINT8 lib_searchBlockmap_Lines(lua_State *L, INT32 x, INT32 y, mobj_t *th
 		plink = (polymaplink_t *)(plink->link.next);
 	}
 
-	offset = *(blockmap + offset); // offset = blockmap[y*bmapwidth+x];
-
-	// First index is really empty, so +1 it.
-	for (list = blockmaplump + offset + 1; *list != -1; list++)
+	for (list = P_BlockLines(offset, &end); list < end; list++)
 	{
 		ld = &lines[*list];
 
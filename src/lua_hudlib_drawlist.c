@@ -111,9 +111,10 @@ void LUA_HUD_ClearDrawList(huddrawlist_h list)
 	// it out for reuse
 
 	// this memset probably isn't necessary
+	// (only the items actually used last time can be dirty)
 	if (list->items)
 	{
-		memset(list->items, 0, sizeof(drawitem_t) * list->items_capacity);
+		memset(list->items, 0, sizeof(drawitem_t) * list->items_len);
 	}
 
 	list->items_len = 0;
@@ -21,6 +21,7 @@
 #include "i_video.h"
 #include "i_system.h" // I_GetPreciseTime
 #include "m_misc.h"
+#include "m_encoder.h"
 #include "st_stuff.h" // st_palette
 
 #ifdef HWRENDER
@@ -30,6 +31,11 @@
 // GIFs are always little-endian
 #include "byteptr.h"
 
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GIF_SSE2
+#endif
+
 #ifdef HAVE_ANIGIF
 static boolean gif_optimize = false; // So nobody can do something dumb
 static boolean gif_downscale = false; // like changing cvars mid output
@@ -39,126 +45,135 @@ static UINT8 gif_dynamicdelay = (UINT8)0; // and messing something up
 static boolean gif_localcolortable = false;
 static boolean gif_colorprofile = false;
 static RGBA_t *gif_headerpalette = NULL;
-static RGBA_t *gif_framepalette = NULL;
 
+// Frames are captured on the game thread and written out by the
+// encoder thread (see m_encoder.h). Everything from here to GIF_open
+// belongs to the encoder while the GIF is open, except as noted.
 static FILE *gif_out = NULL;
+static INT32 gif_width, gif_height; // set by GIF_open
 static INT32 gif_frames = 0;
+static UINT8 gif_writeover = 0;
+
+// Indexed copies of the last few frames. Each one is converted into
+// while the one before it is compared against and packed.
+#define GIFSCREENS 3
+static UINT8 *gif_screens[GIFSCREENS];
+static INT32 gif_screennum = 0; // the next one to convert into
+
+// GIF_packframe ran out of memory, and the file is cut short. Read it
+// once the frame it was packing is waited on.
+static boolean gif_packfailed = false;
+
+// Split frames across the encoder's workers and pipeline them;
+// gifbench turns it off to compare
+static boolean gif_pipeline = true;
+
+// Game thread only
 static precise_t gif_prevframetime = 0;
 static UINT32 gif_delayus = 0; // "us" is microseconds
-static UINT8 gif_writeover = 0;
+static INT32 gif_tics = 0; // frames captured or dropped
+static INT32 gif_lasttic = 0; // gif_tics after the last captured frame
+static INT32 gif_dropped = 0;
+static boolean gif_failed = false; // a frame couldn't be written; GIF_frame stops the movie
 
 
 
 // OPTIMIZE gif output
 // ---
 
+// Rows are compared a chunk at a time, and only the chunks that differ
+// are looked at byte by byte.
+#ifdef GIF_SSE2
+#define GIFCHUNK 16
+
+FUNCINLINE static ATTRINLINE boolean GIF_chunkequal(const UINT8 *a, const UINT8 *b)
+{
+	const __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)a), _mm_loadu_si128((const __m128i *)b));
+	return (_mm_movemask_epi8(eq) == 0xFFFF);
+}
+#else
+#define GIFCHUNK 8
+
+FUNCINLINE static ATTRINLINE boolean GIF_chunkequal(const UINT8 *a, const UINT8 *b)
+{
+	UINT64 wa, wb;
+	memcpy(&wa, a, sizeof wa);
+	memcpy(&wb, b, sizeof wb);
+	return (wa == wb);
+}
+#endif
+
 //
 // GIF_optimizecmprow
 // checks a row for modification, and if any is detected, what parts
-// modified input 'last': returns current row if modification detected
-// modified input 'left': returns leftmost known changed pixel
-// modified input 'right': returns rightmost known changed pixel
+// modified input 'left': returns leftmost changed pixel
+// modified input 'right': returns rightmost changed pixel
 //
-static UINT8 GIF_optimizecmprow(const UINT8 *dst, const UINT8 *src, INT32 row,
-	INT32 *last, INT32 *left, INT32 *right)
+static boolean GIF_optimizecmprow(const UINT8 *dp, const UINT8 *sp, INT32 *left, INT32 *right)
 {
-	const UINT8 *dp = dst + (vid.width * row);
-	const UINT8 *sp = src + (vid.width * row);
-	const UINT8 *dtmp, *stmp;
-	UINT8 doleft = 1, doright = 1;
-	INT32 i = 0;
+	INT32 l = 0, r = gif_width;
 
-	if (!memcmp(sp, dp, vid.width))
-		return 0; // unchanged.
+	// left side
+	while (l + GIFCHUNK <= gif_width && GIF_chunkequal(dp + l, sp + l))
+		l += GIFCHUNK;
+	while (l < gif_width && dp[l] == sp[l])
+		l++;
+
+	if (l == gif_width)
+		return false; // unchanged.
+
+	// right side; the pixel at l is known to differ
+	while (r - GIFCHUNK > l && GIF_chunkequal(dp + r - GIFCHUNK, sp + r - GIFCHUNK))
+		r -= GIFCHUNK;
+	while (dp[r - 1] == sp[r - 1])
+		r--;
+
+	*left = l;
+	*right = r - 1;
+	return true;
+}
 
-	*last = row;
+// Frames are converted and compared in bands of rows, in parallel.
+#define GIFBANDHEIGHT 32
 
-	// left side
-	i = 0;
-	if (*left == 0) // edge reached
-		doleft = 0;
-	else if (*left > 0) // left set, nonzero
-	{
-		if (!memcmp(sp, dp, *left))
-			doleft = 0; // left side not changed
-	}
-	while (doleft)
-	{
-		dtmp = dp + i;
-		stmp = sp + i;
-		if (*dtmp != *stmp)
-		{
-			doleft = 0;
-			*left = i;
-		}
-		++i;
-	}
+// What changed in a band. top < 0 if nothing did.
+typedef struct
+{
+	INT32 top, bottom, left, right;
+} gifband_t;
 
-	// right side
-	i = vid.width - 1;
-	if (*right == vid.width - 1) // edge reached
-		doright = 0;
-	else if (*right >= 0) // right set, non-end-of-width
-	{
-		dtmp = dp + *right + 1;
-		stmp = sp + *right + 1;
-		if (!memcmp(stmp, dtmp, vid.width - (*right + 1)))
-			doright = 0; // right side not changed
-	}
-	while (doright)
-	{
-		dtmp = dp + i;
-		stmp = sp + i;
-		if (*dtmp != *stmp)
-		{
-			doright = 0;
-			*right = i;
-		}
-		--i;
-	}
-	return 1;
-}
+static gifband_t *gif_bands = NULL;
+static INT32 gif_numbands = 0;
 
 //
 // GIF_optimizeregion
-// attempts to optimize a GIF as it's being written by giving a region
-// containing all of the changed pixels instead of rewriting
-// the entire screen buffer to the GIF file every frame
+// gives a region containing all of the changed pixels instead of
+// rewriting the entire screen buffer to the GIF file every frame
 // modified input 'x': returns optimal starting x coordinate
 // modified input 'y': returns optimal starting y coordinate
 // modified input 'w': returns optimal width
 // modified input 'h': returns optimal height
 //
-static void GIF_optimizeregion(const UINT8 *dst, const UINT8 *src,
-	INT32 *x, INT32 *y, INT32 *w, INT32 *h)
+static void GIF_optimizeregion(INT32 *x, INT32 *y, INT32 *w, INT32 *h)
 {
-	INT32 st = 0, sb = vid.height - 1; // work from both directions
-	INT32 firstchg_t = -1, firstchg_b = -1; // store first changed row.
-	INT32 lastchg_t = -1, lastchg_b = -1; // Store last row... just in case
-	INT32 lmpix = -1, rmpix = -1; // store left and rightmost change
-	UINT8 stopt = 0, stopb = 0;
+	INT32 top = -1, bottom = -1, left = gif_width, right = -1;
+	INT32 i;
 
-	while ((!stopt || !stopb) && st < sb)
+	for (i = 0; i < gif_numbands; i++)
 	{
-		if (!stopt)
-		{
-			if (GIF_optimizecmprow(dst, src, st++, &lastchg_t, &lmpix, &rmpix)
-			 && lmpix == 0 && rmpix == vid.width - 1)
-				stopt = 1;
-			if (firstchg_t < 0 && lastchg_t >= 0)
-				firstchg_t = lastchg_t;
-		}
-		if (!stopb)
-		{
-			if (GIF_optimizecmprow(dst, src, sb--, &lastchg_b, &lmpix, &rmpix)
-			 && lmpix == 0 && rmpix == vid.width - 1)
-				stopb = 1;
-			if (firstchg_b < 0 && lastchg_b >= 0)
-				firstchg_b = lastchg_b;
-		}
+		const gifband_t *band = &gif_bands[i];
+
+		if (band->top < 0)
+			continue;
+
+		if (top < 0)
+			top = band->top;
+		bottom = band->bottom;
+		left = min(left, band->left);
+		right = max(right, band->right);
 	}
 
-	if (lmpix < 0) // NO CHANGE.
+	if (top < 0) // NO CHANGE.
 	{
 		// hack: we don't attempt to go back and rewrite the previous
 		// frame's delay, we just make this frame have only a single
@@ -168,13 +183,10 @@ static void GIF_optimizeregion(const UINT8 *dst, const UINT8 *src,
 		return;
 	}
 
-	*x = lmpix;
-	*y = (firstchg_t < 0 && lastchg_b >= 0) ? lastchg_b : firstchg_t;
-	*w = rmpix + 1;
-	*h = ((firstchg_b < 0 && lastchg_t >= 0) ? lastchg_t : firstchg_b) + 1;
-
-	*w -= *x;
-	*h -= *y;
+	*x = left;
+	*y = top;
+	*w = right - left + 1;
+	*h = bottom - top + 1;
 }
 
 
@@ -254,7 +266,7 @@ static void GIF_prepareLZW(void)
 	giflzw_nextCodeToAssign = GIFLZW_DICTSTART;
 
 	if (!giflzw_hashTable)
-		giflzw_hashTable = Z_Malloc(16384*sizeof(UINT32), PU_STATIC, NULL);
+		giflzw_hashTable = malloc(16384*sizeof(UINT32));
 	memset(giflzw_hashTable, 0, 16384*sizeof(UINT32));
 }
 
@@ -360,8 +372,8 @@ static void GIF_lzw(void)
 		}
 		if ((scrbuf_pos += scrbuf_downscaleamt) >= scrbuf_lineend)
 		{
-			scrbuf_lineend += (vid.width * scrbuf_downscaleamt);
-			scrbuf_linebegin += (vid.width * scrbuf_downscaleamt);
+			scrbuf_lineend += (gif_width * scrbuf_downscaleamt);
+			scrbuf_linebegin += (gif_width * scrbuf_downscaleamt);
 			scrbuf_pos = scrbuf_linebegin;
 		}
 		// Just a bit of overflow prevention
@@ -422,7 +434,7 @@ static RGBA_t *GIF_getpalette(size_t palnum)
 // writes the gif palette.
 // used both for the header and local color tables.
 //
-static UINT8 *GIF_palwrite(UINT8 *p, RGBA_t *pal)
+static UINT8 *GIF_palwrite(UINT8 *p, const RGBA_t *pal)
 {
 	INT32 i;
 	for (i = 0; i < 256; i++)
@@ -453,14 +465,14 @@ static void GIF_headwrite(void)
 	if (gif_downscale)
 	{
 		scrbuf_downscaleamt = vid.dupx;
-		rwidth = (vid.width / scrbuf_downscaleamt);
-		rheight = (vid.height / scrbuf_downscaleamt);
+		rwidth = (gif_width / scrbuf_downscaleamt);
+		rheight = (gif_height / scrbuf_downscaleamt);
 	}
 	else
 	{
 		scrbuf_downscaleamt = 1;
-		rwidth = vid.width;
-		rheight = vid.height;
+		rwidth = gif_width;
+		rheight = gif_height;
 	}
 
 	WRITEUINT16(p, rwidth);
@@ -491,153 +503,137 @@ const UINT8 gifframe_gchead[4] = {0x21,0xF9,0x04,0x04}; // GCE, bytes, packed by
 static UINT8 *gifframe_data = NULL;
 static size_t gifframe_size = 8192;
 
+// Whether the last frame converted had a local color table
+static boolean gifframe_lastpalchanged = false;
+
+// A frame captured on the game thread, for the encoder to write.
+typedef struct
+{
+	encoderjob_t job;
+	UINT8 *linear; // RGB888 at gif_width by gif_height, from malloc
+	RGBA_t palette[256]; // to convert it with
+	boolean palchanged; // write palette as a local color table
+	UINT16 delay;
+	boolean ret;
+} gifframe_t;
+
+// A converted frame, for GIF_packframe. The job it came from is gone by
+// the time it gets packed, so it keeps what it needs.
+typedef struct
+{
+	UINT8 *screen;
+	INT32 blitx, blity, blitw, blith;
+	RGBA_t palette[256];
+	boolean palchanged;
+	UINT16 delay;
+} gifpackframe_t;
+
+static gifpackframe_t gif_packing;
+
+// A frame for GIF_convertband.
+typedef struct
+{
+	const UINT8 *linear;
+	UINT8 *screen;
+	const UINT8 *prev; // NULL if the whole frame gets written
+} gifconvert_t;
+
+static colorlookup_t gif_colorlookup;
+
 //
 // GIF_rgbconvert
-// converts an RGB frame to a frame with a palette.
+// converts rows top to bottom-1 of an RGB frame to a frame with a palette.
 //
-#ifdef HWRENDER
-static colorlookup_t gif_colorlookup;
-
-static void GIF_rgbconvert(const UINT8 *linear, UINT8 *scr)
+static void GIF_rgbconvert(const UINT8 *linear, UINT8 *scr, INT32 top, INT32 bottom)
 {
-	UINT8 r, g, b;
-	size_t src = 0, dest = 0;
-	size_t size = (vid.width * vid.height * 3);
+	// When downscaling, only every scrbuf_downscaleamt'th pixel is read
+	size_t dest = (size_t)top * gif_width;
+	const size_t end = (size_t)bottom * gif_width;
+	const UINT8 *src;
 
-	InitColorLUT(&gif_colorlookup, (gif_localcolortable) ? gif_framepalette : gif_headerpalette, true);
+	dest += (scrbuf_downscaleamt - dest % scrbuf_downscaleamt) % scrbuf_downscaleamt;
 
-	while (src < size)
+	for (; dest < end; dest += scrbuf_downscaleamt)
 	{
-		r = (UINT8)linear[src];
-		g = (UINT8)linear[src + 1];
-		b = (UINT8)linear[src + 2];
-		scr[dest] = GetColorLUTDirect(&gif_colorlookup, r, g, b);
-		src += (3 * scrbuf_downscaleamt);
-		dest += scrbuf_downscaleamt;
+		src = linear + dest * 3;
+		scr[dest] = GetColorLUTDirect(&gif_colorlookup, src[0], src[1], src[2]);
 	}
 }
-#endif
 
 //
-// GIF_framewrite
-// writes a frame into the file.
+// GIF_convertband
+// converts a band of a frame, and finds what changed in it.
+// runs on the encoder's workers.
 //
-static void GIF_framewrite(INT32 input_width, INT32 input_height, const UINT8 *input)
+static void GIF_convertband(void *userdata, size_t bandnum)
 {
-	UINT8 *p;
-	UINT8 *movie_screen = screens[2];
-	INT32 blitx, blity, blitw, blith;
-	boolean palchanged;
+	const gifconvert_t *conv = userdata;
+	gifband_t *band = &gif_bands[bandnum];
+	const INT32 top = (INT32)bandnum * GIFBANDHEIGHT;
+	const INT32 bottom = min(top + GIFBANDHEIGHT, gif_height);
+	INT32 row, left, right;
 
-	(void)input_width;
-	(void)input_height;
+	GIF_rgbconvert(conv->linear, conv->screen, top, bottom);
 
-	I_Assert(input_width == vid.width && input_height == vid.height);
+	band->top = -1;
 
-	if (!gifframe_data)
-		gifframe_data = Z_Malloc(gifframe_size, PU_STATIC, NULL);
-	p = gifframe_data;
-
-	if (!gif_out)
+	if (!conv->prev)
 		return;
 
-	// Lactozilla: Compare the header's palette with the current frame's palette and see if it changed.
-	if (gif_localcolortable)
+	for (row = top; row < bottom; row++)
 	{
-		gif_framepalette = GIF_getpalette(max(st_palette, 0));
-		palchanged = memcmp(gif_headerpalette, gif_framepalette, sizeof(RGBA_t) * 256);
-	}
-	else
-		palchanged = false;
+		const size_t ofs = (size_t)row * gif_width;
 
-	// Compare image data (for optimizing GIF)
-	// If the palette has changed, the entire frame is considered to be different.
-	if (gif_optimize && gif_frames > 0 && (!palchanged))
-	{
-		// before blit movie_screen points to last frame, cur_screen points to this frame
-		UINT8 *cur_screen = screens[0];
-		GIF_optimizeregion(cur_screen, movie_screen, &blitx, &blity, &blitw, &blith);
+		if (!GIF_optimizecmprow(conv->screen + ofs, conv->prev + ofs, &left, &right))
+			continue;
 
-		// blit to temp screen
-		if (rendermode == render_soft)
+		if (band->top < 0)
 		{
-			I_Assert(input != NULL);
-			GIF_rgbconvert(input, movie_screen);
+			band->top = row;
+			band->left = left;
+			band->right = right;
 		}
-#ifdef HWRENDER
-		else if (rendermode == render_opengl)
+		else
 		{
-			UINT8 *linear = HWR_GetScreenshot();
-			GIF_rgbconvert(linear, movie_screen);
-			free(linear);
+			band->left = min(band->left, left);
+			band->right = max(band->right, right);
 		}
-#endif
+		band->bottom = row;
 	}
-	else
-	{
-		blitx = blity = 0;
-		blitw = vid.width;
-		blith = vid.height;
+}
 
-#ifdef HWRENDER
-		// Copy the current OpenGL frame into the base screen
-		if (rendermode == render_opengl)
-		{
-			UINT8 *linear = HWR_GetScreenshot();
-			GIF_rgbconvert(linear, screens[0]);
-			free(linear);
-		}
-#endif
+//
+// GIF_packframe
+// packs a converted frame and writes it into the file.
+// runs on the encoder's workers, while the next frame gets converted.
+// sets gif_packfailed if it runs out of memory.
+//
+static void GIF_packframe(void *userdata, size_t part)
+{
+	const gifpackframe_t *frame = userdata;
+	UINT8 *p;
+	UINT8 *movie_screen = frame->screen;
+	INT32 blitx = frame->blitx, blity = frame->blity, blitw = frame->blitw, blith = frame->blith;
 
-		// Copy the first frame into the movie screen
-		// OpenGL already does the same above.
-		if (gif_frames == 0 && rendermode == render_soft)
-		{
-			I_Assert(input != NULL);
-			GIF_rgbconvert(input, screens[0]);
-		}
+	(void)part;
+
+	if (!gifframe_data)
+		gifframe_data = malloc(gifframe_size);
+	p = gifframe_data;
 
-		movie_screen = screens[0];
+	if (!p)
+	{
+		gif_packfailed = true;
+		return;
 	}
 
 	// screen regions are handled in GIF_lzw
 	{
-		UINT16 delay = 0;
 		INT32 startline;
 
-		if (gif_dynamicdelay ==(UINT8) 2)
-		{
-			// golden's attempt at creating a "dynamic delay"
-			UINT16 mingifdelay = 10; // minimum gif delay in milliseconds (keep at 10 because gifs can't get more precise).
-			gif_delayus += (I_GetPreciseTime() - gif_prevframetime) / (I_GetPrecisePrecision() / 1000000); // increase delay by how much time was spent between last measurement
-
-			if (gif_delayus/1000 >= mingifdelay) // delay is big enough to be able to effect gif frame delay?
-			{
-				int frames = (gif_delayus/1000) / mingifdelay; // get amount of frames to delay.
-				delay = frames; // set the delay to delay that amount of frames.
-				gif_delayus -= frames*(mingifdelay*1000); // remove frames by the amount of milliseconds they take. don't reset to 0, the microseconds help consistency.
-			}
-		}
-		else if (gif_dynamicdelay ==(UINT8) 1)
-		{
-			float delayf = ceil(100.0f/NEWTICRATE);
-
-			delay = (UINT16)((I_GetPreciseTime() - gif_prevframetime)) / (I_GetPrecisePrecision() / 1000000) /10/1000;
-
-			if (delay < (UINT16)(delayf))
-				delay = (UINT16)(delayf);
-		}
-		else
-		{
-			// the original code
-			int d1 = (int)((100.0f/NEWTICRATE)*(gif_frames+1));
-			int d2 = (int)((100.0f/NEWTICRATE)*(gif_frames));
-			delay = d1-d2;
-		}
-
 		WRITEMEM(p, gifframe_gchead, 4);
 
-		WRITEUINT16(p, delay);
+		WRITEUINT16(p, frame->delay);
 		WRITEUINT8(p, 0);
 		WRITEUINT8(p, 0); // end of GCE
 
@@ -660,29 +656,34 @@ static void GIF_framewrite(INT32 input_width, INT32 input_height, const UINT8 *i
 			WRITEUINT8(p, 0); // no local table of colors
 		else
 		{
-			if (palchanged)
+			if (frame->palchanged)
 			{
 				// The palettes are different, so write the Local Color Table!
 				WRITEUINT8(p, 0x87); // (0x87 = 1000 0111)
-				p = GIF_palwrite(p, gif_framepalette);
+				p = GIF_palwrite(p, frame->palette);
 			}
 			else
 				WRITEUINT8(p, 0); // They are equal, no Local Color Table needed.
 		}
 
-		scrbuf_pos = movie_screen + blitx + (blity * vid.width);
-		scrbuf_writeend = scrbuf_pos + (blitw - 1) + ((blith - 1) * vid.width);
+		scrbuf_pos = movie_screen + blitx + (blity * gif_width);
+		scrbuf_writeend = scrbuf_pos + (blitw - 1) + ((blith - 1) * gif_width);
 
 		if (!gifbwr_buf)
-			gifbwr_buf = Z_Malloc(256, PU_STATIC, NULL);
+			gifbwr_buf = malloc(256);
+		if (!gifbwr_buf)
+		{
+			gif_packfailed = true;
+			return;
+		}
 		gifbwr_cur = gifbwr_buf;
 
 		GIF_prepareLZW();
 		giflzw_workingCode = UINT16_MAX;
 		WRITEUINT8(p, gifbwr_bits_min - 1);
 
-		startline = (scrbuf_pos - movie_screen) / vid.width;
-		scrbuf_linebegin = movie_screen + (startline * vid.width) + blitx;
+		startline = (scrbuf_pos - movie_screen) / gif_width;
+		scrbuf_linebegin = movie_screen + (startline * gif_width) + blitx;
 		scrbuf_lineend = scrbuf_linebegin + blitw;
 
 		//prewrite a table clear
@@ -696,7 +697,14 @@ static void GIF_framewrite(INT32 input_width, INT32 input_height, const UINT8 *i
 			if ((size_t)(p - gifframe_data) + gifbwr_bufsize + 1 >= gifframe_size)
 			{
 				INT32 temppos = p - gifframe_data;
-				gifframe_data = Z_Realloc(gifframe_data, (gifframe_size *= 2), PU_STATIC, NULL);
+				UINT8 *grown = realloc(gifframe_data, gifframe_size * 2);
+				if (!grown)
+				{
+					gif_packfailed = true;
+					return;
+				}
+				gifframe_data = grown;
+				gifframe_size *= 2;
 				p = gifframe_data + temppos; // realloc moves gifframe_data, so p is now invalid
 			}
 
@@ -711,28 +719,217 @@ static void GIF_framewrite(INT32 input_width, INT32 input_height, const UINT8 *i
 		WRITEUINT8(p, 0); //terminator
 	}
 	fwrite(gifframe_data, 1, (p - gifframe_data), gif_out);
+}
+
+//
+// GIF_framewrite
+// converts a frame and hands it to GIF_packframe.
+// runs on the encoder thread.
+// returns false if the last frame couldn't be packed.
+//
+static boolean GIF_framewrite(gifframe_t *frame)
+{
+	UINT8 *movie_screen = gif_screens[gif_screennum];
+	gifconvert_t conv;
+	INT32 blitx, blity, blitw, blith;
+	INT32 i;
+
+	if (!gif_out)
+		return false;
+
+	InitColorLUT(&gif_colorlookup, frame->palette, true);
+
+	conv.linear = frame->linear;
+	conv.screen = movie_screen;
+	conv.prev = NULL;
+
+	// Compare image data (for optimizing GIF)
+	// If the palette has changed, the entire frame is considered to be different.
+	// The last frame may still be getting packed, but that only reads it.
+	if (gif_optimize && gif_frames > 0 && !frame->palchanged && !gifframe_lastpalchanged)
+		conv.prev = gif_screens[(gif_screennum + GIFSCREENS - 1) % GIFSCREENS];
+
+	if (gif_pipeline)
+		M_EncoderParallel(GIF_convertband, &conv, gif_numbands);
+	else
+	{
+		for (i = 0; i < gif_numbands; i++)
+			GIF_convertband(&conv, i);
+	}
+
+	if (conv.prev)
+		GIF_optimizeregion(&blitx, &blity, &blitw, &blith);
+	else
+	{
+		blitx = blity = 0;
+		blitw = gif_width;
+		blith = gif_height;
+	}
+
+	// The last frame has to be in the file before this one goes in
+	M_EncoderWaitBackground();
+
+	if (gif_packfailed)
+		return false;
+
+	gif_packing.screen = movie_screen;
+	gif_packing.blitx = blitx;
+	gif_packing.blity = blity;
+	gif_packing.blitw = blitw;
+	gif_packing.blith = blith;
+	memcpy(gif_packing.palette, frame->palette, sizeof(RGBA_t) * 256);
+	gif_packing.palchanged = frame->palchanged;
+	gif_packing.delay = frame->delay;
+
+	if (gif_pipeline)
+		M_EncoderBackground(GIF_packframe, &gif_packing);
+	else
+		GIF_packframe(&gif_packing, 0);
+
 	++gif_frames;
+	gif_screennum = (gif_screennum + 1) % GIFSCREENS;
+	gifframe_lastpalchanged = frame->palchanged;
+
+	// If packing this one fails, the next frame or GIF_encodeclose finds out
+	return true;
+}
+
+static void GIF_encodeframe(encoderjob_t *job)
+{
+	gifframe_t *frame = (gifframe_t *)job;
+
+	frame->ret = GIF_framewrite(frame);
+}
+
+static void GIF_finishframe(encoderjob_t *job)
+{
+	gifframe_t *frame = (gifframe_t *)job;
+
+	if (!frame->ret)
+		gif_failed = true;
+
+	free(frame->linear);
+	Z_Free(frame);
+}
+
+//
+// GIF_framedelay
+// works out how long the frame being captured stays up, in centiseconds.
+//
+static UINT16 GIF_framedelay(void)
+{
+	UINT16 delay = 0;
+
+	if (gif_dynamicdelay ==(UINT8) 2)
+	{
+		// golden's attempt at creating a "dynamic delay"
+		UINT16 mingifdelay = 10; // minimum gif delay in milliseconds (keep at 10 because gifs can't get more precise).
+		gif_delayus += (I_GetPreciseTime() - gif_prevframetime) / (I_GetPrecisePrecision() / 1000000); // increase delay by how much time was spent between last measurement
+
+		if (gif_delayus/1000 >= mingifdelay) // delay is big enough to be able to effect gif frame delay?
+		{
+			int frames = (gif_delayus/1000) / mingifdelay; // get amount of frames to delay.
+			delay = frames; // set the delay to delay that amount of frames.
+			gif_delayus -= frames*(mingifdelay*1000); // remove frames by the amount of milliseconds they take. don't reset to 0, the microseconds help consistency.
+		}
+	}
+	else if (gif_dynamicdelay ==(UINT8) 1)
+	{
+		float delayf = ceil(100.0f/NEWTICRATE);
+
+		delay = (UINT16)((I_GetPreciseTime() - gif_prevframetime)) / (I_GetPrecisePrecision() / 1000000) /10/1000;
+
+		if (delay < (UINT16)(delayf))
+			delay = (UINT16)(delayf);
+	}
+	else
+	{
+		// the original code
+		// (frames dropped since the last one add to its delay)
+		int d1 = (int)((100.0f/NEWTICRATE)*(gif_tics+1));
+		int d2 = (int)((100.0f/NEWTICRATE)*(gif_lasttic));
+		delay = d1-d2;
+	}
+
 	gif_prevframetime = I_GetPreciseTime();
+	return delay;
 }
 
+//
+// GIF_submitframe
+// hands a captured frame to the encoder, which takes linear.
+//
+static void GIF_submitframe(UINT8 *linear)
+{
+	gifframe_t *frame = Z_Calloc(sizeof (*frame), PU_STATIC, NULL);
+	RGBA_t *framepalette = gif_headerpalette;
 
+	// Lactozilla: Compare the header's palette with the current frame's palette and see if it changed.
+	if (gif_localcolortable)
+	{
+		framepalette = GIF_getpalette(max(st_palette, 0));
+		frame->palchanged = memcmp(gif_headerpalette, framepalette, sizeof(RGBA_t) * 256);
+	}
 
-// ========================
-// !!! PUBLIC FUNCTIONS !!!
-// ========================
+	frame->linear = linear;
+	memcpy(frame->palette, framepalette, sizeof(RGBA_t) * 256);
+	frame->delay = GIF_framedelay();
+	frame->job.encode = GIF_encodeframe;
+	frame->job.finish = GIF_finishframe;
+
+	gif_lasttic = ++gif_tics;
+
+	M_EncoderSubmit(&frame->job);
+}
 
 //
-// GIF_open
-// opens a new file for writing.
+// GIF_dropframe
+// skips a frame the encoder has no room for.
+// the next frame makes up for its delay.
 //
-INT32 GIF_open(const char *filename)
+static void GIF_dropframe(void)
+{
+	gif_tics++;
+	gif_dropped++;
+}
+
+
+
+//
+// GIF_openfile
+// opens a new file for writing frames of the given size.
+//
+static boolean GIF_openfile(const char *filename, INT32 width, INT32 height, boolean downscale)
 {
+	INT32 i;
+
 	gif_out = fopen(filename, "wb");
 	if (!gif_out)
-		return 0;
+		return false;
+
+	gif_width = width;
+	gif_height = height;
+	gif_numbands = (gif_height + GIFBANDHEIGHT - 1) / GIFBANDHEIGHT;
+	gif_bands = malloc(gif_numbands * sizeof (*gif_bands));
+	for (i = 0; i < GIFSCREENS; i++)
+		gif_screens[i] = calloc(gif_width * gif_height, 1);
+
+	if (!gif_bands || !gif_screens[0] || !gif_screens[1] || !gif_screens[2])
+	{
+		free(gif_bands);
+		gif_bands = NULL;
+		for (i = 0; i < GIFSCREENS; i++)
+		{
+			free(gif_screens[i]);
+			gif_screens[i] = NULL;
+		}
+		fclose(gif_out);
+		gif_out = NULL;
+		return false;
+	}
 
 	gif_optimize = (!!cv_gif_optimize.value);
-	gif_downscale = (!!cv_gif_downscale.value);
+	gif_downscale = downscale;
 	gif_dynamicdelay = (UINT8)cv_gif_dynamicdelay.value;
 	gif_localcolortable = (!!cv_gif_localcolortable.value);
 	gif_colorprofile = (!!cv_screenshot_colorprofile.value);
@@ -740,19 +937,113 @@ INT32 GIF_open(const char *filename)
 
 	GIF_headwrite();
 	gif_frames = 0;
+	gif_screennum = 0;
+	gif_tics = gif_lasttic = gif_dropped = 0;
+	gif_packfailed = gif_failed = false;
+	gifframe_lastpalchanged = false;
 	gif_prevframetime = I_GetPreciseTime();
 	gif_delayus = 0;
-	return 1;
+	return true;
+}
+
+//
+// GIF_encodeclose
+// finishes the file once the last frame is in it.
+// runs on the encoder thread.
+//
+static void GIF_encodeclose(encoderjob_t *job)
+{
+	(void)job;
+
+	M_EncoderWaitBackground();
+
+	// final terminator.
+	if (!gif_packfailed)
+		fwrite(";", 1, 1, gif_out);
+	fclose(gif_out);
+	gif_out = NULL;
+}
+
+static void GIF_finishclose(encoderjob_t *job)
+{
+	Z_Free(job);
+}
+
+//
+// GIF_closefile
+// closes the output file, once the encoder is done with it.
+//
+static void GIF_closefile(void)
+{
+	encoderjob_t *job = Z_Calloc(sizeof (*job), PU_STATIC, NULL);
+	INT32 i;
+
+	// Let the encoder write out whatever is left first
+	job->encode = GIF_encodeclose;
+	job->finish = GIF_finishclose;
+	M_EncoderSubmit(job);
+	M_EncoderFlush();
+
+	free(gifbwr_buf);
+	gifbwr_buf = gifbwr_cur = NULL;
+
+	free(gifframe_data);
+	gifframe_data = NULL;
+
+	free(giflzw_hashTable);
+	giflzw_hashTable = NULL;
+
+	free(gif_bands);
+	gif_bands = NULL;
+	for (i = 0; i < GIFSCREENS; i++)
+	{
+		free(gif_screens[i]);
+		gif_screens[i] = NULL;
+	}
+}
+
+
+
+// ========================
+// !!! PUBLIC FUNCTIONS !!!
+// ========================
+
+//
+// GIF_open
+// opens a new file for writing.
+//
+INT32 GIF_open(const char *filename)
+{
+	return GIF_openfile(filename, vid.width, vid.height, !!cv_gif_downscale.value);
 }
 
 //
 // GIF_frame
-// writes a frame into the output gif
+// writes the current OpenGL frame into the output gif
 //
 void GIF_frame(void)
 {
-	// there's not much actually needed here, is there.
-	GIF_framewrite(vid.width, vid.height, NULL);
+#ifdef HWRENDER
+	UINT8 *linear;
+
+	if (!gif_out)
+		return;
+
+	if (gif_failed)
+	{
+		M_StopMovie();
+		return;
+	}
+
+	if (vid.width != gif_width || vid.height != gif_height || !M_EncoderWantFrame()
+		|| !(linear = HWR_GetScreenshot()))
+	{
+		GIF_dropframe();
+		return;
+	}
+
+	GIF_submitframe(linear);
+#endif
 }
 
 //
@@ -761,7 +1052,26 @@ void GIF_frame(void)
 //
 void GIF_frame_rgb24(INT32 width, INT32 height, const UINT8 *buffer)
 {
-	GIF_framewrite(width, height, buffer);
+	UINT8 *linear;
+
+	if (!gif_out)
+		return;
+
+	if (gif_failed)
+	{
+		M_StopMovie();
+		return;
+	}
+
+	if (width != gif_width || height != gif_height || !M_EncoderWantFrame()
+		|| !(linear = malloc(width * height * 3)))
+	{
+		GIF_dropframe();
+		return;
+	}
+
+	memcpy(linear, buffer, width * height * 3);
+	GIF_submitframe(linear);
 }
 
 //
@@ -773,24 +1083,106 @@ INT32 GIF_close(void)
 	if (!gif_out)
 		return 0;
 
-	// final terminator.
-	fwrite(";", 1, 1, gif_out);
-	fclose(gif_out);
-	gif_out = NULL;
+	GIF_closefile();
 
-	if (gifbwr_buf)
-		Z_Free(gifbwr_buf);
-	gifbwr_buf = gifbwr_cur = NULL;
+	if (gif_failed || gif_packfailed)
+		CONS_Alert(CONS_ERROR, M_GetText("Ran out of memory writing the animated gif; stopped after %d frames\n"), gif_frames);
+	else if (gif_dropped)
+		CONS_Printf(M_GetText("Animated gif closed; wrote %d frames, dropped %d\n"), gif_frames, gif_dropped);
+	else
+		CONS_Printf(M_GetText("Animated gif closed; wrote %d frames\n"), gif_frames);
+	return 1;
+}
 
-	if (gifframe_data)
-		Z_Free(gifframe_data);
-	gifframe_data = NULL;
+#define GIFBENCHWIDTH 1280
+#define GIFBENCHHEIGHT 720
 
-	if (giflzw_hashTable)
-		Z_Free(giflzw_hashTable);
-	giflzw_hashTable = NULL;
+//
+// GIF_benchframe
+// makes up a frame: a still background with a box sweeping across it
+// and a counter in the corner, which is about what a race looks like
+// to the optimizer.
+//
+static void GIF_benchframe(UINT8 *linear, INT32 frame)
+{
+	const INT32 boxx = (frame * 24) % (GIFBENCHWIDTH - 256), boxy = 232;
+	INT32 x, y;
+	UINT8 c;
 
-	CONS_Printf(M_GetText("Animated gif closed; wrote %d frames\n"), gif_frames);
-	return 1;
+	for (y = 0; y < GIFBENCHHEIGHT; y++)
+	{
+		for (x = 0; x < GIFBENCHWIDTH; x++)
+		{
+			if (x >= boxx && x < boxx + 256 && y >= boxy && y < boxy + 256)
+				c = (UINT8)(x - boxx + y - boxy + frame * 4);
+			else if (x < 64 && y < 32)
+				c = (UINT8)(frame * (x / 8 + 1));
+			else
+				c = (UINT8)((x / 16) * 9 + (y / 16) * 5);
+
+			*linear++ = gif_headerpalette[c].s.red;
+			*linear++ = gif_headerpalette[c].s.green;
+			*linear++ = gif_headerpalette[c].s.blue;
+		}
+	}
+}
+
+//
+// Command_GifBench_f
+// times the GIF encoder on made up frames at 1280x720, first one frame
+// at a time, then with frames split across threads and pipelined.
+//
+void Command_GifBench_f(void)
+{
+	const INT32 frames = (COM_Argc() > 1) ? max(atoi(COM_Argv(1)), 1) : 300;
+	const precise_t precision = I_GetPrecisePrecision();
+	char filename[MAX_WADPATH];
+	INT32 pass, i;
+
+	if (gif_out || moviemode)
+	{
+		CONS_Printf(M_GetText("Can't benchmark the GIF encoder while recording a movie.\n"));
+		return;
+	}
+
+	snprintf(filename, sizeof filename, "%s" PATHSEP "gifbench.gif", srb2home);
+
+	for (pass = 0; pass < 2; pass++)
+	{
+		precise_t start, elapsed;
+		double seconds;
+		UINT8 *linear;
+
+		if (!GIF_openfile(filename, GIFBENCHWIDTH, GIFBENCHHEIGHT, false))
+		{
+			CONS_Alert(CONS_ERROR, M_GetText("Couldn't create %s\n"), filename);
+			return;
+		}
+
+		gif_pipeline = (pass == 1);
+		start = I_GetPreciseTime();
+
+		for (i = 0; i < frames; i++)
+		{
+			linear = malloc(GIFBENCHWIDTH * GIFBENCHHEIGHT * 3);
+			if (!linear)
+				break;
+
+			GIF_benchframe(linear, i);
+			GIF_submitframe(linear); // waits on the encoder, rather than dropping
+		}
+
+		GIF_closefile();
+
+		elapsed = I_GetPreciseTime() - start;
+		seconds = (double)elapsed / (double)precision;
+
+		CONS_Printf("%s: %d frames at %dx%d in %.2f s, %.1f fps\n",
+			gif_pipeline ? "Pipelined" : "Serial", gif_frames, GIFBENCHWIDTH, GIFBENCHHEIGHT,
+			seconds, seconds > 0.0 ? gif_frames / seconds : 0.0);
+	}
+
+	gif_pipeline = true;
+	remove(filename);
 }
 #endif //ifdef HAVE_ANIGIF
@@ -31,6 +31,8 @@ INT32 GIF_open(const char *filename);
 void GIF_frame(void);
 void GIF_frame_rgb24(INT32 width, INT32 height, const UINT8 *buffer);
 INT32 GIF_close(void);
+
+void Command_GifBench_f(void);
 #endif
 
 extern consvar_t cv_gif_optimize, cv_gif_downscale, cv_gif_dynamicdelay, cv_gif_localcolortable;
@@ -0,0 +1,441 @@
+// DR. ROBOTNIK'S RING RACERS
+//-----------------------------------------------------------------------------
+// Copyright (C) 2024 by Kart Krew.
+//
+// This program is free software distributed under the
+// terms of the GNU General Public License, version 2.
+// See the 'LICENSE' file for more details.
+//-----------------------------------------------------------------------------
+/// \file  m_benchmark.cpp
+/// \brief Timing a list of demos, for comparing builds
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "m_benchmark.h"
+#include "doomdef.h"
+#include "doomstat.h"
+#include "console.h"
+#include "d_main.h"
+#include "g_demo.h"
+#include "g_game.h"
+#include "i_system.h"
+#include "i_video.h"
+#include "m_argv.h"
+#include "m_misc.h"
+#include "m_perfstats.h"
+#include "r_main.h"
+#include "screen.h"
+
+namespace
+{
+
+enum benchcounter_t
+{
+	BENCH_FRAME,
+	BENCH_TIC,
+	BENCH_THINKERS,
+	BENCH_BSP,
+	BENCH_PLANES,
+	BENCH_MASKED,
+	BENCH_LUA,
+	BENCH_ACS,
+	NUMBENCHCOUNTERS
+};
+
+const char *const counternames[NUMBENCHCOUNTERS] = {
+	"frame",
+	"tic",
+	"thinkers",
+	"bsp",
+	"planes",
+	"masked",
+	"lua",
+	"acs",
+};
+
+// Baseline counters under this (in ms) are left out of the
+// comparison, since the odd microsecond makes them look like huge swings
+constexpr double kMinCompareMs = 0.05;
+
+struct BenchStats
+{
+	double mean, p50, p90, p95, p99, max;
+};
+
+struct BenchDemo
+{
+	std::string name;
+	std::vector<double> samples[NUMBENCHCOUNTERS]; // in ms
+	BenchStats stats[NUMBENCHCOUNTERS];
+};
+
+struct Benchmark
+{
+	bool active = false;
+	std::vector<BenchDemo> demos;
+	size_t current = 0;
+	tic_t lastgametic = 0;
+};
+
+Benchmark g_bench;
+
+double precise_ms(precise_t t)
+{
+	return (double)t * 1000.0 / (double)I_GetPrecisePrecision();
+}
+
+// Nearest rank, on sorted samples
+double percentile(const std::vector<double>& sorted, double p)
+{
+	size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+
+	return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+void compute_stats(BenchDemo& demo)
+{
+	for (size_t i = 0; i < NUMBENCHCOUNTERS; i++)
+	{
+		std::vector<double>& samples = demo.samples[i];
+		BenchStats& stats = demo.stats[i];
+		double sum = 0.0;
+
+		stats = {};
+
+		if (samples.empty())
+			continue;
+
+		std::sort(samples.begin(), samples.end());
+
+		for (double sample : samples)
+			sum += sample;
+
+		stats.mean = sum / samples.size();
+		stats.p50 = percentile(samples, 50.0);
+		stats.p90 = percentile(samples, 90.0);
+		stats.p95 = percentile(samples, 95.0);
+		stats.p99 = percentile(samples, 99.0);
+		stats.max = samples.back();
+	}
+}
+
+std::string json_escape(const std::string& s)
+{
+	std::string out;
+
+	for (char c : s)
+	{
+		if (c == '"' || c == '\\')
+			out += '\\';
+		out += c;
+	}
+
+	return out;
+}
+
+std::string csv_escape(const std::string& s)
+{
+	std::string out;
+
+	for (char c : s)
+	{
+		if (c == '"')
+			out += '"';
+		out += c;
+	}
+
+	return out;
+}
+
+bool write_json(const char *path)
+{
+	FILE *f = fopen(path, "w");
+
+	if (!f)
+		return false;
+
+	fprintf(f, "{\n");
+	fprintf(f, "\t\"version\": \"%s\",\n", json_escape(VERSIONSTRING).c_str());
+	fprintf(f, "\t\"revision\": \"%s\",\n", json_escape(comprevision).c_str());
+	fprintf(f, "\t\"branch\": \"%s\",\n", json_escape(compbranch).c_str());
+	fprintf(f, "\t\"rendermode\": %d,\n", rendermode);
+	fprintf(f, "\t\"nodraw\": %s,\n", nodrawers ? "true" : "false");
+	fprintf(f, "\t\"width\": %d,\n", vid.width);
+	fprintf(f, "\t\"height\": %d,\n", vid.height);
+	fprintf(f, "\t\"demos\": [\n");
+
+	for (size_t d = 0; d < g_bench.demos.size(); d++)
+	{
+		const BenchDemo& demo = g_bench.demos[d];
+
+		fprintf(f, "\t\t{\n");
+		fprintf(f, "\t\t\t\"name\": \"%s\",\n", json_escape(demo.name).c_str());
+		fprintf(f, "\t\t\t\"tics\": %s,\n", sizeu1(demo.samples[BENCH_FRAME].size()));
+		fprintf(f, "\t\t\t\"counters\": {\n");
+
+		for (size_t i = 0; i < NUMBENCHCOUNTERS; i++)
+		{
+			const BenchStats& stats = demo.stats[i];
+
+			fprintf(f, "\t\t\t\t\"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}%s\n",
+				counternames[i], stats.mean, stats.p50, stats.p90, stats.p95, stats.p99, stats.max,
+				i + 1 < NUMBENCHCOUNTERS ? "," : "");
+		}
+
+		fprintf(f, "\t\t\t}\n");
+		fprintf(f, "\t\t}%s\n", d + 1 < g_bench.demos.size() ? "," : "");
+	}
+
+	fprintf(f, "\t]\n");
+	fprintf(f, "}\n");
+
+	return fclose(f) == 0;
+}
+
+bool write_csv(const char *path)
+{
+	FILE *f = fopen(path, "w");
+
+	if (!f)
+		return false;
+
+	fputs("demo,counter,samples,mean,p50,p90,p95,p99,max\n", f);
+
+	for (const BenchDemo& demo : g_bench.demos)
+	{
+		for (size_t i = 0; i < NUMBENCHCOUNTERS; i++)
+		{
+			const BenchStats& stats = demo.stats[i];
+
+			fprintf(f, "\"%s\",%s,%s,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+				csv_escape(demo.name).c_str(), counternames[i], sizeu1(demo.samples[i].size()),
+				stats.mean, stats.p50, stats.p90, stats.p95, stats.p99, stats.max);
+		}
+	}
+
+	return fclose(f) == 0;
+}
+
+// Reads the demo name off the front of a CSV row, returning where the
+// rest of the row starts, or NULL if it's malformed.
+const char *read_csv_name(const char *p, std::string& name)
+{
+	name.clear();
+
+	if (*p++ != '"')
+		return NULL;
+
+	for (;; p++)
+	{
+		if (*p == '\0')
+			return NULL;
+
+		if (*p == '"')
+		{
+			if (p[1] != '"')
+				return p + 1;
+			p++;
+		}
+
+		name += *p;
+	}
+}
+
+// Compares the run against the CSV of an earlier one, returning how many
+// counters got slower than the threshold allows.
+size_t compare_baseline(const char *path, double threshold)
+{
+	FILE *f = fopen(path, "r");
+	char line[1024];
+	size_t regressions = 0, compared = 0;
+
+	if (!f)
+	{
+		CONS_Alert(CONS_WARNING, "Couldn't read benchmark baseline '%s'\n", path);
+		return 0;
+	}
+
+	while (fgets(line, sizeof line, f))
+	{
+		std::string name;
+		char counter[32];
+		unsigned samples;
+		double mean, p50, p90, p95, p99, max;
+		const char *rest = read_csv_name(line, name);
+
+		// Also skips the header
+		if (!rest || sscanf(rest, ",%31[^,],%u,%lf,%lf,%lf,%lf,%lf,%lf",
+				counter, &samples, &mean, &p50, &p90, &p95, &p99, &max) != 8)
+			continue;
+
+		if (p95 < kMinCompareMs)
+			continue;
+
+		for (const BenchDemo& demo : g_bench.demos)
+		{
+			if (demo.name != name)
+				continue;
+
+			for (size_t i = 0; i < NUMBENCHCOUNTERS; i++)
+			{
+				if (strcmp(counternames[i], counter))
+					continue;
+
+				const double now = demo.stats[i].p95;
+				const double change = (now - p95) * 100.0 / p95;
+
+				compared++;
+
+				if (change > threshold)
+				{
+					CONS_Printf("\x85" "Regression:\x80 %s %s p95 %.3f ms -> %.3f ms (%+.1f%%)\n",
+						name.c_str(), counter, p95, now, change);
+					regressions++;
+				}
+			}
+		}
+	}
+
+	fclose(f);
+
+	CONS_Printf("Compared %s counters against '%s', %s over %.1f%% slower\n",
+		sizeu1(compared), path, sizeu2(regressions), threshold);
+
+	return regressions;
+}
+
+void finish_benchmark(void)
+{
+	std::string base = "benchmark";
+	const char *path;
+
+	g_bench.active = false;
+
+	if (M_CheckParm("-benchmarkreport") && M_IsNextParm())
+		base = M_GetNextParm();
+	else
+		base = va("%s" PATHSEP "%s", srb2home, base.c_str());
+
+	for (const BenchDemo& demo : g_bench.demos)
+	{
+		const BenchStats& frame = demo.stats[BENCH_FRAME];
+
+		CONS_Printf("%s: %s tics, frame mean %.3f ms, p50 %.3f, p95 %.3f, p99 %.3f, max %.3f\n",
+			demo.name.c_str(), sizeu1(demo.samples[BENCH_FRAME].size()),
+			frame.mean, frame.p50, frame.p95, frame.p99, frame.max);
+	}
+
+	path = va("%s.json", base.c_str());
+	if (write_json(path))
+		CONS_Printf("Benchmark report saved to '%s'\n", path);
+	else
+		CONS_Alert(CONS_ERROR, "Couldn't write benchmark report '%s'\n", path);
+
+	path = va("%s.csv", base.c_str());
+	if (write_csv(path))
+		CONS_Printf("Benchmark report saved to '%s'\n", path);
+	else
+		CONS_Alert(CONS_ERROR, "Couldn't write benchmark report '%s'\n", path);
+
+	if (M_CheckParm("-benchmarkbaseline") && M_IsNextParm())
+	{
+		std::string baseline = M_GetNextParm();
+		double threshold = 10.0;
+
+		if (M_CheckParm("-benchmarkthreshold") && M_IsNextParm())
+			threshold = atof(M_GetNextParm());
+
+		if (compare_baseline(baseline.c_str(), threshold))
+			quitstatus = 1;
+	}
+
+	I_Quit();
+}
+
+} // namespace
+
+boolean M_BenchmarkStart(void)
+{
+	if (!M_CheckParm("-benchmark"))
+		return false;
+
+	g_bench = {};
+
+	while (M_IsNextParm())
+	{
+		char name[MAX_WADPATH];
+
+		strlcpy(name, M_GetNextParm(), sizeof name);
+		FIL_DefaultExtension(name, ".lmp");
+
+		g_bench.demos.emplace_back();
+		g_bench.demos.back().name = name;
+	}
+
+	if (g_bench.demos.empty())
+		return false;
+
+	g_bench.active = true;
+
+	CONS_Printf(M_GetText("Benchmarking %s demos.\n"), sizeu1(g_bench.demos.size()));
+	CONS_Printf(M_GetText("Playing demo %s.\n"), g_bench.demos[0].name.c_str());
+	G_TimeDemo(g_bench.demos[0].name.c_str());
+
+	return true;
+}
+
+boolean M_BenchmarkActive(void)
+{
+	return g_bench.active;
+}
+
+void M_BenchmarkSample(precise_t frametime, boolean ranwipe)
+{
+	if (!g_bench.active || !demo.timing)
+		return;
+
+	// One tic runs per frame while timing, but loading a level and
+	// wiping the screen would drown out everything else
+	if (gamestate != GS_LEVEL || levelloading || leveltime < 2 || ranwipe
+		|| gametic == g_bench.lastgametic)
+	{
+		g_bench.lastgametic = gametic;
+		return;
+	}
+
+	g_bench.lastgametic = gametic;
+
+	std::vector<double> *samples = g_bench.demos[g_bench.current].samples;
+
+	samples[BENCH_FRAME].push_back(precise_ms(frametime));
+	samples[BENCH_TIC].push_back(precise_ms(ps_tictime));
+	samples[BENCH_THINKERS].push_back(precise_ms(ps_thinkertime));
+	samples[BENCH_BSP].push_back(precise_ms(nodrawers ? 0 : ps_bsptime));
+	samples[BENCH_PLANES].push_back(precise_ms(nodrawers ? 0 : ps_sw_planetime));
+	samples[BENCH_MASKED].push_back(precise_ms(nodrawers ? 0 : ps_sw_maskedtime));
+	samples[BENCH_LUA].push_back(precise_ms(ps_lua_thinkframe_time));
+	samples[BENCH_ACS].push_back(precise_ms(ps_acs_time));
+}
+
+void M_BenchmarkDemoDone(void)
+{
+	if (!g_bench.active)
+		return;
+
+	compute_stats(g_bench.demos[g_bench.current]);
+
+	if (++g_bench.current >= g_bench.demos.size())
+	{
+		finish_benchmark();
+		return;
+	}
+
+	const char *name = g_bench.demos[g_bench.current].name.c_str();
+
+	CONS_Printf(M_GetText("Playing demo %s.\n"), name);
+	G_TimeDemo(name);
+}
@@ -0,0 +1,54 @@
+// DR. ROBOTNIK'S RING RACERS
+//-----------------------------------------------------------------------------
+// Copyright (C) 2024 by Kart Krew.
+//
+// This program is free software distributed under the
+// terms of the GNU General Public License, version 2.
+// See the 'LICENSE' file for more details.
+//-----------------------------------------------------------------------------
+/// \file  m_benchmark.h
+/// \brief Timing a list of demos, for comparing builds
+
+#ifndef __M_BENCHMARK__
+#define __M_BENCHMARK__
+
+#include "doomtype.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// -benchmark times every demo given after it, one after another, the
+// same way -timedemo times one: a tic per frame, as fast as it will go.
+// Every frame is timed along with what perfstats counts for it, and
+// once the last demo is done the percentiles go to a JSON and a CSV
+// report (-benchmarkreport, "benchmark" by default), and the game quits.
+//
+// Given the CSV of an earlier run with -benchmarkbaseline, any demo and
+// counter whose 95th percentile got slower by more than
+// -benchmarkthreshold percent (10 by default) is reported, and the game
+// quits with exit code 1.
+//
+// -nodraw leaves out rendering, for timing the game logic alone.
+//
+
+// Starts timing the demos named on the command line after -benchmark.
+// Returns false if there weren't any.
+boolean M_BenchmarkStart(void);
+
+// Whether a benchmark is running.
+boolean M_BenchmarkActive(void);
+
+// Times the frame that just finished, which took frametime to make.
+void M_BenchmarkSample(precise_t frametime, boolean ranwipe);
+
+// Called when a demo ends. Starts the next one, or writes the report
+// and quits.
+void M_BenchmarkDemoDone(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // __M_BENCHMARK__
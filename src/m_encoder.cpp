@@ -0,0 +1,340 @@
+// DR. ROBOTNIK'S RING RACERS
+//-----------------------------------------------------------------------------
+// Copyright (C) 2024 by Kart Krew.
+//
+// This program is free software distributed under the
+// terms of the GNU General Public License, version 2.
+// See the 'LICENSE' file for more details.
+//-----------------------------------------------------------------------------
+/// \file  m_encoder.cpp
+/// \brief Screenshot and movie frame encoding thread
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <tracy/tracy/Tracy.hpp>
+
+#include "m_encoder.h"
+#include "doomdef.h"
+#include "console.h"
+#include "i_system.h"
+#include "m_argv.h"
+#include "core/thread_pool.h"
+
+namespace
+{
+
+struct Encoder
+{
+	std::mutex mutex;
+	std::condition_variable work; // a job was submitted, or it's time to quit
+	std::condition_variable done; // a job was encoded
+
+	// Submitted and not yet encoded, oldest first
+	encoderjob_t *pending = nullptr;
+	encoderjob_t **pendingtail = &pending;
+
+	// Encoded, waiting for M_EncoderUpdate to finish them, newest first
+	encoderjob_t *encoded = nullptr;
+
+	size_t inflight = 0; // submitted and not yet encoded
+	bool quit = false;
+
+#ifdef HAVE_THREADS
+	std::thread thread;
+
+	// Only touched by the encoder thread, see M_EncoderParallel
+	std::unique_ptr<srb2::ThreadPool> workers;
+	srb2::ThreadPool::Sema background;
+#endif
+
+	~Encoder();
+
+	void run();
+	void start();
+};
+
+// Counted on the game thread only
+struct EncoderStats
+{
+	size_t submitted;
+	size_t finished;
+	size_t dropped;
+	size_t waits; // screenshots that had to wait for the queue
+	size_t peak;
+	precise_t queued; // between submitting and starting to encode
+	precise_t encoding;
+	precise_t longest;
+};
+
+Encoder g_encoder;
+EncoderStats g_stats;
+
+void encode_job(encoderjob_t *job)
+{
+	ZoneScopedN("encode_job");
+
+	job->started = I_GetPreciseTime();
+	job->encode(job);
+	job->finished = I_GetPreciseTime();
+}
+
+Encoder::~Encoder()
+{
+#ifdef HAVE_THREADS
+	// Jobs still queued when the game quits get written all the same,
+	// so a screenshot taken right before quitting isn't lost
+	if (thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		work.notify_one();
+		thread.join();
+	}
+
+	if (workers)
+		workers->shutdown();
+#endif
+}
+
+void Encoder::run()
+{
+	tracy::SetThreadName("Encoder");
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	for (;;)
+	{
+		work.wait(lock, [this] { return pending != nullptr || quit; });
+
+		if (pending == nullptr)
+			break;
+
+		encoderjob_t *job = pending;
+		pending = job->next;
+		if (pending == nullptr)
+			pendingtail = &pending;
+
+		lock.unlock();
+		encode_job(job);
+		lock.lock();
+
+		job->next = encoded;
+		encoded = job;
+		inflight--;
+		done.notify_all();
+	}
+}
+
+void Encoder::start()
+{
+#ifdef HAVE_THREADS
+	if (!thread.joinable())
+		thread = std::thread([this] { run(); });
+#endif
+}
+
+void finish_jobs(encoderjob_t *job)
+{
+	encoderjob_t *next;
+	encoderjob_t *reversed = nullptr;
+
+	// Finish them in the order they were submitted
+	for (; job; job = next)
+	{
+		next = job->next;
+		job->next = reversed;
+		reversed = job;
+	}
+
+	for (job = reversed; job; job = next)
+	{
+		const precise_t encoding = job->finished - job->started;
+
+		next = job->next;
+
+		g_stats.finished++;
+		g_stats.queued += job->started - job->submitted;
+		g_stats.encoding += encoding;
+		g_stats.longest = std::max(g_stats.longest, encoding);
+
+		job->finish(job);
+	}
+}
+
+#ifdef HAVE_THREADS
+srb2::ThreadPool& encoder_workers()
+{
+	if (!g_encoder.workers)
+	{
+		if (M_CheckParm("-singlethreaded"))
+			g_encoder.workers = std::make_unique<srb2::ThreadPool>();
+		else
+		{
+			// Leave most of the machine to the game's own pool. The
+			// encoder thread works too while it waits.
+			const size_t count = std::clamp<size_t>(std::thread::hardware_concurrency() / 2, 1, 4);
+			g_encoder.workers = std::make_unique<srb2::ThreadPool>(count);
+		}
+	}
+
+	return *g_encoder.workers;
+}
+#endif
+
+double precise_ms(precise_t t)
+{
+	return (double)t * 1000.0 / (double)I_GetPrecisePrecision();
+}
+
+} // namespace
+
+void M_EncoderSubmit(encoderjob_t *job)
+{
+	job->next = nullptr;
+	job->submitted = I_GetPreciseTime();
+	g_stats.submitted++;
+
+#ifdef HAVE_THREADS
+	{
+		std::unique_lock<std::mutex> lock(g_encoder.mutex);
+
+		if (g_encoder.inflight >= (size_t)cv_encoder_queue.value)
+		{
+			ZoneScopedN("M_EncoderSubmit wait");
+
+			g_stats.waits++;
+			g_encoder.done.wait(lock, [] { return g_encoder.inflight < (size_t)cv_encoder_queue.value; });
+		}
+
+		*g_encoder.pendingtail = job;
+		g_encoder.pendingtail = &job->next;
+		g_encoder.inflight++;
+		g_stats.peak = std::max(g_stats.peak, g_encoder.inflight);
+	}
+
+	g_encoder.start();
+	g_encoder.work.notify_one();
+#else
+	encode_job(job);
+	job->next = g_encoder.encoded;
+	g_encoder.encoded = job;
+	g_stats.peak = std::max<size_t>(g_stats.peak, 1);
+#endif
+}
+
+boolean M_EncoderWantFrame(void)
+{
+	std::lock_guard<std::mutex> lock(g_encoder.mutex);
+
+	if (g_encoder.inflight < (size_t)cv_encoder_queue.value)
+		return true;
+
+	g_stats.dropped++;
+	return false;
+}
+
+void M_EncoderUpdate(void)
+{
+	encoderjob_t *encoded;
+
+	{
+		std::lock_guard<std::mutex> lock(g_encoder.mutex);
+		encoded = g_encoder.encoded;
+		g_encoder.encoded = nullptr;
+	}
+
+	finish_jobs(encoded);
+}
+
+void M_EncoderFlush(void)
+{
+	ZoneScoped;
+
+	{
+		std::unique_lock<std::mutex> lock(g_encoder.mutex);
+		g_encoder.done.wait(lock, [] { return g_encoder.inflight == 0; });
+	}
+
+	M_EncoderUpdate();
+}
+
+void Command_EncoderStats_f(void)
+{
+	size_t inflight;
+
+	{
+		std::lock_guard<std::mutex> lock(g_encoder.mutex);
+		inflight = g_encoder.inflight;
+	}
+
+	CONS_Printf("Encoder: %s jobs in flight (at most %d, peak %s)\n",
+		sizeu1(inflight), cv_encoder_queue.value, sizeu2(g_stats.peak));
+	CONS_Printf("%s submitted, %s done, %s movie frames dropped, %s screenshots waited for the queue\n",
+		sizeu1(g_stats.submitted), sizeu2(g_stats.finished), sizeu3(g_stats.dropped), sizeu4(g_stats.waits));
+
+	if (g_stats.finished)
+	{
+		CONS_Printf("Average encode %.3f ms (longest %.3f ms), average wait in queue %.3f ms\n",
+			precise_ms(g_stats.encoding) / (double)g_stats.finished, precise_ms(g_stats.longest),
+			precise_ms(g_stats.queued) / (double)g_stats.finished);
+	}
+
+	if (COM_Argc() > 1 && !stricmp(COM_Argv(1), "reset"))
+		g_stats = {};
+}
+
+void M_EncoderParallel(encodertask_t task, void *userdata, size_t count)
+{
+	ZoneScoped;
+
+#ifdef HAVE_THREADS
+	srb2::ThreadPool& pool = encoder_workers();
+
+	pool.begin_sema();
+	for (size_t i = 0; i < count; i++)
+		pool.schedule([task, userdata, i] { task(userdata, i); });
+	srb2::ThreadPool::Sema sema = pool.end_sema();
+
+	pool.notify_sema(sema);
+	pool.wait_sema(sema);
+#else
+	for (size_t i = 0; i < count; i++)
+		task(userdata, i);
+#endif
+}
+
+void M_EncoderBackground(encodertask_t task, void *userdata)
+{
+	M_EncoderWaitBackground();
+
+#ifdef HAVE_THREADS
+	srb2::ThreadPool& pool = encoder_workers();
+
+	pool.begin_sema();
+	pool.schedule([task, userdata] { task(userdata, 0); });
+	g_encoder.background = pool.end_sema();
+
+	pool.notify_sema(g_encoder.background);
+#else
+	task(userdata, 0);
+#endif
+}
+
+void M_EncoderWaitBackground(void)
+{
+#ifdef HAVE_THREADS
+	if (!g_encoder.workers)
+		return;
+
+	ZoneScoped;
+
+	g_encoder.workers->wait_sema(g_encoder.background);
+	g_encoder.background = {};
+#endif
+}
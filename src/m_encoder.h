@@ -0,0 +1,90 @@
+// DR. ROBOTNIK'S RING RACERS
+//-----------------------------------------------------------------------------
+// Copyright (C) 2024 by Kart Krew.
+//
+// This program is free software distributed under the
+// terms of the GNU General Public License, version 2.
+// See the 'LICENSE' file for more details.
+//-----------------------------------------------------------------------------
+/// \file  m_encoder.h
+/// \brief Screenshot and movie frame encoding thread
+
+#ifndef __M_ENCODER__
+#define __M_ENCODER__
+
+#include "doomtype.h"
+#include "command.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Compressing a screenshot or a movie frame takes long enough to show up
+// as a hitch, so the game thread only captures the pixels and hands them
+// to the encoder, which compresses and writes them on a thread of its
+// own, one job at a time and in the order they were submitted.
+//
+// Jobs own whatever they need. The encode callback runs on the encoder
+// thread and may only touch the job and the file it writes; anything
+// that has to go back to the game, like console messages, belongs in
+// finish, which M_EncoderUpdate runs on the game thread afterwards.
+//
+// At most encoder_queue jobs are in flight. Movie frames that come
+// while it's full are dropped (see M_EncoderWantFrame); screenshots
+// wait for a free slot instead.
+//
+
+typedef struct encoderjob_s encoderjob_t;
+
+struct encoderjob_s
+{
+	void (*encode)(encoderjob_t *job); // on the encoder thread
+	void (*finish)(encoderjob_t *job); // on the game thread; frees the job
+
+	// Filled in by the encoder
+	encoderjob_t *next;
+	precise_t submitted, started, finished;
+};
+
+extern consvar_t cv_encoder_queue;
+
+// Hands a job to the encoder, waiting for a free slot if the queue is full.
+void M_EncoderSubmit(encoderjob_t *job);
+
+// Returns whether a movie frame would fit in the queue right now. If it
+// wouldn't, the frame counts as dropped.
+boolean M_EncoderWantFrame(void);
+
+// Runs finish for every job the encoder is done with.
+void M_EncoderUpdate(void);
+
+// Waits for every job in flight, then runs their finish.
+void M_EncoderFlush(void);
+
+void Command_EncoderStats_f(void);
+
+//
+// An encode callback can split its work across the encoder's own worker
+// threads. These are only for the encoder thread: the workers' queues
+// take one producer, so the game thread's pool can't be used from here.
+//
+
+typedef void (*encodertask_t)(void *userdata, size_t part);
+
+// Runs task for every part from 0 to count-1 on the workers, and waits
+// for all of them.
+void M_EncoderParallel(encodertask_t task, void *userdata, size_t count);
+
+// Starts task on a worker and returns right away. There is only room for
+// one of these; starting another waits for the last one first.
+void M_EncoderBackground(encodertask_t task, void *userdata);
+
+// Waits for the task M_EncoderBackground started, if any.
+void M_EncoderWaitBackground(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // __M_ENCODER__
@@ -48,6 +48,7 @@
 #include "command.h" // cv_execversion
 
 #include "m_anigif.h"
+#include "m_encoder.h"
 #ifdef SRB2_CONFIG_ENABLE_WEBM_MOVIES
 #include "m_avrecorder.h"
 #include "m_avrecorder.hpp"
@@ -855,6 +856,16 @@ static void PNG_warn(png_structp PNG, png_const_charp pngtext)
 	CONS_Debug(DBG_RENDER, "libpng warning at %p: %s", (void*)PNG, pngtext);
 }
 
+#ifdef USE_PNG
+// Lets a PNG be given up on instead of bringing the game down, for PNGs
+// written on the encoder thread. Whoever calls libpng has to setjmp first.
+FUNCNORETURN static void PNG_errorjmp(png_structp PNG, png_const_charp pngtext)
+{
+	(void)pngtext;
+	longjmp(png_jmpbuf(PNG), 1);
+}
+#endif
+
 static void M_PNGhdr(png_structp png_ptr, png_infop png_info_ptr, PNG_CONST png_uint_32 width, PNG_CONST png_uint_32 height, PNG_CONST png_byte *palette)
 {
 	const png_byte png_interlace = PNG_INTERLACE_NONE; //PNG_INTERLACE_ADAM7
@@ -889,7 +900,77 @@ static void M_PNGhdr(png_structp png_ptr, png_infop png_info_ptr, PNG_CONST png_
 	}
 }
 
-static void M_PNGText(png_structp png_ptr, png_infop png_info_ptr, PNG_CONST png_byte movie)
+// What goes in a PNG besides the pixels, gathered on the game thread so
+// that the PNG itself can be written on the encoder thread.
+struct pngheader_t
+{
+	INT32 level, memory, strategy, window_bits; // zlib settings
+	char playertxt[MAXPLAYERNAME+1];
+	char rendermodetxt[9];
+	char lvlttltext[48];
+	char locationtxt[40];
+};
+
+static void M_PNGGetHeader(pngheader_t *header, boolean movie)
+{
+	if (movie)
+	{
+		header->level = cv_zlib_levela.value;
+		header->memory = cv_zlib_memorya.value;
+		header->strategy = cv_zlib_strategya.value;
+		header->window_bits = cv_zlib_window_bitsa.value;
+	}
+	else
+	{
+		header->level = cv_zlib_level.value;
+		header->memory = cv_zlib_memory.value;
+		header->strategy = cv_zlib_strategy.value;
+		header->window_bits = cv_zlib_window_bits.value;
+	}
+
+	strlcpy(header->playertxt, cv_playername[0].zstring, sizeof header->playertxt);
+
+	switch (rendermode)
+	{
+		case render_soft:
+			strcpy(header->rendermodetxt, "Software");
+			break;
+		case render_opengl:
+			strcpy(header->rendermodetxt, "OpenGL");
+			break;
+		default: // Just in case
+			strcpy(header->rendermodetxt, "None");
+			break;
+	}
+
+	if (gamestate == GS_LEVEL && mapheaderinfo[gamemap-1]->lvlttl[0] != '\0')
+		snprintf(header->lvlttltext, 48, "%s%s%s",
+			mapheaderinfo[gamemap-1]->lvlttl,
+			(mapheaderinfo[gamemap-1]->levelflags & LF_NOZONE) ? "" :
+			(mapheaderinfo[gamemap-1]->zonttl[0] != '\0') ? va(" %s",mapheaderinfo[gamemap-1]->zonttl) : " Zone",
+			(mapheaderinfo[gamemap-1]->actnum > 0) ? va(" %d",mapheaderinfo[gamemap-1]->actnum) : "");
+	else
+		snprintf(header->lvlttltext, 48, "Unknown");
+
+	if (gamestate == GS_LEVEL && players[g_localplayers[0]].mo)
+		snprintf(header->locationtxt, 40, "X:%d Y:%d Z:%d A:%d",
+			players[g_localplayers[0]].mo->x>>FRACBITS,
+			players[g_localplayers[0]].mo->y>>FRACBITS,
+			players[g_localplayers[0]].mo->z>>FRACBITS,
+			FixedInt(AngleFixed(players[g_localplayers[0]].mo->angle)));
+	else
+		snprintf(header->locationtxt, 40, "Unknown");
+}
+
+static void M_PNGCompression(png_structp png_ptr, const pngheader_t *header)
+{
+	png_set_compression_level(png_ptr, header->level);
+	png_set_compression_mem_level(png_ptr, header->memory);
+	png_set_compression_strategy(png_ptr, header->strategy);
+	png_set_compression_window_bits(png_ptr, header->window_bits);
+}
+
+static void M_PNGText(png_structp png_ptr, png_infop png_info_ptr, const pngheader_t *header, PNG_CONST png_byte movie)
 {
 #ifdef PNG_TEXT_SUPPORTED
 #define SRB2PNGTXT 11 //PNG_KEYWORD_MAX_LENGTH(79) is the max
@@ -898,7 +979,7 @@ static void M_PNGText(png_structp png_ptr, png_infop png_info_ptr, PNG_CONST png
 	"Title", "Description", "Playername", "Mapnum", "Mapname",
 	"Location", "Interface", "Render Mode", "Revision", "Build Date", "Build Time"};
 	char titletxt[] = "Dr. Robotnik's Ring Racers " VERSIONSTRING;
-	png_charp playertxt =  cv_playername[0].zstring;
+	char playertxt[MAXPLAYERNAME+1];
 	char desctxt[] = "Ring Racers Screenshot";
 	char Movietxt[] = "Ring Racers Movie";
 	size_t i;
@@ -916,18 +997,11 @@ static void M_PNGText(png_structp png_ptr, png_infop png_info_ptr, PNG_CONST png
 	char ctdate[40];
 	char cttime[40];
 
-	switch (rendermode)
-	{
-		case render_soft:
-			strcpy(rendermodetxt, "Software");
-			break;
-		case render_opengl:
-			strcpy(rendermodetxt, "OpenGL");
-			break;
-		default: // Just in case
-			strcpy(rendermodetxt, "None");
-			break;
-	}
+	// png_text wants them writable
+	strcpy(playertxt, header->playertxt);
+	strcpy(rendermodetxt, header->rendermodetxt);
+	strcpy(lvlttltext, header->lvlttltext);
+	strcpy(locationtxt, header->locationtxt);
 
 #if 0
 	if (gamestate == GS_LEVEL)
@@ -936,24 +1010,6 @@ static void M_PNGText(png_structp png_ptr, png_infop png_info_ptr, PNG_CONST png
 #endif
 		snprintf(maptext, 8, "Unknown");
 
-	if (gamestate == GS_LEVEL && mapheaderinfo[gamemap-1]->lvlttl[0] != '\0')
-		snprintf(lvlttltext, 48, "%s%s%s",
-			mapheaderinfo[gamemap-1]->lvlttl,
-			(mapheaderinfo[gamemap-1]->levelflags & LF_NOZONE) ? "" :
-			(mapheaderinfo[gamemap-1]->zonttl[0] != '\0') ? va(" %s",mapheaderinfo[gamemap-1]->zonttl) : " Zone",
-			(mapheaderinfo[gamemap-1]->actnum > 0) ? va(" %d",mapheaderinfo[gamemap-1]->actnum) : "");
-	else
-		snprintf(lvlttltext, 48, "Unknown");
-
-	if (gamestate == GS_LEVEL && players[g_localplayers[0]].mo)
-		snprintf(locationtxt, 40, "X:%d Y:%d Z:%d A:%d",
-			players[g_localplayers[0]].mo->x>>FRACBITS,
-			players[g_localplayers[0]].mo->y>>FRACBITS,
-			players[g_localplayers[0]].mo->z>>FRACBITS,
-			FixedInt(AngleFixed(players[g_localplayers[0]].mo->angle)));
-	else
-		snprintf(locationtxt, 40, "Unknown");
-
 	memset(png_infotext,0x00,sizeof (png_infotext));
 
 	for (i = 0; i < SRB2PNGTXT; i++)
@@ -998,7 +1054,12 @@ static png_structp apng_ptr = NULL;
 static png_infop   apng_info_ptr = NULL;
 static apng_infop  apng_ainfo_ptr = NULL;
 static png_FILE_p  apng_FILE = NULL;
-static png_uint_32 apng_frames = 0;
+static png_uint_32 apng_frames = 0; // handed to the encoder so far
+static png_uint_32 apng_skipped = 0; // tics since the last frame handed over
+static boolean apng_failed = false; // libpng gave up on the file
+static boolean apng_encodefailed = false; // same, but the encoder thread's copy
+static png_uint_16 apng_downscaleamt = 1;
+static png_uint_32 apng_width, apng_height; // of the screen, as M_SetupaPNG found it
 #ifdef PNG_STATIC // Win32 build have static libpng
 #define aPNG_set_acTL png_set_acTL
 #define aPNG_write_frame_head png_write_frame_head
@@ -1094,34 +1155,48 @@ static inline boolean M_PNGLib(void)
 #endif
 }
 
-static void M_PNGFrame(png_structp png_ptr, png_infop png_info_ptr, png_bytep png_buf)
+static void M_PNGFreeRows(png_bytepp row_pointers, png_uint_32 height)
 {
-	png_uint_16 downscale = apng_downscale ? vid.dupx : 1;
+	png_uint_32 y;
+
+	for (y = 0; y < height; y++)
+		free(row_pointers[y]);
+	free(row_pointers);
+}
+
+// Runs on the encoder thread. Returns false if libpng gave up on the file.
+static boolean M_PNGFrame(png_structp png_ptr, png_infop png_info_ptr, png_bytep png_buf, png_uint_16 framedelay)
+{
+	png_uint_16 downscale = apng_downscaleamt;
 
 	png_uint_32 pitch = png_get_rowbytes(png_ptr, png_info_ptr);
-	PNG_CONST png_uint_32 width = vid.width / downscale;
-	PNG_CONST png_uint_32 height = vid.height / downscale;
-	png_bytepp row_pointers = (png_bytepp) png_malloc(png_ptr, height * sizeof (png_bytep));
+	PNG_CONST png_uint_32 width = apng_width / downscale;
+	PNG_CONST png_uint_32 height = apng_height / downscale;
+	png_bytepp row_pointers = static_cast<png_bytepp>(calloc(height, sizeof (png_bytep)));
 	png_uint_32 x, y;
-	png_uint_16 framedelay = (png_uint_16)cv_apng_delay.value;
 
-	apng_frames++;
+	// Not png_malloc, which would call the error handler before the setjmp
+	if (!row_pointers)
+		return false;
 
 	for (y = 0; y < height; y++)
 	{
 		row_pointers[y] = (png_bytep) malloc(pitch * sizeof(png_byte));
+		if (!row_pointers[y])
+		{
+			M_PNGFreeRows(row_pointers, y);
+			return false;
+		}
 		for (x = 0; x < width; x++)
 			row_pointers[y][x] = png_buf[x * downscale];
 		png_buf += pitch * (downscale * downscale);
 	}
-		//for (x = 0; x < width; x++)
-		//{
-		//	printf("%d", x);
-		//	row_pointers[y][x] = 0;
-		//}
-	/*	row_pointers[y] = calloc(1, sizeof(png_bytep));
-		png_buf += pitch * 2;
-	}*/
+
+	if (setjmp(png_jmpbuf(png_ptr)))
+	{
+		M_PNGFreeRows(row_pointers, height);
+		return false;
+	}
 
 #ifndef PNG_STATIC
 	if (aPNG_write_frame_head)
@@ -1143,7 +1218,39 @@ static void M_PNGFrame(png_structp png_ptr, png_infop png_info_ptr, png_bytep pn
 #endif
 		aPNG_write_frame_tail(apng_ptr, apng_info_ptr);
 
-	png_free(png_ptr, (png_voidp)row_pointers);
+	M_PNGFreeRows(row_pointers, height);
+	return true;
+}
+
+// A frame captured for the aPNG being recorded, for the encoder to write
+struct apngframe_t
+{
+	encoderjob_t job;
+	UINT8 *linear; // from malloc
+	png_uint_16 delay;
+	boolean ret;
+};
+
+static void M_EncodeaPNGFrame(encoderjob_t *job)
+{
+	apngframe_t *frame = reinterpret_cast<apngframe_t*>(job);
+
+	// Once libpng has given up, the rest of the file can't be written
+	if (!apng_encodefailed)
+		apng_encodefailed = !M_PNGFrame(apng_ptr, apng_info_ptr, static_cast<png_bytep>(frame->linear), frame->delay);
+
+	frame->ret = !apng_encodefailed;
+}
+
+static void M_FinishaPNGFrame(encoderjob_t *job)
+{
+	apngframe_t *frame = reinterpret_cast<apngframe_t*>(job);
+
+	if (!frame->ret)
+		apng_failed = true; // M_LegacySaveFrame stops the movie
+
+	free(frame->linear);
+	Z_Free(frame);
 }
 
 static void M_PNGfix_acTL(png_structp png_ptr, png_infop png_info_ptr,
@@ -1158,11 +1265,15 @@ static void M_PNGfix_acTL(png_structp png_ptr, png_infop png_info_ptr,
 
 static boolean M_SetupaPNG(png_const_charp filename, png_bytep pal)
 {
+	pngheader_t header;
 	png_uint_16 downscale;
 
 	apng_downscale = (!!cv_apng_downscale.value);
 
 	downscale = apng_downscale ? vid.dupx : 1;
+	apng_downscaleamt = downscale;
+	apng_width = vid.width;
+	apng_height = vid.height;
 
 	apng_FILE = fopen(filename,"wb+"); // + mode for reading
 	if (!apng_FILE)
@@ -1172,7 +1283,7 @@ static boolean M_SetupaPNG(png_const_charp filename, png_bytep pal)
 	}
 
 	apng_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL,
-	 PNG_error, PNG_warn);
+	 PNG_errorjmp, PNG_warn);
 	if (!apng_ptr)
 	{
 		CONS_Debug(DBG_RENDER, "M_StartMovie: Error on initialize libpng\n");
@@ -1201,6 +1312,16 @@ static boolean M_SetupaPNG(png_const_charp filename, png_bytep pal)
 		return false;
 	}
 
+	if (setjmp(png_jmpbuf(apng_ptr)))
+	{
+		CONS_Debug(DBG_RENDER, "M_StartMovie: libpng write error on %s\n", filename);
+		png_destroy_write_struct(&apng_ptr, &apng_info_ptr);
+		fclose(apng_FILE);
+		apng_FILE = NULL;
+		remove(filename);
+		return false;
+	}
+
 	png_init_io(apng_ptr, apng_FILE);
 
 #ifdef PNG_SET_USER_LIMITS_SUPPORTED
@@ -1209,14 +1330,12 @@ static boolean M_SetupaPNG(png_const_charp filename, png_bytep pal)
 
 	//png_set_filter(apng_ptr, 0, PNG_ALL_FILTERS);
 
-	png_set_compression_level(apng_ptr, cv_zlib_levela.value);
-	png_set_compression_mem_level(apng_ptr, cv_zlib_memorya.value);
-	png_set_compression_strategy(apng_ptr, cv_zlib_strategya.value);
-	png_set_compression_window_bits(apng_ptr, cv_zlib_window_bitsa.value);
+	M_PNGGetHeader(&header, true);
+	M_PNGCompression(apng_ptr, &header);
 
 	M_PNGhdr(apng_ptr, apng_info_ptr, vid.width / downscale, vid.height / downscale, pal);
 
-	M_PNGText(apng_ptr, apng_info_ptr, true);
+	M_PNGText(apng_ptr, apng_info_ptr, &header, true);
 
 	apng_set_set_acTL_fn(apng_ptr, apng_ainfo_ptr, aPNG_set_acTL);
 
@@ -1225,6 +1344,8 @@ static boolean M_SetupaPNG(png_const_charp filename, png_bytep pal)
 	apng_write_info(apng_ptr, apng_info_ptr, apng_ainfo_ptr);
 
 	apng_frames = 0;
+	apng_skipped = 0;
+	apng_failed = apng_encodefailed = false;
 
 	return true;
 }
@@ -1436,27 +1557,49 @@ void M_LegacySaveFrame(void)
 #ifdef USE_APNG
 			{
 				UINT8 *linear = NULL;
+				apngframe_t *frame;
+
 				if (!apng_FILE) // should not happen!!
 				{
 					moviemode = MM_OFF;
 					return;
 				}
 
+				if (apng_failed)
+				{
+					M_StopMovie();
+					return;
+				}
+
+				// Tics skipped here add to the next frame's delay, like GIF_dropframe
+				apng_skipped++;
+
+				if ((UINT32)vid.width != apng_width || (UINT32)vid.height != apng_height || !M_EncoderWantFrame())
+					return;
+
 				if (rendermode == render_soft)
 				{
 					// munge planar buffer to linear
-					linear = screens[2];
-					I_ReadScreen(linear);
+					I_ReadScreen(screens[2]);
+					linear = static_cast<UINT8*>(malloc(vid.width * vid.height));
+					if (linear)
+						memcpy(linear, screens[2], vid.width * vid.height);
 				}
 #ifdef HWRENDER
 				else
 					linear = HWR_GetScreenshot();
 #endif
-				M_PNGFrame(apng_ptr, apng_info_ptr, (png_bytep)linear);
-#ifdef HWRENDER
-				if (rendermode != render_soft && linear)
-					free(linear);
-#endif
+				if (!linear)
+					return;
+
+				frame = static_cast<apngframe_t*>(Z_Calloc(sizeof (*frame), PU_STATIC, NULL));
+				frame->linear = linear;
+				frame->delay = (png_uint_16)std::min<UINT32>(cv_apng_delay.value * apng_skipped, UINT16_MAX);
+				apng_skipped = 0;
+				frame->job.encode = M_EncodeaPNGFrame;
+				frame->job.finish = M_FinishaPNGFrame;
+				apng_frames++;
+				M_EncoderSubmit(&frame->job);
 
 				if (apng_frames == PNG_UINT_31_MAX)
 				{
@@ -1555,17 +1698,27 @@ void M_StopMovie(void)
 			if (!apng_FILE)
 				return;
 
-			if (apng_frames)
+			M_EncoderFlush();
+
+			if (apng_frames && !apng_failed)
 			{
-				M_PNGfix_acTL(apng_ptr, apng_info_ptr, apng_ainfo_ptr);
-				apng_write_end(apng_ptr, apng_info_ptr, apng_ainfo_ptr);
+				if (setjmp(png_jmpbuf(apng_ptr)))
+					apng_failed = true;
+				else
+				{
+					M_PNGfix_acTL(apng_ptr, apng_info_ptr, apng_ainfo_ptr);
+					apng_write_end(apng_ptr, apng_info_ptr, apng_ainfo_ptr);
+				}
 			}
 
 			png_destroy_write_struct(&apng_ptr, &apng_info_ptr);
 
 			fclose(apng_FILE);
 			apng_FILE = NULL;
-			CONS_Printf("aPNG closed; wrote %u frames\n", (UINT32)apng_frames);
+			if (apng_failed)
+				CONS_Alert(CONS_ERROR, "Couldn't write the aPNG; stopped after %u frames\n", (UINT32)apng_frames);
+			else
+				CONS_Printf("aPNG closed; wrote %u frames\n", (UINT32)apng_frames);
 			apng_frames = 0;
 			break;
 #else
@@ -1590,16 +1743,21 @@ void M_StopMovie(void)
 //                            SCREEN SHOTS
 // ==========================================================================
 #ifdef USE_PNG
-/** Writes a PNG file to disk.
+/** Writes a PNG to a file that is already open, and closes it.
   *
-  * \param filename Filename to write to.
-  * \param data     The image data.
-  * \param width    Width of the picture.
-  * \param height   Height of the picture.
-  * \param palette  Palette of image data.
+  * \param png_FILE  File to write to.
+  * \param filename  Its name, to remove it again if writing fails.
+  * \param data      The image data.
+  * \param width     Width of the picture.
+  * \param height    Height of the picture.
+  * \param palette   Palette of image data.
+  * \param header    From M_PNGGetHeader.
+  * \param error_fn  libpng error handler.
+  * \param warn_fn   libpng warning handler.
   *  \note if palette is NULL, BGR888 format
   */
-boolean M_SavePNG(const char *filename, const void *data, int width, int height, const UINT8 *palette)
+static boolean M_WritePNG(png_FILE_p png_FILE, const char *filename, const void *data, int width, int height, const UINT8 *palette,
+	const pngheader_t *header, png_error_ptr error_fn, png_error_ptr warn_fn)
 {
 	png_structp png_ptr;
 	png_infop png_info_ptr;
@@ -1608,19 +1766,10 @@ boolean M_SavePNG(const char *filename, const void *data, int width, int height,
 	jmp_buf jmpbuf;
 #endif
 #endif
-	png_FILE_p png_FILE;
-
-	png_FILE = fopen(filename,"wb");
-	if (!png_FILE)
-	{
-		CONS_Debug(DBG_RENDER, "M_SavePNG: Error on opening %s for write\n", filename);
-		return false;
-	}
 
-	png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, PNG_error, PNG_warn);
+	png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, error_fn, warn_fn);
 	if (!png_ptr)
 	{
-		CONS_Debug(DBG_RENDER, "M_SavePNG: Error on initialize libpng\n");
 		fclose(png_FILE);
 		remove(filename);
 		return false;
@@ -1629,7 +1778,6 @@ boolean M_SavePNG(const char *filename, const void *data, int width, int height,
 	png_info_ptr = png_create_info_struct(png_ptr);
 	if (!png_info_ptr)
 	{
-		CONS_Debug(DBG_RENDER, "M_SavePNG: Error on allocate for libpng\n");
 		png_destroy_write_struct(&png_ptr,  NULL);
 		fclose(png_FILE);
 		remove(filename);
@@ -1659,14 +1807,11 @@ boolean M_SavePNG(const char *filename, const void *data, int width, int height,
 
 	//png_set_filter(png_ptr, 0, PNG_ALL_FILTERS);
 
-	png_set_compression_level(png_ptr, cv_zlib_level.value);
-	png_set_compression_mem_level(png_ptr, cv_zlib_memory.value);
-	png_set_compression_strategy(png_ptr, cv_zlib_strategy.value);
-	png_set_compression_window_bits(png_ptr, cv_zlib_window_bits.value);
+	M_PNGCompression(png_ptr, header);
 
 	M_PNGhdr(png_ptr, png_info_ptr, width, height, palette);
 
-	M_PNGText(png_ptr, png_info_ptr, false);
+	M_PNGText(png_ptr, png_info_ptr, header, false);
 
 	png_write_info(png_ptr, png_info_ptr);
 
@@ -1678,6 +1823,38 @@ boolean M_SavePNG(const char *filename, const void *data, int width, int height,
 	fclose(png_FILE);
 	return true;
 }
+
+/** Writes a PNG file to disk.
+  *
+  * \param filename Filename to write to.
+  * \param data     The image data.
+  * \param width    Width of the picture.
+  * \param height   Height of the picture.
+  * \param palette  Palette of image data.
+  *  \note if palette is NULL, BGR888 format
+  */
+boolean M_SavePNG(const char *filename, const void *data, int width, int height, const UINT8 *palette)
+{
+	pngheader_t header;
+	png_FILE_p png_FILE;
+
+	png_FILE = fopen(filename,"wb");
+	if (!png_FILE)
+	{
+		CONS_Debug(DBG_RENDER, "M_SavePNG: Error on opening %s for write\n", filename);
+		return false;
+	}
+
+	M_PNGGetHeader(&header, false);
+
+	if (!M_WritePNG(png_FILE, filename, data, width, height, palette, &header, PNG_error, PNG_warn))
+	{
+		CONS_Debug(DBG_RENDER, "M_SavePNG: Error on writing %s\n", filename);
+		return false;
+	}
+
+	return true;
+}
 #else
 /** PCX file structure.
   */
@@ -1784,10 +1961,100 @@ void M_DoLegacyGLScreenShot(void)
 	M_DoScreenShot(vid.width, vid.height, tcb::span(fake_data, vid.width * vid.height));
 }
 
+// Reports how a screenshot went.
+static void M_ScreenShotDone(boolean ret, const char *freename, const char *pathname)
+{
+	if (ret)
+	{
+		if (moviemode != MM_SCREENSHOT)
+			CONS_Printf(M_GetText("Screen shot %s saved in %s\n"), freename, pathname);
+	}
+	else
+	{
+		if (freename)
+			CONS_Alert(CONS_ERROR, M_GetText("Couldn't create screen shot %s in %s\n"), freename, pathname);
+		else
+			CONS_Alert(CONS_ERROR, M_GetText("Couldn't create screen shot in %s (all 10000 slots used!)\n"), pathname);
+
+		if (moviemode == MM_SCREENSHOT)
+			M_StopMovie();
+	}
+}
+
+#if NUMSCREENS > 2 && defined (USE_PNG)
+// A screenshot captured on the game thread, for the encoder to write
+struct screenshotjob_t
+{
+	encoderjob_t job;
+	png_FILE_p file; // opened up front, so the next screenshot picks another name
+	char filename[MAX_WADPATH+20];
+	char pathname[MAX_WADPATH];
+	char freename[20];
+	UINT8 *linear; // RGB888, from malloc
+	UINT32 width, height;
+	pngheader_t header;
+	boolean ret;
+};
+
+static void M_EncodeScreenShot(encoderjob_t *job)
+{
+	screenshotjob_t *shot = reinterpret_cast<screenshotjob_t*>(job);
+
+	shot->ret = M_WritePNG(shot->file, shot->filename, shot->linear, shot->width, shot->height, NULL,
+		&shot->header, PNG_errorjmp, NULL);
+}
+
+static void M_FinishScreenShot(encoderjob_t *job)
+{
+	screenshotjob_t *shot = reinterpret_cast<screenshotjob_t*>(job);
+
+	M_ScreenShotDone(shot->ret, shot->freename, shot->pathname);
+
+	free(shot->linear);
+	Z_Free(shot);
+}
+
+// Hands a screenshot to the encoder, which takes linear.
+static boolean M_SubmitScreenShot(const char *pathname, const char *freename, UINT8 *linear, UINT32 width, UINT32 height)
+{
+	screenshotjob_t *shot;
+	png_FILE_p file;
+
+	if (!linear)
+		return false;
+
+	file = fopen(va(pandf,pathname,freename), "wb");
+	if (!file)
+	{
+		CONS_Debug(DBG_RENDER, "M_DoScreenShot: Error on opening %s for write\n", va(pandf,pathname,freename));
+		free(linear);
+		return false;
+	}
+
+	shot = static_cast<screenshotjob_t*>(Z_Calloc(sizeof (*shot), PU_STATIC, NULL));
+	shot->job.encode = M_EncodeScreenShot;
+	shot->job.finish = M_FinishScreenShot;
+	shot->file = file;
+	snprintf(shot->filename, sizeof shot->filename, pandf, pathname, freename);
+	strlcpy(shot->pathname, pathname, sizeof shot->pathname);
+	strlcpy(shot->freename, freename, sizeof shot->freename);
+	shot->linear = linear;
+	shot->width = width;
+	shot->height = height;
+	M_PNGGetHeader(&shot->header, false);
+
+	M_EncoderSubmit(&shot->job);
+	return true;
+}
+#endif
+
 /** Takes a screenshot.
   * The screenshot is saved as "srb2xxxx.png" where xxxx is the lowest
   * four-digit number for which a file does not already exist.
   *
+  * PNGs are written by the encoder thread, which reports back once it's
+  * done; see m_encoder.h.
+  *
   * \sa HWR_ScreenShot
   */
 void M_DoScreenShot(UINT32 width, UINT32 height, tcb::span<const std::byte> data)
@@ -1804,6 +2071,13 @@ void M_DoScreenShot(UINT32 width, UINT32 height, tcb::span<const std::byte> data
 	if (rendermode == render_none)
 		return;
 
+#ifdef USE_PNG
+	// In movie mode, screenshots are movie frames, and get dropped like
+	// them when the encoder falls behind
+	if (moviemode == MM_SCREENSHOT && !M_EncoderWantFrame())
+		return;
+#endif
+
 	strcpy(pathname, srb2home);
 	strcat(pathname, PATHSEP "media" PATHSEP "screenshots" PATHSEP);
 	M_MkdirEach(pathname, M_PathParts(pathname) - 2, 0755);
@@ -1820,6 +2094,29 @@ void M_DoScreenShot(UINT32 width, UINT32 height, tcb::span<const std::byte> data
 	if (!freename)
 		goto failure;
 
+#ifdef USE_PNG
+	{
+		UINT8 *linear;
+
+#ifdef HWRENDER
+		if (rendermode == render_opengl)
+		{
+			linear = HWR_GetScreenshot();
+			width = vid.width;
+			height = vid.height;
+		}
+		else
+#endif
+		{
+			linear = static_cast<UINT8*>(malloc(data.size_bytes()));
+			if (linear)
+				memcpy(linear, data.data(), data.size_bytes());
+		}
+
+		if (M_SubmitScreenShot(pathname, freename, linear, width, height))
+			return; // M_FinishScreenShot reports back
+	}
+#else
 	// save the pcx file
 #ifdef HWRENDER
 	if (rendermode == render_opengl)
@@ -1827,30 +2124,12 @@ void M_DoScreenShot(UINT32 width, UINT32 height, tcb::span<const std::byte> data
 	else
 #endif
 	{
-		const void* pixel_data = static_cast<const void*>(data.data());
-#ifdef USE_PNG
-		ret = M_SavePNG(va(pandf,pathname,freename), pixel_data, width, height, NULL);
-#else
 		ret = WritePCXfile(va(pandf,pathname,freename), linear, vid.width, vid.height, screenshot_palette);
-#endif
 	}
+#endif
 
 failure:
-	if (ret)
-	{
-		if (moviemode != MM_SCREENSHOT)
-			CONS_Printf(M_GetText("Screen shot %s saved in %s\n"), freename, pathname);
-	}
-	else
-	{
-		if (freename)
-			CONS_Alert(CONS_ERROR, M_GetText("Couldn't create screen shot %s in %s\n"), freename, pathname);
-		else
-			CONS_Alert(CONS_ERROR, M_GetText("Couldn't create screen shot in %s (all 10000 slots used!)\n"), pathname);
-
-		if (moviemode == MM_SCREENSHOT)
-			M_StopMovie();
-	}
+	M_ScreenShotDone(ret, freename, pathname);
 #endif
 }
 
@@ -1858,6 +2137,8 @@ void M_ScreenshotTicker(void)
 {
 	const UINT8 pid = 0; // TODO: should splitscreen players be allowed to use this too?
 
+	M_EncoderUpdate();
+
 	if (M_MenuButtonPressed(pid, MBT_SCREENSHOT))
 	{
 		M_ScreenShot();
@@ -2296,183 +2577,193 @@ UINT32 M_GetTokenPos(void)
 }
 
 #define NUMTOKENS 2
-static const char *tokenizerInput = NULL;
+static tokenizer_t tokenizer;
 static UINT32 tokenCapacity[NUMTOKENS] = {0};
 static char *tokenizerToken[NUMTOKENS] = {NULL};
-static UINT32 tokenizerStartPos = 0;
-static UINT32 tokenizerEndPos = 0;
-static UINT32 tokenizerInputLength = 0;
-static UINT8 tokenizerInComment = 0; // 0 = not in comment, 1 = // Single-line, 2 = /* Multi-line */
-static boolean tokenizerIsString = false; // did we strip quotes from this token?
+
+void M_TokenizerInit(tokenizer_t *t, const char *inputString, size_t inputLength)
+{
+	t->input = inputString;
+	t->inputLength = inputLength;
+	t->startPos = 0;
+	t->endPos = 0;
+	t->inComment = 0;
+	t->isString = false;
+}
 
 void M_TokenizerOpen(const char *inputString, size_t inputLength)
 {
 	size_t i;
 
-	tokenizerInput = inputString;
+	M_TokenizerInit(&tokenizer, inputString, inputLength);
 	for (i = 0; i < NUMTOKENS; i++)
 	{
 		tokenCapacity[i] = 1024;
 		tokenizerToken[i] = (char*)Z_Malloc(tokenCapacity[i] * sizeof(char), PU_STATIC, NULL);
 	}
-	tokenizerInputLength = inputLength;
 }
 
 void M_TokenizerClose(void)
 {
 	size_t i;
 
-	tokenizerInput = NULL;
 	for (i = 0; i < NUMTOKENS; i++)
 		Z_Free(tokenizerToken[i]);
-	tokenizerStartPos = 0;
-	tokenizerEndPos = 0;
-	tokenizerInComment = 0;
-	tokenizerIsString = false;
+	M_TokenizerInit(&tokenizer, NULL, 0);
 }
 
-static void M_DetectComment(UINT32 *pos)
+static void M_DetectComment(tokenizer_t *t, UINT32 *pos)
 {
-	if (tokenizerInComment)
+	if (t->inComment)
 		return;
 
-	if (*pos >= tokenizerInputLength - 1)
+	if (*pos >= t->inputLength - 1)
 		return;
 
-	if (tokenizerInput[*pos] != '/')
+	if (t->input[*pos] != '/')
 		return;
 
 	//Single-line comment start
-	if (tokenizerInput[*pos + 1] == '/')
-		tokenizerInComment = 1;
+	if (t->input[*pos + 1] == '/')
+		t->inComment = 1;
 	//Multi-line comment start
-	else if (tokenizerInput[*pos + 1] == '*')
-		tokenizerInComment = 2;
+	else if (t->input[*pos + 1] == '*')
+		t->inComment = 2;
 }
 
-static void M_ReadTokenString(UINT32 i)
+boolean M_TokenizerNext(tokenizer_t *t)
 {
-	UINT32 tokenLength = tokenizerEndPos - tokenizerStartPos;
-	if (tokenLength + 1 > tokenCapacity[i])
-	{
-		tokenCapacity[i] = tokenLength + 1;
-		// Assign the memory. Don't forget an extra byte for the end of the string!
-		tokenizerToken[i] = (char *)Z_Malloc(tokenCapacity[i] * sizeof(char), PU_STATIC, NULL);
-	}
+	const char *input = t->input;
 
-	// Copy the string.
-	M_Memcpy(tokenizerToken[i], tokenizerInput + tokenizerStartPos, (size_t)tokenLength);
-
-	// Make the final character NUL.
-	tokenizerToken[i][tokenLength] = '\0';
-}
-
-const char *M_TokenizerRead(UINT32 i)
-{
-	if (!tokenizerInput)
-		return NULL;
+	if (!input)
+		return false;
 
-	tokenizerStartPos = tokenizerEndPos;
+	t->startPos = t->endPos;
 
 	// Reset string flag
-	tokenizerIsString = false;
+	t->isString = false;
 
 	// Try to detect comments now, in case we're pointing right at one
-	M_DetectComment(&tokenizerStartPos);
+	M_DetectComment(t, &t->startPos);
 
 	// Find the first non-whitespace char, or else the end of the string trying
-	while ((tokenizerInput[tokenizerStartPos] == ' '
-			|| tokenizerInput[tokenizerStartPos] == '\t'
-			|| tokenizerInput[tokenizerStartPos] == '\r'
-			|| tokenizerInput[tokenizerStartPos] == '\n'
-			|| tokenizerInput[tokenizerStartPos] == '\0'
-			|| tokenizerInput[tokenizerStartPos] == '=' || tokenizerInput[tokenizerStartPos] == ';' // UDMF TEXTMAP.
-			|| tokenizerInComment != 0)
-			&& tokenizerStartPos < tokenizerInputLength)
+	while ((input[t->startPos] == ' '
+			|| input[t->startPos] == '\t'
+			|| input[t->startPos] == '\r'
+			|| input[t->startPos] == '\n'
+			|| input[t->startPos] == '\0'
+			|| input[t->startPos] == '=' || input[t->startPos] == ';' // UDMF TEXTMAP.
+			|| t->inComment != 0)
+			&& t->startPos < t->inputLength)
 	{
 		// Try to detect comment endings now
-		if (tokenizerInComment == 1	&& tokenizerInput[tokenizerStartPos] == '\n')
-			tokenizerInComment = 0; // End of line for a single-line comment
-		else if (tokenizerInComment == 2
-			&& tokenizerStartPos < tokenizerInputLength - 1
-			&& tokenizerInput[tokenizerStartPos] == '*'
-			&& tokenizerInput[tokenizerStartPos+1] == '/')
+		if (t->inComment == 1	&& input[t->startPos] == '\n')
+			t->inComment = 0; // End of line for a single-line comment
+		else if (t->inComment == 2
+			&& t->startPos < t->inputLength - 1
+			&& input[t->startPos] == '*'
+			&& input[t->startPos+1] == '/')
 		{
 			// End of multi-line comment
-			tokenizerInComment = 0;
-			tokenizerStartPos++; // Make damn well sure we're out of the comment ending at the end of it all
+			t->inComment = 0;
+			t->startPos++; // Make damn well sure we're out of the comment ending at the end of it all
 		}
 
-		tokenizerStartPos++;
-		M_DetectComment(&tokenizerStartPos);
+		t->startPos++;
+		M_DetectComment(t, &t->startPos);
 	}
 
 	// If the end of the string is reached, no token is to be read
-	if (tokenizerStartPos == tokenizerInputLength) {
-		tokenizerEndPos = tokenizerInputLength;
-		return NULL;
+	if (t->startPos == t->inputLength) {
+		t->endPos = t->inputLength;
+		return false;
 	}
 	// Else, if it's one of these three symbols, capture only this one character
-	else if (tokenizerInput[tokenizerStartPos] == ','
-			|| tokenizerInput[tokenizerStartPos] == '{'
-			|| tokenizerInput[tokenizerStartPos] == '}')
+	else if (input[t->startPos] == ','
+			|| input[t->startPos] == '{'
+			|| input[t->startPos] == '}')
 	{
-		tokenizerEndPos = tokenizerStartPos + 1;
-		tokenizerToken[i][0] = tokenizerInput[tokenizerStartPos];
-		tokenizerToken[i][1] = '\0';
-		return tokenizerToken[i];
+		t->endPos = t->startPos + 1;
+		t->tokenLength = 1;
+		return true;
 	}
 	// Return entire string within quotes, except without the quotes.
-	else if (tokenizerInput[tokenizerStartPos] == '"')
+	else if (input[t->startPos] == '"')
 	{
-		tokenizerEndPos = ++tokenizerStartPos;
-		while (tokenizerInput[tokenizerEndPos] != '"' && tokenizerEndPos < tokenizerInputLength)
-			tokenizerEndPos++;
+		t->endPos = ++t->startPos;
+		while (input[t->endPos] != '"' && t->endPos < t->inputLength)
+			t->endPos++;
 
-		M_ReadTokenString(i);
-		tokenizerEndPos++;
+		t->tokenLength = t->endPos - t->startPos;
+		t->endPos++;
 
 		// Tell us the the token was a string.
-		tokenizerIsString = true;
+		t->isString = true;
 
-		return tokenizerToken[i];
+		return true;
 	}
 
 	// Now find the end of the token. This includes several additional characters that are okay to capture as one character, but not trailing at the end of another token.
-	tokenizerEndPos = tokenizerStartPos + 1;
-	while ((tokenizerInput[tokenizerEndPos] != ' '
-			&& tokenizerInput[tokenizerEndPos] != '\t'
-			&& tokenizerInput[tokenizerEndPos] != '\r'
-			&& tokenizerInput[tokenizerEndPos] != '\n'
-			&& tokenizerInput[tokenizerEndPos] != ','
-			&& tokenizerInput[tokenizerEndPos] != '{'
-			&& tokenizerInput[tokenizerEndPos] != '}'
-			&& tokenizerInput[tokenizerEndPos] != '=' && tokenizerInput[tokenizerEndPos] != ';' // UDMF TEXTMAP.
-			&& tokenizerInComment == 0)
-			&& tokenizerEndPos < tokenizerInputLength)
-	{
-		tokenizerEndPos++;
+	t->endPos = t->startPos + 1;
+	while ((input[t->endPos] != ' '
+			&& input[t->endPos] != '\t'
+			&& input[t->endPos] != '\r'
+			&& input[t->endPos] != '\n'
+			&& input[t->endPos] != ','
+			&& input[t->endPos] != '{'
+			&& input[t->endPos] != '}'
+			&& input[t->endPos] != '=' && input[t->endPos] != ';' // UDMF TEXTMAP.
+			&& t->inComment == 0)
+			&& t->endPos < t->inputLength)
+	{
+		t->endPos++;
 		// Try to detect comment starts now; if it's in a comment, we don't want it in this token
-		M_DetectComment(&tokenizerEndPos);
+		M_DetectComment(t, &t->endPos);
+	}
+
+	t->tokenLength = t->endPos - t->startPos;
+	return true;
+}
+
+static void M_ReadTokenString(UINT32 i)
+{
+	UINT32 tokenLength = tokenizer.tokenLength;
+	if (tokenLength + 1 > tokenCapacity[i])
+	{
+		tokenCapacity[i] = tokenLength + 1;
+		// Assign the memory. Don't forget an extra byte for the end of the string!
+		tokenizerToken[i] = (char *)Z_Malloc(tokenCapacity[i] * sizeof(char), PU_STATIC, NULL);
 	}
 
+	// Copy the string.
+	M_Memcpy(tokenizerToken[i], tokenizer.input + tokenizer.startPos, (size_t)tokenLength);
+
+	// Make the final character NUL.
+	tokenizerToken[i][tokenLength] = '\0';
+}
+
+const char *M_TokenizerRead(UINT32 i)
+{
+	if (!M_TokenizerNext(&tokenizer))
+		return NULL;
+
 	M_ReadTokenString(i);
 	return tokenizerToken[i];
 }
 
 UINT32 M_TokenizerGetEndPos(void)
 {
-	return tokenizerEndPos;
+	return tokenizer.endPos;
 }
 
 void M_TokenizerSetEndPos(UINT32 newPos)
 {
-	tokenizerEndPos = newPos;
+	tokenizer.endPos = newPos;
 }
 
 boolean M_TokenizerJustReadString(void)
 {
-	return tokenizerIsString;
+	return tokenizer.isString;
 }
 
 /** Count bits in a number.
@@ -20,6 +20,12 @@
 #include "z_zone.h"
 #include "p_local.h"
 #include "g_game.h"
+#include "byteptr.h"
+#include "console.h"
+#include "d_main.h"
+#include "d_net.h"
+#include "m_misc.h"
+#include "core/instrument.h"
 
 #ifdef HWRENDER
 #include "hardware/hw_main.h"
@@ -490,6 +496,54 @@ static void M_DrawTickStats(void)
 	M_DrawPerfCount(&misc_calls_col);
 }
 
+// Everything counted through core/instrument.h, worker threads included.
+static void M_DrawInstrumentStats(void)
+{
+	const boolean hires = M_HighResolution();
+	const size_t count = I_InstrumentNumCounters();
+	instrumentstat_t stat;
+	size_t i;
+	int x = 20;
+	int y = 10;
+
+	for (i = 0; i < count; i++)
+	{
+		const char *text;
+
+		I_InstrumentStat(i, &stat);
+
+		if (i == 0 && !stat.calls)
+			continue; // counters all fit
+
+		if (stat.timer)
+		{
+			text = va("%s: %d (%u calls, %d threads)", stat.name,
+				(int)(stat.value * 1000000 / I_GetPrecisePrecision()), stat.calls, stat.threads);
+		}
+		else
+			text = va("%s: %u", stat.name, (UINT32)stat.value);
+
+		if (hires)
+		{
+			V_DrawSmallString(x, y, V_MONOSPACE | (stat.timer ? V_YELLOWMAP : V_BLUEMAP), text);
+			y += 5;
+		}
+		else
+		{
+			V_DrawThinString(x, y, V_MONOSPACE | (stat.timer ? V_YELLOWMAP : V_BLUEMAP), text);
+			y += 8;
+		}
+
+		if (y > 192)
+		{
+			y = 10;
+			x += 150;
+			if (x > 200)
+				break;
+		}
+	}
+}
+
 void M_DrawPerfStats(void)
 {
 	char s[363];
@@ -504,6 +558,10 @@ void M_DrawPerfStats(void)
 	{
 		M_DrawTickStats();
 	}
+	else if (cv_perfstats.value == PS_INSTRUMENT) // instrumented
+	{
+		M_DrawInstrumentStats();
+	}
 	else if (cv_perfstats.value == PS_BOT) // bot ticcmd
 	{
 		if (vid.width < 640 || vid.height < 400) // low resolution
@@ -704,3 +762,321 @@ void M_DrawPerfStats(void)
 		}
 	}
 }
+
+//
+// Recording
+//
+// Nobody watches the overlay on a dedicated server, so perfstats_record
+// writes what it measures for every tic to a ring file in the home
+// folder instead, to look back at once a hitch has been reported. The
+// file holds the last perfstats_recordlength seconds, and what was
+// recorded before the game started again is kept as perfstats.old.bin.
+// perfstats_export turns either into CSV.
+//
+// The file is a header, with the names of the fields so older files
+// still read, then a record per tic of one UINT32 per field. Times are
+// in microseconds.
+//
+
+#define PERFRECORDFILE "perfstats.bin"
+#define PERFRECORDOLDFILE "perfstats.old.bin"
+#define PERFRECORDHEADER "RRPERF"
+#define PERFRECORDHEADERLEN 6
+#define PERFRECORDVERSION 1
+#define PERFRECORDNAMELEN 16
+
+typedef enum
+{
+	PR_GAMETIC,
+	PR_LEVELTIME,
+	PR_MAP,
+	PR_PLAYERS,
+	PR_TIC,
+	PR_PLAYERTHINK,
+	PR_THINKERS,
+	PR_POLYOBJ,
+	PR_MAIN,
+	PR_MOBJ,
+	PR_DYNSLOPE,
+	PR_LUATHINKFRAME,
+	PR_LUAMOBJHOOKS,
+	PR_CHECKPOSITION,
+	PR_ACS,
+	PR_BOTS,
+	PR_SENDBPS,
+	PR_GETBPS,
+	PR_ZONE,
+	NUMPERFRECORDFIELDS
+} perfrecordfield_t;
+
+static const char *const perfrecordnames[NUMPERFRECORDFIELDS] = {
+	"gametic",
+	"leveltime",
+	"map",
+	"players",
+	"tic_us",
+	"playerthink_us",
+	"thinkers_us",
+	"polyobj_us",
+	"main_us",
+	"mobj_us",
+	"dynslope_us",
+	"luathinkframe_us",
+	"luamobjhooks",
+	"checkposition",
+	"acs_us",
+	"bots_us",
+	"sendbps",
+	"getbps",
+	"zone_kb",
+};
+
+// Where the count and next slot are, in the header
+#define PERFRECORDCOUNTOFS (PERFRECORDHEADERLEN + 2 + 2 + 4)
+#define PERFRECORDHEADERSIZE(numfields) (PERFRECORDCOUNTOFS + 4 + 4 + (numfields) * PERFRECORDNAMELEN)
+
+static FILE *perfrecordfile;
+static UINT32 perfrecordcapacity; // in tics
+static UINT32 perfrecordcount;
+static UINT32 perfrecordnext; // slot the next tic goes in
+static UINT32 perfrecordunflushed;
+
+static UINT32 PS_Microseconds(precise_t t)
+{
+	return (UINT32)(t * 1000000 / I_GetPrecisePrecision());
+}
+
+static void PS_FlushRecording(void)
+{
+	UINT8 header[8], *p = header;
+
+	WRITEUINT32(p, perfrecordcount);
+	WRITEUINT32(p, perfrecordnext);
+
+	fseek(perfrecordfile, PERFRECORDCOUNTOFS, SEEK_SET);
+	fwrite(header, 1, p - header, perfrecordfile);
+	fflush(perfrecordfile);
+
+	perfrecordunflushed = 0;
+}
+
+static void PS_StopRecording(void)
+{
+	if (!perfrecordfile)
+		return;
+
+	PS_FlushRecording();
+	fclose(perfrecordfile);
+	perfrecordfile = NULL;
+}
+
+static void PS_StartRecording(void)
+{
+	static boolean exitfunc = false;
+	UINT8 header[PERFRECORDHEADERSIZE(NUMPERFRECORDFIELDS)], *p = header;
+	const char *path = va("%s" PATHSEP PERFRECORDFILE, srb2home);
+	int i;
+
+	if (perfrecordfile)
+		return;
+
+	// Keep what the last session recorded, in case that's what's being
+	// looked into
+	if (FIL_FileExists(path))
+	{
+		char *old = Z_StrDup(va("%s" PATHSEP PERFRECORDOLDFILE, srb2home));
+
+		remove(old);
+		rename(path, old);
+		Z_Free(old);
+	}
+
+	perfrecordfile = fopen(path, "w+b");
+	if (!perfrecordfile)
+	{
+		CONS_Alert(CONS_ERROR, "Couldn't open %s for recording perfstats\n", path);
+		return;
+	}
+
+	perfrecordcapacity = cv_perfstats_recordlength.value * TICRATE;
+	perfrecordcount = perfrecordnext = perfrecordunflushed = 0;
+
+	WRITEMEM(p, PERFRECORDHEADER, PERFRECORDHEADERLEN);
+	WRITEUINT16(p, PERFRECORDVERSION);
+	WRITEUINT16(p, NUMPERFRECORDFIELDS);
+	WRITEUINT32(p, perfrecordcapacity);
+	WRITEUINT32(p, perfrecordcount);
+	WRITEUINT32(p, perfrecordnext);
+	for (i = 0; i < NUMPERFRECORDFIELDS; i++)
+	{
+		char name[PERFRECORDNAMELEN] = {0};
+
+		strlcpy(name, perfrecordnames[i], sizeof name);
+		WRITEMEM(p, name, PERFRECORDNAMELEN);
+	}
+
+	fwrite(header, 1, p - header, perfrecordfile);
+	fflush(perfrecordfile);
+
+	if (!exitfunc)
+	{
+		I_AddExitFunc(PS_StopRecording);
+		exitfunc = true;
+	}
+
+	CONS_Printf("Recording perfstats to %s\n", path);
+}
+
+void PS_Record_OnChange(void)
+{
+	if (cv_perfstats_record.value)
+		PS_StartRecording();
+	else
+		PS_StopRecording();
+}
+
+void PS_RecordTic(void)
+{
+	UINT32 fields[NUMPERFRECORDFIELDS];
+	UINT8 record[NUMPERFRECORDFIELDS * 4], *p = record;
+	int i;
+
+	if (!perfrecordfile)
+		return;
+
+	fields[PR_GAMETIC] = gametic;
+	fields[PR_LEVELTIME] = leveltime;
+	fields[PR_MAP] = gamemap;
+	fields[PR_PLAYERS] = 0;
+	for (i = 0; i < MAXPLAYERS; i++)
+	{
+		if (playeringame[i])
+			fields[PR_PLAYERS]++;
+	}
+
+	fields[PR_TIC] = PS_Microseconds(ps_tictime);
+	fields[PR_PLAYERTHINK] = PS_Microseconds(ps_playerthink_time);
+	fields[PR_THINKERS] = PS_Microseconds(ps_thinkertime);
+	fields[PR_POLYOBJ] = PS_Microseconds(ps_thlist_times[THINK_POLYOBJ]);
+	fields[PR_MAIN] = PS_Microseconds(ps_thlist_times[THINK_MAIN]);
+	fields[PR_MOBJ] = PS_Microseconds(ps_thlist_times[THINK_MOBJ]);
+	fields[PR_DYNSLOPE] = PS_Microseconds(ps_thlist_times[THINK_DYNSLOPE]);
+	fields[PR_LUATHINKFRAME] = PS_Microseconds(ps_lua_thinkframe_time);
+	fields[PR_LUAMOBJHOOKS] = ps_lua_mobjhooks;
+	fields[PR_CHECKPOSITION] = ps_checkposition_calls;
+	fields[PR_ACS] = PS_Microseconds(ps_acs_time);
+	fields[PR_BOTS] = PS_Microseconds(ps_botticcmd_time);
+
+	// Averaged over a second or so
+	Net_GetNetStat();
+	fields[PR_SENDBPS] = sendbps;
+	fields[PR_GETBPS] = getbps;
+
+	fields[PR_ZONE] = (UINT32)(Z_TotalUsage() >> 10);
+
+	for (i = 0; i < NUMPERFRECORDFIELDS; i++)
+		WRITEUINT32(p, fields[i]);
+
+	fseek(perfrecordfile, PERFRECORDHEADERSIZE(NUMPERFRECORDFIELDS) + perfrecordnext * sizeof record, SEEK_SET);
+	fwrite(record, 1, sizeof record, perfrecordfile);
+
+	perfrecordnext = (perfrecordnext + 1) % perfrecordcapacity;
+	if (perfrecordcount < perfrecordcapacity)
+		perfrecordcount++;
+
+	// Whatever's still buffered is lost if the game crashes
+	if (++perfrecordunflushed >= TICRATE)
+		PS_FlushRecording();
+}
+
+void Command_PerfStatsExport_f(void)
+{
+	char path[MAX_WADPATH], csvpath[MAX_WADPATH];
+	UINT8 *buffer;
+	const UINT8 *p, *end;
+	size_t size, recordsize;
+	UINT16 numfields;
+	UINT32 capacity, count, next, r, f;
+	FILE *csv;
+
+	if (COM_Argc() > 1)
+		strlcpy(path, COM_Argv(1), sizeof path);
+	else
+		snprintf(path, sizeof path, "%s" PATHSEP PERFRECORDFILE, srb2home);
+
+	if (COM_Argc() > 2)
+		strlcpy(csvpath, COM_Argv(2), sizeof csvpath);
+	else
+	{
+		strlcpy(csvpath, path, sizeof csvpath);
+		FIL_ForceExtension(csvpath, ".csv");
+	}
+
+	// Exporting what's being recorded
+	if (perfrecordfile)
+		PS_FlushRecording();
+
+	size = FIL_ReadFile(path, &buffer);
+	if (!size)
+	{
+		CONS_Alert(CONS_ERROR, "Couldn't read %s\n", path);
+		return;
+	}
+
+	p = buffer;
+	end = buffer + size;
+
+	if (size < PERFRECORDHEADERSIZE(0) || memcmp(p, PERFRECORDHEADER, PERFRECORDHEADERLEN))
+		goto bad;
+	p += PERFRECORDHEADERLEN;
+
+	if (READUINT16(p) != PERFRECORDVERSION)
+		goto bad;
+
+	numfields = READUINT16(p);
+	capacity = READUINT32(p);
+	count = READUINT32(p);
+	next = READUINT32(p);
+	recordsize = numfields * 4;
+
+	if (!numfields || !capacity || count > capacity || next >= capacity
+		|| (size_t)(end - p) < numfields * PERFRECORDNAMELEN
+		|| (size_t)(end - p) - numfields * PERFRECORDNAMELEN < count * recordsize)
+		goto bad;
+
+	csv = fopen(csvpath, "w");
+	if (!csv)
+	{
+		CONS_Alert(CONS_ERROR, "Couldn't write %s\n", csvpath);
+		Z_Free(buffer);
+		return;
+	}
+
+	for (f = 0; f < numfields; f++)
+	{
+		fprintf(csv, "%s%.*s", f ? "," : "", PERFRECORDNAMELEN, (const char *)p);
+		p += PERFRECORDNAMELEN;
+	}
+	fputc('\n', csv);
+
+	// Oldest first: once the ring has wrapped, that's the next slot
+	for (r = 0; r < count; r++)
+	{
+		const UINT32 slot = (count < capacity) ? r : (next + r) % capacity;
+		const UINT8 *record = p + slot * recordsize;
+
+		for (f = 0; f < numfields; f++)
+			fprintf(csv, "%s%u", f ? "," : "", READUINT32(record));
+		fputc('\n', csv);
+	}
+
+	fclose(csv);
+	Z_Free(buffer);
+
+	CONS_Printf("Exported %u tics from %s to %s\n", count, path, csvpath);
+	return;
+
+bad:
+	CONS_Alert(CONS_ERROR, "%s isn't a perfstats recording\n", path);
+	Z_Free(buffer);
+}
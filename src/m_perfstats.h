@@ -28,6 +28,7 @@ typedef enum
 	PS_LOGIC,
 	PS_BOT,
 	PS_THINKFRAME,
+	PS_INSTRUMENT,
 } ps_types_t;
 
 extern precise_t ps_tictime;
@@ -68,6 +69,15 @@ void PS_ResetBotInfo(void);
 
 void M_DrawPerfStats(void);
 
+extern consvar_t cv_perfstats_record, cv_perfstats_recordlength;
+
+void PS_Record_OnChange(void);
+
+// Writes this tic's numbers to the perfstats_record file, if it's on.
+void PS_RecordTic(void);
+
+void Command_PerfStatsExport_f(void);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -152,12 +152,11 @@ static void UFOUpdateDistanceToFinish(mobj_t *ufo)
 	if (nextWaypoint != NULL && finishLine != NULL)
 	{
 		const boolean useshortcuts = false;
-		const boolean huntbackwards = false;
 		boolean pathfindsuccess = false;
-		path_t pathtofinish = {0};
+		UINT32 findist = 0U;
 
 		pathfindsuccess =
-			K_PathfindToWaypoint(nextWaypoint, finishLine, &pathtofinish, useshortcuts, huntbackwards);
+			K_GetWaypointDistanceToFinish(nextWaypoint, useshortcuts, &findist);
 
 		// Update the UFO's distance to the finish line if a path was found.
 		if (pathfindsuccess == true)
@@ -172,8 +171,7 @@ static void UFOUpdateDistanceToFinish(mobj_t *ufo)
 
 			adddist = (UINT32)disttowaypoint;
 
-			ufo_distancetofinish(ufo) = pathtofinish.totaldist + adddist;
-			Z_Free(pathtofinish.array);
+			ufo_distancetofinish(ufo) = findist + adddist;
 		}
 	}
 }
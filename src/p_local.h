@@ -23,6 +23,7 @@
 #include "p_tick.h"
 #include "r_defs.h"
 #include "p_maputl.h"
+#include "z_pool.h"
 #include "doomstat.h" // MAXSPLITSCREENPLAYERS
 
 #ifdef __cplusplus
@@ -78,7 +79,7 @@ typedef enum
 	NUM_THINKERLISTS
 } thinklistnum_t; /**< Thinker lists. */
 extern thinker_t thlist[];
-extern mobj_t *mobjcache;
+extern zpool_t mobjpool, precipmobjpool, floorspriteslopepool;
 
 void P_InitThinkers(void);
 void P_InvalidateThinkersWithoutInit(void);
@@ -455,6 +456,24 @@ boolean P_CheckSight(mobj_t *t1, mobj_t *t2);
 boolean P_TraceBlockingLines(mobj_t *t1, mobj_t *t2);
 boolean P_TraceBotTraversal(mobj_t *t1, mobj_t *t2);
 boolean P_TraceWaypointTraversal(mobj_t *t1, mobj_t *t2);
+
+typedef enum
+{
+	LOS_CHECKSIGHT,
+	LOS_BLOCKINGLINES,
+	LOS_BOTTRAVERSAL,
+	LOS_WAYPOINTTRAVERSAL,
+	NUMLOSTYPES
+} lostype_t;
+
+typedef struct
+{
+	mobj_t *t1, *t2;
+} losquery_t;
+
+void P_CheckSightBatch(lostype_t type, const losquery_t *queries, boolean *results, size_t count);
+boolean P_CheckSightCached(mobj_t *t1, mobj_t *t2);
+void P_ClearSightCache(void);
 void P_CheckHoopPosition(mobj_t *hoopthing, fixed_t x, fixed_t y, fixed_t z, fixed_t radius);
 
 boolean P_CheckSector(sector_t *sector, boolean crunch);
@@ -484,8 +503,8 @@ fixed_t P_VeryBottomOfFOF (ffloor_t *rover);
 // P_SETUP
 //
 extern UINT8 *rejectmatrix; // for fast sight rejection
-extern INT32 *blockmaplump; // offsets in blockmap are from here
-extern INT32 *blockmap; // Big blockmap
+extern UINT32 *blockmapoffsets; // where each block starts in blockmaplines, plus where the last one ends
+extern UINT32 *blockmaplines; // line numbers of every block, back to back
 extern INT32 bmapwidth;
 extern INT32 bmapheight; // in mapblocks
 extern fixed_t bmaporgx;
@@ -493,6 +512,14 @@ extern fixed_t bmaporgy; // origin of block map
 extern mobj_t **blocklinks; // for thing chains
 extern precipmobj_t **precipblocklinks; // special blockmap for precip rendering
 
+// Returns the line numbers in block b (y*bmapwidth + x) of the blockmap,
+// which run up to *end.
+FUNCINLINE static ATTRINLINE const UINT32 *P_BlockLines(size_t b, const UINT32 **end)
+{
+	*end = blockmaplines + blockmapoffsets[b + 1];
+	return blockmaplines + blockmapoffsets[b];
+}
+
 extern struct minimapinfo
 {
 	patch_t *minimap_pic;
@@ -1088,6 +1088,9 @@ void P_UnsetThingPosition(mobj_t *thing)
 		if (bprev && (*bprev = bnext = thing->bnext) != NULL)  // unlink from block map
 			bnext->bprev = bprev;
 	}
+
+	// done regardless of MF_NOBLOCKMAP, in case the flag changed since linking
+	P_SpatialHashUnlink(thing);
 }
 
 void P_UnsetPrecipThingPosition(precipmobj_t *thing)
@@ -1191,6 +1194,7 @@ void P_SetThingPosition(mobj_t *thing)
 	{
 		// inert things don't need to be in blockmap
 		P_LinkToBlockMap(thing, blocklinks);
+		P_SpatialHashLink(thing);
 	}
 
 	// Allows you to 'step' on a new linedef exec when the previous
@@ -1276,7 +1280,7 @@ void P_SetPrecipitationThingPosition(precipmobj_t *thing)
 boolean P_BlockLinesIterator(INT32 x, INT32 y, BlockItReturn_t (*func)(line_t *))
 {
 	INT32 offset;
-	const INT32 *list; // Big blockmap
+	const UINT32 *list, *end;
 	polymaplink_t *plink; // haleyjd 02/22/06
 	line_t *ld;
 
@@ -1320,10 +1324,7 @@ boolean P_BlockLinesIterator(INT32 x, INT32 y, BlockItReturn_t (*func)(line_t *)
 		plink = (polymaplink_t *)(plink->link.next);
 	}
 
-	offset = *(blockmap + offset); // offset = blockmap[y*bmapwidth+x];
-
-	// First index is really empty, so +1 it.
-	for (list = blockmaplump + offset + 1; *list != -1; list++)
+	for (list = P_BlockLines(offset, &end); list < end; list++)
 	{
 		BlockItReturn_t ret = BMIT_CONTINUE;
 
@@ -90,6 +90,13 @@ typedef enum
 boolean P_BlockLinesIterator(INT32 x, INT32 y, BlockItReturn_t(*func)(line_t *));
 boolean P_BlockThingsIterator(INT32 x, INT32 y, BlockItReturn_t(*func)(mobj_t *));
 
+// Spatial hash of blockmap things, finer than the blockmap (p_spatial.cpp)
+void P_InitSpatialHash(void);
+void P_SpatialHashLink(mobj_t *thing);
+void P_SpatialHashUnlink(mobj_t *thing);
+size_t P_QueryThingsInRadius(fixed_t x, fixed_t y, fixed_t radius, mobj_t **results, size_t maxresults);
+boolean P_RadiusThingsIterator(fixed_t x, fixed_t y, fixed_t radius, BlockItReturn_t(*func)(mobj_t *));
+
 #define PT_ADDLINES		(1)
 #define PT_ADDTHINGS	(2)
 
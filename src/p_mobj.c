@@ -32,6 +32,7 @@
 #include "m_misc.h"
 #include "info.h"
 #include "i_video.h"
+#include "lua_script.h" // LUA_InvalidateUserdata
 #include "lua_hook.h"
 #include "p_slopes.h"
 #include "f_finale.h"
@@ -64,7 +65,11 @@ mobj_t *waypointcap = NULL;
 // general purpose.
 mobj_t *trackercap = NULL;
 
-mobj_t *mobjcache = NULL;
+// Pools for the objects spawned and removed in bulk every level.
+// They are purged along with PU_LEVEL, see Z_PoolPurgeTags.
+zpool_t mobjpool = Z_POOL("mobj_t", mobj_t, 256, PU_LEVEL);
+zpool_t precipmobjpool = Z_POOL("precipmobj_t", precipmobj_t, 512, PU_LEVEL);
+zpool_t floorspriteslopepool = Z_POOL("Floor sprite slopes", pslope_t, 32, PU_LEVEL);
 
 void P_InitCachedActions(void)
 {
@@ -10757,16 +10762,7 @@ mobj_t *P_SpawnMobj(fixed_t x, fixed_t y, fixed_t z, mobjtype_t type)
 		type = MT_RAY;
 	}
 
-	if (mobjcache != NULL)
-	{
-		mobj = mobjcache;
-		mobjcache = mobjcache->hnext;
-		memset(mobj, 0, sizeof(*mobj));
-	}
-	else
-	{
-		mobj = Z_Calloc(sizeof (*mobj), PU_LEVEL, NULL);
-	}
+	mobj = Z_PoolAlloc(&mobjpool);
 
 	// this is officially a mobj, declared as soon as possible.
 	mobj->thinker.function.acp1 = (actionf_p1)P_MobjThinker;
@@ -11253,7 +11249,7 @@ static precipmobj_t *P_SpawnPrecipMobj(fixed_t x, fixed_t y, fixed_t z, mobjtype
 	const mobjinfo_t *info = &mobjinfo[type];
 	state_t *st;
 	fixed_t start_z = INT32_MIN;
-	precipmobj_t *mobj = Z_Calloc(sizeof (*mobj), PU_LEVEL, NULL);
+	precipmobj_t *mobj = Z_PoolAlloc(&precipmobjpool);
 
 	mobj->type = type;
 	mobj->info = info;
@@ -11320,9 +11316,8 @@ static precipmobj_t *P_SpawnPrecipMobj(fixed_t x, fixed_t y, fixed_t z, mobjtype
 
 void *P_CreateFloorSpriteSlope(mobj_t *mobj)
 {
-	if (mobj->floorspriteslope)
-		Z_Free(mobj->floorspriteslope);
-	mobj->floorspriteslope = Z_Calloc(sizeof(pslope_t), PU_LEVEL, NULL);
+	P_RemoveFloorSpriteSlope(mobj);
+	mobj->floorspriteslope = Z_PoolAlloc(&floorspriteslopepool);
 	mobj->floorspriteslope->normal.z = FRACUNIT;
 	return (void *)mobj->floorspriteslope;
 }
@@ -11330,7 +11325,11 @@ void *P_CreateFloorSpriteSlope(mobj_t *mobj)
 void P_RemoveFloorSpriteSlope(mobj_t *mobj)
 {
 	if (mobj->floorspriteslope)
-		Z_Free(mobj->floorspriteslope);
+	{
+		// Lua can hold on to this through mobj.floorspriteslope
+		LUA_InvalidateUserdata(mobj->floorspriteslope);
+		Z_PoolFree(&floorspriteslopepool, mobj->floorspriteslope);
+	}
 	mobj->floorspriteslope = NULL;
 }
 
@@ -11529,6 +11528,7 @@ void P_RemoveMobj(mobj_t *mobj)
 	P_SetTarget(&mobj->owner, NULL);
 
 	P_DeleteMobjStringArgs(mobj);
+	P_RemoveFloorSpriteSlope(mobj);
 	R_RemoveMobjInterpolator(mobj);
 
 	// free block
@@ -11537,9 +11537,8 @@ void P_RemoveMobj(mobj_t *mobj)
 		INT32 prevreferences;
 		if (!mobj->thinker.references)
 		{
-			// no references, dump it directly in the mobj cache
-			mobj->hnext = mobjcache;
-			mobjcache = mobj;
+			// no references, put it straight back in the pool
+			Z_PoolFree(&mobjpool, mobj);
 			return;
 		}
 
@@ -11618,6 +11617,7 @@ void P_RemoveSavegameMobj(mobj_t *mobj)
 		}
 
 		P_DeleteMobjStringArgs(mobj);
+		P_RemoveFloorSpriteSlope(mobj);
 	}
 
 	// stop any playing sound
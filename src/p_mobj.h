@@ -297,6 +297,11 @@ struct mobj_t
 	mobj_t *bnext;
 	mobj_t **bprev; // killough 8/11/98: change to ptr-to-ptr
 
+	// Links in the spatial hash, see p_spatial.cpp
+	mobj_t *spnext;
+	mobj_t **spprev;
+	UINT32 spcell;
+
 	// More drawing info: to determine current sprite.
 	angle_t angle, pitch, roll; // orientation
 	angle_t old_angle, old_pitch, old_roll; // orientation interpolation
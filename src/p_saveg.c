@@ -49,6 +49,7 @@
 #include "k_vote.h"
 #include "k_zvote.h"
 #include "k_endcam.h"
+#include "core/thread_pool.h"
 
 #include <tracy/tracy/TracyC.h>
 
@@ -57,6 +58,113 @@ savedata_cup_t cupsavedata;
 
 static savebuffer_t *current_savebuffer;
 
+// The netgame save is encoded in these sections, some of them in parallel, and then joined in this order.
+typedef enum
+{
+	NETSAVE_HEAD,      // Netvars, misc, end camera
+	NETSAVE_PLAYERS,   // Players, parties, round queue, Z-vote
+	NETSAVE_WORLD,     // Sectors, lines, polyobjects, thinkers, specials, colormaps
+	NETSAVE_WAYPOINTS, // Tube waypoints and waypoints
+	NETSAVE_TAIL,      // ACS, Lua, RNG, Luabanks and consistency
+	NUMNETSAVESECTIONS
+} netsavesection_t;
+
+// Nothing checks for room while a record is written, so the sections the
+// thread pool writes are sized up front from the most their records can
+// take, and the world grows before each record. The head and tail (netvars,
+// ACS and Lua) have nothing to size them by, so they share one buffer as
+// big as a whole netgame save. Everything is malloc'd, since the pool can't
+// use the zone, and only lives until the save is joined up.
+static savebuffer_t netsavesections[NUMNETSAVESECTIONS];
+
+#define NETSAVE_BASESIZE (4*1024) // Block markers, parties, round queue, Z-vote
+#define NETSAVE_PLAYERSIZE (4*1024)
+#define NETSAVE_RECORDSIZE (512) // Most a sector, line, polyobject or thinker writes, besides strings and lists
+#define NETSAVE_DIFFSIZE (16) // What a sector or line usually comes to
+
+// The mobj thinker list is split between jobs once it gets long enough.
+#define NETSAVE_MOBJJOBS (8)
+#define NETSAVE_MOBJGRAIN (256)
+
+typedef struct
+{
+	savebuffer_t save;
+	const thinker_t *start;
+	const thinker_t *end;
+	UINT32 numsaved;
+} mobjsavejob_t;
+
+static mobjsavejob_t mobjsavejobs[NETSAVE_MOBJJOBS];
+static size_t nummobjsavejobs = 0;
+
+static void P_NetSaveBufferAlloc(savebuffer_t *save, size_t size)
+{
+	I_Assert(save->buffer == NULL);
+	save->buffer = malloc(size);
+
+	if (save->buffer == NULL)
+		I_Error("No more free memory for savegame");
+
+	save->size = size;
+	save->p = save->buffer;
+	save->end = save->buffer + size;
+}
+
+static void P_NetSaveBufferFree(savebuffer_t *save, boolean owned)
+{
+	if (owned)
+		free(save->buffer);
+
+	save->buffer = save->p = save->end = NULL;
+	save->size = 0;
+}
+
+//
+// P_NetSaveReserve
+//
+// Grows a section buffer until it has at least length bytes left. Goes
+// before each record, with the most that record can write. Only for the
+// sections written on the main thread.
+//
+static void P_NetSaveReserve(savebuffer_t *save, size_t length)
+{
+	const size_t used = save->p - save->buffer;
+	size_t size = save->size;
+	UINT8 *grown;
+
+	if (save->p > save->end)
+		I_Error("Savegame buffer overrun");
+
+	if (P_SaveBufferRemaining(save) >= length)
+		return;
+
+	while (size - used < length)
+		size *= 2;
+
+	grown = realloc(save->buffer, size);
+	if (grown == NULL)
+		I_Error("No more free memory for savegame");
+
+	save->buffer = grown;
+	save->size = size;
+	save->p = grown + used;
+	save->end = grown + size;
+}
+
+static size_t StringArgsLength(char *const *stringargs, size_t count)
+{
+	size_t length = 0;
+	size_t i;
+
+	for (i = 0; i < count; i++)
+	{
+		if (stringargs[i] != NULL)
+			length += strlen(stringargs[i]);
+	}
+
+	return length;
+}
+
 // Block UINT32s to attempt to ensure that the correct data is
 // being sent and received
 #define ARCHIVEBLOCK_MISC			0x7FEEDEED
@@ -1774,6 +1882,8 @@ static void P_NetArchiveColormaps(savebuffer_t *save)
 	// We save and then we clean up our colormap mess
 	extracolormap_t *exc, *exc_next;
 	UINT32 i = 0;
+
+	P_NetSaveReserve(save, NETSAVE_RECORDSIZE + num_net_colormaps * 32); // 20 bytes each, at most
 	WRITEUINT32(save->p, num_net_colormaps); // save for safety
 
 	for (exc = net_colormaps; i < num_net_colormaps; i++, exc = exc_next)
@@ -2216,6 +2326,19 @@ static void ArchiveSectors(savebuffer_t *save)
 
 		if (diff)
 		{
+			const ffloor_t *rover;
+			size_t length = NETSAVE_RECORDSIZE
+				+ ss->tags.count * sizeof (INT16)
+				+ StringArgsLength(ss->stringargs, NUM_SCRIPT_STRINGARGS);
+
+			if (diff & SD_FFLOORS)
+			{
+				for (rover = ss->ffloors; rover; rover = rover->next)
+					length += 9; // number, diff, flags and alpha
+			}
+
+			P_NetSaveReserve(save, length);
+
 			WRITEUINT16(save->p, i);
 			WRITEUINT8(save->p, diff);
 			if (diff & SD_DIFF2)
@@ -2556,6 +2679,8 @@ static void ArchiveLines(savebuffer_t *save)
 
 		if (diff)
 		{
+			P_NetSaveReserve(save, NETSAVE_RECORDSIZE + StringArgsLength(li->stringargs, NUM_SCRIPT_STRINGARGS));
+
 			WRITEINT16(save->p, i);
 			WRITEUINT8(save->p, diff);
 			if (diff & LD_DIFF2)
@@ -2718,9 +2843,11 @@ static void P_NetArchiveWorld(savebuffer_t *save)
 	// initialize colormap vars because paranoia
 	ClearNetColormaps();
 
+	P_NetSaveReserve(save, NETSAVE_RECORDSIZE);
 	WRITEUINT32(save->p, ARCHIVEBLOCK_WORLD);
 
 	ArchiveSectors(save);
+	P_NetSaveReserve(save, NETSAVE_RECORDSIZE);
 	ArchiveLines(save);
 	R_ClearTextureNumCache(false);
 
@@ -2989,6 +3116,17 @@ boolean TypeIsNetSynced(mobjtype_t type)
 	return true;
 }
 
+// The most SaveMobjThinker can write for this mobj
+static size_t MobjRecordLength(const mobj_t *mobj)
+{
+	if (TypeIsNetSynced(mobj->type) == false)
+		return 0;
+
+	return NETSAVE_RECORDSIZE
+		+ StringArgsLength(mobj->thing_stringargs, NUM_MAPTHING_STRINGARGS)
+		+ StringArgsLength(mobj->script_stringargs, NUM_SCRIPT_STRINGARGS);
+}
+
 static void SaveMobjThinker(savebuffer_t *save, const thinker_t *th, const UINT8 type)
 {
 	const mobj_t *mobj = (const mobj_t *)th;
@@ -4001,6 +4139,105 @@ static void WriteMobjPointer(mobj_t *mobj)
 	WRITEUINT32(current_savebuffer->p, SaveMobjnum(mobj));
 }
 
+#ifdef HAVE_THREADS
+//
+// P_PrepareMobjSaveJobs
+//
+// Splits the mobj thinker list into runs of about the same number of mobjs,
+// so they can be saved in parallel with the rest of the world. Returns false
+// if the list is too short to be worth splitting, or has something other
+// than mobjs in it.
+//
+static boolean P_PrepareMobjSaveJobs(void)
+{
+	const thinker_t *th;
+	size_t nummobjs = 0, perjob, n = 0;
+	size_t lengths[NETSAVE_MOBJJOBS] = {0};
+
+	nummobjsavejobs = 0;
+
+	for (th = thlist[THINK_MOBJ].next; th != &thlist[THINK_MOBJ]; th = th->next)
+	{
+		if (th->function.acp1 == (actionf_p1)P_MobjThinker)
+			nummobjs++;
+		else if (th->function.acp1 != (actionf_p1)P_RemoveThinkerDelayed)
+			return false;
+	}
+
+	if (nummobjs < 2 * NETSAVE_MOBJGRAIN)
+		return false;
+
+	nummobjsavejobs = min(NETSAVE_MOBJJOBS, nummobjs / NETSAVE_MOBJGRAIN);
+	perjob = (nummobjs + nummobjsavejobs - 1) / nummobjsavejobs;
+
+	for (th = thlist[THINK_MOBJ].next; th != &thlist[THINK_MOBJ]; th = th->next)
+	{
+		if (th->function.acp1 != (actionf_p1)P_MobjThinker)
+			continue;
+
+		if (n % perjob == 0)
+		{
+			mobjsavejob_t *job = &mobjsavejobs[n / perjob];
+
+			job->start = th;
+			job->numsaved = 0;
+
+			if (n > 0)
+				mobjsavejobs[n / perjob - 1].end = th;
+		}
+
+		lengths[n / perjob] += MobjRecordLength((const mobj_t *)th);
+		n++;
+	}
+
+	nummobjsavejobs = (n + perjob - 1) / perjob;
+	mobjsavejobs[nummobjsavejobs - 1].end = &thlist[THINK_MOBJ];
+
+	// Sized for the most they can write, since the jobs can't grow them
+	for (n = 0; n < nummobjsavejobs; n++)
+		P_NetSaveBufferAlloc(&mobjsavejobs[n].save, max(lengths[n], 1));
+
+	return true;
+}
+
+static void P_RunMobjSaveJob(void *data)
+{
+	mobjsavejob_t *job = data;
+	const thinker_t *th;
+
+	for (th = job->start; th != job->end; th = th->next)
+	{
+		if (th->function.acp1 == (actionf_p1)P_MobjThinker)
+		{
+			SaveMobjThinker(&job->save, th, tc_mobj);
+			job->numsaved++;
+		}
+	}
+}
+#endif
+
+static void P_JoinMobjSaveJobs(savebuffer_t *save, UINT32 *numsaved)
+{
+	size_t i;
+
+#ifdef HAVE_THREADS
+	I_ThreadPoolWaitIdle();
+#endif
+
+	for (i = 0; i < nummobjsavejobs; i++)
+	{
+		const mobjsavejob_t *job = &mobjsavejobs[i];
+		const size_t length = job->save.p - job->save.buffer;
+
+		if (job->save.p > job->save.end)
+			I_Error("Savegame buffer overrun");
+
+		P_NetSaveReserve(save, length);
+		WRITEMEM(save->p, job->save.buffer, length);
+		*numsaved += job->numsaved;
+	}
+}
+
 static void P_NetArchiveThinkers(savebuffer_t *save)
 {
 	TracyCZone(__zone, true);
@@ -4008,6 +4245,7 @@ static void P_NetArchiveThinkers(savebuffer_t *save)
 	const thinker_t *th;
 	UINT32 i;
 
+	P_NetSaveReserve(save, NETSAVE_RECORDSIZE);
 	WRITEUINT32(save->p, ARCHIVEBLOCK_THINKERS);
 
 	P_SaveMobjPointers(WriteMobjPointer);
@@ -4015,13 +4253,31 @@ static void P_NetArchiveThinkers(savebuffer_t *save)
 	for (i = 0; i < NUM_THINKERLISTS; i++)
 	{
 		UINT32 numsaved = 0;
+
+		if (i == THINK_MOBJ && nummobjsavejobs > 0)
+		{
+			// Already saved by P_RunMobjSaveJob, just join them up
+			P_JoinMobjSaveJobs(save, &numsaved);
+			th = &thlist[i];
+		}
+		else
+		{
+			th = thlist[i].next;
+		}
+
 		// save off the current thinkers
-		for (th = thlist[i].next; th != &thlist[i]; th = th->next)
+		for (; th != &thlist[i]; th = th->next)
 		{
 			if (!(th->function.acp1 == (actionf_p1)P_RemoveThinkerDelayed
 			 || th->function.acp1 == (actionf_p1)P_NullPrecipThinker))
 				numsaved++;
 
+			// Every thinker but a mobj is fixed size
+			if (th->function.acp1 == (actionf_p1)P_MobjThinker)
+				P_NetSaveReserve(save, MobjRecordLength((const mobj_t *)th));
+			else
+				P_NetSaveReserve(save, NETSAVE_RECORDSIZE);
+
 			if (th->function.acp1 == (actionf_p1)P_MobjThinker)
 			{
 				SaveMobjThinker(save, th, tc_mobj);
@@ -4446,13 +4702,13 @@ static thinker_t* LoadMobjThinker(savebuffer_t *save, actionf_p1 thinker)
 			return NULL;
 		}
 
-		mobj = Z_Calloc(sizeof (*mobj), PU_LEVEL, NULL);
+		mobj = Z_PoolAlloc(&mobjpool);
 
 		mobj->spawnpoint = &mapthings[spawnpointnum];
 		mapthings[spawnpointnum].mobj = mobj;
 	}
 	else
-		mobj = Z_Calloc(sizeof (*mobj), PU_LEVEL, NULL);
+		mobj = Z_PoolAlloc(&mobjpool);
 
 	// declare this as a valid mobj as soon as possible.
 	mobj->thinker.function.acp1 = thinker;
@@ -5756,13 +6012,17 @@ static inline void P_ArchivePolyObjects(savebuffer_t *save)
 
 	INT32 i;
 
+	P_NetSaveReserve(save, NETSAVE_RECORDSIZE);
 	WRITEUINT32(save->p, ARCHIVEBLOCK_POBJS);
 
 	// save number of polyobjects
 	WRITEINT32(save->p, numPolyObjects);
 
 	for (i = 0; i < numPolyObjects; ++i)
+	{
+		P_NetSaveReserve(save, NETSAVE_RECORDSIZE);
 		P_ArchivePolyObj(save, &PolyObjects[i]);
+	}
 
 	TracyCZoneEnd(__zone);
 }
@@ -5992,6 +6252,7 @@ static inline void P_NetArchiveSpecials(savebuffer_t *save)
 
 	size_t i, z;
 
+	P_NetSaveReserve(save, NETSAVE_RECORDSIZE + ITEMQUESIZE * 2 * sizeof (UINT32));
 	WRITEUINT32(save->p, ARCHIVEBLOCK_SPECIALS);
 
 	// itemrespawn queue for deathmatch
@@ -6977,15 +7238,97 @@ void P_SaveGame(savebuffer_t *save)
 	P_ArchiveLuabanksAndConsistency(save);
 }
 
-void P_SaveNetGame(savebuffer_t *save, boolean resending)
+static savebuffer_t *P_ResetNetSaveSection(netsavesection_t section, size_t size)
 {
-	TracyCZone(__zone, true);
+	savebuffer_t *save = &netsavesections[section];
 
-	current_savebuffer = save;
+	P_NetSaveBufferAlloc(save, size);
+	return save;
+}
+
+static void P_FreeNetSaveSections(void)
+{
+	size_t i;
+
+	for (i = 0; i < NUMNETSAVESECTIONS; i++)
+	{
+		// The tail is written in the rest of the head's buffer
+		P_NetSaveBufferFree(&netsavesections[i], (i != NETSAVE_TAIL));
+	}
+
+	for (i = 0; i < NETSAVE_MOBJJOBS; i++)
+		P_NetSaveBufferFree(&mobjsavejobs[i].save, true);
+
+	nummobjsavejobs = 0;
+}
+
+// The most the player section can write, since the thread pool can't grow it
+static size_t P_NetPlayerSectionLength(void)
+{
+	size_t length = NETSAVE_BASESIZE;
+	INT32 i;
+
+	for (i = 0; i < MAXPLAYERS; i++)
+	{
+		if (playeringame[i])
+			length += NETSAVE_PLAYERSIZE;
+	}
+
+	return length;
+}
+
+static size_t P_NetWaypointSectionLength(void)
+{
+	size_t length = NETSAVE_BASESIZE + K_GetNumWaypoints() * sizeof (UINT32);
+	INT32 i;
+
+	for (i = 0; i < NUMTUBEWAYPOINTSEQUENCES; i++)
+		length += sizeof (UINT16) + numtubewaypoints[i] * sizeof (UINT32);
+
+	return length;
+}
+
+static void P_NetArchivePlayerSection(void *data)
+{
+	savebuffer_t *save = data;
+
+	P_NetArchivePlayers(save);
+	P_NetArchiveParties(save);
+	P_NetArchiveRoundQueue(save);
+	P_NetArchiveZVote(save);
+}
+
+static void P_NetArchiveWaypointSection(void *data)
+{
+	savebuffer_t *save = data;
+
+	P_NetArchiveTubeWaypoints(save);
+	P_NetArchiveWaypoints(save);
+}
+
+//
+// P_EncodeNetGame
+//
+// Encodes every section of the netgame save. The players, the waypoints
+// and long runs of mobjs only read the game state, so they are saved by
+// the thread pool while the world is saved here. Everything that can run
+// Lua or allocate zone memory stays on this thread, and Lua is only
+// archived once everything else is done, so the NetVars hook can't change
+// anything while it is being read.
+//
+static void P_EncodeNetGame(boolean resending)
+{
+	savebuffer_t *save = P_ResetNetSaveSection(NETSAVE_HEAD, NETSAVEGAMESIZE);
+	savebuffer_t *playersave = P_ResetNetSaveSection(NETSAVE_PLAYERS, P_NetPlayerSectionLength());
+	savebuffer_t *worldsave = P_ResetNetSaveSection(NETSAVE_WORLD, NETSAVE_BASESIZE + (numsectors + numlines) * NETSAVE_DIFFSIZE);
+	savebuffer_t *waypointsave = P_ResetNetSaveSection(NETSAVE_WAYPOINTS, P_NetWaypointSectionLength());
 
 	thinker_t *th;
 	mobj_t *mobj;
 	UINT32 i = 1; // don't start from 0, it'd be confused with a blank pointer otherwise
+	size_t j;
+
+	current_savebuffer = save;
 
 	CV_SaveNetVars(&save->p);
 	P_NetArchiveMisc(save, resending);
@@ -7008,22 +7351,48 @@ void P_SaveNetGame(savebuffer_t *save, boolean resending)
 	K_SaveEndCamera(save);
 	WriteMobjPointer(g_endcam.panMobj);
 
-	P_NetArchivePlayers(save);
-	P_NetArchiveParties(save);
-	P_NetArchiveRoundQueue(save);
-	P_NetArchiveZVote(save);
+	nummobjsavejobs = 0;
+
+#ifdef HAVE_THREADS
+	I_ThreadPoolSubmit(&P_NetArchivePlayerSection, playersave);
+
+	if (gamestate == GS_LEVEL)
+	{
+		I_ThreadPoolSubmit(&P_NetArchiveWaypointSection, waypointsave);
+
+		if (P_PrepareMobjSaveJobs() == true)
+		{
+			for (j = 0; j < nummobjsavejobs; j++)
+				I_ThreadPoolSubmit(&P_RunMobjSaveJob, &mobjsavejobs[j]);
+		}
+	}
+#else
+	P_NetArchivePlayerSection(playersave);
+
+	if (gamestate == GS_LEVEL)
+		P_NetArchiveWaypointSection(waypointsave);
+#endif
 
 	if (gamestate == GS_LEVEL)
 	{
-		P_NetArchiveWorld(save);
-		P_ArchivePolyObjects(save);
-		P_NetArchiveThinkers(save);
-		P_NetArchiveSpecials(save);
-		P_NetArchiveColormaps(save);
-		P_NetArchiveTubeWaypoints(save);
-		P_NetArchiveWaypoints(save);
+		current_savebuffer = worldsave;
+
+		P_NetArchiveWorld(worldsave);
+		P_ArchivePolyObjects(worldsave);
+		P_NetArchiveThinkers(worldsave);
+		P_NetArchiveSpecials(worldsave);
+		P_NetArchiveColormaps(worldsave);
 	}
 
+#ifdef HAVE_THREADS
+	I_ThreadPoolWaitIdle();
+#endif
+
+	save = &netsavesections[NETSAVE_TAIL];
+	if (P_SaveBufferFromExisting(save, netsavesections[NETSAVE_HEAD].p, P_SaveBufferRemaining(&netsavesections[NETSAVE_HEAD])) == false)
+		I_Error("Savegame buffer overrun");
+	current_savebuffer = save;
+
 	ACS_Archive(save);
 	LUA_Archive(save, true);
 
@@ -7031,7 +7400,68 @@ void P_SaveNetGame(savebuffer_t *save, boolean resending)
 
 	P_ArchiveLuabanksAndConsistency(save);
 
+	for (j = 0; j < NUMNETSAVESECTIONS; j++)
+	{
+		if (netsavesections[j].p > netsavesections[j].end)
+			I_Error("Savegame buffer overrun");
+	}
+}
+
+static size_t P_NetGameEncodedSize(void)
+{
+	size_t length = 0;
+	size_t i;
+
+	for (i = 0; i < NUMNETSAVESECTIONS; i++)
+		length += netsavesections[i].p - netsavesections[i].buffer;
+
+	return length;
+}
+
+static void P_WriteNetGameSections(savebuffer_t *save)
+{
+	size_t i;
+
+	if (P_SaveBufferRemaining(save) < P_NetGameEncodedSize())
+		I_Error("Savegame buffer overrun");
+
+	for (i = 0; i < NUMNETSAVESECTIONS; i++)
+	{
+		const savebuffer_t *section = &netsavesections[i];
+		WRITEMEM(save->p, section->buffer, section->p - section->buffer);
+	}
+}
+
+void P_SaveNetGame(savebuffer_t *save, boolean resending)
+{
+	TracyCZone(__zone, true);
+
+	P_EncodeNetGame(resending);
+	P_WriteNetGameSections(save);
+	P_FreeNetSaveSections();
+
+	TracyCZoneEnd(__zone);
+}
+
+boolean P_SaveNetGameAlloc(savebuffer_t *save, size_t headroom, boolean resending)
+{
+	TracyCZone(__zone, true);
+
+	P_EncodeNetGame(resending);
+
+	if (P_SaveBufferAlloc(save, headroom + P_NetGameEncodedSize()) == false)
+	{
+		P_FreeNetSaveSections();
+		TracyCZoneEnd(__zone);
+		return false;
+	}
+
+	save->p += headroom;
+	P_WriteNetGameSections(save);
+	P_FreeNetSaveSections();
+
 	TracyCZoneEnd(__zone);
+	return true;
 }
 
 boolean P_LoadGame(savebuffer_t *save)
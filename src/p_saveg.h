@@ -36,6 +36,10 @@ void P_GetBackupCupData(savebuffer_t *save);
 
 // Online
 void P_SaveNetGame(savebuffer_t *save, boolean resending);
+
+// Like P_SaveNetGame, but allocates the buffer at the size the save turned out to be,
+// with headroom bytes free at the start. Returns false if the buffer couldn't be allocated.
+boolean P_SaveNetGameAlloc(savebuffer_t *save, size_t headroom, boolean resending);
 boolean P_LoadNetGame(savebuffer_t *save, boolean reloading);
 
 mobj_t *P_FindNewPosition(UINT32 oldposition);
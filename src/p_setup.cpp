@@ -19,6 +19,7 @@
 #include <fmt/format.h>
 
 #include "cxxutil.hpp"
+#include "core/thread_pool.h"
 
 #include "doomdef.h"
 #include "d_main.h"
@@ -177,9 +178,9 @@ virtres_t *curmapvirt;
 // Blockmap size.
 INT32 bmapwidth, bmapheight; // size in mapblocks
 
-INT32 *blockmap; // INT32 for large maps
-// offsets in blockmap are from here
-INT32 *blockmaplump; // Big blockmap
+// Lines of each block, in compressed sparse rows
+UINT32 *blockmapoffsets;
+UINT32 *blockmaplines;
 
 // origin of block map
 fixed_t bmaporgx, bmaporgy;
@@ -1508,6 +1509,124 @@ static boolean TextmapCount(size_t size)
 	return true;
 }
 
+// Every key the TEXTMAP block parsers know by name. Keys that take a
+// numeric suffix (arg0, stringarg0, ...) and user_ properties are not in
+// here, and are matched by prefix instead.
+#define TEXTMAPKEYS(X) \
+	X(action) X(alpha) X(angle) X(blendmode) X(blocking) X(blockmonsters) \
+	X(blockplayers) X(ceilingplane_a) X(ceilingplane_b) X(ceilingplane_c) \
+	X(ceilingplane_d) X(cheatcheckactivator) X(colormapfadesprites) \
+	X(colormapfog) X(colormapprotected) X(continuousspecial) X(damagetype) \
+	X(deleteitems) X(dontpegbottom) X(dontpegtop) X(doublestepup) X(exit) \
+	X(fadealpha) X(fadecolor) X(fadeend) X(fadestart) X(fan) X(flatlighting) \
+	X(flip) X(flipspecial_ceiling) X(flipspecial_nofloor) X(floorplane_a) \
+	X(floorplane_b) X(floorplane_c) X(floorplane_d) X(foflayer) \
+	X(forcedirectionallighting) X(friction) X(gravity) X(gravityflip) \
+	X(heatwave) X(height) X(heightceiling) X(heightfloor) X(id) X(impact) \
+	X(invertencore) X(invertprecip) X(lightalpha) X(lightceiling) \
+	X(lightceilingabsolute) X(lightcolor) X(lightfloor) X(lightfloorabsolute) \
+	X(lightlevel) X(midpeg) X(midsolid) X(missileceiling) X(missilecross) \
+	X(missileenter) X(missilefloor) X(mobjscale) X(monsterceiling) \
+	X(monstercross) X(monsterenter) X(monsterfloor) X(monsterpush) X(moreids) \
+	X(netonly) X(noclimb) X(noclipcamera) X(nonet) X(noskew) X(nostepdown) \
+	X(nostepup) X(notbouncy) X(offsetx) X(offsety) X(pitch) X(playerceiling) \
+	X(playercross) X(playerenter) X(playerfloor) X(playerpush) X(renderstyle) \
+	X(repeatcnt) X(repeatspecial) X(ripple_ceiling) X(ripple_floor) X(roll) \
+	X(rotationceiling) X(rotationfloor) X(scale) X(scalex) X(scaley) X(sector) \
+	X(sideback) X(sidefront) X(skewtd) X(special) X(starpostactivator) \
+	X(texturebottom) X(textureceiling) X(texturefloor) X(texturemiddle) \
+	X(texturetop) X(transfer) X(triggerspecial_headbump) \
+	X(triggerspecial_touch) X(twosided) X(type) X(v1) X(v2) X(wrapmidtex) X(x) \
+	X(xpanningceiling) X(xpanningfloor) X(y) X(ypanningceiling) \
+	X(ypanningfloor) X(zceiling) X(zfloor) X(zoomtubeend) X(zoomtubestart)
+
+#define TEXTMAPKEY_ENUM(name) TMK_##name,
+#define TEXTMAPKEY_NAME(name) #name,
+
+enum textmapkey_t : UINT8
+{
+	TMK_NONE,
+	TEXTMAPKEYS(TEXTMAPKEY_ENUM)
+	NUMTEXTMAPKEYS
+};
+
+static constexpr const char *textmapkeynames[NUMTEXTMAPKEYS] = {
+	"",
+	TEXTMAPKEYS(TEXTMAPKEY_NAME)
+};
+
+#undef TEXTMAPKEY_ENUM
+#undef TEXTMAPKEY_NAME
+
+// Keys are looked up through a perfect hash: the seed below leaves no
+// two keys sharing a slot, which leaves one string comparison per
+// lookup, to rule out unknown keys. If a new key makes the build fail,
+// find another seed that works, or raise TEXTMAPKEYSLOTS.
+#define TEXTMAPKEYSLOTS 2048
+#define TEXTMAPKEYSEED 48
+
+struct textmapkeytable_t
+{
+	bool collided;
+	UINT8 slots[TEXTMAPKEYSLOTS];
+};
+
+static constexpr UINT32 TextmapKeyHash(const char *key, size_t len)
+{
+	UINT32 hash = 2166136261u ^ TEXTMAPKEYSEED;
+
+	for (size_t i = 0; i < len; i++)
+	{
+		hash ^= static_cast<UINT8>(key[i]);
+		hash *= 16777619u;
+	}
+
+	return (hash ^ (hash >> 16)) & (TEXTMAPKEYSLOTS - 1);
+}
+
+static constexpr size_t TextmapKeyLength(const char *key)
+{
+	size_t len = 0;
+
+	while (key[len])
+		len++;
+
+	return len;
+}
+
+static constexpr textmapkeytable_t TextmapBuildKeyTable(void)
+{
+	textmapkeytable_t table = {};
+
+	for (size_t k = 1; k < NUMTEXTMAPKEYS; k++)
+	{
+		const UINT32 slot = TextmapKeyHash(textmapkeynames[k], TextmapKeyLength(textmapkeynames[k]));
+
+		if (table.slots[slot])
+			table.collided = true;
+		else
+			table.slots[slot] = static_cast<UINT8>(k);
+	}
+
+	return table;
+}
+
+static constexpr textmapkeytable_t textmapkeytable = TextmapBuildKeyTable();
+static_assert(!textmapkeytable.collided, "TEXTMAP keys collide with TEXTMAPKEYSEED; pick another seed");
+
+static textmapkey_t TextmapLookupKey(const char *key, size_t len)
+{
+	const UINT8 k = textmapkeytable.slots[TextmapKeyHash(key, len)];
+
+	if (k && fastcmp(key, textmapkeynames[k]))
+		return static_cast<textmapkey_t>(k);
+
+	return TMK_NONE;
+}
+
+// Whether the value handed to a parser was quoted in the TEXTMAP.
+static boolean textmap_valisstring;
+
 enum
 {
 	PROP_NUM_TYPE_NA,
@@ -1519,7 +1638,7 @@ static void ParseUserProperty(mapUserProperties_t *user, const char *param, cons
 {
 	if (fastncmp(param, "user_", 5) && strlen(param) > 5)
 	{
-		const boolean valIsString = M_TokenizerJustReadString();
+		const boolean valIsString = textmap_valisstring;
 		const char *key = param + 5;
 		const size_t valLen = strlen(val);
 		UINT8 numberType = PROP_NUM_TYPE_INT;
@@ -1584,21 +1703,28 @@ static void ParseUserProperty(mapUserProperties_t *user, const char *param, cons
 	}
 }
 
-static void ParseTextmapVertexParameter(UINT32 i, const char *param, const char *val)
+static void ParseTextmapVertexParameter(UINT32 i, textmapkey_t key, const char *param, const char *val)
 {
-	if (fastcmp(param, "x"))
-		vertexes[i].x = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "y"))
-		vertexes[i].y = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "zfloor"))
-	{
-		vertexes[i].floorz = FLOAT_TO_FIXED(atof(val));
-		vertexes[i].floorzset = true;
-	}
-	else if (fastcmp(param, "zceiling"))
+	(void)param;
+
+	switch (key)
 	{
-		vertexes[i].ceilingz = FLOAT_TO_FIXED(atof(val));
-		vertexes[i].ceilingzset = true;
+		case TMK_x:
+			vertexes[i].x = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_y:
+			vertexes[i].y = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_zfloor:
+			vertexes[i].floorz = FLOAT_TO_FIXED(atof(val));
+			vertexes[i].floorzset = true;
+			break;
+		case TMK_zceiling:
+			vertexes[i].ceilingz = FLOAT_TO_FIXED(atof(val));
+			vertexes[i].ceilingzset = true;
+			break;
+		default:
+			break;
 	}
 }
 
@@ -1631,512 +1757,1248 @@ typedef struct textmap_plane_s {
 textmap_plane_t textmap_planefloor = {0, 0, 0, 0, 0};
 textmap_plane_t textmap_planeceiling = {0, 0, 0, 0, 0};
 
-static void ParseTextmapSectorParameter(UINT32 i, const char *param, const char *val)
+#define SECTORFLAG(flag) sectors[i].flags = static_cast<sectorflags_t>(sectors[i].flags | (flag))
+#define SECTORSPECIALFLAG(flag) sectors[i].specialflags = static_cast<sectorspecialflags_t>(sectors[i].specialflags | (flag))
+#define SECTORACTIVATION(flag) sectors[i].activation = static_cast<sectoractionflags_t>(sectors[i].activation | (flag))
+
+static void ParseTextmapSectorParameter(UINT32 i, textmapkey_t key, const char *param, const char *val)
 {
-	if (fastcmp(param, "heightfloor"))
-		sectors[i].floorheight = atol(val) << FRACBITS;
-	else if (fastcmp(param, "heightceiling"))
-		sectors[i].ceilingheight = atol(val) << FRACBITS;
-	if (fastcmp(param, "texturefloor"))
-		sectors[i].floorpic = P_AddLevelFlat(val, foundflats);
-	else if (fastcmp(param, "textureceiling"))
-		sectors[i].ceilingpic = P_AddLevelFlat(val, foundflats);
-	else if (fastcmp(param, "lightlevel"))
-		sectors[i].lightlevel = atol(val);
-	else if (fastcmp(param, "lightfloor"))
-		sectors[i].floorlightlevel = atol(val);
-	else if (fastcmp(param, "lightfloorabsolute") && fastcmp("true", val))
-		sectors[i].floorlightabsolute = true;
-	else if (fastcmp(param, "lightceiling"))
-		sectors[i].ceilinglightlevel = atol(val);
-	else if (fastcmp(param, "lightceilingabsolute") && fastcmp("true", val))
-		sectors[i].ceilinglightabsolute = true;
-	else if (fastcmp(param, "id"))
-		Tag_FSet(&sectors[i].tags, atol(val));
-	else if (fastcmp(param, "moreids"))
+	const boolean istrue = fastcmp("true", val);
+
+	switch (key)
 	{
-		const char* id = val;
-		while (id)
+		case TMK_heightfloor:
+			sectors[i].floorheight = atol(val) << FRACBITS;
+			break;
+		case TMK_heightceiling:
+			sectors[i].ceilingheight = atol(val) << FRACBITS;
+			break;
+		case TMK_texturefloor:
+			sectors[i].floorpic = P_AddLevelFlat(val, foundflats);
+			break;
+		case TMK_textureceiling:
+			sectors[i].ceilingpic = P_AddLevelFlat(val, foundflats);
+			break;
+		case TMK_lightlevel:
+			sectors[i].lightlevel = atol(val);
+			break;
+		case TMK_lightfloor:
+			sectors[i].floorlightlevel = atol(val);
+			break;
+		case TMK_lightfloorabsolute:
+			if (istrue)
+				sectors[i].floorlightabsolute = true;
+			break;
+		case TMK_lightceiling:
+			sectors[i].ceilinglightlevel = atol(val);
+			break;
+		case TMK_lightceilingabsolute:
+			if (istrue)
+				sectors[i].ceilinglightabsolute = true;
+			break;
+		case TMK_id:
+			Tag_FSet(&sectors[i].tags, atol(val));
+			break;
+		case TMK_moreids:
 		{
-			Tag_Add(&sectors[i].tags, atol(id));
-			if ((id = strchr(id, ' ')))
-				id++;
+			const char* id = val;
+			while (id)
+			{
+				Tag_Add(&sectors[i].tags, atol(id));
+				if ((id = strchr(id, ' ')))
+					id++;
+			}
+			break;
 		}
+		case TMK_xpanningfloor:
+			sectors[i].floor_xoffs = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_ypanningfloor:
+			sectors[i].floor_yoffs = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_xpanningceiling:
+			sectors[i].ceiling_xoffs = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_ypanningceiling:
+			sectors[i].ceiling_yoffs = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_rotationfloor:
+			sectors[i].floorpic_angle = FixedAngle(FLOAT_TO_FIXED(atof(val)));
+			break;
+		case TMK_rotationceiling:
+			sectors[i].ceilingpic_angle = FixedAngle(FLOAT_TO_FIXED(atof(val)));
+			break;
+		case TMK_floorplane_a:
+			textmap_planefloor.defined |= PD_A;
+			textmap_planefloor.a = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_floorplane_b:
+			textmap_planefloor.defined |= PD_B;
+			textmap_planefloor.b = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_floorplane_c:
+			textmap_planefloor.defined |= PD_C;
+			textmap_planefloor.c = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_floorplane_d:
+			textmap_planefloor.defined |= PD_D;
+			textmap_planefloor.d = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_ceilingplane_a:
+			textmap_planeceiling.defined |= PD_A;
+			textmap_planeceiling.a = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_ceilingplane_b:
+			textmap_planeceiling.defined |= PD_B;
+			textmap_planeceiling.b = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_ceilingplane_c:
+			textmap_planeceiling.defined |= PD_C;
+			textmap_planeceiling.c = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_ceilingplane_d:
+			textmap_planeceiling.defined |= PD_D;
+			textmap_planeceiling.d = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_lightcolor:
+			textmap_colormap.used = true;
+			textmap_colormap.lightcolor = atol(val);
+			break;
+		case TMK_lightalpha:
+			textmap_colormap.used = true;
+			textmap_colormap.lightalpha = atol(val);
+			break;
+		case TMK_fadecolor:
+			textmap_colormap.used = true;
+			textmap_colormap.fadecolor = atol(val);
+			break;
+		case TMK_fadealpha:
+			textmap_colormap.used = true;
+			textmap_colormap.fadealpha = atol(val);
+			break;
+		case TMK_fadestart:
+			textmap_colormap.used = true;
+			textmap_colormap.fadestart = atol(val);
+			break;
+		case TMK_fadeend:
+			textmap_colormap.used = true;
+			textmap_colormap.fadeend = atol(val);
+			break;
+		case TMK_colormapfog:
+			if (istrue)
+			{
+				textmap_colormap.used = true;
+				textmap_colormap.flags |= CMF_FOG;
+			}
+			break;
+		case TMK_colormapfadesprites:
+			if (istrue)
+			{
+				textmap_colormap.used = true;
+				textmap_colormap.flags |= CMF_FADEFULLBRIGHTSPRITES;
+			}
+			break;
+		case TMK_colormapprotected:
+			if (istrue)
+				sectors[i].colormap_protected = true;
+			break;
+		case TMK_flipspecial_nofloor:
+			if (istrue)
+				sectors[i].flags = static_cast<sectorflags_t>(sectors[i].flags & ~MSF_FLIPSPECIAL_FLOOR);
+			break;
+		case TMK_flipspecial_ceiling:
+			if (istrue)
+				SECTORFLAG(MSF_FLIPSPECIAL_CEILING);
+			break;
+		case TMK_triggerspecial_touch:
+			if (istrue)
+				SECTORFLAG(MSF_TRIGGERSPECIAL_TOUCH);
+			break;
+		case TMK_triggerspecial_headbump:
+			if (istrue)
+				SECTORFLAG(MSF_TRIGGERSPECIAL_HEADBUMP);
+			break;
+		case TMK_invertprecip:
+			if (istrue)
+				SECTORFLAG(MSF_INVERTPRECIP);
+			break;
+		case TMK_gravityflip:
+			if (istrue)
+				SECTORFLAG(MSF_GRAVITYFLIP);
+			break;
+		case TMK_heatwave:
+			if (istrue)
+				SECTORFLAG(MSF_HEATWAVE);
+			break;
+		case TMK_noclipcamera:
+			if (istrue)
+				SECTORFLAG(MSF_NOCLIPCAMERA);
+			break;
+		case TMK_ripple_floor:
+			if (istrue)
+				SECTORFLAG(MSF_RIPPLE_FLOOR);
+			break;
+		case TMK_ripple_ceiling:
+			if (istrue)
+				SECTORFLAG(MSF_RIPPLE_CEILING);
+			break;
+		case TMK_invertencore:
+			if (istrue)
+				SECTORFLAG(MSF_INVERTENCORE);
+			break;
+		case TMK_flatlighting:
+			if (istrue)
+				SECTORFLAG(MSF_FLATLIGHTING);
+			break;
+		case TMK_forcedirectionallighting:
+			if (istrue)
+				SECTORFLAG(MSF_DIRECTIONLIGHTING);
+			break;
+		case TMK_nostepup:
+			if (istrue)
+				SECTORSPECIALFLAG(SSF_NOSTEPUP);
+			break;
+		case TMK_doublestepup:
+			if (istrue)
+				SECTORSPECIALFLAG(SSF_DOUBLESTEPUP);
+			break;
+		case TMK_nostepdown:
+			if (istrue)
+				SECTORSPECIALFLAG(SSF_NOSTEPDOWN);
+			break;
+		case TMK_cheatcheckactivator:
+		case TMK_starpostactivator:
+			if (istrue)
+				SECTORSPECIALFLAG(SSF_CHEATCHECKACTIVATOR);
+			break;
+		case TMK_exit:
+			if (istrue)
+				SECTORSPECIALFLAG(SSF_EXIT);
+			break;
+		case TMK_deleteitems:
+			if (istrue)
+				SECTORSPECIALFLAG(SSF_DELETEITEMS);
+			break;
+		case TMK_fan:
+			if (istrue)
+				SECTORSPECIALFLAG(SSF_FAN);
+			break;
+		case TMK_zoomtubestart:
+			if (istrue)
+				SECTORSPECIALFLAG(SSF_ZOOMTUBESTART);
+			break;
+		case TMK_zoomtubeend:
+			if (istrue)
+				SECTORSPECIALFLAG(SSF_ZOOMTUBEEND);
+			break;
+		case TMK_friction:
+			sectors[i].friction = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_gravity:
+			sectors[i].gravity = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_damagetype:
+			if (fastcmp(val, "Generic"))
+				sectors[i].damagetype = SD_GENERIC;
+			if (fastcmp(val, "Lava"))
+				sectors[i].damagetype = SD_LAVA;
+			if (fastcmp(val, "DeathPit"))
+				sectors[i].damagetype = SD_DEATHPIT;
+			if (fastcmp(val, "Instakill"))
+				sectors[i].damagetype = SD_INSTAKILL;
+			if (fastcmp(val, "Stumble"))
+				sectors[i].damagetype = SD_STUMBLE;
+			break;
+		case TMK_action:
+			sectors[i].action = atol(val);
+			break;
+		case TMK_repeatspecial:
+			if (istrue)
+				SECTORACTIVATION((sectors[i].activation & ~SECSPAC_TRIGGERMASK) | SECSPAC_REPEATSPECIAL);
+			break;
+		case TMK_continuousspecial:
+			if (istrue)
+				SECTORACTIVATION((sectors[i].activation & ~SECSPAC_TRIGGERMASK) | SECSPAC_CONTINUOUSSPECIAL);
+			break;
+		case TMK_playerenter:
+			if (istrue)
+				SECTORACTIVATION(SECSPAC_ENTER);
+			break;
+		case TMK_playerfloor:
+			if (istrue)
+				SECTORACTIVATION(SECSPAC_FLOOR);
+			break;
+		case TMK_playerceiling:
+			if (istrue)
+				SECTORACTIVATION(SECSPAC_CEILING);
+			break;
+		case TMK_monsterenter:
+			if (istrue)
+				SECTORACTIVATION(SECSPAC_ENTERMONSTER);
+			break;
+		case TMK_monsterfloor:
+			if (istrue)
+				SECTORACTIVATION(SECSPAC_FLOORMONSTER);
+			break;
+		case TMK_monsterceiling:
+			if (istrue)
+				SECTORACTIVATION(SECSPAC_CEILINGMONSTER);
+			break;
+		case TMK_missileenter:
+			if (istrue)
+				SECTORACTIVATION(SECSPAC_ENTERMISSILE);
+			break;
+		case TMK_missilefloor:
+			if (istrue)
+				SECTORACTIVATION(SECSPAC_FLOORMISSILE);
+			break;
+		case TMK_missileceiling:
+			if (istrue)
+				SECTORACTIVATION(SECSPAC_CEILINGMISSILE);
+			break;
+		default:
+			if (fastncmp(param, "stringarg", 9) && strlen(param) > 9)
+			{
+				size_t argnum = atol(param + 9);
+				if (argnum >= NUM_SCRIPT_STRINGARGS)
+					return;
+				sectors[i].stringargs[argnum] = static_cast<char*>(Z_Malloc(strlen(val) + 1, PU_LEVEL, NULL));
+				M_Memcpy(sectors[i].stringargs[argnum], val, strlen(val) + 1);
+			}
+			else if (fastncmp(param, "arg", 3) && strlen(param) > 3)
+			{
+				size_t argnum = atol(param + 3);
+				if (argnum >= NUM_SCRIPT_ARGS)
+					return;
+				sectors[i].args[argnum] = atol(val);
+			}
+			else
+				ParseUserProperty(&sectors[i].user, param, val);
+			break;
 	}
-	else if (fastcmp(param, "xpanningfloor"))
-		sectors[i].floor_xoffs = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "ypanningfloor"))
-		sectors[i].floor_yoffs = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "xpanningceiling"))
-		sectors[i].ceiling_xoffs = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "ypanningceiling"))
-		sectors[i].ceiling_yoffs = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "rotationfloor"))
-		sectors[i].floorpic_angle = FixedAngle(FLOAT_TO_FIXED(atof(val)));
-	else if (fastcmp(param, "rotationceiling"))
-		sectors[i].ceilingpic_angle = FixedAngle(FLOAT_TO_FIXED(atof(val)));
-	else if (fastcmp(param, "floorplane_a"))
+}
+
+#undef SECTORFLAG
+#undef SECTORSPECIALFLAG
+#undef SECTORACTIVATION
+
+static void ParseTextmapSidedefParameter(UINT32 i, textmapkey_t key, const char *param, const char *val)
+{
+	switch (key)
 	{
-		textmap_planefloor.defined |= PD_A;
-		textmap_planefloor.a = FLOAT_TO_FIXED(atof(val));
+		case TMK_offsetx:
+			sides[i].textureoffset = atol(val)<<FRACBITS;
+			break;
+		case TMK_offsety:
+			sides[i].rowoffset = atol(val)<<FRACBITS;
+			break;
+		case TMK_texturetop:
+			sides[i].toptexture = R_TextureNumForName(val);
+			break;
+		case TMK_texturebottom:
+			sides[i].bottomtexture = R_TextureNumForName(val);
+			break;
+		case TMK_texturemiddle:
+			sides[i].midtexture = R_TextureNumForName(val);
+			break;
+		case TMK_sector:
+			P_SetSidedefSector(i, atol(val));
+			break;
+		case TMK_repeatcnt:
+			sides[i].repeatcnt = atol(val);
+			break;
+		default:
+			ParseUserProperty(&sides[i].user, param, val);
+			break;
 	}
-	else if (fastcmp(param, "floorplane_b"))
+}
+
+static void ParseTextmapLinedefParameter(UINT32 i, textmapkey_t key, const char *param, const char *val)
+{
+	const boolean istrue = fastcmp("true", val);
+
+	switch (key)
 	{
-		textmap_planefloor.defined |= PD_B;
-		textmap_planefloor.b = FLOAT_TO_FIXED(atof(val));
+		case TMK_id:
+			Tag_FSet(&lines[i].tags, atol(val));
+			break;
+		case TMK_moreids:
+		{
+			const char* id = val;
+			while (id)
+			{
+				Tag_Add(&lines[i].tags, atol(id));
+				if ((id = strchr(id, ' ')))
+					id++;
+			}
+			break;
+		}
+		case TMK_special:
+			lines[i].special = atol(val);
+			break;
+		case TMK_v1:
+			P_SetLinedefV1(i, atol(val));
+			break;
+		case TMK_v2:
+			P_SetLinedefV2(i, atol(val));
+			break;
+		case TMK_sidefront:
+			lines[i].sidenum[0] = atol(val);
+			break;
+		case TMK_sideback:
+			lines[i].sidenum[1] = atol(val);
+			break;
+		case TMK_alpha:
+			lines[i].alpha = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_blendmode:
+		case TMK_renderstyle:
+			if (fastcmp(val, "translucent"))
+				lines[i].blendmode = AST_COPY;
+			else if (fastcmp(val, "add"))
+				lines[i].blendmode = AST_ADD;
+			else if (fastcmp(val, "subtract"))
+				lines[i].blendmode = AST_SUBTRACT;
+			else if (fastcmp(val, "reversesubtract"))
+				lines[i].blendmode = AST_REVERSESUBTRACT;
+			else if (fastcmp(val, "modulate"))
+				lines[i].blendmode = AST_MODULATE;
+			if (fastcmp(val, "fog"))
+				lines[i].blendmode = AST_FOG;
+			break;
+		// Flags
+		case TMK_blocking:
+			if (istrue)
+				lines[i].flags |= ML_IMPASSABLE;
+			break;
+		case TMK_blockplayers:
+			if (istrue)
+				lines[i].flags |= ML_BLOCKPLAYERS;
+			break;
+		case TMK_twosided:
+			if (istrue)
+				lines[i].flags |= ML_TWOSIDED;
+			break;
+		case TMK_dontpegtop:
+			if (istrue)
+				lines[i].flags |= ML_DONTPEGTOP;
+			break;
+		case TMK_dontpegbottom:
+			if (istrue)
+				lines[i].flags |= ML_DONTPEGBOTTOM;
+			break;
+		case TMK_skewtd:
+			if (istrue)
+				lines[i].flags |= ML_SKEWTD;
+			break;
+		case TMK_noclimb:
+			if (istrue)
+				lines[i].flags |= ML_NOCLIMB;
+			break;
+		case TMK_noskew:
+			if (istrue)
+				lines[i].flags |= ML_NOSKEW;
+			break;
+		case TMK_midpeg:
+			if (istrue)
+				lines[i].flags |= ML_MIDPEG;
+			break;
+		case TMK_midsolid:
+			if (istrue)
+				lines[i].flags |= ML_MIDSOLID;
+			break;
+		case TMK_wrapmidtex:
+			if (istrue)
+				lines[i].flags |= ML_WRAPMIDTEX;
+			break;
+		case TMK_blockmonsters:
+			if (istrue)
+				lines[i].flags |= ML_BLOCKMONSTERS;
+			break;
+		case TMK_nonet:
+			if (istrue)
+				lines[i].flags |= ML_NONET;
+			break;
+		case TMK_netonly:
+			if (istrue)
+				lines[i].flags |= ML_NETONLY;
+			break;
+		case TMK_notbouncy:
+			if (istrue)
+				lines[i].flags |= ML_NOTBOUNCY;
+			break;
+		case TMK_transfer:
+			if (istrue)
+				lines[i].flags |= ML_TFERLINE;
+			break;
+		// Activation flags
+		case TMK_repeatspecial:
+			if (istrue)
+				lines[i].activation |= SPAC_REPEATSPECIAL;
+			break;
+		case TMK_playercross:
+			if (istrue)
+				lines[i].activation |= SPAC_CROSS;
+			break;
+		case TMK_monstercross:
+			if (istrue)
+				lines[i].activation |= SPAC_CROSSMONSTER;
+			break;
+		case TMK_missilecross:
+			if (istrue)
+				lines[i].activation |= SPAC_CROSSMISSILE;
+			break;
+		case TMK_playerpush:
+			if (istrue)
+				lines[i].activation |= SPAC_PUSH;
+			break;
+		case TMK_monsterpush:
+			if (istrue)
+				lines[i].activation |= SPAC_PUSHMONSTER;
+			break;
+		case TMK_impact:
+			if (istrue)
+				lines[i].activation |= SPAC_IMPACT;
+			break;
+		default:
+			if (fastncmp(param, "stringarg", 9) && strlen(param) > 9)
+			{
+				size_t argnum = atol(param + 9);
+				if (argnum >= NUM_SCRIPT_STRINGARGS)
+					return;
+				lines[i].stringargs[argnum] = static_cast<char*>(Z_Malloc(strlen(val) + 1, PU_LEVEL, NULL));
+				M_Memcpy(lines[i].stringargs[argnum], val, strlen(val) + 1);
+			}
+			else if (fastncmp(param, "arg", 3) && strlen(param) > 3)
+			{
+				size_t argnum = atol(param + 3);
+				if (argnum >= NUM_SCRIPT_ARGS)
+					return;
+				lines[i].args[argnum] = atol(val);
+			}
+			else
+				ParseUserProperty(&lines[i].user, param, val);
+			break;
 	}
-	else if (fastcmp(param, "floorplane_c"))
-	{
-		textmap_planefloor.defined |= PD_C;
-		textmap_planefloor.c = FLOAT_TO_FIXED(atof(val));
-	}
-	else if (fastcmp(param, "floorplane_d"))
-	{
-		textmap_planefloor.defined |= PD_D;
-		textmap_planefloor.d = FLOAT_TO_FIXED(atof(val));
-	}
-	else if (fastcmp(param, "ceilingplane_a"))
-	{
-		textmap_planeceiling.defined |= PD_A;
-		textmap_planeceiling.a = FLOAT_TO_FIXED(atof(val));
-	}
-	else if (fastcmp(param, "ceilingplane_b"))
-	{
-		textmap_planeceiling.defined |= PD_B;
-		textmap_planeceiling.b = FLOAT_TO_FIXED(atof(val));
-	}
-	else if (fastcmp(param, "ceilingplane_c"))
-	{
-		textmap_planeceiling.defined |= PD_C;
-		textmap_planeceiling.c = FLOAT_TO_FIXED(atof(val));
-	}
-	else if (fastcmp(param, "ceilingplane_d"))
-	{
-		textmap_planeceiling.defined |= PD_D;
-		textmap_planeceiling.d = FLOAT_TO_FIXED(atof(val));
-	}
-	else if (fastcmp(param, "lightcolor"))
-	{
-		textmap_colormap.used = true;
-		textmap_colormap.lightcolor = atol(val);
-	}
-	else if (fastcmp(param, "lightalpha"))
-	{
-		textmap_colormap.used = true;
-		textmap_colormap.lightalpha = atol(val);
-	}
-	else if (fastcmp(param, "fadecolor"))
-	{
-		textmap_colormap.used = true;
-		textmap_colormap.fadecolor = atol(val);
-	}
-	else if (fastcmp(param, "fadealpha"))
-	{
-		textmap_colormap.used = true;
-		textmap_colormap.fadealpha = atol(val);
-	}
-	else if (fastcmp(param, "fadestart"))
-	{
-		textmap_colormap.used = true;
-		textmap_colormap.fadestart = atol(val);
-	}
-	else if (fastcmp(param, "fadeend"))
-	{
-		textmap_colormap.used = true;
-		textmap_colormap.fadeend = atol(val);
-	}
-	else if (fastcmp(param, "colormapfog") && fastcmp("true", val))
-	{
-		textmap_colormap.used = true;
-		textmap_colormap.flags |= CMF_FOG;
-	}
-	else if (fastcmp(param, "colormapfadesprites") && fastcmp("true", val))
-	{
-		textmap_colormap.used = true;
-		textmap_colormap.flags |= CMF_FADEFULLBRIGHTSPRITES;
-	}
-	else if (fastcmp(param, "colormapprotected") && fastcmp("true", val))
-		sectors[i].colormap_protected = true;
-	else if (fastcmp(param, "flipspecial_nofloor") && fastcmp("true", val))
-		sectors[i].flags = static_cast<sectorflags_t>(sectors[i].flags & ~MSF_FLIPSPECIAL_FLOOR);
-	else if (fastcmp(param, "flipspecial_ceiling") && fastcmp("true", val))
-		sectors[i].flags = static_cast<sectorflags_t>(sectors[i].flags | MSF_FLIPSPECIAL_CEILING);
-	else if (fastcmp(param, "triggerspecial_touch") && fastcmp("true", val))
-		sectors[i].flags = static_cast<sectorflags_t>(sectors[i].flags | MSF_TRIGGERSPECIAL_TOUCH);
-	else if (fastcmp(param, "triggerspecial_headbump") && fastcmp("true", val))
-		sectors[i].flags = static_cast<sectorflags_t>(sectors[i].flags | MSF_TRIGGERSPECIAL_HEADBUMP);
-	else if (fastcmp(param, "invertprecip") && fastcmp("true", val))
-		sectors[i].flags = static_cast<sectorflags_t>(sectors[i].flags | MSF_INVERTPRECIP);
-	else if (fastcmp(param, "gravityflip") && fastcmp("true", val))
-		sectors[i].flags = static_cast<sectorflags_t>(sectors[i].flags | MSF_GRAVITYFLIP);
-	else if (fastcmp(param, "heatwave") && fastcmp("true", val))
-		sectors[i].flags = static_cast<sectorflags_t>(sectors[i].flags | MSF_HEATWAVE);
-	else if (fastcmp(param, "noclipcamera") && fastcmp("true", val))
-		sectors[i].flags = static_cast<sectorflags_t>(sectors[i].flags | MSF_NOCLIPCAMERA);
-	else if (fastcmp(param, "ripple_floor") && fastcmp("true", val))
-		sectors[i].flags = static_cast<sectorflags_t>(sectors[i].flags | MSF_RIPPLE_FLOOR);
-	else if (fastcmp(param, "ripple_ceiling") && fastcmp("true", val))
-		sectors[i].flags = static_cast<sectorflags_t>(sectors[i].flags | MSF_RIPPLE_CEILING);
-	else if (fastcmp(param, "invertencore") && fastcmp("true", val))
-		sectors[i].flags = static_cast<sectorflags_t>(sectors[i].flags | MSF_INVERTENCORE);
-	else if (fastcmp(param, "flatlighting") && fastcmp("true", val))
-		sectors[i].flags = static_cast<sectorflags_t>(sectors[i].flags | MSF_FLATLIGHTING);
-	else if (fastcmp(param, "forcedirectionallighting") && fastcmp("true", val))
-		sectors[i].flags = static_cast<sectorflags_t>(sectors[i].flags | MSF_DIRECTIONLIGHTING);
-	else if (fastcmp(param, "nostepup") && fastcmp("true", val))
-		sectors[i].specialflags = static_cast<sectorspecialflags_t>(sectors[i].specialflags | SSF_NOSTEPUP);
-	else if (fastcmp(param, "doublestepup") && fastcmp("true", val))
-		sectors[i].specialflags = static_cast<sectorspecialflags_t>(sectors[i].specialflags | SSF_DOUBLESTEPUP);
-	else if (fastcmp(param, "nostepdown") && fastcmp("true", val))
-		sectors[i].specialflags = static_cast<sectorspecialflags_t>(sectors[i].specialflags | SSF_NOSTEPDOWN);
-	else if ((fastcmp(param, "cheatcheckactivator") || fastcmp(param, "starpostactivator")) && fastcmp("true", val))
-		sectors[i].specialflags = static_cast<sectorspecialflags_t>(sectors[i].specialflags | SSF_CHEATCHECKACTIVATOR);
-	else if (fastcmp(param, "exit") && fastcmp("true", val))
-		sectors[i].specialflags = static_cast<sectorspecialflags_t>(sectors[i].specialflags | SSF_EXIT);
-	else if (fastcmp(param, "deleteitems") && fastcmp("true", val))
-		sectors[i].specialflags = static_cast<sectorspecialflags_t>(sectors[i].specialflags | SSF_DELETEITEMS);
-	else if (fastcmp(param, "fan") && fastcmp("true", val))
-		sectors[i].specialflags = static_cast<sectorspecialflags_t>(sectors[i].specialflags | SSF_FAN);
-	else if (fastcmp(param, "zoomtubestart") && fastcmp("true", val))
-		sectors[i].specialflags = static_cast<sectorspecialflags_t>(sectors[i].specialflags | SSF_ZOOMTUBESTART);
-	else if (fastcmp(param, "zoomtubeend") && fastcmp("true", val))
-		sectors[i].specialflags = static_cast<sectorspecialflags_t>(sectors[i].specialflags | SSF_ZOOMTUBEEND);
-	else if (fastcmp(param, "friction"))
-		sectors[i].friction = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "gravity"))
-		sectors[i].gravity = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "damagetype"))
-	{
-		if (fastcmp(val, "Generic"))
-			sectors[i].damagetype = SD_GENERIC;
-		if (fastcmp(val, "Lava"))
-			sectors[i].damagetype = SD_LAVA;
-		if (fastcmp(val, "DeathPit"))
-			sectors[i].damagetype = SD_DEATHPIT;
-		if (fastcmp(val, "Instakill"))
-			sectors[i].damagetype = SD_INSTAKILL;
-		if (fastcmp(val, "Stumble"))
-			sectors[i].damagetype = SD_STUMBLE;
-	}
-	else if (fastcmp(param, "action"))
-		sectors[i].action = atol(val);
-	else if (fastncmp(param, "stringarg", 9) && strlen(param) > 9)
-	{
-		size_t argnum = atol(param + 9);
-		if (argnum >= NUM_SCRIPT_STRINGARGS)
-			return;
-		sectors[i].stringargs[argnum] = static_cast<char*>(Z_Malloc(strlen(val) + 1, PU_LEVEL, NULL));
-		M_Memcpy(sectors[i].stringargs[argnum], val, strlen(val) + 1);
+}
+
+static void ParseTextmapThingParameter(UINT32 i, textmapkey_t key, const char *param, const char *val)
+{
+	switch (key)
+	{
+		case TMK_id:
+			mapthings[i].tid = atol(val);
+			break;
+		case TMK_x:
+			mapthings[i].x = atol(val);
+			break;
+		case TMK_y:
+			mapthings[i].y = atol(val);
+			break;
+		case TMK_height:
+			mapthings[i].z = atol(val);
+			break;
+		case TMK_angle:
+			mapthings[i].angle = atol(val);
+			break;
+		case TMK_pitch:
+			mapthings[i].pitch = atol(val);
+			break;
+		case TMK_roll:
+			mapthings[i].roll = atol(val);
+			break;
+		case TMK_type:
+			mapthings[i].type = atol(val);
+			break;
+		case TMK_scale:
+			if (udmf_version < 1)
+			{
+				mapthings[i].scale = FLOAT_TO_FIXED(atof(val));
+			}
+			else
+			{
+				mapthings[i].spritexscale = mapthings[i].spriteyscale = FLOAT_TO_FIXED(atof(val));
+			}
+			break;
+		case TMK_scalex:
+			if (udmf_version < 1)
+			{
+				mapthings[i].scale = FLOAT_TO_FIXED(atof(val));
+			}
+			else
+			{
+				mapthings[i].spritexscale = FLOAT_TO_FIXED(atof(val));
+			}
+			break;
+		case TMK_scaley:
+			if (udmf_version < 1)
+			{
+				mapthings[i].scale = FLOAT_TO_FIXED(atof(val));
+			}
+			else
+			{
+				mapthings[i].spriteyscale = FLOAT_TO_FIXED(atof(val));
+			}
+			break;
+		case TMK_mobjscale:
+			mapthings[i].scale = FLOAT_TO_FIXED(atof(val));
+			break;
+		// Flags
+		case TMK_flip:
+			if (fastcmp("true", val))
+				mapthings[i].options |= MTF_OBJECTFLIP;
+			break;
+		case TMK_special:
+			mapthings[i].special = atol(val);
+			break;
+		case TMK_foflayer:
+			mapthings[i].layer = atol(val);
+			break;
+		default:
+			if (fastncmp(param, "stringarg", 9) && strlen(param) > 9)
+			{
+				if (udmf_version < 1)
+				{
+					size_t argnum = atol(param + 9);
+					if (argnum >= NUM_MAPTHING_STRINGARGS)
+						return;
+					size_t len = strlen(val);
+					mapthings[i].thing_stringargs[argnum] = static_cast<char*>(Z_Malloc(len + 1, PU_LEVEL, NULL));
+					M_Memcpy(mapthings[i].thing_stringargs[argnum], val, len);
+					mapthings[i].thing_stringargs[argnum][len] = '\0';
+				}
+				else
+				{
+					size_t argnum = atol(param + 9);
+					if (argnum >= NUM_SCRIPT_STRINGARGS)
+						return;
+					size_t len = strlen(val);
+					mapthings[i].script_stringargs[argnum] = static_cast<char*>(Z_Malloc(len + 1, PU_LEVEL, NULL));
+					M_Memcpy(mapthings[i].script_stringargs[argnum], val, len);
+					mapthings[i].script_stringargs[argnum][len] = '\0';
+				}
+			}
+			else if (fastncmp(param, "arg", 3) && strlen(param) > 3)
+			{
+				if (udmf_version < 1)
+				{
+					size_t argnum = atol(param + 3);
+					if (argnum >= NUM_MAPTHING_ARGS)
+						return;
+					mapthings[i].thing_args[argnum] = atol(val);
+				}
+				else
+				{
+					size_t argnum = atol(param + 3);
+					if (argnum >= NUM_SCRIPT_ARGS)
+						return;
+					mapthings[i].script_args[argnum] = atol(val);
+				}
+			}
+			else if (fastncmp(param, "thingstringarg", 14) && strlen(param) > 14)
+			{
+				size_t argnum = atol(param + 14);
+				if (argnum >= NUM_MAPTHING_STRINGARGS)
+					return;
+				size_t len = strlen(val);
+				mapthings[i].thing_stringargs[argnum] = static_cast<char*>(Z_Malloc(len + 1, PU_LEVEL, NULL));
+				M_Memcpy(mapthings[i].thing_stringargs[argnum], val, len);
+				mapthings[i].thing_stringargs[argnum][len] = '\0';
+			}
+			else if (fastncmp(param, "thingarg", 8) && strlen(param) > 8)
+			{
+				size_t argnum = atol(param + 8);
+				if (argnum >= NUM_MAPTHING_ARGS)
+					return;
+				mapthings[i].thing_args[argnum] = atol(val);
+			}
+			else
+				ParseUserProperty(&mapthings[i].user, param, val);
+			break;
+	}
+}
+
+// A key and value read from a {}-encapsulated block ahead of time, as
+// offsets of NUL-terminated copies in the arena of the job that read it.
+typedef struct
+{
+	UINT32 param, val;
+	textmapkey_t key;
+	boolean isstring;
+} textmapfield_t;
+
+// Blocks are read TEXTMAPLEXCHUNK at a time, each chunk as one job on
+// the thread pool. Reading a block only touches the TEXTMAP and the
+// job itself; the parsers, which touch the zone and level data, are
+// then run over the results one block at a time on the main thread.
+#define TEXTMAPLEXCHUNK 512
+
+typedef struct
+{
+	const UINT32 *positions;
+	size_t count;
+	std::vector<char> arena;
+	std::vector<textmapfield_t> fields;
+	std::vector<UINT32> firstfield; // count + 1, the last one past the end
+	std::vector<UINT8> invalid;
+} textmaplexjob_t;
+
+static UINT32 TextmapLexCopy(textmaplexjob_t *job, const char *str, size_t len)
+{
+	const UINT32 offset = job->arena.size();
+
+	job->arena.insert(job->arena.end(), str, str + len);
+	job->arena.push_back('\0');
+
+	return offset;
+}
+
+static void TextmapLexBlocks(textmaplexjob_t *job, const char *data, size_t size)
+{
+	tokenizer_t t;
+	size_t b;
+
+	M_TokenizerInit(&t, data, size);
+
+	job->firstfield.reserve(job->count + 1);
+	job->invalid.assign(job->count, false);
+
+	for (b = 0; b < job->count; b++)
+	{
+		job->firstfield.push_back(job->fields.size());
+
+		t.endPos = job->positions[b];
+		t.inComment = 0;
+		if (!M_TokenizerNext(&t) || t.tokenLength != 1 || data[t.startPos] != '{')
+		{
+			job->invalid[b] = true;
+			continue;
+		}
+
+		while (M_TokenizerNext(&t))
+		{
+			textmapfield_t field;
+
+			if (t.tokenLength == 1 && data[t.startPos] == '}')
+				break;
+
+			field.param = TextmapLexCopy(job, data + t.startPos, t.tokenLength);
+			field.key = TextmapLookupKey(&job->arena[field.param], t.tokenLength);
+
+			if (M_TokenizerNext(&t))
+			{
+				field.val = TextmapLexCopy(job, data + t.startPos, t.tokenLength);
+				field.isstring = t.isString;
+			}
+			else
+			{
+				field.val = TextmapLexCopy(job, "", 0);
+				field.isstring = false;
+			}
+
+			job->fields.push_back(field);
+		}
 	}
-	else if (fastncmp(param, "arg", 3) && strlen(param) > 3)
+
+	job->firstfield.push_back(job->fields.size());
+}
+
+enum
+{
+	LEX_VERTEXES,
+	LEX_SECTORS,
+	LEX_LINES,
+	LEX_SIDES,
+	LEX_THINGS,
+	NUMLEXTABLES
+};
+
+// Blocks of the map being loaded, as read by TextmapLex or from the map cache.
+static std::vector<textmaplexjob_t> textmaplex[NUMLEXTABLES];
+
+/** Reads every block TextmapCount found into textmaplex, on the thread pool if there is one.
+  *
+  * \param data TEXTMAP lump.
+  * \param size TEXTMAP lump size.
+  */
+static void TextmapLex(const char *data, size_t size)
+{
+	TracyCZone(__zone, true);
+
+	const UINT32 *positions[NUMLEXTABLES] = {vertexesPos, sectorsPos, linesPos, sidesPos, mapthingsPos};
+	const size_t counts[NUMLEXTABLES] = {numvertexes, numsectors, numlines, numsides, nummapthings};
+	size_t t, j;
+
+	for (t = 0; t < NUMLEXTABLES; t++)
 	{
-		size_t argnum = atol(param + 3);
-		if (argnum >= NUM_SCRIPT_ARGS)
-			return;
-		sectors[i].args[argnum] = atol(val);
-	}
-	else if (fastcmp(param, "repeatspecial") && fastcmp("true", val))
-		sectors[i].activation = static_cast<sectoractionflags_t>(sectors[i].activation | ((sectors[i].activation & ~SECSPAC_TRIGGERMASK) | SECSPAC_REPEATSPECIAL));
-	else if (fastcmp(param, "continuousspecial") && fastcmp("true", val))
-		sectors[i].activation = static_cast<sectoractionflags_t>(sectors[i].activation | ((sectors[i].activation & ~SECSPAC_TRIGGERMASK) | SECSPAC_CONTINUOUSSPECIAL));
-	else if (fastcmp(param, "playerenter") && fastcmp("true", val))
-		sectors[i].activation = static_cast<sectoractionflags_t>(sectors[i].activation | SECSPAC_ENTER);
-	else if (fastcmp(param, "playerfloor") && fastcmp("true", val))
-		sectors[i].activation = static_cast<sectoractionflags_t>(sectors[i].activation | SECSPAC_FLOOR);
-	else if (fastcmp(param, "playerceiling") && fastcmp("true", val))
-		sectors[i].activation = static_cast<sectoractionflags_t>(sectors[i].activation | SECSPAC_CEILING);
-	else if (fastcmp(param, "monsterenter") && fastcmp("true", val))
-		sectors[i].activation = static_cast<sectoractionflags_t>(sectors[i].activation | SECSPAC_ENTERMONSTER);
-	else if (fastcmp(param, "monsterfloor") && fastcmp("true", val))
-		sectors[i].activation = static_cast<sectoractionflags_t>(sectors[i].activation | SECSPAC_FLOORMONSTER);
-	else if (fastcmp(param, "monsterceiling") && fastcmp("true", val))
-		sectors[i].activation = static_cast<sectoractionflags_t>(sectors[i].activation | SECSPAC_CEILINGMONSTER);
-	else if (fastcmp(param, "missileenter") && fastcmp("true", val))
-		sectors[i].activation = static_cast<sectoractionflags_t>(sectors[i].activation | SECSPAC_ENTERMISSILE);
-	else if (fastcmp(param, "missilefloor") && fastcmp("true", val))
-		sectors[i].activation = static_cast<sectoractionflags_t>(sectors[i].activation | SECSPAC_FLOORMISSILE);
-	else if (fastcmp(param, "missileceiling") && fastcmp("true", val))
-		sectors[i].activation = static_cast<sectoractionflags_t>(sectors[i].activation | SECSPAC_CEILINGMISSILE);
-	else
-		ParseUserProperty(&sectors[i].user, param, val);
-}
-
-static void ParseTextmapSidedefParameter(UINT32 i, const char *param, const char *val)
-{
-	if (fastcmp(param, "offsetx"))
-		sides[i].textureoffset = atol(val)<<FRACBITS;
-	else if (fastcmp(param, "offsety"))
-		sides[i].rowoffset = atol(val)<<FRACBITS;
-	else if (fastcmp(param, "texturetop"))
-		sides[i].toptexture = R_TextureNumForName(val);
-	else if (fastcmp(param, "texturebottom"))
-		sides[i].bottomtexture = R_TextureNumForName(val);
-	else if (fastcmp(param, "texturemiddle"))
-		sides[i].midtexture = R_TextureNumForName(val);
-	else if (fastcmp(param, "sector"))
-		P_SetSidedefSector(i, atol(val));
-	else if (fastcmp(param, "repeatcnt"))
-		sides[i].repeatcnt = atol(val);
+		textmaplex[t].clear();
+		textmaplex[t].resize((counts[t] + TEXTMAPLEXCHUNK - 1) / TEXTMAPLEXCHUNK);
+
+		for (j = 0; j < textmaplex[t].size(); j++)
+		{
+			textmaplex[t][j].positions = positions[t] + j * TEXTMAPLEXCHUNK;
+			textmaplex[t][j].count = std::min<size_t>(counts[t] - j * TEXTMAPLEXCHUNK, TEXTMAPLEXCHUNK);
+		}
+	}
+
+	if (srb2::g_main_threadpool)
+	{
+		srb2::ThreadPool::Sema sema;
+
+		srb2::g_main_threadpool->begin_sema();
+		for (t = 0; t < NUMLEXTABLES; t++)
+		{
+			for (j = 0; j < textmaplex[t].size(); j++)
+			{
+				textmaplexjob_t *job = &textmaplex[t][j];
+				srb2::g_main_threadpool->schedule([job, data, size]() { TextmapLexBlocks(job, data, size); });
+			}
+		}
+		sema = srb2::g_main_threadpool->end_sema();
+		srb2::g_main_threadpool->notify_sema(sema);
+		srb2::g_main_threadpool->wait_sema(sema);
+	}
 	else
-		ParseUserProperty(&sides[i].user, param, val);
+	{
+		for (t = 0; t < NUMLEXTABLES; t++)
+			for (j = 0; j < textmaplex[t].size(); j++)
+				TextmapLexBlocks(&textmaplex[t][j], data, size);
+	}
+
+	TracyCZoneEnd(__zone);
 }
 
-static void ParseTextmapLinedefParameter(UINT32 i, const char *param, const char *val)
+// Gives back the memory of textmaplex once the level is loaded.
+static void TextmapLexFree(void)
 {
-	if (fastcmp(param, "id"))
-		Tag_FSet(&lines[i].tags, atol(val));
-	else if (fastcmp(param, "moreids"))
+	size_t t;
+
+	for (t = 0; t < NUMLEXTABLES; t++)
+		std::vector<textmaplexjob_t>().swap(textmaplex[t]);
+}
+
+//
+// Map cache
+//
+// Reading a UDMF map takes two passes over its TEXTMAP, and UDMF maps
+// rarely come with a blockmap, so one is built on every load too. None
+// of it changes unless the TEXTMAP does, so the blocks as TextmapLex
+// read them, and the blockmap P_CreateBlockMap built, are kept on disk
+// under the TEXTMAP's MD5. Loading the same map again reads both back
+// as they are. The parsers still run, since texture and flat numbers
+// depend on the addons loaded at the time.
+//
+
+#define MAPCACHEDIR "mapcache"
+#define MAPCACHEHEADER "RRMAPCACHE"
+#define MAPCACHEHEADERLEN 10
+#define MAPCACHEVERSION 2
+
+// Whether P_CreateBlockMap built the blockmap of this map
+static boolean createdblockmap;
+
+// Cache file of the map being loaded, if there was one to read
+static UINT8 *mapcachefile;
+
+// The blockmap in it, if any
+static const UINT8 *mapcacheblockmap;
+static size_t mapcacheblockmapsize; // in blocks
+static fixed_t mapcachebmaporgx, mapcachebmaporgy;
+static INT32 mapcachebmapwidth, mapcachebmapheight;
+
+// Changes whenever a key is added to or renamed in TEXTMAPKEYS, since
+// the cache stores keys by number.
+static constexpr UINT32 TextmapKeysFingerprint(void)
+{
+	UINT32 hash = 2166136261u ^ TEXTMAPKEYSEED;
+
+	for (size_t k = 0; k < NUMTEXTMAPKEYS; k++)
+	{
+		for (const char *c = textmapkeynames[k]; *c; c++)
+		{
+			hash ^= static_cast<UINT8>(*c);
+			hash *= 16777619u;
+		}
+
+		hash ^= '\n';
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static const char *P_MapCachePath(void)
+{
+	char md5hex[33];
+	size_t i;
+
+	for (i = 0; i < 16; i++)
+		sprintf(&md5hex[i*2], "%02x", mapmd5[i]);
+
+	return va("%s" PATHSEP MAPCACHEDIR PATHSEP "%s", srb2home, md5hex);
+}
+
+static boolean P_MapCacheEnabled(void)
+{
+#ifdef NOMD5
+	// Every map would share the same all-zero MD5
+	return false;
+#else
+	return cv_mapcache.value;
+#endif
+}
+
+// Reads one of the textmaplex jobs back. Offsets in the fields are
+// checked, since the parsers take them on trust.
+static boolean P_ReadMapCacheJob(textmaplexjob_t *job, const UINT8 **pp, const UINT8 *end)
+{
+	const UINT8 *p = *pp;
+	UINT32 arenasize, numfields, i;
+
+	if (end - p < 4)
+		return false;
+	arenasize = READUINT32(p);
+	if ((size_t)(end - p) < (size_t)arenasize + 4 || (arenasize && p[arenasize - 1] != '\0'))
+		return false;
+	job->arena.assign(p, p + arenasize);
+	p += arenasize;
+
+	numfields = READUINT32(p);
+	if ((size_t)(end - p) < (size_t)numfields * 10 + (job->count + 1) * 4 + job->count)
+		return false;
+	job->fields.resize(numfields);
+	for (i = 0; i < numfields; i++)
+	{
+		textmapfield_t *field = &job->fields[i];
+
+		field->param = READUINT32(p);
+		field->val = READUINT32(p);
+		field->key = static_cast<textmapkey_t>(READUINT8(p));
+		field->isstring = READUINT8(p);
+
+		if (field->param >= arenasize || field->val >= arenasize || field->key >= NUMTEXTMAPKEYS)
+			return false;
+	}
+
+	job->firstfield.resize(job->count + 1);
+	for (i = 0; i <= job->count; i++)
+	{
+		job->firstfield[i] = READUINT32(p);
+		if (job->firstfield[i] > numfields || (i && job->firstfield[i] < job->firstfield[i - 1]))
+			return false;
+	}
+
+	job->invalid.assign(p, p + job->count);
+	p += job->count;
+
+	*pp = p;
+	return true;
+}
+
+// Checks that the block offsets are in order and fit in the file, and
+// that the lines they list exist.
+static boolean P_CheckMapCacheBlockMap(const UINT8 *p, const UINT8 *end)
+{
+	const size_t numblocks = mapcacheblockmapsize;
+	UINT32 offset, total = 0;
+	size_t i;
+
+	if (mapcachebmapwidth <= 0 || mapcachebmapheight <= 0
+		|| (size_t)mapcachebmapwidth * mapcachebmapheight != numblocks
+		|| (size_t)(end - p) / 4 <= numblocks)
+		return false;
+
+	for (i = 0; i <= numblocks; i++)
+	{
+		offset = READUINT32(p);
+		if (offset < total || (i == 0 && offset != 0))
+			return false;
+		total = offset;
+	}
+
+	if ((size_t)(end - p) / 4 < total)
+		return false;
+
+	for (i = 0; i < total; i++)
+	{
+		if (READUINT32(p) >= numlines)
+			return false;
+	}
+
+	return true;
+}
+
+/** Reads the cached blocks of the map being loaded into textmaplex.
+  *
+  * \return true if there was a usable cache file, false if the TEXTMAP
+  *         has to be read.
+  */
+static boolean P_ReadMapCache(void)
+{
+	TracyCZone(__zone, true);
+
+	const UINT8 *p, *end;
+	size_t counts[NUMLEXTABLES];
+	size_t size, t, j;
+	boolean ok = false;
+
+	mapcachefile = NULL;
+	mapcacheblockmap = NULL;
+	mapcacheblockmapsize = 0;
+
+	if (!P_MapCacheEnabled())
+	{
+		TracyCZoneEnd(__zone);
+		return false;
+	}
+
+	size = FIL_ReadFile(P_MapCachePath(), &mapcachefile);
+	if (!size)
+	{
+		mapcachefile = NULL;
+		TracyCZoneEnd(__zone);
+		return false;
+	}
+
+	p = mapcachefile;
+	end = p + size;
+
+	if (size < MAPCACHEHEADERLEN + 2 + 4 + 16 + 4 + NUMLEXTABLES*4 + 4
+		|| memcmp(p, MAPCACHEHEADER, MAPCACHEHEADERLEN))
+		goto done;
+	p += MAPCACHEHEADERLEN;
+
+	if (READUINT16(p) != MAPCACHEVERSION || READUINT32(p) != TextmapKeysFingerprint())
+		goto done;
+
+	if (memcmp(p, mapmd5, 16))
+		goto done;
+	p += 16;
+
+	udmf_version = READINT32(p);
+
+	for (t = 0; t < NUMLEXTABLES; t++)
+	{
+		counts[t] = READUINT32(p);
+		if (counts[t] > UINT16_MAX)
+			goto done;
+	}
+
+	numvertexes = counts[LEX_VERTEXES];
+	numsectors = counts[LEX_SECTORS];
+	numlines = counts[LEX_LINES];
+	numsides = counts[LEX_SIDES];
+	nummapthings = counts[LEX_THINGS];
+
+	for (t = 0; t < NUMLEXTABLES; t++)
 	{
-		const char* id = val;
-		while (id)
+		textmaplex[t].clear();
+		textmaplex[t].resize((counts[t] + TEXTMAPLEXCHUNK - 1) / TEXTMAPLEXCHUNK);
+
+		for (j = 0; j < textmaplex[t].size(); j++)
 		{
-			Tag_Add(&lines[i].tags, atol(id));
-			if ((id = strchr(id, ' ')))
-				id++;
+			textmaplexjob_t *job = &textmaplex[t][j];
+
+			job->positions = NULL;
+			job->count = std::min<size_t>(counts[t] - j * TEXTMAPLEXCHUNK, TEXTMAPLEXCHUNK);
+
+			if (!P_ReadMapCacheJob(job, &p, end))
+				goto done;
 		}
 	}
-	else if (fastcmp(param, "special"))
-		lines[i].special = atol(val);
-	else if (fastcmp(param, "v1"))
-		P_SetLinedefV1(i, atol(val));
-	else if (fastcmp(param, "v2"))
-		P_SetLinedefV2(i, atol(val));
-	else if (fastncmp(param, "stringarg", 9) && strlen(param) > 9)
+
+	if (end - p < 4)
+		goto done;
+	mapcacheblockmapsize = READUINT32(p);
+	if (mapcacheblockmapsize)
 	{
-		size_t argnum = atol(param + 9);
-		if (argnum >= NUM_SCRIPT_STRINGARGS)
-			return;
-		lines[i].stringargs[argnum] = static_cast<char*>(Z_Malloc(strlen(val) + 1, PU_LEVEL, NULL));
-		M_Memcpy(lines[i].stringargs[argnum], val, strlen(val) + 1);
+		if (end - p < 16)
+			goto done;
+
+		mapcachebmaporgx = READFIXED(p);
+		mapcachebmaporgy = READFIXED(p);
+		mapcachebmapwidth = READINT32(p);
+		mapcachebmapheight = READINT32(p);
+		mapcacheblockmap = p;
+
+		if (!P_CheckMapCacheBlockMap(mapcacheblockmap, end))
+			goto done;
 	}
-	else if (fastncmp(param, "arg", 3) && strlen(param) > 3)
+
+	ok = true;
+	CONS_Debug(DBG_SETUP, "Read map from cache %s\n", P_MapCachePath());
+
+done:
+	if (!ok)
 	{
-		size_t argnum = atol(param + 3);
-		if (argnum >= NUM_SCRIPT_ARGS)
-			return;
-		lines[i].args[argnum] = atol(val);
-	}
-	else if (fastcmp(param, "sidefront"))
-		lines[i].sidenum[0] = atol(val);
-	else if (fastcmp(param, "sideback"))
-		lines[i].sidenum[1] = atol(val);
-	else if (fastcmp(param, "alpha"))
-		lines[i].alpha = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "blendmode") || fastcmp(param, "renderstyle"))
-	{
-		if (fastcmp(val, "translucent"))
-			lines[i].blendmode = AST_COPY;
-		else if (fastcmp(val, "add"))
-			lines[i].blendmode = AST_ADD;
-		else if (fastcmp(val, "subtract"))
-			lines[i].blendmode = AST_SUBTRACT;
-		else if (fastcmp(val, "reversesubtract"))
-			lines[i].blendmode = AST_REVERSESUBTRACT;
-		else if (fastcmp(val, "modulate"))
-			lines[i].blendmode = AST_MODULATE;
-		if (fastcmp(val, "fog"))
-			lines[i].blendmode = AST_FOG;
+		CONS_Debug(DBG_SETUP, "Map cache file %s is stale or damaged, rebuilding it\n", P_MapCachePath());
+		udmf_version = 0;
+		Z_Free(mapcachefile);
+		mapcachefile = NULL;
+		mapcacheblockmap = NULL;
+		mapcacheblockmapsize = 0;
 	}
 
-	// Flags
-	else if (fastcmp(param, "blocking") && fastcmp("true", val))
-		lines[i].flags |= ML_IMPASSABLE;
-	else if (fastcmp(param, "blockplayers") && fastcmp("true", val))
-		lines[i].flags |= ML_BLOCKPLAYERS;
-	else if (fastcmp(param, "twosided") && fastcmp("true", val))
-		lines[i].flags |= ML_TWOSIDED;
-	else if (fastcmp(param, "dontpegtop") && fastcmp("true", val))
-		lines[i].flags |= ML_DONTPEGTOP;
-	else if (fastcmp(param, "dontpegbottom") && fastcmp("true", val))
-		lines[i].flags |= ML_DONTPEGBOTTOM;
-	else if (fastcmp(param, "skewtd") && fastcmp("true", val))
-		lines[i].flags |= ML_SKEWTD;
-	else if (fastcmp(param, "noclimb") && fastcmp("true", val))
-		lines[i].flags |= ML_NOCLIMB;
-	else if (fastcmp(param, "noskew") && fastcmp("true", val))
-		lines[i].flags |= ML_NOSKEW;
-	else if (fastcmp(param, "midpeg") && fastcmp("true", val))
-		lines[i].flags |= ML_MIDPEG;
-	else if (fastcmp(param, "midsolid") && fastcmp("true", val))
-		lines[i].flags |= ML_MIDSOLID;
-	else if (fastcmp(param, "wrapmidtex") && fastcmp("true", val))
-		lines[i].flags |= ML_WRAPMIDTEX;
-	else if (fastcmp(param, "blockmonsters") && fastcmp("true", val))
-		lines[i].flags |= ML_BLOCKMONSTERS;
-	else if (fastcmp(param, "nonet") && fastcmp("true", val))
-		lines[i].flags |= ML_NONET;
-	else if (fastcmp(param, "netonly") && fastcmp("true", val))
-		lines[i].flags |= ML_NETONLY;
-	else if (fastcmp(param, "notbouncy") && fastcmp("true", val))
-		lines[i].flags |= ML_NOTBOUNCY;
-	else if (fastcmp(param, "transfer") && fastcmp("true", val))
-		lines[i].flags |= ML_TFERLINE;
-	// Activation flags
-	else if (fastcmp(param, "repeatspecial") && fastcmp("true", val))
-		lines[i].activation |= SPAC_REPEATSPECIAL;
-	else if (fastcmp(param, "playercross") && fastcmp("true", val))
-		lines[i].activation |= SPAC_CROSS;
-	else if (fastcmp(param, "monstercross") && fastcmp("true", val))
-		lines[i].activation |= SPAC_CROSSMONSTER;
-	else if (fastcmp(param, "missilecross") && fastcmp("true", val))
-		lines[i].activation |= SPAC_CROSSMISSILE;
-	else if (fastcmp(param, "playerpush") && fastcmp("true", val))
-		lines[i].activation |= SPAC_PUSH;
-	else if (fastcmp(param, "monsterpush") && fastcmp("true", val))
-		lines[i].activation |= SPAC_PUSHMONSTER;
-	else if (fastcmp(param, "impact") && fastcmp("true", val))
-		lines[i].activation |= SPAC_IMPACT;
-	else
-		ParseUserProperty(&lines[i].user, param, val);
-}
-
-static void ParseTextmapThingParameter(UINT32 i, const char *param, const char *val)
-{
-	if (fastcmp(param, "id"))
-		mapthings[i].tid = atol(val);
-	else if (fastcmp(param, "x"))
-		mapthings[i].x = atol(val);
-	else if (fastcmp(param, "y"))
-		mapthings[i].y = atol(val);
-	else if (fastcmp(param, "height"))
-		mapthings[i].z = atol(val);
-	else if (fastcmp(param, "angle"))
-		mapthings[i].angle = atol(val);
-	else if (fastcmp(param, "pitch"))
-		mapthings[i].pitch = atol(val);
-	else if (fastcmp(param, "roll"))
-		mapthings[i].roll = atol(val);
-	else if (fastcmp(param, "type"))
-		mapthings[i].type = atol(val);
-	else if (fastcmp(param, "scale"))
-	{
-		if (udmf_version < 1)
-		{
-			mapthings[i].scale = FLOAT_TO_FIXED(atof(val));
-		}
-		else
-		{
-			mapthings[i].spritexscale = mapthings[i].spriteyscale = FLOAT_TO_FIXED(atof(val));
-		}
-	}
-	else if (fastcmp(param, "scalex"))
+	TracyCZoneEnd(__zone);
+	return ok;
+}
+
+// Writes what TextmapLex and P_CreateBlockMap made of this map to the cache.
+static void P_WriteMapCache(void)
+{
+	TracyCZone(__zone, true);
+
+	const char *path;
+	char *temp;
+	UINT8 *buffer, *p;
+	size_t size, t, j;
+	UINT32 i;
+
+	if (!P_MapCacheEnabled() || mapcachefile)
 	{
-		if (udmf_version < 1)
-		{
-			mapthings[i].scale = FLOAT_TO_FIXED(atof(val));
-		}
-		else
-		{
-			mapthings[i].spritexscale = FLOAT_TO_FIXED(atof(val));
-		}
+		TracyCZoneEnd(__zone);
+		return;
 	}
-	else if (fastcmp(param, "scaley"))
+
+	// P_ReadMapCache turns these down, so writing one would only happen again every load
+	if (numvertexes > UINT16_MAX || numsectors > UINT16_MAX || numlines > UINT16_MAX
+		|| numsides > UINT16_MAX || nummapthings > UINT16_MAX)
 	{
-		if (udmf_version < 1)
-		{
-			mapthings[i].scale = FLOAT_TO_FIXED(atof(val));
-		}
-		else
-		{
-			mapthings[i].spriteyscale = FLOAT_TO_FIXED(atof(val));
-		}
+		TracyCZoneEnd(__zone);
+		return;
 	}
-	else if (fastcmp(param, "mobjscale"))
-		mapthings[i].scale = FLOAT_TO_FIXED(atof(val));
-	// Flags
-	else if (fastcmp(param, "flip") && fastcmp("true", val))
-		mapthings[i].options |= MTF_OBJECTFLIP;
 
-	else if (fastcmp(param, "special"))
-		mapthings[i].special = atol(val);
-	else if (fastcmp(param, "foflayer"))
-		mapthings[i].layer = atol(val);
-	else if (fastncmp(param, "stringarg", 9) && strlen(param) > 9)
+	size = MAPCACHEHEADERLEN + 2 + 4 + 16 + 4 + NUMLEXTABLES*4;
+	for (t = 0; t < NUMLEXTABLES; t++)
 	{
-		if (udmf_version < 1)
+		for (j = 0; j < textmaplex[t].size(); j++)
 		{
-			size_t argnum = atol(param + 9);
-			if (argnum >= NUM_MAPTHING_STRINGARGS)
-				return;
-			size_t len = strlen(val);
-			mapthings[i].thing_stringargs[argnum] = static_cast<char*>(Z_Malloc(len + 1, PU_LEVEL, NULL));
-			M_Memcpy(mapthings[i].thing_stringargs[argnum], val, len);
-			mapthings[i].thing_stringargs[argnum][len] = '\0';
-		}
-		else
-		{
-			size_t argnum = atol(param + 9);
-			if (argnum >= NUM_SCRIPT_STRINGARGS)
-				return;
-			size_t len = strlen(val);
-			mapthings[i].script_stringargs[argnum] = static_cast<char*>(Z_Malloc(len + 1, PU_LEVEL, NULL));
-			M_Memcpy(mapthings[i].script_stringargs[argnum], val, len);
-			mapthings[i].script_stringargs[argnum][len] = '\0';
+			const textmaplexjob_t *job = &textmaplex[t][j];
+			size += 4 + job->arena.size() + 4 + job->fields.size() * 10 + (job->count + 1) * 4 + job->count;
 		}
 	}
-	else if (fastncmp(param, "arg", 3) && strlen(param) > 3)
+	size += 4;
+	if (createdblockmap)
+		size += 16 + ((size_t)bmapwidth * bmapheight + 1 + blockmapoffsets[bmapwidth * bmapheight]) * 4;
+
+	buffer = p = static_cast<UINT8*>(Z_Malloc(size, PU_STATIC, NULL));
+
+	WRITEMEM(p, MAPCACHEHEADER, MAPCACHEHEADERLEN);
+	WRITEUINT16(p, MAPCACHEVERSION);
+	WRITEUINT32(p, TextmapKeysFingerprint());
+	WRITEMEM(p, mapmd5, 16);
+	WRITEINT32(p, udmf_version);
+
+	WRITEUINT32(p, numvertexes);
+	WRITEUINT32(p, numsectors);
+	WRITEUINT32(p, numlines);
+	WRITEUINT32(p, numsides);
+	WRITEUINT32(p, nummapthings);
+
+	for (t = 0; t < NUMLEXTABLES; t++)
 	{
-		if (udmf_version < 1)
-		{
-			size_t argnum = atol(param + 3);
-			if (argnum >= NUM_MAPTHING_ARGS)
-				return;
-			mapthings[i].thing_args[argnum] = atol(val);
-		}
-		else
+		for (j = 0; j < textmaplex[t].size(); j++)
 		{
-			size_t argnum = atol(param + 3);
-			if (argnum >= NUM_SCRIPT_ARGS)
-				return;
-			mapthings[i].script_args[argnum] = atol(val);
+			const textmaplexjob_t *job = &textmaplex[t][j];
+
+			WRITEUINT32(p, job->arena.size());
+			WRITEMEM(p, job->arena.data(), job->arena.size());
+
+			WRITEUINT32(p, job->fields.size());
+			for (i = 0; i < job->fields.size(); i++)
+			{
+				WRITEUINT32(p, job->fields[i].param);
+				WRITEUINT32(p, job->fields[i].val);
+				WRITEUINT8(p, job->fields[i].key);
+				WRITEUINT8(p, job->fields[i].isstring);
+			}
+
+			for (i = 0; i <= job->count; i++)
+				WRITEUINT32(p, job->firstfield[i]);
+
+			WRITEMEM(p, job->invalid.data(), job->count);
 		}
 	}
-	else if (fastncmp(param, "thingstringarg", 14) && strlen(param) > 14)
+
+	// Maps that brought their own BLOCKMAP have nothing to save here
+	if (createdblockmap)
 	{
-		size_t argnum = atol(param + 14);
-		if (argnum >= NUM_MAPTHING_STRINGARGS)
-			return;
-		size_t len = strlen(val);
-		mapthings[i].thing_stringargs[argnum] = static_cast<char*>(Z_Malloc(len + 1, PU_LEVEL, NULL));
-		M_Memcpy(mapthings[i].thing_stringargs[argnum], val, len);
-		mapthings[i].thing_stringargs[argnum][len] = '\0';
+		const UINT32 numblocks = bmapwidth * bmapheight;
+
+		WRITEUINT32(p, numblocks);
+		WRITEFIXED(p, bmaporgx);
+		WRITEFIXED(p, bmaporgy);
+		WRITEINT32(p, bmapwidth);
+		WRITEINT32(p, bmapheight);
+		for (i = 0; i <= numblocks; i++)
+			WRITEUINT32(p, blockmapoffsets[i]);
+		for (i = 0; i < blockmapoffsets[numblocks]; i++)
+			WRITEUINT32(p, blockmaplines[i]);
 	}
-	else if (fastncmp(param, "thingarg", 8) && strlen(param) > 8)
+	else
+		WRITEUINT32(p, 0);
+
+	I_mkdir(va("%s" PATHSEP MAPCACHEDIR, srb2home), 0755);
+
+	// Write it aside and move it in place, so another process loading the
+	// same map can't read half of it
+	path = Z_StrDup(P_MapCachePath());
+	temp = Z_StrDup(va("%s.tmp", path));
+
+	if (!FIL_WriteFile(temp, buffer, p - buffer))
+		CONS_Alert(CONS_WARNING, "Couldn't write map cache file %s\n", temp);
+	else
 	{
-		size_t argnum = atol(param + 8);
-		if (argnum >= NUM_MAPTHING_ARGS)
-			return;
-		mapthings[i].thing_args[argnum] = atol(val);
+		// Windows won't rename over an existing file
+		remove(path);
+		if (rename(temp, path) != 0)
+			remove(temp);
+		else
+			CONS_Debug(DBG_SETUP, "Wrote map cache %s (%s bytes)\n", path, sizeu1(p - buffer));
 	}
-	else
-		ParseUserProperty(&mapthings[i].user, param, val);
+
+	Z_Free(temp);
+	Z_Free((void *)path);
+	Z_Free(buffer);
+
+	TracyCZoneEnd(__zone);
+}
+
+// Done with the cache and textmaplex once the map is loaded.
+static void P_FreeMapCache(void)
+{
+	Z_Free(mapcachefile);
+	mapcachefile = NULL;
+	mapcacheblockmap = NULL;
+	mapcacheblockmapsize = 0;
+
+	TextmapLexFree();
 }
 
-/** From a given position table, run a specified parser function through a {}-encapsuled text.
+/** Runs a specified parser function over the fields of a {}-encapsuled block read by TextmapLex.
   *
-  * \param Position of the data to parse, in the textmap.
+  * \param Jobs that read the blocks of this type.
   * \param Structure number (mapthings, sectors, ...).
   * \param Parser function pointer.
   */
-static void TextmapParse(UINT32 dataPos, size_t num, void (*parser)(UINT32, const char *, const char *))
+static void TextmapParse(const std::vector<textmaplexjob_t> &jobs, size_t num, void (*parser)(UINT32, textmapkey_t, const char *, const char *))
 {
-	const char *param, *val;
+	const textmaplexjob_t *job = &jobs[num / TEXTMAPLEXCHUNK];
+	const size_t b = num % TEXTMAPLEXCHUNK;
+	UINT32 f;
 
-	M_TokenizerSetEndPos(dataPos);
-	param = M_TokenizerRead(0);
-	if (!fastcmp(param, "{"))
+	if (job->invalid[b])
 	{
 		CONS_Alert(CONS_WARNING, "Invalid UDMF data capsule!\n");
 		return;
 	}
 
-	while (true)
+	for (f = job->firstfield[b]; f < job->firstfield[b + 1]; f++)
 	{
-		param = M_TokenizerRead(0);
-		if (fastcmp(param, "}"))
-			break;
-		val = M_TokenizerRead(1);
-		parser(num, param, val);
+		const textmapfield_t *field = &job->fields[f];
+
+		textmap_valisstring = field->isstring;
+		parser(num, field->key, &job->arena[field->param], &job->arena[field->val]);
 	}
 }
 
@@ -3141,6 +4003,7 @@ static void P_LoadTextmap(void)
 	TracyCZone(__zone, true);
 
 	UINT32 i;
+	const std::vector<textmaplexjob_t> *lex = textmaplex;
 
 	vertex_t   *vt;
 	sector_t   *sc;
@@ -3160,7 +4023,7 @@ static void P_LoadTextmap(void)
 		vt->floorzset = vt->ceilingzset = false;
 		vt->floorz = vt->ceilingz = 0;
 
-		TextmapParse(vertexesPos[i], i, ParseTextmapVertexParameter);
+		TextmapParse(lex[LEX_VERTEXES], i, ParseTextmapVertexParameter);
 
 		if (vt->x == INT32_MAX)
 			I_Error("P_LoadTextmap: vertex %s has no x value set!\n", sizeu1(i));
@@ -3221,7 +4084,7 @@ static void P_LoadTextmap(void)
 		textmap_planefloor.defined = 0;
 		textmap_planeceiling.defined = 0;
 
-		TextmapParse(sectorsPos[i], i, ParseTextmapSectorParameter);
+		TextmapParse(lex[LEX_SECTORS], i, ParseTextmapSectorParameter);
 
 		P_InitializeSector(sc);
 		if (textmap_colormap.used)
@@ -3264,7 +4127,7 @@ static void P_LoadTextmap(void)
 		ld->activation = 0;
 		K_UserPropertiesClear(&ld->user);
 
-		TextmapParse(linesPos[i], i, ParseTextmapLinedefParameter);
+		TextmapParse(lex[LEX_LINES], i, ParseTextmapLinedefParameter);
 
 		if (!ld->v1)
 			I_Error("P_LoadTextmap: linedef %s has no v1 value set!\n", sizeu1(i));
@@ -3289,7 +4152,7 @@ static void P_LoadTextmap(void)
 
 		K_UserPropertiesClear(&sd->user);
 
-		TextmapParse(sidesPos[i], i, ParseTextmapSidedefParameter);
+		TextmapParse(lex[LEX_SIDES], i, ParseTextmapSidedefParameter);
 
 		if (!sd->sector)
 			I_Error("P_LoadTextmap: sidedef %s has no sector value set!\n", sizeu1(i));
@@ -3320,7 +4183,7 @@ static void P_LoadTextmap(void)
 
 		K_UserPropertiesClear(&mt->user);
 
-		TextmapParse(mapthingsPos[i], i, ParseTextmapThingParameter);
+		TextmapParse(lex[LEX_THINGS], i, ParseTextmapThingParameter);
 	}
 
 	TracyCZoneEnd(__zone);
@@ -3483,15 +4346,23 @@ static boolean P_LoadMapData(const virtres_t *virt)
 	virtlump_t *virtvertexes = NULL, *virtsectors = NULL, *virtsidedefs = NULL, *virtlinedefs = NULL, *virtthings = NULL;
 
 	// Count map data.
-	if (udmf) // Count how many entries for each type we got in textmap.
+	if (udmf)
 	{
-		virtlump_t *textmap = vres_Find(virt, "TEXTMAP");
-		M_TokenizerOpen((char *)textmap->data, textmap->size);
-		if (!TextmapCount(textmap->size))
+		// A map loaded before comes read already.
+		if (!P_ReadMapCache())
 		{
+			// Count how many entries for each type we got in textmap.
+			virtlump_t *textmap = vres_Find(virt, "TEXTMAP");
+			M_TokenizerOpen((char *)textmap->data, textmap->size);
+			if (!TextmapCount(textmap->size))
+			{
+				M_TokenizerClose();
+				TracyCZoneEnd(__zone);
+				return false;
+			}
 			M_TokenizerClose();
-			TracyCZoneEnd(__zone);
-			return false;
+
+			TextmapLex((const char *)textmap->data, textmap->size);
 		}
 	}
 	else
@@ -3552,7 +4423,6 @@ static boolean P_LoadMapData(const virtres_t *virt)
 	if (udmf)
 	{
 		P_LoadTextmap();
-		M_TokenizerClose();
 	}
 	else
 	{
@@ -4113,12 +4983,32 @@ static void P_LoadMapBSP(const virtres_t *virt)
 	return;
 }
 
+// Sets up everything that hangs off the blockmap, once its lines and
+// dimensions are in place.
+static void P_AllocBlockLinks(void)
+{
+	size_t count;
+
+	// clear out mobj chains
+	count = sizeof (*blocklinks)* bmapwidth*bmapheight;
+	blocklinks = static_cast<mobj_t**>(Z_Calloc(count, PU_LEVEL, NULL));
+
+	P_InitSpatialHash();
+
+	// haleyjd 2/22/06: setup polyobject blockmap
+	count = sizeof(*polyblocklinks) * bmapwidth * bmapheight;
+	polyblocklinks = static_cast<polymaplink_t**>(Z_Calloc(count, PU_LEVEL, NULL));
+
+	count = sizeof (*precipblocklinks)* bmapwidth*bmapheight;
+	precipblocklinks = static_cast<precipmobj_t**>(Z_Calloc(count, PU_LEVEL, NULL));
+}
+
 // Split from P_LoadBlockMap for convenience
 // -- Monster Iestyn 08/01/18
-static void P_ReadBlockMapLump(INT16 *wadblockmaplump, size_t count)
+static INT32 *P_ReadBlockMapLump(INT16 *wadblockmaplump, size_t count)
 {
 	size_t i;
-	blockmaplump = static_cast<INT32*>(Z_Calloc(sizeof (*blockmaplump) * count, PU_LEVEL, NULL));
+	INT32 *blockmaplump = static_cast<INT32*>(Z_Calloc(sizeof (*blockmaplump) * count, PU_STATIC, NULL));
 
 	// killough 3/1/98: Expand wad blockmap into larger internal one,
 	// by treating all offsets except -1 as unsigned and zero-extending
@@ -4135,6 +5025,47 @@ static void P_ReadBlockMapLump(INT16 *wadblockmaplump, size_t count)
 		INT16 t = SHORT(wadblockmaplump[i]);          // killough 3/1/98
 		blockmaplump[i] = t == -1 ? (INT32)-1 : (INT32) t & 0xffff;
 	}
+
+	return blockmaplump;
+}
+
+// Packs the lists of a BLOCKMAP lump -- an offset per block after the
+// header, each to a 0, the lines in the block, and a -1 -- back to back
+// into blockmaplines. Lists running off the lump are cut short there,
+// and lines that don't exist are left out.
+static void P_CompressBlockMapLump(const INT32 *blockmaplump, size_t count)
+{
+	const size_t numblocks = (size_t)bmapwidth * bmapheight;
+	UINT32 total = 0;
+	size_t b, j;
+
+	auto walk = [blockmaplump, count](size_t block, auto &&func)
+	{
+		const INT32 offset = 4 + block < count ? blockmaplump[4 + block] : -1;
+
+		if (offset < 0)
+			return;
+
+		// First index is really empty, so +1 it.
+		for (size_t k = offset + 1; k < count && blockmaplump[k] != -1; k++)
+		{
+			if ((size_t)blockmaplump[k] < numlines)
+				func(blockmaplump[k]);
+		}
+	};
+
+	blockmapoffsets = static_cast<UINT32*>(Z_Malloc(sizeof (*blockmapoffsets) * (numblocks + 1), PU_LEVEL, NULL));
+	for (b = 0; b < numblocks; b++)
+	{
+		blockmapoffsets[b] = total;
+		walk(b, [&total](INT32) { total++; });
+	}
+	blockmapoffsets[numblocks] = total;
+
+	blockmaplines = static_cast<UINT32*>(Z_Malloc(sizeof (*blockmaplines) * total, PU_LEVEL, NULL));
+	j = 0;
+	for (b = 0; b < numblocks; b++)
+		walk(b, [&j](INT32 line) { blockmaplines[j++] = line; });
 }
 
 // This needs to be a separate function
@@ -4143,6 +5074,8 @@ static void P_ReadBlockMapLump(INT16 *wadblockmaplump, size_t count)
 // -- Monster Iestyn 09/01/18
 static boolean P_LoadBlockMap(UINT8 *data, size_t count)
 {
+	INT32 *blockmaplump;
+
 	if (!count || count >= 0x20000)
 		return false;
 
@@ -4150,24 +5083,17 @@ static boolean P_LoadBlockMap(UINT8 *data, size_t count)
 
 	// no need to malloc anything, assume the data is uncompressed for now
 	count /= 2;
-	P_ReadBlockMapLump((INT16 *)data, count);
+	blockmaplump = P_ReadBlockMapLump((INT16 *)data, count);
 
 	bmaporgx = blockmaplump[0]<<FRACBITS;
 	bmaporgy = blockmaplump[1]<<FRACBITS;
 	bmapwidth = blockmaplump[2];
 	bmapheight = blockmaplump[3];
 
-	// clear out mobj chains
-	count = sizeof (*blocklinks)* bmapwidth*bmapheight;
-	blocklinks = static_cast<mobj_t**>(Z_Calloc(count, PU_LEVEL, NULL));
-	blockmap = blockmaplump+4;
-
-	// haleyjd 2/22/06: setup polyobject blockmap
-	count = sizeof(*polyblocklinks) * bmapwidth * bmapheight;
-	polyblocklinks = static_cast<polymaplink_t**>(Z_Calloc(count, PU_LEVEL, NULL));
+	P_CompressBlockMapLump(blockmaplump, count);
+	Z_Free(blockmaplump);
 
-	count = sizeof (*precipblocklinks)* bmapwidth*bmapheight;
-	precipblocklinks = static_cast<precipmobj_t**>(Z_Calloc(count, PU_LEVEL, NULL));
+	P_AllocBlockLinks();
 
 	return true;
 }
@@ -4223,6 +5149,145 @@ static boolean LineInBlock(fixed_t cx1, fixed_t cy1, fixed_t cx2, fixed_t cy2, f
 	return P_BoxOnLineSide(bbox, &testline) == -1;
 }
 
+// Calls func with the number of every block line i goes through, on a
+// blockmap of numblocks blocks whose corner is at minx, miny.
+template <typename F>
+static void P_ForEachBlockOfLine(size_t i, INT32 minx, INT32 miny, size_t numblocks, F &&func)
+{
+	// starting coordinates
+	INT32 x = (lines[i].v1->x>>FRACBITS) - minx;
+	INT32 y = (lines[i].v1->y>>FRACBITS) - miny;
+	INT32 bxstart, bxend, bystart, byend, v2x, v2y, curblockx, curblocky;
+	boolean straight;
+
+	v2x = lines[i].v2->x>>FRACBITS;
+	v2y = lines[i].v2->y>>FRACBITS;
+
+	// Draw a "box" around the line.
+	bxstart = (x >> MAPBTOFRAC);
+	bystart = (y >> MAPBTOFRAC);
+
+	v2x -= minx;
+	v2y -= miny;
+
+	bxend = ((v2x) >> MAPBTOFRAC);
+	byend = ((v2y) >> MAPBTOFRAC);
+
+	if (bxend < bxstart)
+	{
+		INT32 temp = bxstart;
+		bxstart = bxend;
+		bxend = temp;
+	}
+
+	if (byend < bystart)
+	{
+		INT32 temp = bystart;
+		bystart = byend;
+		byend = temp;
+	}
+
+	// Catch straight lines
+	// This fixes the error where straight lines
+	// directly on a blockmap boundary would not
+	// be included in the proper blocks.
+	if (lines[i].v1->y == lines[i].v2->y)
+	{
+		straight = true;
+		bystart--;
+		byend++;
+	}
+	else if (lines[i].v1->x == lines[i].v2->x)
+	{
+		straight = true;
+		bxstart--;
+		bxend++;
+	}
+	else
+		straight = false;
+
+	// Now we simply iterate block-by-block until we reach the end block.
+	for (curblockx = bxstart; curblockx <= bxend; curblockx++)
+	for (curblocky = bystart; curblocky <= byend; curblocky++)
+	{
+		size_t b = curblocky * bmapwidth + curblockx;
+
+		if (b >= numblocks)
+			continue;
+
+		if (!straight && !(LineInBlock((fixed_t)x, (fixed_t)y, (fixed_t)v2x, (fixed_t)v2y, (fixed_t)(curblockx << MAPBTOFRAC), (fixed_t)(curblocky << MAPBTOFRAC))))
+			continue;
+
+		func(b);
+	}
+}
+
+// P_CreateBlockMap splits the lines into up to BLOCKMAPSLICES slices of
+// at least BLOCKMAPSLICELINES lines, and works through each slice on a
+// thread of its own.
+#define BLOCKMAPSLICES 8
+#define BLOCKMAPSLICELINES 1024
+
+struct blockmapbuild_t
+{
+	INT32 minx, miny;
+	size_t numblocks;
+	size_t numslices;
+
+	// numblocks entries per slice: first how many of its lines go in each
+	// block, then where in blockmaplines the next one goes
+	std::vector<UINT32> slots;
+};
+
+static size_t P_BlockMapSliceStart(const blockmapbuild_t *build, size_t s)
+{
+	return numlines * s / build->numslices;
+}
+
+// First pass: counts the lines of slice s in each block.
+static void P_CountBlockMapSlice(blockmapbuild_t *build, size_t s)
+{
+	UINT32 *counts = &build->slots[s * build->numblocks];
+	size_t i;
+
+	for (i = P_BlockMapSliceStart(build, s); i < P_BlockMapSliceStart(build, s + 1); i++)
+		P_ForEachBlockOfLine(i, build->minx, build->miny, build->numblocks, [counts](size_t b) { counts[b]++; });
+}
+
+// Second pass: writes the lines of slice s into their blocks. Blocks have
+// always listed their lines from the last to the first, and the order
+// lines are checked in is part of the game, so they go in backwards.
+static void P_FillBlockMapSlice(blockmapbuild_t *build, size_t s)
+{
+	UINT32 *next = &build->slots[s * build->numblocks];
+	size_t i = P_BlockMapSliceStart(build, s + 1);
+
+	while (i-- > P_BlockMapSliceStart(build, s))
+		P_ForEachBlockOfLine(i, build->minx, build->miny, build->numblocks, [next, i](size_t b) { blockmaplines[next[b]++] = (UINT32)i; });
+}
+
+static void P_RunBlockMapSlices(blockmapbuild_t *build, void (*func)(blockmapbuild_t *, size_t))
+{
+	size_t s;
+
+	if (srb2::g_main_threadpool && build->numslices > 1)
+	{
+		srb2::ThreadPool::Sema sema;
+
+		srb2::g_main_threadpool->begin_sema();
+		for (s = 0; s < build->numslices; s++)
+			srb2::g_main_threadpool->schedule([build, func, s]() { func(build, s); });
+		sema = srb2::g_main_threadpool->end_sema();
+		srb2::g_main_threadpool->notify_sema(sema);
+		srb2::g_main_threadpool->wait_sema(sema);
+	}
+	else
+	{
+		for (s = 0; s < build->numslices; s++)
+			func(build, s);
+	}
+}
+
 //
 // killough 10/98:
 //
@@ -4236,6 +5301,8 @@ static boolean LineInBlock(fixed_t cx1, fixed_t cy1, fixed_t cx2, fixed_t cy2, f
 // code which attempts to fix the same problem.
 static void P_CreateBlockMap(void)
 {
+	TracyCZone(__zone, true);
+
 	size_t i;
 	fixed_t minx = INT32_MAX, miny = INT32_MAX, maxx = INT32_MIN, maxy = INT32_MIN;
 	// First find limits of map
@@ -4258,174 +5325,53 @@ static void P_CreateBlockMap(void)
 	bmapwidth = ((maxx-minx) >> MAPBTOFRAC) + 1;
 	bmapheight = ((maxy-miny) >> MAPBTOFRAC)+ 1;
 
-	// Compute blockmap, which is stored as a 2d array of variable-sized lists.
-	//
-	// Pseudocode:
-	//
-	// For each linedef:
-	//
-	//   Map the starting and ending vertices to blocks.
-	//
-	//   Starting in the starting vertex's block, do:
+	// Compute blockmap, which is stored as the lines of every block back
+	// to back, with blockmapoffsets saying where each block starts.
 	//
-	//     Add linedef to current block's list, dynamically resizing it.
-	//
-	//     If current block is the same as the ending vertex's block, exit loop.
-	//
-	//     Move to an adjacent block by moving towards the ending block in
-	//     either the x or y direction, to the block which contains the linedef.
-
+	// For each linedef, the blocks it goes through are those of the box
+	// around it that it crosses. The lines are gone over twice, once to
+	// count how many lines each block gets and once to write them in, so
+	// nothing has to be resized along the way. Both passes run over
+	// slices of the lines in parallel; a block lists the lines of later
+	// slices first, which keeps the order the same however it is split.
 	{
-		typedef struct
-		{
-			INT32 n, nalloc;
-			INT32 *list;
-		} bmap_t; // blocklist structure
+		blockmapbuild_t build;
+		size_t b, s;
+		UINT32 total = 0;
 
-		size_t tot = bmapwidth * bmapheight; // size of blockmap
-		bmap_t *bmap = static_cast<bmap_t*>(calloc(tot, sizeof (*bmap))); // array of blocklists
-		boolean straight;
+		build.minx = minx;
+		build.miny = miny;
+		build.numblocks = (size_t)bmapwidth * bmapheight;
+		build.numslices = srb2::g_main_threadpool ? std::clamp<size_t>(numlines / BLOCKMAPSLICELINES, 1, BLOCKMAPSLICES) : 1;
+		build.slots.assign(build.numslices * build.numblocks, 0);
 
-		if (bmap == NULL) I_Error("%s: Out of memory making blockmap", "P_CreateBlockMap");
+		P_RunBlockMapSlices(&build, P_CountBlockMapSlice);
 
-		for (i = 0; i < numlines; i++)
+		blockmapoffsets = static_cast<UINT32*>(Z_Malloc(sizeof (*blockmapoffsets) * (build.numblocks + 1), PU_LEVEL, NULL));
+		for (b = 0; b < build.numblocks; b++)
 		{
-			// starting coordinates
-			INT32 x = (lines[i].v1->x>>FRACBITS) - minx;
-			INT32 y = (lines[i].v1->y>>FRACBITS) - miny;
-			INT32 bxstart, bxend, bystart, byend, v2x, v2y, curblockx, curblocky;
-
-			v2x = lines[i].v2->x>>FRACBITS;
-			v2y = lines[i].v2->y>>FRACBITS;
-
-			// Draw a "box" around the line.
-			bxstart = (x >> MAPBTOFRAC);
-			bystart = (y >> MAPBTOFRAC);
-
-			v2x -= minx;
-			v2y -= miny;
-
-			bxend = ((v2x) >> MAPBTOFRAC);
-			byend = ((v2y) >> MAPBTOFRAC);
-
-			if (bxend < bxstart)
-			{
-				INT32 temp = bxstart;
-				bxstart = bxend;
-				bxend = temp;
-			}
-
-			if (byend < bystart)
-			{
-				INT32 temp = bystart;
-				bystart = byend;
-				byend = temp;
-			}
-
-			// Catch straight lines
-			// This fixes the error where straight lines
-			// directly on a blockmap boundary would not
-			// be included in the proper blocks.
-			if (lines[i].v1->y == lines[i].v2->y)
+			blockmapoffsets[b] = total;
+			for (s = build.numslices; s-- > 0;)
 			{
-				straight = true;
-				bystart--;
-				byend++;
-			}
-			else if (lines[i].v1->x == lines[i].v2->x)
-			{
-				straight = true;
-				bxstart--;
-				bxend++;
-			}
-			else
-				straight = false;
-
-			// Now we simply iterate block-by-block until we reach the end block.
-			for (curblockx = bxstart; curblockx <= bxend; curblockx++)
-			for (curblocky = bystart; curblocky <= byend; curblocky++)
-			{
-				size_t b = curblocky * bmapwidth + curblockx;
-
-				if (b >= tot)
-					continue;
+				UINT32 *slot = &build.slots[s * build.numblocks + b];
+				const UINT32 count = *slot;
 
-				if (!straight && !(LineInBlock((fixed_t)x, (fixed_t)y, (fixed_t)v2x, (fixed_t)v2y, (fixed_t)(curblockx << MAPBTOFRAC), (fixed_t)(curblocky << MAPBTOFRAC))))
-					continue;
-
-				// Increase size of allocated list if necessary
-				if (bmap[b].n >= bmap[b].nalloc)
-				{
-					// Graue 02-29-2004: make code more readable, don't realloc a null pointer
-					// (because it crashes for me, and because the comp.lang.c FAQ says so)
-					if (bmap[b].nalloc == 0)
-						bmap[b].nalloc = 8;
-					else
-						bmap[b].nalloc *= 2;
-					bmap[b].list = static_cast<INT32*>(Z_Realloc(bmap[b].list, bmap[b].nalloc * sizeof (*bmap->list), PU_CACHE, &bmap[b].list));
-					if (!bmap[b].list)
-						I_Error("Out of Memory in P_CreateBlockMap");
-				}
-
-				// Add linedef to end of list
-				bmap[b].list[bmap[b].n++] = (INT32)i;
+				*slot = total;
+				total += count;
 			}
 		}
+		blockmapoffsets[build.numblocks] = total;
 
-		// Compute the total size of the blockmap.
-		//
-		// Compression of empty blocks is performed by reserving two offset words
-		// at tot and tot+1.
-		//
-		// 4 words, unused if this routine is called, are reserved at the start.
-		{
-			size_t count = tot + 6; // we need at least 1 word per block, plus reserved's
-
-			for (i = 0; i < tot; i++)
-				if (bmap[i].n)
-					count += bmap[i].n + 2; // 1 header word + 1 trailer word + blocklist
-
-			// Allocate blockmap lump with computed count
-			blockmaplump = static_cast<INT32*>(Z_Calloc(sizeof (*blockmaplump) * count, PU_LEVEL, NULL));
-		}
-
-		// Now compress the blockmap.
-		{
-			size_t ndx = tot += 4; // Advance index to start of linedef lists
-			bmap_t *bp = bmap; // Start of uncompressed blockmap
-
-			blockmaplump[ndx++] = 0; // Store an empty blockmap list at start
-			blockmaplump[ndx++] = -1; // (Used for compression)
-
-			for (i = 4; i < tot; i++, bp++)
-				if (bp->n) // Non-empty blocklist
-				{
-					blockmaplump[blockmaplump[i] = (INT32)(ndx++)] = 0; // Store index & header
-					do
-						blockmaplump[ndx++] = bp->list[--bp->n]; // Copy linedef list
-					while (bp->n);
-					blockmaplump[ndx++] = -1; // Store trailer
-					Z_Free(bp->list); // Free linedef list
-				}
-				else // Empty blocklist: point to reserved empty blocklist
-					blockmaplump[i] = (INT32)tot;
+		blockmaplines = static_cast<UINT32*>(Z_Malloc(sizeof (*blockmaplines) * total, PU_LEVEL, NULL));
 
-			free(bmap); // Free uncompressed blockmap
-		}
+		P_RunBlockMapSlices(&build, P_FillBlockMapSlice);
 	}
-	{
-		size_t count = sizeof (*blocklinks) * bmapwidth * bmapheight;
-		// clear out mobj chains (copied from from P_LoadBlockMap)
-		blocklinks = static_cast<mobj_t**>(Z_Calloc(count, PU_LEVEL, NULL));
-		blockmap = blockmaplump + 4;
 
-		// haleyjd 2/22/06: setup polyobject blockmap
-		count = sizeof(*polyblocklinks) * bmapwidth * bmapheight;
-		polyblocklinks = static_cast<polymaplink_t**>(Z_Calloc(count, PU_LEVEL, NULL));
+	createdblockmap = true;
 
-		count = sizeof (*precipblocklinks)* bmapwidth*bmapheight;
-		precipblocklinks = static_cast<precipmobj_t**>(Z_Calloc(count, PU_LEVEL, NULL));
-	}
+	P_AllocBlockLinks();
+
+	TracyCZoneEnd(__zone);
 }
 
 // PK3 version
@@ -4444,6 +5390,33 @@ static void P_LoadReject(UINT8 *data, size_t count)
 	}
 }
 
+// Puts back the blockmap P_CreateBlockMap built the last time this map was loaded.
+static boolean P_LoadCachedBlockMap(void)
+{
+	const UINT8 *p = mapcacheblockmap;
+	size_t i;
+
+	if (!p)
+		return false;
+
+	bmaporgx = mapcachebmaporgx;
+	bmaporgy = mapcachebmaporgy;
+	bmapwidth = mapcachebmapwidth;
+	bmapheight = mapcachebmapheight;
+
+	blockmapoffsets = static_cast<UINT32*>(Z_Malloc(sizeof (*blockmapoffsets) * (mapcacheblockmapsize + 1), PU_LEVEL, NULL));
+	for (i = 0; i <= mapcacheblockmapsize; i++)
+		blockmapoffsets[i] = READUINT32(p);
+
+	blockmaplines = static_cast<UINT32*>(Z_Malloc(sizeof (*blockmaplines) * blockmapoffsets[mapcacheblockmapsize], PU_LEVEL, NULL));
+	for (i = 0; i < blockmapoffsets[mapcacheblockmapsize]; i++)
+		blockmaplines[i] = READUINT32(p);
+
+	P_AllocBlockLinks();
+
+	return true;
+}
+
 static void P_LoadMapLUT(const virtres_t *virt)
 {
 	virtlump_t* virtblockmap = vres_Find(virt, "BLOCKMAP");
@@ -4455,7 +5428,10 @@ static void P_LoadMapLUT(const virtres_t *virt)
 	else
 		rejectmatrix = NULL;
 
-	if (!(virtblockmap && P_LoadBlockMap(virtblockmap->data, virtblockmap->size)))
+	createdblockmap = false;
+
+	if (!(virtblockmap && P_LoadBlockMap(virtblockmap->data, virtblockmap->size))
+		&& !P_LoadCachedBlockMap())
 		P_CreateBlockMap();
 }
 
@@ -7542,8 +8518,12 @@ static boolean P_LoadMapFromFile(void)
 	udmf = textmap != NULL;
 	udmf_version = 0;
 
+	// Needed up front, to find the map in the map cache
+	P_MakeMapMD5(curmapvirt, &mapmd5);
+
 	if (!P_LoadMapData(curmapvirt))
 	{
+		P_FreeMapCache();
 		TracyCZoneEnd(__zone);
 		return false;
 	}
@@ -7551,6 +8531,10 @@ static boolean P_LoadMapFromFile(void)
 	P_LoadMapBSP(curmapvirt);
 	P_LoadMapLUT(curmapvirt);
 
+	if (udmf)
+		P_WriteMapCache();
+	P_FreeMapCache();
+
 	P_LinkMapData();
 
 	if (!udmf)
@@ -7577,8 +8561,6 @@ static boolean P_LoadMapFromFile(void)
 		if (sectors[i].tags.count)
 			spawnsectors[i].tags.tags = static_cast<mtag_t*>(memcpy(Z_Malloc(sectors[i].tags.count*sizeof(mtag_t), PU_LEVEL, NULL), sectors[i].tags.tags, sectors[i].tags.count*sizeof(mtag_t)));
 
-	P_MakeMapMD5(curmapvirt, &mapmd5);
-
 	TracyCZoneEnd(__zone);
 	return true;
 }
@@ -8607,7 +9589,6 @@ boolean P_LoadLevel(boolean fromnetsave, boolean reloadinggamestate)
 	Patch_FreeTag(PU_PATCH_LOWPRIORITY);
 	Patch_FreeTag(PU_PATCH_ROTATED);
 	Z_FreeTags(PU_LEVEL, PU_PURGELEVEL - 1);
-	mobjcache = NULL;
 
 	R_InitializeLevelInterpolators();
 
@@ -27,6 +27,8 @@ extern "C" {
 // map md5, sent to players via PT_SERVERINFO
 extern unsigned char mapmd5[16];
 
+extern consvar_t cv_mapcache;
+
 // Player spawn spots for deathmatch.
 #define MAX_DM_STARTS 64
 extern mapthing_t *deathmatchstarts[MAX_DM_STARTS];
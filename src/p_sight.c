@@ -22,6 +22,24 @@
 
 #include "k_bot.h" // K_BotHatesThisSector
 #include "k_kart.h" // K_TripwirePass
+#include "core/thread_pool.h"
+#include "z_zone.h"
+
+//
+// Per-worker visit marks for batched queries.
+//
+// The scalar path marks lines and polyobjects with the global validcount,
+// which can't be shared between threads. Batched queries stamp their own
+// arrays instead, so each worker only ever writes to memory it owns.
+//
+typedef struct
+{
+	UINT32 *lines;
+	UINT32 *polys;
+	size_t numlines;
+	size_t numpolys;
+	UINT32 stamp;
+} losmarks_t;
 
 //
 // P_CheckSight
@@ -39,6 +57,7 @@ typedef struct
 	mobj_t *t1, *t2;
 	boolean alreadyHates;				// For bot traversal, for if the bot is already in a sector it doesn't want to be
 	UINT8 traversed;
+	losmarks_t *marks;					// If not NULL, use these instead of validcount
 } los_t;
 
 typedef boolean (*los_init_t)(mobj_t *, mobj_t *, register los_t *);
@@ -52,14 +71,58 @@ typedef struct
 	los_valid_poly_t validatePolyobj;	// If not NULL, then we will also check polyobject lines using this func.
 } los_funcs_t;
 
-static INT32 sightcounts[2];
-
 #ifdef DEVELOP
 extern consvar_t cv_debugtraversemax;
 #undef TRAVERSE_MAX
 #define TRAVERSE_MAX (cv_debugtraversemax.value)
 #endif
 
+//
+// P_LOSLineChecked
+//
+// Returns true if this line was already checked by the current query,
+// otherwise marks it as checked.
+//
+static inline boolean P_LOSLineChecked(line_t *line, los_t *los)
+{
+	if (los->marks != NULL)
+	{
+		UINT32 *mark = &los->marks->lines[line - lines];
+
+		if (*mark == los->marks->stamp)
+			return true;
+
+		*mark = los->marks->stamp;
+		return false;
+	}
+
+	if (line->validcount == validcount)
+		return true;
+
+	line->validcount = validcount;
+	return false;
+}
+
+static inline boolean P_LOSPolyChecked(polyobj_t *po, los_t *los)
+{
+	if (los->marks != NULL)
+	{
+		UINT32 *mark = &los->marks->polys[po - PolyObjects];
+
+		if (*mark == los->marks->stamp)
+			return true;
+
+		*mark = los->marks->stamp;
+		return false;
+	}
+
+	if (po->validcount == validcount)
+		return true;
+
+	po->validcount = validcount;
+	return false;
+}
+
 //
 // P_DivlineSide
 //
@@ -137,11 +200,9 @@ static boolean P_CrossSubsecPolyObj(polyobj_t *po, register los_t *los, register
 		const vertex_t *v1,*v2;
 
 		// already checked other side?
-		if (line->validcount == validcount)
+		if (P_LOSLineChecked(line, los))
 			continue;
 
-		line->validcount = validcount;
-
 		// OPTIMIZE: killough 4/20/98: Added quick bounding-box rejection test
 		if (line->bbox[BOXLEFT  ] > los->bbox[BOXRIGHT ] ||
 			line->bbox[BOXRIGHT ] < los->bbox[BOXLEFT  ] ||
@@ -493,9 +554,8 @@ static boolean P_CrossSubsector(size_t num, register los_t *los, register los_fu
 		{
 			while (po)
 			{
-				if (po->validcount != validcount)
+				if (!P_LOSPolyChecked(po, los))
 				{
-					po->validcount = validcount;
 					if (!P_CrossSubsecPolyObj(po, los, funcs))
 						return false;
 				}
@@ -514,11 +574,9 @@ static boolean P_CrossSubsector(size_t num, register los_t *los, register los_fu
 			continue;
 
 		// already checked other side?
-		if (line->validcount == validcount)
+		if (P_LOSLineChecked(line, los))
 			continue;
 
-		line->validcount = validcount;
-
 		// OPTIMIZE: killough 4/20/98: Added quick bounding-box rejection test
 		if (line->bbox[BOXLEFT  ] > los->bbox[BOXRIGHT ] ||
 			line->bbox[BOXRIGHT ] < los->bbox[BOXLEFT  ] ||
@@ -596,8 +654,6 @@ static boolean P_InitCheckSight(mobj_t *t1, mobj_t *t2, register los_t *los)
 
 	// An unobstructed LOS is possible.
 	// Now look from eyes of t1 to any part of t2.
-	sightcounts[1]++;
-
 	// Prevent SOME cases of looking through 3dfloors
 	//
 	// This WILL NOT work for things like 3d stairs with monsters behind
@@ -681,7 +737,7 @@ static boolean P_InitTraceBotTraversal(mobj_t *t1, mobj_t *t2, register los_t *l
 	return true;
 }
 
-static boolean P_CompareMobjsAcrossLines(mobj_t *t1, mobj_t *t2, register los_funcs_t *funcs)
+static boolean P_CompareMobjsAcrossLines(mobj_t *t1, mobj_t *t2, register los_funcs_t *funcs, losmarks_t *marks)
 {
 	los_t los;
 	const sector_t *s1, *s2;
@@ -721,12 +777,26 @@ static boolean P_CompareMobjsAcrossLines(mobj_t *t1, mobj_t *t2, register los_fu
 		return true;
 	}
 
-	validcount++;
+	if (marks != NULL)
+	{
+		if (++marks->stamp == 0)
+		{
+			// Wrapped around, so old marks could collide.
+			memset(marks->lines, 0, marks->numlines * sizeof (*marks->lines));
+			memset(marks->polys, 0, marks->numpolys * sizeof (*marks->polys));
+			marks->stamp = 1;
+		}
+	}
+	else
+	{
+		validcount++;
+	}
 
 	los.t1 = t1;
 	los.t2 = t2;
 	los.alreadyHates = false;
 	los.traversed = 0;
+	los.marks = marks;
 
 	los.topslope =
 		(los.bottomslope = t2->z - (los.sightzstart =
@@ -760,6 +830,37 @@ static boolean P_CompareMobjsAcrossLines(mobj_t *t1, mobj_t *t2, register los_fu
 	return P_CrossBSPNode((INT32)numnodes - 1, &los, funcs);
 }
 
+
+static void P_GetLOSFuncs(lostype_t type, los_funcs_t *funcs)
+{
+	memset(funcs, 0, sizeof (*funcs));
+
+	switch (type)
+	{
+		case LOS_CHECKSIGHT:
+			funcs->init = &P_InitCheckSight;
+			funcs->validate = &P_IsVisible;
+			funcs->validatePolyobj = &P_IsVisiblePolyObj;
+			break;
+
+		case LOS_BLOCKINGLINES:
+			funcs->validate = &P_CanTraceBlockingLine;
+			break;
+
+		case LOS_BOTTRAVERSAL:
+			funcs->init = &P_InitTraceBotTraversal;
+			funcs->validate = &P_CanBotTraverse;
+			break;
+
+		case LOS_WAYPOINTTRAVERSAL:
+			funcs->validate = &P_CanWaypointTraverse;
+			break;
+
+		default:
+			I_Error("P_GetLOSFuncs: invalid query type %d", type);
+	}
+}
+
 //
 // P_CheckSight
 //
@@ -768,39 +869,338 @@ static boolean P_CompareMobjsAcrossLines(mobj_t *t1, mobj_t *t2, register los_fu
 //
 boolean P_CheckSight(mobj_t *t1, mobj_t *t2)
 {
-	los_funcs_t funcs = {0};
+	los_funcs_t funcs;
+	P_GetLOSFuncs(LOS_CHECKSIGHT, &funcs);
+	return P_CompareMobjsAcrossLines(t1, t2, &funcs, NULL);
+}
+
+boolean P_TraceBlockingLines(mobj_t *t1, mobj_t *t2)
+{
+	los_funcs_t funcs;
+	P_GetLOSFuncs(LOS_BLOCKINGLINES, &funcs);
+	return P_CompareMobjsAcrossLines(t1, t2, &funcs, NULL);
+}
 
-	funcs.init = &P_InitCheckSight;
-	funcs.validate = &P_IsVisible;
-	funcs.validatePolyobj = &P_IsVisiblePolyObj;
+boolean P_TraceBotTraversal(mobj_t *t1, mobj_t *t2)
+{
+	los_funcs_t funcs;
+	P_GetLOSFuncs(LOS_BOTTRAVERSAL, &funcs);
+	return P_CompareMobjsAcrossLines(t1, t2, &funcs, NULL);
+}
 
-	return P_CompareMobjsAcrossLines(t1, t2, &funcs);
+boolean P_TraceWaypointTraversal(mobj_t *t1, mobj_t *t2)
+{
+	los_funcs_t funcs;
+	P_GetLOSFuncs(LOS_WAYPOINTTRAVERSAL, &funcs);
+	return P_CompareMobjsAcrossLines(t1, t2, &funcs, NULL);
 }
 
-boolean P_TraceBlockingLines(mobj_t *t1, mobj_t *t2)
+// ---------------------------------------------------------------------------
+// Sight result cache
+//
+// Direct-mapped, keyed on both mobjs and every input the sight check reads
+// from them, so a mobj that moved simply misses. Only sight checks are
+// cached; the traversal queries also depend on player state. The cache is
+// dropped every tic and whenever the thinker lists start over, since
+// sectors and polyobjects may have moved.
+// ---------------------------------------------------------------------------
+
+#define LOSCACHE_SIZE 1024 // must be a power of two
+#define LOSCACHE_KEYS 8
+
+typedef struct
 {
-	los_funcs_t funcs = {0};
+	mobj_t *t1, *t2;
+	fixed_t key[LOSCACHE_KEYS];
+	UINT32 epoch;
+	boolean result;
+} loscache_t;
+
+static loscache_t loscache[LOSCACHE_SIZE];
+static UINT32 loscacheepoch = 1;
+static tic_t loscachetic;
 
-	funcs.validate = &P_CanTraceBlockingLine;
+void P_ClearSightCache(void)
+{
+	if (++loscacheepoch == 0)
+	{
+		memset(loscache, 0, sizeof loscache);
+		loscacheepoch = 1;
+	}
 
-	return P_CompareMobjsAcrossLines(t1, t2, &funcs);
+	loscachetic = leveltime;
 }
 
-boolean P_TraceBotTraversal(mobj_t *t1, mobj_t *t2)
+static void P_LOSCacheKey(const mobj_t *t1, const mobj_t *t2, fixed_t key[LOSCACHE_KEYS])
 {
-	los_funcs_t funcs = {0};
+	key[0] = t1->x;
+	key[1] = t1->y;
+	key[2] = t1->z;
+	key[3] = t1->height;
+	key[4] = t2->x;
+	key[5] = t2->y;
+	key[6] = t2->z;
+	key[7] = t2->height;
+}
 
-	funcs.init = &P_InitTraceBotTraversal;
-	funcs.validate = &P_CanBotTraverse;
+static loscache_t *P_LOSCacheSlot(const mobj_t *t1, const mobj_t *t2)
+{
+	UINT32 hash = (UINT32)((uintptr_t)t1 >> 4) * 2654435761u;
+	hash ^= (UINT32)((uintptr_t)t2 >> 4) * 2246822519u;
 
-	return P_CompareMobjsAcrossLines(t1, t2, &funcs);
+	if (loscachetic != leveltime)
+	{
+		P_ClearSightCache();
+	}
+
+	return &loscache[(hash ^ (hash >> 16)) & (LOSCACHE_SIZE - 1)];
 }
 
-boolean P_TraceWaypointTraversal(mobj_t *t1, mobj_t *t2)
+static boolean P_LOSCacheLookup(mobj_t *t1, mobj_t *t2, boolean *result)
+{
+	const loscache_t *slot = P_LOSCacheSlot(t1, t2);
+	fixed_t key[LOSCACHE_KEYS];
+
+	if (slot->epoch != loscacheepoch || slot->t1 != t1 || slot->t2 != t2)
+	{
+		return false;
+	}
+
+	P_LOSCacheKey(t1, t2, key);
+
+	if (memcmp(key, slot->key, sizeof key) != 0)
+	{
+		return false;
+	}
+
+	*result = slot->result;
+	return true;
+}
+
+static void P_LOSCacheStore(mobj_t *t1, mobj_t *t2, boolean result)
+{
+	loscache_t *slot = P_LOSCacheSlot(t1, t2);
+
+	slot->t1 = t1;
+	slot->t2 = t2;
+	P_LOSCacheKey(t1, t2, slot->key);
+	slot->epoch = loscacheepoch;
+	slot->result = result;
+}
+
+static boolean P_LOSCacheable(mobj_t *t1, mobj_t *t2)
+{
+	// Removed mobjs fail trivially, and their memory may be reused.
+	return (P_MobjWasRemoved(t1) == false && P_MobjWasRemoved(t2) == false
+		&& t1->subsector != NULL && t2->subsector != NULL);
+}
+
+//
+// P_CheckSightCached
+//
+// Same as P_CheckSight, but answers repeated queries for the same pair
+// from the per-tic cache.
+//
+boolean P_CheckSightCached(mobj_t *t1, mobj_t *t2)
+{
+	boolean result;
+
+	if (P_LOSCacheable(t1, t2) == false)
+	{
+		return false;
+	}
+
+	if (P_LOSCacheLookup(t1, t2, &result) == false)
+	{
+		result = P_CheckSight(t1, t2);
+		P_LOSCacheStore(t1, t2, result);
+	}
+
+	return result;
+}
+
+// ---------------------------------------------------------------------------
+// Batched queries
+// ---------------------------------------------------------------------------
+
+#define LOSBATCH_MAXJOBS 8
+#define LOSBATCH_GRAIN 16 // minimum queries per job
+
+typedef struct
+{
+	UINT32 index;
+	UINT32 angle;
+	uintptr_t origin;
+} losorder_t;
+
+typedef struct
+{
+	const losquery_t *queries;
+	const losorder_t *order;
+	boolean *results;
+	size_t start, end;
+	los_funcs_t funcs;
+	losmarks_t *marks;
+} losjob_t;
+
+static losmarks_t losmarks[LOSBATCH_MAXJOBS];
+
+static void P_PrepareLOSMarks(losmarks_t *marks)
+{
+	// PU_LEVEL with a user pointer, so a level change
+	// NULLs these out and they get reallocated here.
+	if (marks->lines != NULL && marks->polys != NULL
+		&& marks->numlines == numlines && marks->numpolys == (size_t)numPolyObjects)
+	{
+		return;
+	}
+
+	if (marks->lines != NULL)
+		Z_Free(marks->lines);
+
+	if (marks->polys != NULL)
+		Z_Free(marks->polys);
+
+	marks->numlines = numlines;
+	marks->numpolys = numPolyObjects;
+	Z_Calloc(max(marks->numlines, 1) * sizeof (*marks->lines), PU_LEVEL, &marks->lines);
+	Z_Calloc(max(marks->numpolys, 1) * sizeof (*marks->polys), PU_LEVEL, &marks->polys);
+	marks->stamp = 0;
+}
+
+static void P_RunLOSJob(void *data)
+{
+	losjob_t *job = data;
+	size_t i;
+
+	for (i = job->start; i < job->end; i++)
+	{
+		const losquery_t *q = &job->queries[job->order[i].index];
+		job->results[job->order[i].index] = P_CompareMobjsAcrossLines(q->t1, q->t2, &job->funcs, job->marks);
+	}
+}
+
+static int P_CompareLOSOrder(const void *a, const void *b)
 {
-	los_funcs_t funcs = {0};
+	const losorder_t *oa = a, *ob = b;
+
+	if (oa->origin != ob->origin)
+		return (oa->origin < ob->origin) ? -1 : 1;
+
+	if (oa->angle != ob->angle)
+		return (oa->angle < ob->angle) ? -1 : 1;
 
-	funcs.validate = &P_CanWaypointTraverse;
+	return (oa->index < ob->index) ? -1 : (oa->index > ob->index);
+}
+
+//
+// P_CheckSightBatch
+//
+// Answers count queries of the given type at once, writing one result per
+// query. Results are identical to calling the scalar function per pair.
+//
+// Rays are grouped by origin and then direction, so consecutive queries walk
+// the same BSP subtrees and touch the same lines. Sight checks only read the
+// world, so large batches of them are split across the thread pool, and
+// repeated pairs are answered from the per-tic cache. The traversal queries
+// write to g_tm and always run on the calling thread.
+//
+void P_CheckSightBatch(lostype_t type, const losquery_t *queries, boolean *results, size_t count)
+{
+	const boolean usecache = (type == LOS_CHECKSIGHT);
+	losjob_t jobs[LOSBATCH_MAXJOBS];
+	losorder_t *order;
+	size_t numorder = 0;
+	size_t numjobs, perjob;
+	los_funcs_t funcs;
+	size_t i;
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	P_GetLOSFuncs(type, &funcs);
+	order = Z_Malloc(count * sizeof (*order), PU_STATIC, NULL);
+
+	for (i = 0; i < count; i++)
+	{
+		mobj_t *t1 = queries[i].t1;
+		mobj_t *t2 = queries[i].t2;
+
+		if (usecache == true)
+		{
+			if (P_LOSCacheable(t1, t2) == false)
+			{
+				results[i] = false;
+				continue;
+			}
+
+			if (P_LOSCacheLookup(t1, t2, &results[i]) == true)
+			{
+				continue;
+			}
+		}
+
+		order[numorder].index = (UINT32)i;
+		order[numorder].origin = (uintptr_t)t1;
+		order[numorder].angle = (P_MobjWasRemoved(t1) || P_MobjWasRemoved(t2))
+			? 0 : R_PointToAngle2(t1->x, t1->y, t2->x, t2->y);
+		numorder++;
+	}
+
+	qsort(order, numorder, sizeof (*order), P_CompareLOSOrder);
+
+	numjobs = 1;
+
+#ifdef HAVE_THREADS
+	if (type == LOS_CHECKSIGHT)
+	{
+		numjobs = min(LOSBATCH_MAXJOBS, max(numorder / LOSBATCH_GRAIN, 1));
+	}
+#endif
+
+	perjob = (numorder + numjobs - 1) / numjobs;
+
+	for (i = 0; i < numjobs; i++)
+	{
+		losjob_t *job = &jobs[i];
+
+		P_PrepareLOSMarks(&losmarks[i]);
+
+		job->queries = queries;
+		job->order = order;
+		job->results = results;
+		job->start = min(i * perjob, numorder);
+		job->end = min(job->start + perjob, numorder);
+		job->funcs = funcs;
+		job->marks = &losmarks[i];
+	}
+
+	if (numjobs == 1)
+	{
+		P_RunLOSJob(&jobs[0]);
+	}
+#ifdef HAVE_THREADS
+	else
+	{
+		for (i = 0; i < numjobs; i++)
+		{
+			I_ThreadPoolSubmit(&P_RunLOSJob, &jobs[i]);
+		}
+
+		I_ThreadPoolWaitIdle();
+	}
+#endif
+
+	if (usecache == true)
+	{
+		for (i = 0; i < numorder; i++)
+		{
+			const losquery_t *q = &queries[order[i].index];
+			P_LOSCacheStore(q->t1, q->t2, results[order[i].index]);
+		}
+	}
 
-	return P_CompareMobjsAcrossLines(t1, t2, &funcs);
+	Z_Free(order);
 }
@@ -0,0 +1,285 @@
+// DR. ROBOTNIK'S RING RACERS
+//-----------------------------------------------------------------------------
+// Copyright (C) 2024 by Kart Krew
+//
+// This program is free software distributed under the
+// terms of the GNU General Public License, version 2.
+// See the 'LICENSE' file for more details.
+//-----------------------------------------------------------------------------
+/// \file  p_spatial.cpp
+/// \brief Uniform spatial hash of blockmap things.
+///
+///        Every thing that is linked into the blockmap is also linked into
+///        a hash of 64-unit cells, kept in sync by P_SetThingPosition and
+///        P_UnsetThingPosition. Radius queries only look at the cells that
+///        overlap the query, and return things sorted nearest first.
+///
+///        Results are gathered in cell order and stable sorted, so the order
+///        is identical on every machine -- callers may rely on it in netgames.
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include <tracy/tracy/Tracy.hpp>
+
+#include "doomdef.h"
+#include "p_local.h"
+#include "p_maputl.h"
+#include "z_zone.h"
+
+namespace
+{
+
+constexpr INT32 kCellShift = FRACBITS + 6; // 64 units, half a blockmap block
+constexpr size_t kNumBuckets = 1 << 14;
+
+mobj_t **g_buckets = nullptr;
+INT32 g_cellwidth = 0;
+INT32 g_cellheight = 0;
+
+constexpr UINT32 cell_key(INT32 cx, INT32 cy)
+{
+	return (UINT32)cx | ((UINT32)cy << 16);
+}
+
+constexpr size_t bucket_for(INT32 cx, INT32 cy)
+{
+	return (((UINT32)cx * 73856093u) ^ ((UINT32)cy * 19349663u)) & (kNumBuckets - 1);
+}
+
+struct Candidate
+{
+	mobj_t *mobj;
+	INT64 distsq;
+};
+
+// One buffer per nesting level, so a callback can run its own query.
+// A deque, so growing it doesn't move the buffers of outer queries.
+std::deque<std::vector<Candidate>> g_candidates;
+size_t g_depth = 0;
+
+void gather(std::vector<Candidate>& out, fixed_t x, fixed_t y, fixed_t radius)
+{
+	out.clear();
+
+	if (g_buckets == nullptr || radius < 0)
+	{
+		return;
+	}
+
+	// Things are linked by their center, so look MAXRADIUS further
+	// out like the blockmap iterators do.
+	const INT64 reach = (INT64)radius + MAXRADIUS;
+	const INT64 left = (INT64)x - reach - bmaporgx;
+	const INT64 right = (INT64)x + reach - bmaporgx;
+	const INT64 bottom = (INT64)y - reach - bmaporgy;
+	const INT64 top = (INT64)y + reach - bmaporgy;
+
+	if (right < 0 || top < 0)
+	{
+		return;
+	}
+
+	const INT32 xl = (INT32)std::max<INT64>(left >> kCellShift, 0);
+	const INT32 xh = (INT32)std::min<INT64>(right >> kCellShift, g_cellwidth - 1);
+	const INT32 yl = (INT32)std::max<INT64>(bottom >> kCellShift, 0);
+	const INT32 yh = (INT32)std::min<INT64>(top >> kCellShift, g_cellheight - 1);
+
+	for (INT32 cy = yl; cy <= yh; cy++)
+	{
+		for (INT32 cx = xl; cx <= xh; cx++)
+		{
+			const UINT32 key = cell_key(cx, cy);
+
+			for (mobj_t *mo = g_buckets[bucket_for(cx, cy)]; mo != nullptr; mo = mo->spnext)
+			{
+				if (mo->spcell != key)
+				{
+					// another cell sharing the bucket
+					continue;
+				}
+
+				const INT64 dx = (INT64)mo->x - x;
+				const INT64 dy = (INT64)mo->y - y;
+				const INT64 distsq = (dx * dx) + (dy * dy);
+				const INT64 limit = (INT64)radius + mo->radius;
+
+				if (distsq > limit * limit)
+				{
+					continue;
+				}
+
+				out.push_back({mo, distsq});
+			}
+		}
+	}
+
+	std::stable_sort(
+		out.begin(),
+		out.end(),
+		[](const Candidate& a, const Candidate& b) { return a.distsq < b.distsq; }
+	);
+}
+
+} // namespace
+
+/** Sets up an empty spatial hash for the current blockmap.
+  * Called wherever blocklinks are (re)allocated during level load.
+  */
+void P_InitSpatialHash(void)
+{
+	g_buckets = static_cast<mobj_t**>(Z_Calloc(sizeof(*g_buckets) * kNumBuckets, PU_LEVEL, &g_buckets));
+	g_cellwidth = std::min(bmapwidth << (MAPBLOCKSHIFT - kCellShift), 0xFFFF);
+	g_cellheight = std::min(bmapheight << (MAPBLOCKSHIFT - kCellShift), 0xFFFF);
+}
+
+/** Links a thing into the spatial hash by its current position.
+  * Things off the blockmap are left unlinked, like in P_LinkToBlockMap.
+  *
+  * \param thing The thing to link. Must not be linked already.
+  */
+void P_SpatialHashLink(mobj_t *thing)
+{
+	const INT32 cx = (INT32)((UINT32)(thing->x - bmaporgx) >> kCellShift);
+	const INT32 cy = (INT32)((UINT32)(thing->y - bmaporgy) >> kCellShift);
+
+	if (g_buckets == nullptr || cx < 0 || cx >= g_cellwidth || cy < 0 || cy >= g_cellheight)
+	{
+		thing->spnext = nullptr;
+		thing->spprev = nullptr;
+		return;
+	}
+
+	mobj_t **link = &g_buckets[bucket_for(cx, cy)];
+	mobj_t *spnext = *link;
+
+	thing->spcell = cell_key(cx, cy);
+	thing->spnext = spnext;
+
+	if (spnext != nullptr)
+	{
+		spnext->spprev = &thing->spnext;
+	}
+
+	thing->spprev = link;
+	*link = thing;
+}
+
+/** Unlinks a thing from the spatial hash. Safe on unlinked things.
+  *
+  * \param thing The thing to unlink.
+  */
+void P_SpatialHashUnlink(mobj_t *thing)
+{
+	mobj_t **spprev = thing->spprev;
+	mobj_t *spnext;
+
+	if (spprev != nullptr && (*spprev = spnext = thing->spnext) != nullptr)
+	{
+		spnext->spprev = spprev;
+	}
+
+	thing->spnext = nullptr;
+	thing->spprev = nullptr;
+}
+
+/** Finds blockmap things touching a circle, nearest first.
+  *
+  * \param x X of the center.
+  * \param y Y of the center.
+  * \param radius Radius of the circle. A thing is found if its own
+  *        radius reaches into the circle.
+  * \param results Array to receive the things, sorted by distance.
+  * \param maxresults Size of the array. Farther things past this are dropped.
+  * \return Number of things written to results.
+  */
+size_t P_QueryThingsInRadius(fixed_t x, fixed_t y, fixed_t radius, mobj_t **results, size_t maxresults)
+{
+	ZoneScoped;
+
+	if (g_candidates.size() <= g_depth)
+	{
+		g_candidates.resize(g_depth + 1);
+	}
+
+	std::vector<Candidate>& candidates = g_candidates[g_depth];
+	gather(candidates, x, y, radius);
+
+	const size_t count = std::min(candidates.size(), maxresults);
+	for (size_t i = 0; i < count; i++)
+	{
+		results[i] = candidates[i].mobj;
+	}
+
+	return count;
+}
+
+/** Calls a function for each blockmap thing touching a circle, nearest first.
+  * This is the spatial hash counterpart of P_BlockThingsIterator, with the
+  * same meaning for the callback's return value.
+  *
+  * \param x X of the center.
+  * \param y Y of the center.
+  * \param radius Radius of the circle.
+  * \param func Function to call for each thing.
+  * \return false if func returned BMIT_ABORT, true otherwise.
+  */
+boolean P_RadiusThingsIterator(fixed_t x, fixed_t y, fixed_t radius, BlockItReturn_t (*func)(mobj_t *))
+{
+	ZoneScoped;
+
+	boolean ret = true;
+
+	if (g_candidates.size() <= g_depth)
+	{
+		g_candidates.resize(g_depth + 1);
+	}
+
+	std::vector<Candidate>& candidates = g_candidates[g_depth];
+	gather(candidates, x, y, radius);
+
+	// Hold a reference to every candidate, since the callback may remove
+	// things and MF_NOTHINK things would otherwise be freed on the spot.
+	for (Candidate& c : candidates)
+	{
+		mobj_t *mo = NULL;
+		P_SetTarget(&mo, c.mobj);
+	}
+
+	g_depth++;
+
+	for (const Candidate& c : candidates)
+	{
+		mobj_t *mo = c.mobj;
+
+		if (P_MobjWasRemoved(mo))
+		{
+			continue;
+		}
+
+		BlockItReturn_t result = func(mo);
+
+		if (result == BMIT_ABORT)
+		{
+			ret = false;
+			break;
+		}
+
+		if (result == BMIT_STOP)
+		{
+			break;
+		}
+	}
+
+	g_depth--;
+
+	for (Candidate& c : candidates)
+	{
+		mobj_t *mo = c.mobj;
+		P_SetTarget(&mo, NULL);
+	}
+
+	return ret;
+}
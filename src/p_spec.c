@@ -52,6 +52,7 @@
 #include "m_easing.h"
 #include "music.h"
 #include "k_battle.h" // battleprisons
+#include "k_waypoint.h" // K_InvalidateWaypointRoutes
 
 // Not sure if this is necessary, but it was in w_wad.c, so I'm putting it here too -Shadow Hog
 #include <errno.h>
@@ -4506,6 +4507,8 @@ boolean P_ProcessSpecial(activator_t *activator, INT16 special, INT32 *args, cha
 						}
 					}
 				}
+
+				K_InvalidateWaypointRoutes();
 			}
 			break;
 
@@ -298,6 +298,8 @@ void P_InitThinkers(void)
 	waypointcap = NULL;
 	trackercap = NULL;
 
+	P_ClearSightCache();
+
 	titlemapcam.mobj = NULL;
 
 	for (i = 0; i <= 15; i++)
@@ -330,7 +332,14 @@ void P_AddThinker(const thinklistnum_t n, thinker_t *thinker)
 	thlist[n].prev = thinker;
 
 	thinker->references = 0;    // killough 11/98: init reference counter to 0
-	thinker->cachable = n == THINK_MOBJ;
+
+	// mobjs and precipitation are allocated from their own pools, see P_SpawnMobj
+	if (n == THINK_MOBJ)
+		thinker->pool = &mobjpool;
+	else if (n == THINK_PRECIP)
+		thinker->pool = &precipmobjpool;
+	else
+		thinker->pool = NULL;
 
 #ifdef PARANOIA
 	thinker->debug_mobjtype = MT_NULL;
@@ -448,11 +457,10 @@ void P_UnlinkThinker(thinker_t *thinker)
 	I_Assert(thinker->references == 0);
 
 	(next->prev = thinker->prev)->next = next;
-	if (thinker->cachable)
+	if (thinker->pool)
 	{
-		// put cachable thinkers in the mobj cache, so we can avoid allocations
-		((mobj_t *)thinker)->hnext = mobjcache;
-		mobjcache = (mobj_t *)thinker;
+		// pooled thinkers go back on their free list, so we can avoid allocations
+		Z_PoolFree(thinker->pool, thinker);
 	}
 	else
 	{
@@ -561,6 +569,7 @@ static void P_RunThinkers(void)
 	for (i = 0; i < NUM_ACTIVETHINKERLISTS; i++)
 	{
 		ps_thlist_times[i] = I_GetPreciseTime();
+		P_ClearSightCache(); // the previous list may have moved sectors or polyobjects
 		for (currentthinker = thlist[i].next; currentthinker != &thlist[i]; currentthinker = currentthinker->next)
 		{
 #ifdef PARANOIA
@@ -40,6 +40,8 @@
 #include "i_system.h" // I_GetPreciseTime
 #include "doomstat.h" // MAXSPLITSCREENPLAYERS
 #include "r_fps.h" // Frame interpolation/uncapped
+#include "core/memory.h"
+#include "core/instrument.h"
 #include "core/thread_pool.h"
 
 #ifdef HWRENDER
@@ -1503,7 +1505,7 @@ void R_RenderPlayerView(void)
 {
 	player_t * player = &players[displayplayers[viewssnum]];
 	INT32			nummasks	= 1;
-	maskcount_t*	masks		= static_cast<maskcount_t*>(malloc(sizeof(maskcount_t)));
+	srb2::FrameVector<maskcount_t> masks(nummasks);
 
 	R_SetupFrame(viewssnum);
 	framecount++;
@@ -1539,13 +1541,13 @@ void R_RenderPlayerView(void)
 	ProfZeroTimer();
 #endif
 	ps_numbspcalls = ps_numpolyobjects = ps_numdrawnodes = 0;
-	ps_bsptime = I_GetPreciseTime();
 
 	srb2::ThreadPool::Sema tp_sema;
 	srb2::g_main_threadpool->begin_sema();
-	R_RenderViewpoint(&masks[nummasks - 1], nummasks - 1);
-
-	ps_bsptime = I_GetPreciseTime() - ps_bsptime;
+	{
+		INSTRUMENT_SCOPE_TO("R_RenderBSPNode", ps_bsptime);
+		R_RenderViewpoint(&masks[nummasks - 1], nummasks - 1);
+	}
 #ifdef TIMING
 	RDMSR(0x10, &mycount);
 	mytotal += mycount; // 64bit add
@@ -1554,9 +1556,10 @@ void R_RenderPlayerView(void)
 #endif
 //profile stuff ---------------------------------------------------------
 
-	ps_sw_spritecliptime = I_GetPreciseTime();
-	R_ClipSprites(drawsegs, NULL);
-	ps_sw_spritecliptime = I_GetPreciseTime() - ps_sw_spritecliptime;
+	{
+		INSTRUMENT_SCOPE_TO("R_ClipSprites", ps_sw_spritecliptime);
+		R_ClipSprites(drawsegs, NULL);
+	}
 
 
 	// Add skybox portals caused by sky visplanes.
@@ -1564,71 +1567,74 @@ void R_RenderPlayerView(void)
 		Portal_AddSkyboxPortals(player);
 
 	// Portal rendering. Hijacks the BSP traversal.
-	ps_sw_portaltime = I_GetPreciseTime();
-	if (portal_base && !cv_debugrender_portal.value)
 	{
-		// tp_sema = srb2::g_main_threadpool->end_sema();
-		// srb2::g_main_threadpool->notify_sema(tp_sema);
-		// srb2::g_main_threadpool->wait_sema(tp_sema);
-		// srb2::g_main_threadpool->begin_sema();
+		INSTRUMENT_SCOPE_TO("R_RenderPortals", ps_sw_portaltime);
+		if (portal_base && !cv_debugrender_portal.value)
+		{
+			// tp_sema = srb2::g_main_threadpool->end_sema();
+			// srb2::g_main_threadpool->notify_sema(tp_sema);
+			// srb2::g_main_threadpool->wait_sema(tp_sema);
+			// srb2::g_main_threadpool->begin_sema();
 
-		portal_t *portal;
+			portal_t *portal;
 
-		for(portal = portal_base; portal; portal = portal_base)
-		{
-			portalrender = portal->pass; // Recursiveness depth.
+			for(portal = portal_base; portal; portal = portal_base)
+			{
+				portalrender = portal->pass; // Recursiveness depth.
 
-			R_ClearFFloorClips();
+				R_ClearFFloorClips();
 
-			// Apply the viewpoint stored for the portal.
-			R_PortalFrame(portal);
+				// Apply the viewpoint stored for the portal.
+				R_PortalFrame(portal);
 
-			// Hack in the clipsegs to delimit the starting
-			// clipping for sprites and possibly other similar
-			// future items.
-			R_PortalClearClipSegs(portal->start, portal->end);
+				// Hack in the clipsegs to delimit the starting
+				// clipping for sprites and possibly other similar
+				// future items.
+				R_PortalClearClipSegs(portal->start, portal->end);
 
-			// Hack in the top/bottom clip values for the window
-			// that were previously stored.
-			Portal_ClipApply(portal);
+				// Hack in the top/bottom clip values for the window
+				// that were previously stored.
+				Portal_ClipApply(portal);
 
-			validcount++;
+				validcount++;
 
-			masks = static_cast<maskcount_t*>(realloc(masks, (++nummasks)*sizeof(maskcount_t)));
+				masks.resize(++nummasks);
 
-			portalskipprecipmobjs = portal->isskybox;
+				portalskipprecipmobjs = portal->isskybox;
 
-			// Render the BSP from the new viewpoint, and clip
-			// any sprites with the new clipsegs and window.
+				// Render the BSP from the new viewpoint, and clip
+				// any sprites with the new clipsegs and window.
 
-			R_RenderViewpoint(&masks[nummasks - 1], nummasks - 1);
+				R_RenderViewpoint(&masks[nummasks - 1], nummasks - 1);
 
-			portalskipprecipmobjs = false;
+				portalskipprecipmobjs = false;
 
-			R_ClipSprites(ds_p - (masks[nummasks - 1].drawsegs[1] - masks[nummasks - 1].drawsegs[0]), portal);
+				R_ClipSprites(ds_p - (masks[nummasks - 1].drawsegs[1] - masks[nummasks - 1].drawsegs[0]), portal);
 
-			Portal_Remove(portal);
-		}
+				Portal_Remove(portal);
+			}
 
-		// tp_sema = srb2::g_main_threadpool->end_sema();
-		// srb2::g_main_threadpool->notify_sema(tp_sema);
-		// srb2::g_main_threadpool->wait_sema(tp_sema);
-		// srb2::g_main_threadpool->begin_sema();
+			// tp_sema = srb2::g_main_threadpool->end_sema();
+			// srb2::g_main_threadpool->notify_sema(tp_sema);
+			// srb2::g_main_threadpool->wait_sema(tp_sema);
+			// srb2::g_main_threadpool->begin_sema();
+		}
 	}
-	ps_sw_portaltime = I_GetPreciseTime() - ps_sw_portaltime;
 
-	ps_sw_planetime = I_GetPreciseTime();
-	R_DrawPlanes();
-	tp_sema = srb2::g_main_threadpool->end_sema();
-	srb2::g_main_threadpool->notify_sema(tp_sema);
-	srb2::g_main_threadpool->wait_sema(tp_sema);
-	ps_sw_planetime = I_GetPreciseTime() - ps_sw_planetime;
+	{
+		INSTRUMENT_SCOPE_TO("R_DrawPlanes", ps_sw_planetime);
+		R_DrawPlanes();
+		tp_sema = srb2::g_main_threadpool->end_sema();
+		srb2::g_main_threadpool->notify_sema(tp_sema);
+		srb2::g_main_threadpool->wait_sema(tp_sema);
+	}
 
 	// draw mid texture and sprite
 	// And now 3D floors/sides!
-	ps_sw_maskedtime = I_GetPreciseTime();
-	R_DrawMasked(masks, nummasks);
-	ps_sw_maskedtime = I_GetPreciseTime() - ps_sw_maskedtime;
+	{
+		INSTRUMENT_SCOPE_TO("R_DrawMasked", ps_sw_maskedtime);
+		R_DrawMasked(masks.data(), nummasks);
+	}
 
 	if (cv_debugrender_visplanes.value)
 	{
@@ -1711,8 +1717,6 @@ void R_RenderPlayerView(void)
 			Portal_Remove(portal);
 		}
 	}
-
-	free(masks);
 }
 
 // =========================================================================
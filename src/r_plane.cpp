@@ -30,6 +30,7 @@
 #include "r_splats.h" // faB(21jan):testing
 #include "r_sky.h"
 #include "r_portal.h"
+#include "core/instrument.h"
 #include "core/thread_pool.h"
 
 #include "v_video.h"
@@ -606,6 +607,7 @@ static void R_MakeSpans(void (*mapfunc)(drawspandata_t* ds, void(*spanfunc)(draw
 			taskspans += 1;
 		}
 		auto task = [=]() mutable -> void {
+			INSTRUMENT_SCOPE("Plane spans");
 			for (int i = 0; i < taskspans; i++)
 			{
 				mapfunc(&dc_copy, spanfunc, t1 + i, spanstartcopy[i], x - 1, false);
@@ -635,6 +637,7 @@ static void R_MakeSpans(void (*mapfunc)(drawspandata_t* ds, void(*spanfunc)(draw
 			taskspans += 1;
 		}
 		auto task = [=]() mutable -> void {
+			INSTRUMENT_SCOPE("Plane spans");
 			for (int i = 0; i < taskspans; i++)
 			{
 				mapfunc(&dc_copy, spanfunc, b1 - i, spanstartcopy[i], x - 1, false);
@@ -732,6 +735,7 @@ static void R_DrawSkyPlane(visplane_t *pl, void(*colfunc)(drawcolumndata_t*), bo
 		constexpr const int kSkyPlaneMacroColumns = 8;
 
 		auto thunk = [=]() mutable -> void {
+			INSTRUMENT_SCOPE("Sky columns");
 			for (int i = 0; i < kSkyPlaneMacroColumns && i + x <= pl->maxx; i++)
 			{
 				dc.yl = pl->top[x + i];
@@ -210,6 +210,7 @@ SDL_bool framebuffer = SDL_FALSE;
 
 UINT8 keyboard_started = false;
 boolean g_in_exiting_signal_handler = false;
+INT32 quitstatus = 0;
 
 #ifdef UNIXBACKTRACE
 #define STDERR_WRITE(string) if (fd != -1) I_OutputMsg("%s", string)
@@ -1696,7 +1697,7 @@ void I_Quit(void)
 		free(myargv); // Deallocate allocated memory
 death:
 	W_Shutdown();
-	exit(0);
+	exit(quitstatus);
 }
 
 void I_WaitVBL(INT32 count)
@@ -83,6 +83,7 @@ TYPEDEF (challengeall_pak);
 TYPEDEF (responseall_pak);
 TYPEDEF (resultsall_pak);
 TYPEDEF (say_pak);
+TYPEDEF (consistency_pak);
 TYPEDEF (netinfo_pak);
 
 // d_event.h
@@ -467,6 +468,10 @@ TYPEDEF (virtlump_t);
 TYPEDEF (virtres_t);
 TYPEDEF (wadfile_t);
 
+// z_pool.h
+TYPEDEF (zpool_t);
+TYPEDEF (zpoolchunk_t);
+
 #undef TYPEDEF
 #undef TYPEDEF2
 
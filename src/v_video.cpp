@@ -16,6 +16,9 @@
 
 #include <cmath>
 #include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <tracy/tracy/Tracy.hpp>
 
@@ -48,6 +51,7 @@
 #include "k_boss.h"
 #include "i_time.h"
 #include "v_draw.hpp"
+#include "font.h"
 
 using namespace srb2;
 
@@ -729,24 +733,23 @@ void V_RestoreClipRect(const cliprect_t *copy)
 static UINT8 hudplusalpha[11]  = { 10,  8,  6,  4,  2,  0,  0,  0,  0,  0,  0};
 static UINT8 hudminusalpha[11] = { 10,  9,  9,  8,  8,  7,  7,  6,  6,  5,  5};
 
-static const UINT8 *v_colormap = NULL;
-static const UINT8 *v_translevel = NULL;
-
-static inline UINT8 standardpdraw(const UINT8 *dest, const UINT8 *source, fixed_t ofs)
-{
-	(void)dest; return source[ofs>>FRACBITS];
-}
-static inline UINT8 mappedpdraw(const UINT8 *dest, const UINT8 *source, fixed_t ofs)
+// Whether any of a screen rect can show up. Draws that can't are dropped
+// before they cost a quad in Twodee, and an atlas slot for their patch.
+static boolean V_RectVisible(float x1, float y1, float x2, float y2, const cliprect_t *clip)
 {
-	(void)dest; return *(v_colormap + source[ofs>>FRACBITS]);
-}
-static inline UINT8 translucentpdraw(const UINT8 *dest, const UINT8 *source, fixed_t ofs)
-{
-	return *(v_translevel + ((source[ofs>>FRACBITS]<<8)&0xff00) + (*dest&0xff));
-}
-static inline UINT8 transmappedpdraw(const UINT8 *dest, const UINT8 *source, fixed_t ofs)
-{
-	return *(v_translevel + (((*(v_colormap + source[ofs>>FRACBITS]))<<8)&0xff00) + (*dest&0xff));
+	if (x1 > x2)
+		std::swap(x1, x2);
+	if (y1 > y2)
+		std::swap(y1, y2);
+
+	if (x2 <= 0.f || y2 <= 0.f || x1 >= vid.width || y1 >= vid.height || x1 == x2 || y1 == y2)
+		return false;
+
+	if (clip && clip->enabled
+		&& (x2 <= clip->left || y2 <= clip->top || x1 >= clip->right || y1 >= clip->bottom))
+		return false;
+
+	return true;
 }
 
 UINT32 V_GetHUDTranslucency(INT32 scrn)
@@ -782,33 +785,31 @@ static UINT32 V_GetAlphaLevel(INT32 scrn)
 	}
 }
 
-// Draws a patch scaled to arbitrary size.
-void V_DrawStretchyFixedPatch(fixed_t x, fixed_t y, fixed_t pscale, fixed_t vscale, INT32 scrn, patch_t *patch, const UINT8 *colormap)
+// What V_DrawStretchyFixedPatch works out from the flags and scale alone.
+// Kept apart so that runs of patches drawn with the same ones, like the
+// characters of a string, only work it out once.
+struct patchdrawsetup_t
 {
-	UINT32 alphalevel, blendmode;
-
+	INT32 scrn;
+	fixed_t pscale, vscale;
 	fixed_t vdup;
 	INT32 dupx, dupy;
-	fixed_t pwidth; // patch width
-
-	const cliprect_t *clip = V_GetClipRect();
-
-	if (rendermode == render_none)
-		return;
+	INT32 snapx, snapy; // from V_AdjustXYWithSnap
+	float falpha;
+	hwr2::BlendMode blend;
+	const cliprect_t *clip;
+};
 
-#ifdef HWRENDER
-	//if (rendermode != render_soft && !con_startup)		// Why?
-	if (rendermode == render_opengl)
-	{
-		HWR_DrawStretchyFixedPatch(patch, x, y, pscale, vscale, scrn, colormap);
-		return;
-	}
-#endif
+// Returns false if nothing drawn with these flags would show up.
+static boolean V_SetupPatchDraw(patchdrawsetup_t *setup, fixed_t pscale, fixed_t vscale, INT32 scrn)
+{
+	UINT32 alphalevel, blendmode;
+	INT32 dupx, dupy;
 
 	if ((blendmode = ((scrn & V_BLENDMASK) >> V_BLENDSHIFT)))
 		blendmode++; // realign to constants
 	if ((alphalevel = V_GetAlphaLevel(scrn)) >= 10)
-		return;
+		return false;
 
 	dupx = vid.dupx;
 	dupy = vid.dupy;
@@ -831,9 +832,62 @@ void V_DrawStretchyFixedPatch(fixed_t x, fixed_t y, fixed_t pscale, fixed_t vsca
 
 	// only use one dup, to avoid stretching (har har)
 	dupx = dupy = (dupx < dupy ? dupx : dupy);
-	vdup = FixedMul(dupx<<FRACBITS, pscale);
+	setup->vdup = FixedMul(dupx<<FRACBITS, pscale);
 	if (vscale != pscale)
-		vdup = FixedMul(dupx<<FRACBITS, vscale);
+		setup->vdup = FixedMul(dupx<<FRACBITS, vscale);
+
+	setup->scrn = scrn;
+	setup->pscale = pscale;
+	setup->vscale = vscale;
+	setup->dupx = dupx;
+	setup->dupy = dupy;
+
+	// Centering only ever adds to the position
+	setup->snapx = setup->snapy = 0;
+	if (!(scrn & V_NOSCALESTART) && !(scrn & V_SCALEPATCHMASK))
+		V_AdjustXYWithSnap(&setup->snapx, &setup->snapy, scrn, dupx, dupy);
+
+	setup->falpha = 1.f;
+	if (alphalevel > 0 && alphalevel <= 10)
+	{
+		setup->falpha = (10 - alphalevel) / 10.f;
+	}
+
+	switch (blendmode)
+	{
+	case AST_MODULATE:
+		setup->blend = hwr2::BlendMode::kModulate;
+		break;
+	case AST_ADD:
+		setup->blend = hwr2::BlendMode::kAdditive;
+		break;
+
+	// Note: SRB2 has these blend modes flipped compared to GL and Vulkan.
+	// SRB2's Subtract is Dst - Src. OpenGL is Src - Dst. And vice versa for reverse.
+	// Twodee will use the GL definitions.
+	case AST_SUBTRACT:
+		setup->blend = hwr2::BlendMode::kReverseSubtractive;
+		break;
+	case AST_REVERSESUBTRACT:
+		setup->blend = hwr2::BlendMode::kSubtractive;
+		break;
+	default:
+		setup->blend = hwr2::BlendMode::kAlphaTransparent;
+		break;
+	}
+
+	setup->clip = V_GetClipRect();
+	return true;
+}
+
+// Draws a patch with what V_SetupPatchDraw worked out.
+static void V_DrawSetupPatch(const patchdrawsetup_t *setup, fixed_t x, fixed_t y, patch_t *patch, const UINT8 *colormap)
+{
+	const INT32 scrn = setup->scrn;
+	const fixed_t pscale = setup->pscale, vscale = setup->vscale;
+	const INT32 dupx = setup->dupx, dupy = setup->dupy;
+	const cliprect_t *clip = setup->clip;
+	fixed_t pwidth; // patch width
 
 	{
 		fixed_t offsetx = 0, offsety = 0;
@@ -868,10 +922,8 @@ void V_DrawStretchyFixedPatch(fixed_t x, fixed_t y, fixed_t pscale, fixed_t vsca
 		y >>= FRACBITS;
 
 		// Center it if necessary
-		if (!(scrn & V_SCALEPATCHMASK))
-		{
-			V_AdjustXYWithSnap(&x, &y, scrn, dupx, dupy);
-		}
+		x += setup->snapx;
+		y += setup->snapy;
 	}
 
 	if (pscale != FRACUNIT) // scale width properly
@@ -884,57 +936,15 @@ void V_DrawStretchyFixedPatch(fixed_t x, fixed_t y, fixed_t pscale, fixed_t vsca
 	else
 		pwidth = patch->width * dupx;
 
-	float fdupy = FIXED_TO_FLOAT(vdup);
+	float fdupy = FIXED_TO_FLOAT(setup->vdup);
 
 	float fx = x;
 	float fy = y;
 	float fx2 = fx + pwidth;
 	float fy2 = fy + std::round(static_cast<float>(patch->height) * fdupy);
-	float falpha = 1.f;
-	float umin = 0.f;
-	float umax = 1.f;
-	float vmin = 0.f;
-	float vmax = 1.f;
 
-	// flip UVs
-	if (scrn & V_FLIP)
-	{
-		umin = 1.f - umin;
-		umax = 1.f - umax;
-	}
-	if (scrn & V_VFLIP)
-	{
-		vmin = 1.f - vmin;
-		vmax = 1.f - vmax;
-	}
-
-	if (alphalevel > 0 && alphalevel <= 10)
-	{
-		falpha = (10 - alphalevel) / 10.f;
-	}
-	hwr2::BlendMode blend = hwr2::BlendMode::kAlphaTransparent;
-	switch (blendmode)
-	{
-	case AST_MODULATE:
-		blend = hwr2::BlendMode::kModulate;
-		break;
-	case AST_ADD:
-		blend = hwr2::BlendMode::kAdditive;
-		break;
-
-	// Note: SRB2 has these blend modes flipped compared to GL and Vulkan.
-	// SRB2's Subtract is Dst - Src. OpenGL is Src - Dst. And vice versa for reverse.
-	// Twodee will use the GL definitions.
-	case AST_SUBTRACT:
-		blend = hwr2::BlendMode::kReverseSubtractive;
-		break;
-	case AST_REVERSESUBTRACT:
-		blend = hwr2::BlendMode::kSubtractive;
-		break;
-	default:
-		blend = hwr2::BlendMode::kAlphaTransparent;
-		break;
-	}
+	if (!V_RectVisible(fx, fy, fx2, fy2, clip))
+		return;
 
 	auto builder = g_2d.begin_quad();
 	builder
@@ -942,8 +952,8 @@ void V_DrawStretchyFixedPatch(fixed_t x, fixed_t y, fixed_t pscale, fixed_t vsca
 		.rect(fx, fy, fx2 - fx, fy2 - fy)
 		.flip((scrn & V_FLIP) > 0)
 		.vflip((scrn & V_VFLIP) > 0)
-		.color(1, 1, 1, falpha)
-		.blend(blend)
+		.color(1, 1, 1, setup->falpha)
+		.blend(setup->blend)
 		.colormap(colormap);
 
 	if (clip && clip->enabled)
@@ -953,6 +963,29 @@ void V_DrawStretchyFixedPatch(fixed_t x, fixed_t y, fixed_t pscale, fixed_t vsca
 	builder.done();
 }
 
+// Draws a patch scaled to arbitrary size.
+void V_DrawStretchyFixedPatch(fixed_t x, fixed_t y, fixed_t pscale, fixed_t vscale, INT32 scrn, patch_t *patch, const UINT8 *colormap)
+{
+	patchdrawsetup_t setup;
+
+	if (rendermode == render_none)
+		return;
+
+#ifdef HWRENDER
+	//if (rendermode != render_soft && !con_startup)		// Why?
+	if (rendermode == render_opengl)
+	{
+		HWR_DrawStretchyFixedPatch(patch, x, y, pscale, vscale, scrn, colormap);
+		return;
+	}
+#endif
+
+	if (!V_SetupPatchDraw(&setup, pscale, vscale, scrn))
+		return;
+
+	V_DrawSetupPatch(&setup, x, y, patch, colormap);
+}
+
 // Draws a patch cropped and scaled to arbitrary size.
 void V_DrawCroppedPatch(fixed_t x, fixed_t y, fixed_t pscale, INT32 scrn, patch_t *patch, fixed_t sx, fixed_t sy, fixed_t w, fixed_t h)
 {
@@ -1090,6 +1123,9 @@ void V_DrawFill(INT32 x, INT32 y, INT32 w, INT32 h, INT32 c)
 
 		w = std::max<INT32>(0, x2 - x);
 		h = std::max<INT32>(0, y2 - y);
+
+		if (w <= 0 || h <= 0)
+			return; // clipped away entirely
 	}
 
 	g_2d.begin_quad()
@@ -1332,6 +1368,9 @@ void V_DrawFadeFill(INT32 x, INT32 y, INT32 w, INT32 h, INT32 c, UINT16 color, U
 	if (y + h > vid.height)
 		h = vid.height-y;
 
+	if (strength == 0)
+		return; // either kind of fade leaves the screen as it is
+
 	float r;
 	float g;
 	float b;
@@ -2524,41 +2563,169 @@ static UINT8 V_GetButtonCodeWidth(UINT8 c)
 	return x;
 }
 
-void V_DrawStringScaled(
-		fixed_t    x,
-		fixed_t    y,
-		fixed_t      scale,
-		fixed_t spacescale,
-		fixed_t    lfscale,
-		INT32      flags,
-		const UINT8 *colormap,
-		int        fontno,
-		const char *s)
+// Glyph runs
+// ---
+// Laying out a string means case folding, checking and measuring every
+// character of it, every frame, for text that mostly stays the same:
+// menu labels, HUD names, the scoreboard, chat. So strings are laid out
+// once, into runs of glyphs placed relative to the string's position,
+// and a run is kept for as long as the same text keeps getting drawn or
+// measured with the same font, flags and scale. What changes from frame
+// to frame (dancing, the colormap, button prompts) is left to drawing.
+
+#define GLYPHRUNCACHESIZE 1024
+
+struct glyph_t
+{
+	fixed_t pen; // where the pen was, for clipping against the right edge
+	fixed_t x, y; // offsets included
+	UINT16 line;
+	INT32 dancecounter;
+	boolean dance;
+	INT32 codecolor; // V_CHARCOLORMASK bits of the last color code
+
+	patch_t *patch; // nullptr for button prompts
+	srb2::Draw::Button button;
+	std::optional<bool> press;
+	INT32 buttonx, buttony;
+};
+
+struct glyphrun_t
+{
+	// What it was laid out for
+	std::string text;
+	int fontno;
+	INT32 flags;
+	fixed_t scale, spacescale, lfscale;
+	INT32 viddupx, viddupy;
+
+	tic_t lastused;
+
+	boolean laidout;
+	std::vector<glyph_t> glyphs;
+	INT32 dupx, dupy;
+	fixed_t lfh;
+
+	boolean measured;
+	fixed_t width;
+};
+
+static std::unordered_map<UINT64, glyphrun_t> glyphruns;
+static UINT32 glyphrunfontgeneration;
+
+static UINT64 V_GlyphRunHash(const char *s, size_t len, fixed_t scale, fixed_t spacescale, fixed_t lfscale, INT32 flags, int fontno)
+{
+	const INT32 params[] = {scale, spacescale, lfscale, flags, fontno, vid.dupx, vid.dupy};
+	UINT64 hash = 14695981039346656037ull;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+	{
+		hash ^= static_cast<UINT8>(s[i]);
+		hash *= 1099511628211ull;
+	}
+
+	for (INT32 param : params)
+	{
+		hash ^= static_cast<UINT32>(param);
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+// Drops runs that haven't been used in a while, once there are too many.
+static void V_TrimGlyphRuns(void)
+{
+	const tic_t now = I_GetTime();
+
+	for (auto it = glyphruns.begin(); it != glyphruns.end();)
+	{
+		if (now - it->second.lastused > TICRATE)
+			it = glyphruns.erase(it);
+		else
+			++it;
+	}
+
+	if (glyphruns.size() >= GLYPHRUNCACHESIZE)
+		glyphruns.clear(); // all still in use? start over
+}
+
+// Finds the run for a string, or makes an empty one for it.
+static glyphrun_t *V_GetGlyphRun(fixed_t scale, fixed_t spacescale, fixed_t lfscale, INT32 flags, int fontno, const char *s)
+{
+	const size_t len = strlen(s);
+	const UINT64 hash = V_GlyphRunHash(s, len, scale, spacescale, lfscale, flags, fontno);
+
+	if (glyphrunfontgeneration != fontgeneration)
+	{
+		// The patches in every run may be gone
+		glyphruns.clear();
+		glyphrunfontgeneration = fontgeneration;
+	}
+
+	auto it = glyphruns.find(hash);
+
+	if (it == glyphruns.end())
+	{
+		if (glyphruns.size() >= GLYPHRUNCACHESIZE)
+			V_TrimGlyphRuns();
+
+		it = glyphruns.try_emplace(hash).first;
+	}
+
+	glyphrun_t *run = &it->second;
+
+	if (run->text.compare(0, std::string::npos, s, len) != 0 || run->fontno != fontno || run->flags != flags
+		|| run->scale != scale || run->spacescale != spacescale || run->lfscale != lfscale
+		|| run->viddupx != vid.dupx || run->viddupy != vid.dupy)
+	{
+		// New, or another string that hashed the same
+		run->text.assign(s, len);
+		run->fontno = fontno;
+		run->flags = flags;
+		run->scale = scale;
+		run->spacescale = spacescale;
+		run->lfscale = lfscale;
+		run->viddupx = vid.dupx;
+		run->viddupy = vid.dupy;
+		run->laidout = run->measured = false;
+		run->glyphs.clear();
+	}
+
+	run->lastused = I_GetTime();
+	return run;
+}
+
+// Places every glyph of a run, as V_DrawStringScaled would draw them.
+static void V_LayoutGlyphRun(glyphrun_t *run)
 {
 	INT32     hchw;/* half-width for centering */
 
 	INT32     dupx;
 	INT32     dupy;
 
-	fixed_t  right;
-	fixed_t    bot;
+	const fixed_t scale = run->scale;
+	INT32     flags = run->flags;
 
 	font_t   *font;
 
 	boolean uppercase;
-	boolean notcolored;
 
 	boolean   dance;
 	boolean nodanceoverride;
 	INT32     dancecounter;
 
+	INT32 codecolor = 0;
+
 	fixed_t cx, cy;
 
-	fixed_t cxoff, cyoff;
+	fixed_t cxoff;
 	fixed_t cw;
 
-	fixed_t   left;
+	UINT16 line = 0;
 
+	const char *s = run->text.c_str();
 	int c;
 
 	uppercase  = ((flags & V_FORCEUPPERCASE) == V_FORCEUPPERCASE);
@@ -2572,18 +2739,11 @@ void V_DrawStringScaled(
 	   don't pass them on. */
 	flags &= ~(V_PARAMMASK);
 
-	if (colormap == NULL)
-	{
-		colormap   =  V_GetStringColormap(( flags & V_CHARCOLORMASK ));
-	}
-
-	notcolored = !colormap;
-
-	font       = &fontv[fontno];
+	font       = &fontv[run->fontno];
 
 	fontspec_t fontspec;
 
-	V_GetFontSpecification(fontno, flags, &fontspec);
+	V_GetFontSpecification(run->fontno, flags, &fontspec);
 
 	hchw     = fontspec.chw >> 1;
 
@@ -2596,8 +2756,8 @@ void V_DrawStringScaled(
 	Mul (fontspec.spacew,      scale);
 	Mul    (fontspec.lfh,      scale);
 
-	Mul (fontspec.spacew, spacescale);
-	Mul    (fontspec.lfh,    lfscale);
+	Mul (fontspec.spacew, run->spacescale);
+	Mul    (fontspec.lfh,    run->lfscale);
 #undef  Mul
 
 	if (( flags & V_NOSCALESTART ))
@@ -2610,164 +2770,264 @@ void V_DrawStringScaled(
 		fontspec.chw      *=     dupx;
 		fontspec.spacew   *=     dupx;
 		fontspec.lfh      *=     dupy;
-
-		right     = vid.width;
 	}
 	else
 	{
 		dupx      = 1;
 		dupy      = 1;
-
-		right     = ( vid.width / vid.dupx );
-		if (!( flags & V_SNAPTOLEFT ))
-		{
-			left   = ( right - BASEVIDWIDTH )/ 2;/* left edge of drawable area */
-			right -= left;
-		}
 	}
 
-	right      <<=               FRACBITS;
-	bot          = vid.height << FRACBITS;
+	run->dupx = dupx;
+	run->dupy = dupy;
+	run->lfh = fontspec.lfh;
 
-	cx = x;
-	cy = y;
-	cyoff = 0;
+	cx = 0;
+	cy = 0;
 
 	for (; ( c = *s ); ++s, ++dancecounter)
 	{
+		glyph_t glyph = {};
+
 		switch (c)
 		{
 			case '\n':
 				cy += fontspec.lfh;
-				if (cy >= bot)
-					return;
-				cx  =   x;
+				line++;
+				cx  =   0;
 				break;
 			default:
 				if (( c & 0xF0 ) == 0x80)
 				{
-					if (notcolored)
-					{
-						colormap = V_GetStringColormap(
-								( ( c & 0x7f )<< V_CHARCOLORSHIFT )&
-								V_CHARCOLORMASK);
-					}
+					// Only counts if the string isn't colored already,
+					// which is up to drawing
+					codecolor = ( ( c & 0x7f )<< V_CHARCOLORSHIFT )& V_CHARCOLORMASK;
 					if (nodanceoverride)
 					{
 						dance = false;
 					}
+					break;
 				}
 				else if (c == V_STRINGDANCE)
 				{
 					dance = true;
+					break;
+				}
+
+				if (uppercase)
+				{
+					c = toupper(c);
 				}
-				else if (cx < right)
+				else if (V_CharacterValid(font, c - font->start) == false)
 				{
-					if (uppercase)
+					// Try the other case if it doesn't exist
+					if (c >= 'A' && c <= 'Z')
 					{
-						c = toupper(c);
+						c = tolower(c);
 					}
-					else if (V_CharacterValid(font, c - font->start) == false)
+					else if (c >= 'a' && c <= 'z')
 					{
-						// Try the other case if it doesn't exist
-						if (c >= 'A' && c <= 'Z')
-						{
-							c = tolower(c);
-						}
-						else if (c >= 'a' && c <= 'z')
-						{
-							c = toupper(c);
-						}
+						c = toupper(c);
 					}
+				}
 
+				glyph.pen = cx;
+				glyph.y = cy;
+				glyph.line = line;
+				glyph.dance = dance;
+				glyph.dancecounter = dancecounter;
+				glyph.codecolor = codecolor;
 
-					if (dance)
-					{
-						cyoff = V_DanceYOffset(dancecounter) * FRACUNIT;
-					}
+				if (( c & 0xB0 ) & 0x80) // button prompts
+				{
+					using srb2::Draw;
 
-					if (( c & 0xB0 ) & 0x80) // button prompts
+					struct BtConf
 					{
-						using srb2::Draw;
-
-						struct BtConf
-						{
-							UINT8 x, y;
-							Draw::Button type;
-						};
+						UINT8 x, y;
+						Draw::Button type;
+					};
 
-						auto bt_inst = [c]() -> std::optional<BtConf>
+					auto bt_inst = [c]() -> std::optional<BtConf>
+					{
+						switch (c & 0x0F)
 						{
-							switch (c & 0x0F)
-							{
-							case 0x00: return {{0, 3, Draw::Button::up}};
-							case 0x01: return {{0, 3, Draw::Button::down}};
-							case 0x02: return {{0, 3, Draw::Button::right}};
-							case 0x03: return {{0, 3, Draw::Button::left}};
+						case 0x00: return {{0, 3, Draw::Button::up}};
+						case 0x01: return {{0, 3, Draw::Button::down}};
+						case 0x02: return {{0, 3, Draw::Button::right}};
+						case 0x03: return {{0, 3, Draw::Button::left}};
 
-							case 0x04: return {{0, 4, Draw::Button::dpad}};
+						case 0x04: return {{0, 4, Draw::Button::dpad}};
 
-							case 0x07: return {{0, 2, Draw::Button::r}};
-							case 0x08: return {{0, 2, Draw::Button::l}};
+						case 0x07: return {{0, 2, Draw::Button::r}};
+						case 0x08: return {{0, 2, Draw::Button::l}};
 
-							case 0x09: return {{0, 1, Draw::Button::start}};
+						case 0x09: return {{0, 1, Draw::Button::start}};
 
-							case 0x0A: return {{2, 1, Draw::Button::a}};
-							case 0x0B: return {{2, 1, Draw::Button::b}};
-							case 0x0C: return {{2, 1, Draw::Button::c}};
+						case 0x0A: return {{2, 1, Draw::Button::a}};
+						case 0x0B: return {{2, 1, Draw::Button::b}};
+						case 0x0C: return {{2, 1, Draw::Button::c}};
 
-							case 0x0D: return {{2, 1, Draw::Button::x}};
-							case 0x0E: return {{2, 1, Draw::Button::y}};
-							case 0x0F: return {{2, 1, Draw::Button::z}};
+						case 0x0D: return {{2, 1, Draw::Button::x}};
+						case 0x0E: return {{2, 1, Draw::Button::y}};
+						case 0x0F: return {{2, 1, Draw::Button::z}};
 
-							default: return {};
-							}
-						}();
+						default: return {};
+						}
+					}();
 
-						if (bt_inst)
+					if (bt_inst)
+					{
+						auto bt_translate_press = [c]() -> std::optional<bool>
 						{
-							auto bt_translate_press = [c]() -> std::optional<bool>
+							switch (c & 0xB0)
 							{
-								switch (c & 0xB0)
-								{
-								default:
-								case 0x90: return true;
-								case 0xA0: return {};
-								case 0xB0: return false;
-								}
-							};
-
-							cw = V_GetButtonCodeWidth(c) * dupx;
-							cxoff = (*fontspec.dim_fn)(scale, fontspec.chw, hchw, dupx, &cw);
-							Draw(
-								FixedToFloat(cx + cxoff) - (bt_inst->x * dupx),
-								FixedToFloat(cy + cyoff) - ((bt_inst->y + fontspec.button_yofs) * dupy))
-								.flags(flags)
-								.small_button(bt_inst->type, bt_translate_press());
-							cx += cw;
-						}
-						break;
-					}
+							default:
+							case 0x90: return true;
+							case 0xA0: return {};
+							case 0xB0: return false;
+							}
+						};
 
-					c -= font->start;
-					if (V_CharacterValid(font, c) == true)
-					{
-						// Remove offsets from patch
-						fixed_t patchxofs = SHORT (font->font[c]->leftoffset) * dupx * scale;
-						cw = SHORT (font->font[c]->width) * dupx;
+						cw = V_GetButtonCodeWidth(c) * dupx;
 						cxoff = (*fontspec.dim_fn)(scale, fontspec.chw, hchw, dupx, &cw);
-						V_DrawFixedPatch(cx + cxoff + patchxofs, cy + cyoff, scale,
-								flags, font->font[c], colormap);
+
+						glyph.x = cx + cxoff;
+						glyph.button = bt_inst->type;
+						glyph.press = bt_translate_press();
+						glyph.buttonx = bt_inst->x;
+						glyph.buttony = bt_inst->y + fontspec.button_yofs;
+						run->glyphs.push_back(glyph);
+
 						cx += cw;
 					}
-					else
-						cx += fontspec.spacew;
+					break;
+				}
+
+				c -= font->start;
+				if (V_CharacterValid(font, c) == true)
+				{
+					// Remove offsets from patch
+					fixed_t patchxofs = SHORT (font->font[c]->leftoffset) * dupx * scale;
+					cw = SHORT (font->font[c]->width) * dupx;
+					cxoff = (*fontspec.dim_fn)(scale, fontspec.chw, hchw, dupx, &cw);
+
+					glyph.x = cx + cxoff + patchxofs;
+					glyph.patch = font->font[c];
+					run->glyphs.push_back(glyph);
+
+					cx += cw;
 				}
+				else
+					cx += fontspec.spacew;
 		}
 	}
+
+	run->laidout = true;
 }
 
-fixed_t V_StringScaledWidth(
+void V_DrawStringScaled(
+		fixed_t    x,
+		fixed_t    y,
+		fixed_t      scale,
+		fixed_t spacescale,
+		fixed_t    lfscale,
+		INT32      flags,
+		const UINT8 *colormap,
+		int        fontno,
+		const char *s)
+{
+	glyphrun_t *run = V_GetGlyphRun(scale, spacescale, lfscale, flags, fontno, s);
+	patchdrawsetup_t setup;
+	boolean batched = false;
+	boolean visible = false;
+
+	fixed_t  right;
+	fixed_t    bot;
+
+	boolean notcolored;
+
+	fixed_t cyoff = 0;
+	UINT16 line = 0;
+
+	if (!run->laidout)
+		V_LayoutGlyphRun(run);
+
+	flags	&= ~(V_FLIP);/* These two (V_FORCEUPPERCASE) share a bit. */
+	flags &= ~(V_PARAMMASK);
+
+	if (colormap == NULL)
+	{
+		colormap   =  V_GetStringColormap(( flags & V_CHARCOLORMASK ));
+	}
+
+	notcolored = !colormap;
+
+	if (( flags & V_NOSCALESTART ))
+	{
+		right     = vid.width;
+	}
+	else
+	{
+		right     = ( vid.width / vid.dupx );
+		if (!( flags & V_SNAPTOLEFT ))
+		{
+			right -= ( right - BASEVIDWIDTH )/ 2;/* left edge of drawable area */
+		}
+	}
+
+	right      <<=               FRACBITS;
+	bot          = vid.height << FRACBITS;
+
+	// Work out the flags once for the whole run, rather than per
+	// character. The glyphs go to Twodee back to back, which draws them
+	// in one go as long as they share an atlas and colormap.
+#ifdef HWRENDER
+	if (rendermode != render_opengl)
+#endif
+	if (rendermode != render_none)
+	{
+		visible = V_SetupPatchDraw(&setup, scale, scale, flags);
+		batched = true;
+	}
+
+	for (const glyph_t &glyph : run->glyphs)
+	{
+		if (glyph.line != line)
+		{
+			if (y + glyph.y >= bot)
+				return;
+			line = glyph.line;
+		}
+
+		if (x + glyph.pen >= right)
+			continue;
+
+		if (glyph.dance)
+		{
+			cyoff = V_DanceYOffset(glyph.dancecounter) * FRACUNIT;
+		}
+
+		if (glyph.patch == nullptr)
+		{
+			Draw(
+				FixedToFloat(x + glyph.x) - (glyph.buttonx * run->dupx),
+				FixedToFloat(y + glyph.y + cyoff) - (glyph.buttony * run->dupy))
+				.flags(flags)
+				.small_button(glyph.button, glyph.press);
+			continue;
+		}
+
+		const UINT8 *glyphmap = notcolored ? V_GetStringColormap(glyph.codecolor) : colormap;
+
+		if (!batched)
+			V_DrawFixedPatch(x + glyph.x, y + glyph.y + cyoff, scale, flags, glyph.patch, glyphmap);
+		else if (visible)
+			V_DrawSetupPatch(&setup, x + glyph.x, y + glyph.y + cyoff, glyph.patch, glyphmap);
+	}
+}
+
+// The width of a string as laid out, without the glyph run cache.
+static fixed_t V_MeasureString(
 		fixed_t      scale,
 		fixed_t spacescale,
 		fixed_t    lfscale,
@@ -2892,6 +3152,25 @@ fixed_t V_StringScaledWidth(
 	return fullwidth;
 }
 
+fixed_t V_StringScaledWidth(
+		fixed_t      scale,
+		fixed_t spacescale,
+		fixed_t    lfscale,
+		INT32      flags,
+		int        fontno,
+		const char *s)
+{
+	glyphrun_t *run = V_GetGlyphRun(scale, spacescale, lfscale, flags, fontno, s);
+
+	if (!run->measured)
+	{
+		run->width = V_MeasureString(scale, spacescale, lfscale, flags, fontno, s);
+		run->measured = true;
+	}
+
+	return run->width;
+}
+
 // Modify a string to wordwrap at any given width.
 char * V_ScaledWordWrap(
 		fixed_t          w,
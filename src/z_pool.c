@@ -0,0 +1,171 @@
+// DR. ROBOTNIK'S RING RACERS
+//-----------------------------------------------------------------------------
+// Copyright (C) 2024 by Kart Krew.
+//
+// This program is free software distributed under the
+// terms of the GNU General Public License, version 2.
+// See the 'LICENSE' file for more details.
+//-----------------------------------------------------------------------------
+/// \file  z_pool.c
+/// \brief Typed fixed-size object pools on top of zone memory.
+///        Objects that are spawned and removed in large numbers
+///        every level (mobjs, precipitation, floor sprite slopes)
+///        are carved out of large zone chunks instead of getting a
+///        zone block, and a zone header, each. The chunks carry the
+///        pool's tag, so purging that tag frees everything at once.
+
+#include <stddef.h>
+#include <stdalign.h>
+
+#include "doomdef.h"
+#include "z_zone.h"
+#include "z_pool.h"
+
+struct zpoolchunk_t
+{
+	zpoolchunk_t *next;
+	// slots follow, aligned to max_align_t
+};
+
+#define CHUNKHEADER ((sizeof (zpoolchunk_t) + (alignof (max_align_t) - 1)) & ~(alignof (max_align_t) - 1))
+#define CHUNKSLOT(chunk, pool, i) (void *)((UINT8 *)(chunk) + CHUNKHEADER + (i) * (pool)->slotsize)
+
+// pools that currently hold at least one chunk
+static zpool_t *activepools = NULL;
+
+static void Z_PoolNewChunk(zpool_t *pool)
+{
+	zpoolchunk_t *chunk;
+
+	if (pool->slotsize == 0)
+	{
+		pool->slotsize = (pool->objsize + (alignof (max_align_t) - 1)) & ~(alignof (max_align_t) - 1);
+
+		if (pool->slotsize < sizeof (void *))
+			pool->slotsize = sizeof (void *);
+
+		if (pool->perchunk == 0)
+			pool->perchunk = 1;
+	}
+
+	chunk = Z_Malloc(CHUNKHEADER + pool->perchunk * pool->slotsize, pool->tag, NULL);
+	chunk->next = pool->chunks;
+	pool->chunks = chunk;
+	pool->numchunks++;
+	pool->nextslot = pool->perchunk;
+
+	if (!pool->linked)
+	{
+		pool->nextpool = activepools;
+		activepools = pool;
+		pool->linked = true;
+	}
+}
+
+/** Gets a zeroed object from a pool.
+  *
+  * \param pool The pool to allocate from.
+  * \return A pointer to memory of at least pool->objsize bytes,
+  *         aligned like Z_Malloc.
+  * \sa Z_PoolFree
+  */
+void *Z_PoolAlloc(zpool_t *pool)
+{
+	void *ptr;
+
+	if (pool->freelist != NULL)
+	{
+		ptr = pool->freelist;
+		pool->freelist = *(void **)ptr;
+	}
+	else
+	{
+		if (pool->nextslot == 0)
+			Z_PoolNewChunk(pool);
+
+		ptr = CHUNKSLOT(pool->chunks, pool, pool->perchunk - pool->nextslot);
+		pool->nextslot--;
+	}
+
+	pool->inuse++;
+	pool->allocs++;
+
+	if (pool->inuse > pool->peak)
+		pool->peak = pool->inuse;
+
+	return memset(ptr, 0, pool->objsize);
+}
+
+/** Returns an object to its pool.
+  * The memory stays with the pool until its tag is purged.
+  *
+  * \param pool The pool the object was allocated from.
+  * \param ptr The object, or NULL.
+  * \sa Z_PoolAlloc
+  */
+void Z_PoolFree(zpool_t *pool, void *ptr)
+{
+	if (ptr == NULL)
+		return;
+
+#ifdef PARANOIA
+	if (pool->inuse == 0)
+		I_Error("Z_PoolFree: pool %s has no objects in use", pool->name);
+#endif
+
+	*(void **)ptr = pool->freelist;
+	pool->freelist = ptr;
+	pool->inuse--;
+}
+
+/** Forgets the chunks of every pool using a tag within a range.
+  * Must be called before those chunks are freed by Z_FreeTags.
+  *
+  * \param lowtag The lowest tag to consider.
+  * \param hightag The highest tag to consider.
+  */
+void Z_PoolPurgeTags(INT32 lowtag, INT32 hightag)
+{
+	zpool_t **link = &activepools;
+
+	while (*link != NULL)
+	{
+		zpool_t *pool = *link;
+
+		if (pool->tag < lowtag || pool->tag > hightag)
+		{
+			link = &pool->nextpool;
+			continue;
+		}
+
+		*link = pool->nextpool;
+
+		pool->freelist = NULL;
+		pool->chunks = NULL;
+		pool->numchunks = 0;
+		pool->nextslot = 0;
+		pool->inuse = 0;
+		pool->peak = 0;
+		pool->allocs = 0;
+		pool->nextpool = NULL;
+		pool->linked = false;
+	}
+}
+
+/** Prints occupancy for all pools holding memory.
+  * Used by the "memfree" console command.
+  */
+void Z_PoolPrintStats(void)
+{
+	zpool_t *pool;
+
+	for (pool = activepools; pool != NULL; pool = pool->nextpool)
+	{
+		const size_t capacity = pool->numchunks * pool->perchunk;
+
+		CONS_Printf(M_GetText("%-22s : %7s KB, %s/%s used (peak %s, %s allocs)\n"),
+			pool->name,
+			sizeu1((pool->numchunks * (CHUNKHEADER + pool->perchunk * pool->slotsize))>>10),
+			sizeu2(pool->inuse), sizeu3(capacity), sizeu4(pool->peak), sizeu5(pool->allocs));
+	}
+}
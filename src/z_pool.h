@@ -0,0 +1,71 @@
+// DR. ROBOTNIK'S RING RACERS
+//-----------------------------------------------------------------------------
+// Copyright (C) 2024 by Kart Krew.
+//
+// This program is free software distributed under the
+// terms of the GNU General Public License, version 2.
+// See the 'LICENSE' file for more details.
+//-----------------------------------------------------------------------------
+/// \file  z_pool.h
+/// \brief Typed fixed-size object pools on top of zone memory
+
+#ifndef __Z_POOL__
+#define __Z_POOL__
+
+#include "doomtype.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// A pool hands out fixed-size, zeroed slots carved from
+// large zone blocks ("chunks") allocated with the pool's tag.
+// Freed slots go on a free list and are reused before any new
+// chunk is allocated. When the pool's tag is purged with
+// Z_FreeTags, the chunks go with it and the pool starts over
+// empty -- there is no need to free each object individually.
+//
+struct zpool_t
+{
+	const char *name;
+	size_t objsize; // requested object size
+	size_t slotsize; // objsize rounded up to max_align_t
+	size_t perchunk; // number of slots per chunk
+	INT32 tag; // zone tag for chunks
+
+	void *freelist; // singly linked through the first word of each slot
+	zpoolchunk_t *chunks;
+	size_t numchunks;
+	size_t nextslot; // unused slots remaining in the newest chunk
+
+	// occupancy stats
+	size_t inuse;
+	size_t peak;
+	size_t allocs; // since last purge
+
+	zpool_t *nextpool; // in the list of pools that have chunks
+	boolean linked;
+};
+
+#define Z_POOL(name, type, perchunk, tag) \
+	{ name, sizeof (type), 0, perchunk, tag, NULL, NULL, 0, 0, 0, 0, 0, NULL, false }
+
+// Get a zeroed slot from the pool.
+void *Z_PoolAlloc(zpool_t *pool);
+
+// Return a slot to the pool. NULL is allowed.
+void Z_PoolFree(zpool_t *pool, void *ptr);
+
+// Drop every chunk of every pool whose tag is within [lowtag, hightag].
+// Called by Z_FreeTags right before the chunks themselves are freed.
+void Z_PoolPurgeTags(INT32 lowtag, INT32 hightag);
+
+// Print occupancy of every pool currently holding memory.
+void Z_PoolPrintStats(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
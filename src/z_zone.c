@@ -25,6 +25,13 @@
 ///        caught with this direct-malloc version. We also suspected that SRB2's
 ///        allocator was fragmenting badly. Finally, this version is a bit
 ///        simpler (about half the lines of code).
+///
+///        Blocks are kept on one list per tag, with a bitmap of which tags
+///        are in use, so freeing or measuring a tag range only visits the
+///        blocks that have those tags. Small blocks are carved out of
+///        size-classed slabs, with separate slabs for static, level and
+///        purgable tags so that a level's allocations pack together and
+///        the slabs empty out when the level is purged.
 
 #include <stddef.h>
 #include <stdalign.h>
@@ -38,6 +45,7 @@
 #include "i_system.h" // I_GetFreeMem
 #include "i_video.h" // rendermode
 #include "z_zone.h"
+#include "z_pool.h"
 #include "m_misc.h" // M_Memcpy
 #include "lua_script.h"
 
@@ -66,21 +74,78 @@ typedef struct memblock_s
 	const char *ownerfile;
 	INT32 ownerline;
 
-	struct memblock_s *next, *prev;
+	struct zslab_s *slab; // slab this block was carved from, or NULL if malloc'd
+
+	struct memblock_s *next, *prev; // in the list for this tag
 } memblock_t;
 
 #define ALIGNPAD (((sizeof (memblock_t) + (alignof (max_align_t) - 1)) & ~(alignof (max_align_t) - 1)) - sizeof (memblock_t))
 #define MEMORY(x) (void *)((uintptr_t)(x) + sizeof(memblock_t) + ALIGNPAD)
 #define MEMBLOCK(x) (memblock_t *)((uintptr_t)(x) - ALIGNPAD - sizeof(memblock_t))
 
-// both the head and tail of the zone memory block list
-static memblock_t head;
+// Tags at or above this share the last list and are told apart by block->tag.
+#define NUMZONETAGS 128
+
+// one list head per tag, each both the head and tail of its list
+static memblock_t taghead[NUMZONETAGS];
+
+// bit set for each tag list that has blocks in it
+static UINT32 tagbits[NUMZONETAGS / 32];
+
+// bytes in use per tag list, counted the way Z_TagsUsage reports it
+static size_t tagusage[NUMZONETAGS];
+
+#define TAGLIST(tag) ((tag) < 0 ? 0 : (tag) >= NUMZONETAGS ? NUMZONETAGS - 1 : (tag))
+
+// ------------
+// Slab arenas
+// ------------
+
+// Total block sizes (header included) that are served from slabs.
+// Anything bigger goes straight to malloc.
+static const size_t zclasssizes[] = {
+	64, 80, 96, 112, 128, 160, 192, 224, 256,
+	320, 384, 448, 512, 640, 768, 1024
+};
+
+#define NUMZONECLASSES (sizeof zclasssizes / sizeof *zclasssizes)
+#define ZSLABSIZE (64 << 10)
+#define MAXCLASSBLOCK 1024
+
+typedef enum
+{
+	ZARENA_STATIC, // tag < PU_LEVEL
+	ZARENA_LEVEL, // PU_LEVEL <= tag < PU_PURGELEVEL
+	ZARENA_PURGABLE, // tag >= PU_PURGELEVEL
+	NUMZONEARENAS
+} zarena_t;
+
+typedef struct zslab_s
+{
+	struct zslab_s *next, *prev; // in the partial list of its class
+	void *freelist; // freed blocks, linked through their first word
+	size_t used; // blocks handed out
+	size_t carved; // blocks ever carved from the slab
+	size_t capacity;
+	UINT8 arena, sizeclass;
+	boolean partial; // on the partial list
+} zslab_t;
+
+#define SLABHEADER ((sizeof (zslab_t) + (alignof (max_align_t) - 1)) & ~(alignof (max_align_t) - 1))
+
+// slabs that still have room, per arena and size class
+static zslab_t *partialslabs[NUMZONEARENAS][NUMZONECLASSES];
+static size_t numslabs[NUMZONEARENAS];
+
+// size class for each 16 bytes of block size, filled by Z_Init
+static UINT8 zclassfor[MAXCLASSBLOCK / 16 + 1];
 
 //
 // Function prototypes
 //
 static void Command_Memfree_f(void);
 static void Command_Memdump_f(void);
+static void Z_SlabFree(memblock_t *block);
 
 // --------------------------
 // Zone memory initialisation
@@ -94,10 +159,21 @@ static void Command_Memdump_f(void);
 void Z_Init(void)
 {
 	UINT32 total, memfree;
+	size_t i, c;
 
-	memset(&head, 0x00, sizeof(head));
+	memset(taghead, 0x00, sizeof(taghead));
+	memset(tagbits, 0x00, sizeof(tagbits));
+	memset(tagusage, 0x00, sizeof(tagusage));
 
-	head.next = head.prev = &head;
+	for (i = 0; i < NUMZONETAGS; i++)
+		taghead[i].next = taghead[i].prev = &taghead[i];
+
+	for (i = 0, c = 0; i < sizeof zclassfor; i++)
+	{
+		while (zclasssizes[c] < i * 16)
+			c++;
+		zclassfor[i] = (UINT8)c;
+	}
 
 	memfree = I_GetFreeMem(&total)>>20;
 	CONS_Printf("System memory: %uMB - Free: %uMB\n", total>>20, memfree);
@@ -112,6 +188,68 @@ void Z_Init(void)
 // Zone memory allocation
 // ----------------------
 
+static void Z_LinkBlock(memblock_t *block)
+{
+	const INT32 list = TAGLIST(block->tag);
+	memblock_t *head = &taghead[list];
+
+	block->next = head->next;
+	block->prev = head;
+	head->next = block;
+	block->next->prev = block;
+
+	tagbits[list >> 5] |= 1u << (list & 31);
+	tagusage[list] += block->size + sizeof (memblock_t);
+}
+
+static void Z_UnlinkBlock(memblock_t *block)
+{
+	const INT32 list = TAGLIST(block->tag);
+
+	block->prev->next = block->next;
+	block->next->prev = block->prev;
+
+	if (taghead[list].next == &taghead[list])
+		tagbits[list >> 5] &= ~(1u << (list & 31));
+	tagusage[list] -= block->size + sizeof (memblock_t);
+}
+
+/** Finds the next tag list in use within a range of tags.
+  *
+  * \param list The tag list to start looking from, inclusive.
+  * \param hightag The highest tag to consider.
+  * \return The index of the next list in use, or -1 if there are none.
+  */
+static INT32 Z_NextTagList(INT32 list, INT32 hightag)
+{
+	const INT32 last = TAGLIST(hightag);
+
+	while (list <= last)
+	{
+		UINT32 bits = tagbits[list >> 5] >> (list & 31);
+
+		if (bits == 0)
+		{
+			list = (list | 31) + 1;
+			continue;
+		}
+
+		while (!(bits & 1))
+		{
+			bits >>= 1;
+			list++;
+		}
+
+		return (list <= last) ? list : -1;
+	}
+
+	return -1;
+}
+
+#define FOREACHTAGLIST(list, lowtag, hightag) \
+	for (list = Z_NextTagList(TAGLIST(lowtag), hightag); list != -1; list = Z_NextTagList(list + 1, hightag))
+
+
 /** Frees allocated memory.
   *
   * \param ptr A pointer to allocated memory,
@@ -155,10 +293,13 @@ void Z_Free2(void *ptr, const char *file, INT32 line)
 #ifdef VALGRIND_DESTROY_MEMPOOL
 	VALGRIND_DESTROY_MEMPOOL(block);
 #endif
-	block->prev->next = block->next;
-	block->next->prev = block->prev;
+	Z_UnlinkBlock(block);
 	TracyCFree(block);
-	free(block);
+
+	if (block->slab != NULL)
+		Z_SlabFree(block);
+	else
+		free(block);
 }
 
 /** malloc() that doesn't accept failure.
@@ -190,6 +331,110 @@ static void *xm(size_t size)
 	return p;
 }
 
+static zarena_t Z_ArenaForTag(INT32 tag)
+{
+	if (tag >= PU_PURGELEVEL)
+		return ZARENA_PURGABLE;
+	if (tag >= PU_LEVEL)
+		return ZARENA_LEVEL;
+	return ZARENA_STATIC;
+}
+
+static void Z_SlabLinkPartial(zslab_t *slab)
+{
+	zslab_t **head = &partialslabs[slab->arena][slab->sizeclass];
+
+	slab->prev = NULL;
+	slab->next = *head;
+	if (*head != NULL)
+		(*head)->prev = slab;
+	*head = slab;
+	slab->partial = true;
+}
+
+static void Z_SlabUnlinkPartial(zslab_t *slab)
+{
+	if (slab->prev != NULL)
+		slab->prev->next = slab->next;
+	else
+		partialslabs[slab->arena][slab->sizeclass] = slab->next;
+
+	if (slab->next != NULL)
+		slab->next->prev = slab->prev;
+
+	slab->next = slab->prev = NULL;
+	slab->partial = false;
+}
+
+/** Carves a block out of a slab of the right size class.
+  *
+  * \param blocksize Size of the block, header included. Must be <= MAXCLASSBLOCK.
+  * \param tag Purge tag, used to pick the arena.
+  * \return The new block, with its slab set.
+  */
+static memblock_t *Z_SlabAlloc(size_t blocksize, INT32 tag)
+{
+	const UINT8 sizeclass = zclassfor[(blocksize + 15) / 16];
+	const zarena_t arena = Z_ArenaForTag(tag);
+	zslab_t *slab = partialslabs[arena][sizeclass];
+	memblock_t *block;
+
+	if (slab == NULL)
+	{
+		slab = xm(ZSLABSIZE);
+		memset(slab, 0, sizeof *slab);
+		slab->capacity = (ZSLABSIZE - SLABHEADER) / zclasssizes[sizeclass];
+		slab->arena = (UINT8)arena;
+		slab->sizeclass = sizeclass;
+		numslabs[arena]++;
+		Z_SlabLinkPartial(slab);
+	}
+
+	if (slab->freelist != NULL)
+	{
+		block = slab->freelist;
+		slab->freelist = *(void **)block;
+	}
+	else
+	{
+		block = (memblock_t *)((UINT8 *)slab + SLABHEADER + slab->carved * zclasssizes[sizeclass]);
+		slab->carved++;
+	}
+
+	if (++slab->used == slab->capacity)
+		Z_SlabUnlinkPartial(slab);
+
+	block->slab = slab;
+	return block;
+}
+
+/** Returns a block to its slab, freeing the slab once it is empty.
+  *
+  * \param block The block, already unlinked from its tag list.
+  */
+static void Z_SlabFree(memblock_t *block)
+{
+	zslab_t *slab = block->slab;
+
+	*(void **)block = slab->freelist;
+	slab->freelist = block;
+
+	if (!slab->partial)
+		Z_SlabLinkPartial(slab);
+
+	if (--slab->used == 0)
+	{
+		// Keep one empty slab around so a class that
+		// bounces between 0 and 1 blocks doesn't thrash.
+		if (slab->next != NULL || slab->prev != NULL)
+		{
+			Z_SlabUnlinkPartial(slab);
+			numslabs[slab->arena]--;
+			free(slab);
+		}
+	}
+}
+
 /** The Z_MallocAlign function.
   * Allocates a block of memory, adds it to a linked list so we can keep track of it.
   *
@@ -214,7 +459,15 @@ void *Z_Malloc2(size_t size, INT32 tag, void *user, INT32 alignbits,
 	CONS_Debug(DBG_MEMORY, "Z_Malloc %s:%d\n", file, line);
 #endif
 
-	block = xm(sizeof (memblock_t) + ALIGNPAD + size);
+	if (size <= MAXCLASSBLOCK - sizeof (memblock_t) - ALIGNPAD)
+	{
+		block = Z_SlabAlloc(sizeof (memblock_t) + ALIGNPAD + size, tag);
+	}
+	else
+	{
+		block = xm(sizeof (memblock_t) + ALIGNPAD + size);
+		block->slab = NULL;
+	}
 	TracyCAlloc(block, sizeof (memblock_t) + ALIGNPAD + size);
 	ptr = MEMORY(block);
 	I_Assert((intptr_t)ptr % alignof (max_align_t) == 0);
@@ -223,11 +476,6 @@ void *Z_Malloc2(size_t size, INT32 tag, void *user, INT32 alignbits,
 	Z_calloc = false;
 #endif
 
-	block->next = head.next;
-	block->prev = &head;
-	head.next = block;
-	block->next->prev = block;
-
 	block->tag = tag;
 	block->user = NULL;
 	block->ownerline = line;
@@ -235,6 +483,8 @@ void *Z_Malloc2(size_t size, INT32 tag, void *user, INT32 alignbits,
 	block->size = sizeof (memblock_t) + size;
 	block->realsize = size;
 
+	Z_LinkBlock(block);
+
 #ifdef VALGRIND_CREATE_MEMPOOL
 	VALGRIND_CREATE_MEMPOOL(block, size, Z_calloc);
 #endif
@@ -352,14 +602,25 @@ void *Z_Realloc2(void *ptr, size_t size, INT32 tag, void *user, INT32 alignbits,
 void Z_FreeTags(INT32 lowtag, INT32 hightag)
 {
 	memblock_t *block, *next;
+	INT32 list;
 	TracyCZone(__zone, true);
 
+#ifdef PARANOIA
+	// Walks every block there is, so not on every level change
 	Z_CheckHeap(420);
-	for (block = head.next; block != &head; block = next)
+#endif
+
+	// pool chunks are about to go away with everything else
+	Z_PoolPurgeTags(lowtag, hightag);
+
+	FOREACHTAGLIST(list, lowtag, hightag)
 	{
-		next = block->next; // get link before freeing
-		if (block->tag >= lowtag && block->tag <= hightag)
-			Z_Free(MEMORY(block));
+		for (block = taghead[list].next; block != &taghead[list]; block = next)
+		{
+			next = block->next; // get link before freeing
+			if (block->tag >= lowtag && block->tag <= hightag)
+				Z_Free(MEMORY(block));
+		}
 	}
 
 	TracyCZoneEnd(__zone);
@@ -374,21 +635,25 @@ void Z_FreeTags(INT32 lowtag, INT32 hightag)
 void Z_IterateTags(INT32 lowtag, INT32 hightag, boolean (*iterfunc)(void *))
 {
 	memblock_t *block, *next;
+	INT32 list;
 	TracyCZone(__zone, true);
 
 	if (!iterfunc)
 		I_Error("Z_IterateTags: no iterator function was given");
 
-	for (block = head.next; block != &head; block = next)
+	FOREACHTAGLIST(list, lowtag, hightag)
 	{
-		next = block->next; // get link before possibly freeing
-
-		if (block->tag >= lowtag && block->tag <= hightag)
+		for (block = taghead[list].next; block != &taghead[list]; block = next)
 		{
-			void *mem = MEMORY(block);
-			boolean free = iterfunc(mem);
-			if (free)
-				Z_Free(mem);
+			next = block->next; // get link before possibly freeing
+
+			if (block->tag >= lowtag && block->tag <= hightag)
+			{
+				void *mem = MEMORY(block);
+				boolean free = iterfunc(mem);
+				if (free)
+					Z_Free(mem);
+			}
 		}
 	}
 
@@ -434,8 +699,10 @@ void Z_CheckHeap(INT32 i)
 	memblock_t *block;
 	UINT32 blocknumon = 0;
 	void *given;
+	INT32 list;
 
-	for (block = head.next; block != &head; block = block->next)
+	FOREACHTAGLIST(list, 0, INT32_MAX)
+	for (block = taghead[list].next; block != &taghead[list]; block = block->next)
 	{
 		blocknumon++;
 		given = MEMORY(block);
@@ -462,6 +729,14 @@ void Z_CheckHeap(INT32 i)
 				block->ownerfile, block->ownerline
 			);
 		}
+		if (TAGLIST(block->tag) != list)
+		{
+			I_Error("Z_CheckHeap %d: block %u"
+				"(owned by %s:%d)"
+				" is in the wrong tag list", i, blocknumon,
+				block->ownerfile, block->ownerline
+			);
+		}
 		if (block->next->prev != block)
 		{
 			I_Error("Z_CheckHeap %d: block %u"
@@ -524,7 +799,11 @@ void Z_ChangeTag(void *ptr, INT32 tag)
 		I_Error("Internal memory management error: "
 			"tried to make block purgable but it has no owner");
 
+	// Move it to the new tag's list. The memory itself stays
+	// in whichever arena it was allocated from.
+	Z_UnlinkBlock(block);
 	block->tag = tag;
+	Z_LinkBlock(block);
 }
 
 /** Changes a memory block's user.
@@ -574,12 +853,23 @@ size_t Z_TagsUsage(INT32 lowtag, INT32 hightag)
 {
 	size_t cnt = 0;
 	memblock_t *rover;
+	INT32 list;
 
-	for (rover = head.next; rover != &head; rover = rover->next)
+	FOREACHTAGLIST(list, lowtag, hightag)
 	{
-		if (rover->tag < lowtag || rover->tag > hightag)
+		if (list > 0 && list < NUMZONETAGS - 1)
+		{
+			// only one tag lives in this list
+			cnt += tagusage[list];
 			continue;
-		cnt += rover->size + sizeof *rover;
+		}
+
+		for (rover = taghead[list].next; rover != &taghead[list]; rover = rover->next)
+		{
+			if (rover->tag < lowtag || rover->tag > hightag)
+				continue;
+			cnt += rover->size + sizeof *rover;
+		}
 	}
 
 	return cnt;
@@ -613,6 +903,12 @@ static void Command_Memfree_f(void)
 	CONS_Printf(M_GetText("All purgable           : %7s KB\n"),
 		sizeu1(Z_TagsUsage(PU_PURGELEVEL, INT32_MAX)>>10));
 
+	CONS_Printf(M_GetText("Slabs (static/level/purgable): %s/%s/%s x %d KB\n"),
+		sizeu1(numslabs[ZARENA_STATIC]), sizeu2(numslabs[ZARENA_LEVEL]), sizeu3(numslabs[ZARENA_PURGABLE]), ZSLABSIZE>>10);
+
+	CONS_Printf("\x82%s", M_GetText("Object Pools\n"));
+	Z_PoolPrintStats();
+
 #ifdef HWRENDER
 	if (rendermode == render_opengl)
 	{
@@ -639,7 +935,7 @@ static void Command_Memdump_f(void)
 {
 	memblock_t *block;
 	INT32 mintag = 0, maxtag = INT32_MAX;
-	INT32 i;
+	INT32 i, list;
 
 	if ((i = COM_CheckParm("-min")))
 		mintag = atoi(COM_Argv(i + 1));
@@ -647,7 +943,8 @@ static void Command_Memdump_f(void)
 	if ((i = COM_CheckParm("-max")))
 		maxtag = atoi(COM_Argv(i + 1));
 
-	for (block = head.next; block != &head; block = block->next)
+	FOREACHTAGLIST(list, mintag, maxtag)
+	for (block = taghead[list].next; block != &taghead[list]; block = block->next)
 		if (block->tag >= mintag && block->tag <= maxtag)
 		{
 			char *filename = strrchr(block->ownerfile, PATHSEP[0]);